@@ -0,0 +1,231 @@
+/*
+ * Broadcast ring fan-out: one producer, several consumers, every consumer sees every message
+ *
+ * The producer publishes -n messages of -s bytes into an shm_bcast ring. Each message
+ * carries its sequence number in its first and last 8 bytes. Consumers run as child
+ * processes:
+ *   gating - applies backpressure; must receive every message, in order
+ *   lossy  - never slows the producer; must account for every message as either
+ *            received or reported lost by an overrun
+ * With -d the lossy consumers burn the given number of microseconds per message, so
+ * they fall behind and exercise the overrun path.
+ *
+ * Usage:
+ *   ./bcastBench [-g gating] [-l lossy] [-n messages] [-s size] [-r ring_slots] [-d usec]
+ *
+ * Example:
+ *   ./bcastBench -g 2 -l 2 -n 1000000 -s 64
+ *   ./bcastBench -g 1 -l 1 -d 20
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_bcast.h"
+
+#define RING_NAME "/bcast_bench"
+#define SPINS     256  // Reads attempted before sleeping on the ring
+
+typedef struct
+{
+    uint64_t received;
+    uint64_t lost;
+    uint64_t errors;
+    double   seconds;
+} STATS;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void burn_us(int us)
+{
+    uint64_t end = now_ns() + (uint64_t)us * 1000;
+    while (now_ns() < end)
+    {
+    }
+}
+
+static void consumer(int gating, uint32_t size, int delay_us, STATS *st)
+{
+    SHM_BCAST     ring;
+    SHM_BCAST_SUB sub;
+    uint8_t      *buf = malloc(size);
+    uint64_t      expected = 0;
+    uint64_t      start = 0;
+
+    if (buf == NULL || shm_bcast_open(&ring, RING_NAME) != SHM_BCAST_SUCCESS || shm_bcast_subscribe(&ring, &sub, gating) != SHM_BCAST_SUCCESS)
+    {
+        st->errors = 1;
+        _exit(1);
+    }
+
+    for (;;)
+    {
+        uint32_t len;
+        uint64_t seq;
+        int      ret = SHM_BCAST_AGAIN;
+
+        for (int i = 0; i < SPINS && ret == SHM_BCAST_AGAIN; i++)
+        {
+            ret = shm_bcast_read(&sub, buf, size, &len, &seq);
+        }
+        if (ret == SHM_BCAST_AGAIN)
+        {
+            shm_bcast_wait_readable(&sub, -1);
+            continue;
+        }
+        if (ret == SHM_BCAST_OVERRUN)
+        {
+            st->lost += len;
+            expected += len;
+            continue;
+        }
+        if (ret != SHM_BCAST_SUCCESS)
+        {
+            st->errors++;
+            break;
+        }
+        if (start == 0)
+        {
+            start = now_ns();
+        }
+        if (len == 0)
+        {
+            break;  // End marker
+        }
+
+        uint64_t head, tail;
+        memcpy(&head, buf, sizeof(head));
+        memcpy(&tail, buf + len - sizeof(tail), sizeof(tail));
+        if (seq != expected || head != seq || tail != seq)
+        {
+            st->errors++;
+        }
+        expected = seq + 1;
+        st->received++;
+        if (delay_us > 0 && !gating)
+        {
+            burn_us(delay_us);
+        }
+    }
+
+    st->seconds = (now_ns() - start) / 1e9;
+    shm_bcast_unsubscribe(&sub);
+    shm_bcast_close(&ring);
+    free(buf);
+    _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    int       gating = 2, lossy = 2, delay_us = 0;
+    uint64_t  count = 1000000;
+    uint32_t  size = 64, slots = 1024;
+    int       opt;
+    SHM_BCAST ring;
+    STATS    *stats;
+    uint8_t  *msg;
+    int       failed = 0;
+
+    while ((opt = getopt(argc, argv, "g:l:n:s:r:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'g': gating = atoi(optarg); break;
+            case 'l': lossy = atoi(optarg); break;
+            case 'n': count = strtoull(optarg, NULL, 10); break;
+            case 's': size = (uint32_t)atoi(optarg); break;
+            case 'r': slots = (uint32_t)atoi(optarg); break;
+            case 'd': delay_us = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-g gating] [-l lossy] [-n messages] [-s size] [-r ring_slots] [-d usec]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (size < 16 || gating < 0 || lossy < 0 || gating + lossy < 1 || gating + lossy > SHM_BCAST_MAX_CONSUMERS)
+    {
+        fprintf(stderr, "Need size >= 16 and 1..%d consumers\n", SHM_BCAST_MAX_CONSUMERS);
+        return 1;
+    }
+
+    stats = mmap(NULL, sizeof(STATS) * (gating + lossy), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    msg = calloc(1, size);
+    if (stats == MAP_FAILED || msg == NULL || shm_bcast_create(&ring, RING_NAME, slots, size) != SHM_BCAST_SUCCESS)
+    {
+        return 1;
+    }
+    memset(stats, 0, sizeof(STATS) * (gating + lossy));
+
+    printf("%d gating + %d lossy consumers, %llu messages of %u bytes, ring of %u slots%s\n", gating, lossy, (unsigned long long)count, size,
+           ring.hdr->slots, delay_us > 0 ? ", lossy consumers delayed" : "");
+    fflush(stdout);
+
+    for (int i = 0; i < gating + lossy; i++)
+    {
+        if (fork() == 0)
+        {
+            consumer(i < gating, size, delay_us, &stats[i]);
+        }
+    }
+
+    // Start once everyone is subscribed, so each consumer's first message is sequence 0
+    while (1)
+    {
+        int active = 0;
+        for (int i = 0; i < SHM_BCAST_MAX_CONSUMERS; i++)
+        {
+            active += atomic_load(&ring.hdr->consumers[i].active) != 0;
+        }
+        if (active == gating + lossy)
+        {
+            break;
+        }
+        usleep(1000);
+    }
+
+    uint64_t start = now_ns();
+    uint64_t stalls = 0;
+    for (uint64_t seq = 0; seq <= count; seq++)
+    {
+        uint32_t len = seq == count ? 0 : size;  // Zero-length message ends the run
+        memcpy(msg, &seq, sizeof(seq));
+        memcpy(msg + size - sizeof(seq), &seq, sizeof(seq));
+        while (shm_bcast_publish(&ring, msg, len) == SHM_BCAST_AGAIN)
+        {
+            stalls++;
+            shm_bcast_wait_writable(&ring, -1);
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+
+    while (wait(NULL) > 0)
+    {
+    }
+
+    printf("producer  %10.0f msg/s  %8.1f MB/s  (%llu stalls on gating consumers)\n", count / seconds, count * (double)size / seconds / 1e6,
+           (unsigned long long)stalls);
+    for (int i = 0; i < gating + lossy; i++)
+    {
+        STATS *st = &stats[i];
+        int    ok = st->errors == 0 && st->received + st->lost == count && (i >= gating || st->lost == 0);
+
+        printf("%-7s %d  received %10llu  lost %10llu  %10.0f msg/s  %s\n", i < gating ? "gating" : "lossy", i, (unsigned long long)st->received,
+               (unsigned long long)st->lost, st->seconds > 0 ? st->received / st->seconds : 0.0, ok ? "ok" : "FAILED");
+        failed |= !ok;
+    }
+
+    shm_bcast_close(&ring);
+    free(msg);
+    return failed;
+}
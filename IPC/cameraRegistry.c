@@ -0,0 +1,419 @@
+/*
+ * Camera registry kept as a hash table in a shared heap (shm_heap.c)
+ *
+ * Every invocation attaches to the same segment, so the registry persists between runs
+ * and any number of processes can read and update it. Entries, names and URLs are heap
+ * blocks linked by offsets; an SHM_RWLOCK guards the table. A new entry is filled in
+ * before the lock is taken and linked with a single store, so a writer killed at any
+ * point never leaves a half-built entry in a bucket.
+ *
+ * Usage:
+ *   ./cameraRegistry add <id> <name> <url> [fps]
+ *   ./cameraRegistry get <id>
+ *   ./cameraRegistry del <id>
+ *   ./cameraRegistry list
+ *   ./cameraRegistry stats
+ *   ./cameraRegistry bench [processes]
+ *   ./cameraRegistry destroy
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_heap.h"
+#include "shm_sync.h"
+
+#define HEAP_NAME "/camera_registry"
+#define HEAP_SIZE (64 * 1024 * 1024)
+#define BUCKETS   256
+
+typedef struct
+{
+    SHM_RWLOCK lock;
+    uint32_t   count;
+    SHM_OFF    buckets[BUCKETS];
+} REGISTRY;
+
+typedef struct
+{
+    SHM_OFF  next;
+    uint32_t id;
+    uint32_t fps;
+    SHM_OFF  name;  // NUL-terminated strings in their own blocks
+    SHM_OFF  url;
+} CAMERA;
+
+static SHM_HEAP heap;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static SHM_OFF heap_strdup(const char *s)
+{
+    size_t  len = strlen(s) + 1;
+    SHM_OFF off = shm_heap_alloc(&heap, len);
+
+    if (off != 0)
+    {
+        memcpy(shm_heap_ptr(&heap, off), s, len);
+    }
+    return off;
+}
+
+// Find the registry through the heap root, creating it on first use
+static REGISTRY *registry(void)
+{
+    SHM_OFF root = shm_heap_root(&heap);
+
+    if (root == 0)
+    {
+        SHM_OFF   off = shm_heap_alloc(&heap, sizeof(REGISTRY));
+        REGISTRY *reg = shm_heap_ptr(&heap, off);
+
+        if (reg == NULL)
+        {
+            return NULL;
+        }
+        memset(reg, 0, sizeof(*reg));
+        shm_rwlock_init(&reg->lock);
+        if (shm_heap_set_root(&heap, 0, off) != SHM_HEAP_SUCCESS)
+        {
+            shm_heap_free(&heap, off);  // Another process installed one first
+        }
+        root = shm_heap_root(&heap);
+    }
+    return shm_heap_ptr(&heap, root);
+}
+
+static void free_camera(SHM_OFF off)
+{
+    CAMERA *cam = shm_heap_ptr(&heap, off);
+
+    shm_heap_free(&heap, cam->name);
+    shm_heap_free(&heap, cam->url);
+    shm_heap_free(&heap, off);
+}
+
+// Insert or replace; returns 0 on success
+static int camera_add(REGISTRY *reg, uint32_t id, const char *name, const char *url, uint32_t fps)
+{
+    SHM_OFF off = shm_heap_alloc(&heap, sizeof(CAMERA));
+    CAMERA *cam = shm_heap_ptr(&heap, off);
+    SHM_OFF old = 0;
+
+    if (cam == NULL)
+    {
+        return -1;
+    }
+    cam->id = id;
+    cam->fps = fps;
+    cam->name = heap_strdup(name);
+    cam->url = heap_strdup(url);
+    if (cam->name == 0 || cam->url == 0)
+    {
+        free_camera(off);
+        return -1;
+    }
+
+    shm_rwlock_wrlock(&reg->lock);
+    SHM_OFF *link = &reg->buckets[id % BUCKETS];
+    for (; *link != 0; link = &((CAMERA *)shm_heap_ptr(&heap, *link))->next)
+    {
+        if (((CAMERA *)shm_heap_ptr(&heap, *link))->id == id)
+        {
+            old = *link;
+            break;
+        }
+    }
+    cam->next = old ? ((CAMERA *)shm_heap_ptr(&heap, old))->next : reg->buckets[id % BUCKETS];
+    if (old)
+    {
+        *link = off;
+    }
+    else
+    {
+        reg->buckets[id % BUCKETS] = off;
+        reg->count++;
+    }
+    shm_rwlock_wrunlock(&reg->lock);
+
+    if (old)
+    {
+        free_camera(old);
+    }
+    return 0;
+}
+
+static int camera_del(REGISTRY *reg, uint32_t id)
+{
+    SHM_OFF found = 0;
+
+    shm_rwlock_wrlock(&reg->lock);
+    for (SHM_OFF *link = &reg->buckets[id % BUCKETS]; *link != 0; link = &((CAMERA *)shm_heap_ptr(&heap, *link))->next)
+    {
+        CAMERA *cam = shm_heap_ptr(&heap, *link);
+        if (cam->id == id)
+        {
+            found = *link;
+            *link = cam->next;
+            reg->count--;
+            break;
+        }
+    }
+    shm_rwlock_wrunlock(&reg->lock);
+
+    // Readers hold the read lock while they look at an entry, so it is unreachable now
+    if (found)
+    {
+        free_camera(found);
+    }
+    return found ? 0 : -1;
+}
+
+// Copy one camera out under the read lock; returns 0 if found
+static int camera_get(REGISTRY *reg, uint32_t id, CAMERA *out, char *name, char *url, size_t size)
+{
+    int found = -1;
+
+    shm_rwlock_rdlock(&reg->lock);
+    for (SHM_OFF off = reg->buckets[id % BUCKETS]; off != 0;)
+    {
+        CAMERA *cam = shm_heap_ptr(&heap, off);
+        if (cam->id == id)
+        {
+            *out = *cam;
+            snprintf(name, size, "%s", (char *)shm_heap_ptr(&heap, cam->name));
+            snprintf(url, size, "%s", (char *)shm_heap_ptr(&heap, cam->url));
+            found = 0;
+            break;
+        }
+        off = cam->next;
+    }
+    shm_rwlock_rdunlock(&reg->lock);
+    return found;
+}
+
+static void list(REGISTRY *reg)
+{
+    shm_rwlock_rdlock(&reg->lock);
+    printf("%u cameras\n", reg->count);
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        for (SHM_OFF off = reg->buckets[b]; off != 0;)
+        {
+            CAMERA *cam = shm_heap_ptr(&heap, off);
+            printf("%6u  %-20s %3u fps  %s\n", cam->id, (char *)shm_heap_ptr(&heap, cam->name), cam->fps, (char *)shm_heap_ptr(&heap, cam->url));
+            off = cam->next;
+        }
+    }
+    shm_rwlock_rdunlock(&reg->lock);
+}
+
+static void stats(void)
+{
+    SHM_HEAP_STATS st;
+
+    shm_heap_stats(&heap, &st);
+    printf("slabs %u / %u, %llu bytes in use\n", st.slabs_used, st.slabs_total, (unsigned long long)st.bytes_in_use);
+    for (int c = 0; c < SHM_HEAP_CLASSES; c++)
+    {
+        if (st.classes[c].slabs > 0)
+        {
+            printf("  class %6u: %3u slabs, %8llu blocks in use\n", st.classes[c].size, st.classes[c].slabs, (unsigned long long)st.classes[c].in_use);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Benchmark
+//-------------------------------------------------------------------------------------------------
+
+#define BENCH_LIVE  1024     // Blocks each worker keeps allocated
+#define BENCH_OPS   2000000  // Alloc/free pairs per worker
+
+// Random sizes, each block stamped with its owner and checked before it is freed
+static uint64_t stress(int worker)
+{
+    SHM_OFF  live[BENCH_LIVE] = {0};
+    uint32_t seed = 12345 + worker;
+    uint64_t errors = 0;
+
+    for (int i = 0; i < BENCH_OPS; i++)
+    {
+        int slot = i % BENCH_LIVE;
+
+        if (live[slot] != 0)
+        {
+            uint32_t *p = shm_heap_ptr(&heap, live[slot]);
+            size_t    words = shm_heap_usable_size(&heap, live[slot]) / 4;
+            errors += p[0] != (uint32_t)worker || p[words - 1] != (uint32_t)slot;
+            shm_heap_free(&heap, live[slot]);
+        }
+        seed = seed * 1103515245 + 12345;
+        live[slot] = shm_heap_alloc(&heap, 16 + (seed >> 16) % 1024);
+        if (live[slot] == 0)
+        {
+            errors++;
+            continue;
+        }
+        uint32_t *p = shm_heap_ptr(&heap, live[slot]);
+        p[0] = worker;
+        p[shm_heap_usable_size(&heap, live[slot]) / 4 - 1] = slot;
+    }
+    for (int slot = 0; slot < BENCH_LIVE; slot++)
+    {
+        shm_heap_free(&heap, live[slot]);
+    }
+    return errors;
+}
+
+static void bench(REGISTRY *reg, int procs)
+{
+    static const size_t sizes[] = {16, 64, 256, 1024, 4096};
+    static SHM_OFF      offs[1000];
+    static void        *ptrs[1000];
+
+    printf("alloc + free pair, 1000 live blocks (single process)\n");
+    printf("%8s %12s %12s\n", "size", "shm_heap ns", "malloc ns");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint64_t t0 = now_ns();
+        for (int round = 0; round < 1000; round++)
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                offs[i] = shm_heap_alloc(&heap, sizes[s]);
+            }
+            for (int i = 0; i < 1000; i++)
+            {
+                shm_heap_free(&heap, offs[i]);
+            }
+        }
+        uint64_t t1 = now_ns();
+        for (int round = 0; round < 1000; round++)
+        {
+            for (int i = 0; i < 1000; i++)
+            {
+                ptrs[i] = malloc(sizes[s]);
+                __asm__ volatile("" : : "r"(ptrs[i]) : "memory");
+            }
+            for (int i = 0; i < 1000; i++)
+            {
+                free(ptrs[i]);
+            }
+        }
+        uint64_t t2 = now_ns();
+        printf("%8zu %12.1f %12.1f\n", sizes[s], (t1 - t0) / 1e6, (t2 - t1) / 1e6);
+    }
+
+    // Registry lookups
+    for (uint32_t id = 0; id < 10000; id++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "bench-%u", id);
+        camera_add(reg, 1000000 + id, name, "rtsp://10.0.0.1/stream", 25);
+    }
+    uint64_t t0 = now_ns();
+    uint64_t hits = 0;
+    for (int i = 0; i < 1000000; i++)
+    {
+        CAMERA cam;
+        char   name[128], url[128];
+        hits += camera_get(reg, 1000000 + (uint32_t)i * 7919u % 10000, &cam, name, url, sizeof(name)) == 0;
+    }
+    printf("registry lookup (10000 cameras): %.1f ns, %llu hits\n", (now_ns() - t0) / 1e6, (unsigned long long)hits);
+    for (uint32_t id = 0; id < 10000; id++)
+    {
+        camera_del(reg, 1000000 + id);
+    }
+
+    // Concurrent stress across processes
+    printf("%d processes x %d random-size alloc/free pairs: ", procs, BENCH_OPS);
+    fflush(stdout);
+    uint64_t start = now_ns();
+    for (int w = 0; w < procs; w++)
+    {
+        if (fork() == 0)
+        {
+            _exit(stress(w + 1) != 0);
+        }
+    }
+    int failed = 0, status;
+    while (wait(&status) > 0)
+    {
+        failed |= !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    printf("%.1f ns per pair, %s\n", (now_ns() - start) / (double)procs / BENCH_OPS, failed ? "CORRUPTION DETECTED" : "ok");
+}
+
+int main(int argc, char *argv[])
+{
+    REGISTRY *reg;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s add <id> <name> <url> [fps] | get <id> | del <id> | list | stats | bench [procs] | destroy\n", argv[0]);
+        return 1;
+    }
+    if (strcmp(argv[1], "destroy") == 0)
+    {
+        return shm_heap_unlink(HEAP_NAME);
+    }
+    if (shm_heap_attach(&heap, HEAP_NAME, HEAP_SIZE) != SHM_HEAP_SUCCESS || (reg = registry()) == NULL)
+    {
+        return 1;
+    }
+
+    int ret = 0;
+    if (strcmp(argv[1], "add") == 0 && argc >= 5)
+    {
+        ret = camera_add(reg, (uint32_t)atoi(argv[2]), argv[3], argv[4], argc > 5 ? (uint32_t)atoi(argv[5]) : 25) != 0;
+    }
+    else if (strcmp(argv[1], "get") == 0 && argc >= 3)
+    {
+        CAMERA cam;
+        char   name[256], url[256];
+        ret = camera_get(reg, (uint32_t)atoi(argv[2]), &cam, name, url, sizeof(name)) != 0;
+        if (ret == 0)
+        {
+            printf("%u  %s  %u fps  %s\n", cam.id, name, cam.fps, url);
+        }
+        else
+        {
+            printf("no camera %s\n", argv[2]);
+        }
+    }
+    else if (strcmp(argv[1], "del") == 0 && argc >= 3)
+    {
+        ret = camera_del(reg, (uint32_t)atoi(argv[2])) != 0;
+    }
+    else if (strcmp(argv[1], "list") == 0)
+    {
+        list(reg);
+    }
+    else if (strcmp(argv[1], "stats") == 0)
+    {
+        stats();
+    }
+    else if (strcmp(argv[1], "bench") == 0)
+    {
+        bench(reg, argc > 2 ? atoi(argv[2]) : 4);
+    }
+    else
+    {
+        fprintf(stderr, "Unknown command %s\n", argv[1]);
+        ret = 1;
+    }
+
+    shm_heap_close(&heap);
+    return ret;
+}
@@ -0,0 +1,152 @@
+/*
+ * Config publisher: parses a JSON file once and publishes it as a flattened binary
+ * snapshot in shared memory (shm_config.h). Worker processes read it with
+ * configReader-style lookups instead of parsing the file themselves.
+ *
+ * Nested keys are flattened to dotted paths: {"camera": [{"url": "..."}]} becomes
+ * "camera.0.url". The file is re-published whenever its modification time changes.
+ *
+ * Usage:
+ *   ./configPublisher config.json [-n shm_name] [-s slot_bytes] [-i poll_ms]
+ *
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "json_utils.h"
+#include "shm_config.h"
+
+#define DEFAULT_NAME "/app_config"
+#define DEFAULT_SLOT (256 * 1024)
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int add_leaf(const char *path, JSON_OBJ *value, void *ctx)
+{
+    SHM_CONFIG_BUILDER *b = ctx;
+    int                 ret;
+
+    switch (json_typeof(value))
+    {
+        case JSON_INTEGER:
+            ret = shm_config_builder_add(b, path, SHM_CONFIG_INT, json_integer_value(value), 0, NULL);
+            break;
+        case JSON_REAL:
+            ret = shm_config_builder_add(b, path, SHM_CONFIG_DOUBLE, 0, json_real_value(value), NULL);
+            break;
+        case JSON_TRUE:
+        case JSON_FALSE:
+            ret = shm_config_builder_add(b, path, SHM_CONFIG_BOOL, json_is_true(value), 0, NULL);
+            break;
+        case JSON_STRING:
+            ret = shm_config_builder_add(b, path, SHM_CONFIG_STRING, 0, 0, json_string_value(value));
+            break;
+        default:
+            ret = shm_config_builder_add(b, path, SHM_CONFIG_NULL, 0, 0, NULL);
+            break;
+    }
+    return ret == SHM_CONFIG_SUCCESS ? JSON_SUCCESS : JSON_ERROR;
+}
+
+static int publish_file(SHM_CONFIG *cfg, const char *path)
+{
+    SHM_CONFIG_BUILDER b;
+    JSON_OBJ          *root;
+    uint64_t           start = now_ns();
+    int                ret = SHM_CONFIG_ERROR;
+
+    if (json_load_from_file(path, &root) != JSON_SUCCESS)
+    {
+        return SHM_CONFIG_ERROR;  // Keep serving the last good snapshot
+    }
+
+    shm_config_builder_init(&b);
+    if (json_walk(root, add_leaf, &b) == JSON_SUCCESS)
+    {
+        ret = shm_config_publish(cfg, &b);
+    }
+    if (ret == SHM_CONFIG_SUCCESS)
+    {
+        printf("Published generation %llu: %zu entries in %.1f us\n", (unsigned long long)shm_config_generation(cfg), b.count,
+               (now_ns() - start) / 1e3);
+    }
+    shm_config_builder_free(&b);
+    json_free(root);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *name = DEFAULT_NAME;
+    size_t      slot = DEFAULT_SLOT;
+    int         poll_ms = 200;
+    SHM_CONFIG  cfg;
+    struct stat st;
+    time_t      mtime = 0;
+    long        mtime_ns = 0;
+    int         opt;
+
+    while ((opt = getopt(argc, argv, "n:s:i:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                name = optarg;
+                break;
+            case 's':
+                slot = strtoul(optarg, NULL, 10);
+                break;
+            case 'i':
+                poll_ms = atoi(optarg);
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (optind != argc - 1 || poll_ms <= 0)
+    {
+        fprintf(stderr, "Usage: %s config.json [-n shm_name] [-s slot_bytes] [-i poll_ms]\n", argv[0]);
+        return 1;
+    }
+
+    if (shm_config_create(&cfg, name, slot) != SHM_CONFIG_SUCCESS)
+    {
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    printf("Publishing %s to %s (Ctrl-C to stop)\n", argv[optind], name);
+    while (running)
+    {
+        if (stat(argv[optind], &st) == 0 && (st.st_mtim.tv_sec != mtime || st.st_mtim.tv_nsec != mtime_ns))
+        {
+            mtime = st.st_mtim.tv_sec;
+            mtime_ns = st.st_mtim.tv_nsec;
+            publish_file(&cfg, argv[optind]);
+        }
+        usleep(poll_ms * 1000);
+    }
+
+    shm_config_close(&cfg);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Config reader: follows the snapshot published by configPublisher.
+ *
+ * Sleeps until a new generation is published, refreshes its private view and prints
+ * the requested keys (or every entry) together with how long the update took to
+ * arrive. With -b it instead measures the read path: refresh + lookup per call.
+ *
+ * Usage:
+ *   ./configReader [-n shm_name] [-b iterations] [key ...]
+ *   Example: ./configReader camera.0.url camera.0.fps
+ *
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_config.h"
+
+#define DEFAULT_NAME "/app_config"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void print_entry(const SHM_CONFIG_VIEW *view, const char *key, const SHM_CONFIG_ENTRY *e)
+{
+    if (e == NULL)
+    {
+        printf("  %s = (missing)\n", key);
+        return;
+    }
+    switch (e->type)
+    {
+        case SHM_CONFIG_INT:
+            printf("  %s = %" PRId64 "\n", key, e->v.i);
+            break;
+        case SHM_CONFIG_BOOL:
+            printf("  %s = %s\n", key, e->v.i ? "true" : "false");
+            break;
+        case SHM_CONFIG_DOUBLE:
+            printf("  %s = %g\n", key, e->v.d);
+            break;
+        case SHM_CONFIG_STRING:
+            printf("  %s = \"%s\"\n", key, (const char *)view->buf + e->v.s.off);
+            break;
+        default:
+            printf("  %s = null\n", key);
+            break;
+    }
+}
+
+static void bench(SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view, const char *key, uint64_t iterations)
+{
+    uint64_t start = now_ns(), found = 0;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        shm_config_refresh(cfg, view);
+        found += shm_config_find(view, key) != NULL;
+    }
+    printf("%.1f ns per refresh + lookup of %s (%s)\n", (double)(now_ns() - start) / iterations, key, found ? "found" : "missing");
+}
+
+int main(int argc, char *argv[])
+{
+    const char     *name = DEFAULT_NAME;
+    uint64_t        iterations = 0;
+    SHM_CONFIG      cfg;
+    SHM_CONFIG_VIEW view;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "n:b:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                name = optarg;
+                break;
+            case 'b':
+                iterations = strtoull(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n shm_name] [-b iterations] [key ...]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (shm_config_open(&cfg, name) != SHM_CONFIG_SUCCESS || shm_config_view_init(&cfg, &view) != SHM_CONFIG_SUCCESS)
+    {
+        return 1;
+    }
+
+    if (iterations > 0)
+    {
+        shm_config_refresh(&cfg, &view);
+        bench(&cfg, &view, optind < argc ? argv[optind] : "", iterations);
+        shm_config_view_free(&view);
+        shm_config_close(&cfg);
+        return 0;
+    }
+
+    for (;;)
+    {
+        if (shm_config_refresh(&cfg, &view))
+        {
+            const SHM_CONFIG_SNAP *snap = (const SHM_CONFIG_SNAP *)view.buf;
+
+            printf("Generation %llu (%u entries), arrived %.1f us after publish\n", (unsigned long long)view.generation, snap->count,
+                   (now_ns() - snap->published_ns) / 1e3);
+            if (optind < argc)
+            {
+                for (int i = optind; i < argc; i++)
+                {
+                    print_entry(&view, argv[i], shm_config_find(&view, argv[i]));
+                }
+            }
+            else
+            {
+                const SHM_CONFIG_ENTRY *entries = (const SHM_CONFIG_ENTRY *)(view.buf + sizeof(SHM_CONFIG_SNAP));
+                for (uint32_t i = 0; i < snap->count; i++)
+                {
+                    print_entry(&view, shm_config_key(&view, &entries[i]), &entries[i]);
+                }
+            }
+            fflush(stdout);
+        }
+        if (shm_config_wait(&cfg, view.generation, -1) == SHM_CONFIG_ERROR)
+        {
+            break;
+        }
+    }
+
+    shm_config_view_free(&view);
+    shm_config_close(&cfg);
+    return 1;
+}
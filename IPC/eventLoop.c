@@ -0,0 +1,532 @@
+/*
+ * One epoll thread serving every kind of IPC channel at once
+ *
+ * The parent process creates -r shm rings plus one of each other channel: an MPMC
+ * queue, a broadcast ring, a pub/sub inbox, a journal, a SysV message queue, a memfd
+ * channel and a config segment. It registers each channel's pollable descriptor with
+ * one epoll instance and drains whichever fires with the channel's non-blocking
+ * try_* call; nothing in the loop ever blocks on a channel.
+ *
+ * A forked producer sends -n messages round-robin over all channels, sleeping -g us
+ * after each round so the loop goes idle between rounds and every message pays a real
+ * wake-up. Each message carries its send time; the loop reports per channel type how
+ * long delivery took, checks that each channel received its messages in order, and
+ * counts how many epoll_wait() calls it needed.
+ *
+ * The SysV queue has no descriptor of its own and is polled from a timerfd (-t us),
+ * so its latency is bounded by that interval rather than by a wake-up.
+ *
+ * Usage:
+ *   ./eventLoop [-r rings] [-n messages] [-g gap_us] [-t msgq_poll_us] [-d journal_dir]
+ *
+ * Example:
+ *   ./eventLoop -r 32 -n 2000 -g 200
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ipc.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "memfd_chan.h"
+#include "msgq.h"
+#include "shm_bcast.h"
+#include "shm_config.h"
+#include "shm_mpmc.h"
+#include "shm_pubsub.h"
+#include "shm_ring.h"
+
+#define MAX_RINGS   256
+#define RING_NAME   "/event_loop_ring.%d"
+#define MPMC_NAME   "/event_loop_mpmc"
+#define BCAST_NAME  "/event_loop_bcast"
+#define PUBSUB_NAME "/event_loop_pubsub"
+#define CONFIG_NAME "/event_loop_config"
+#define UPDATES     10  // Config snapshots published over the run
+#define MAX_EVENTS  64
+#define TIMEOUT_S   30  // Give up if the producer stalls this long
+
+typedef enum
+{
+    CH_RING,
+    CH_MPMC,
+    CH_BCAST,
+    CH_PUBSUB,
+    CH_JOURNAL,
+    CH_MSGQ,
+    CH_MEMFD,
+    CH_CONFIG,
+    CH_TYPES,
+    CH_STATS = CH_TYPES  // Once-a-second progress timer
+} CH_TYPE_E;
+
+static const char *type_names[CH_TYPES] = {"shm_ring", "shm_mpmc", "shm_bcast", "shm_pubsub", "journal", "msgq", "memfd_chan", "shm_config"};
+
+typedef struct
+{
+    uint64_t seq;
+    uint64_t sent_ns;
+} MSG;
+
+typedef struct
+{
+    CH_TYPE_E type;
+    void     *handle;
+    uint64_t  received;
+    int       errors;
+} CHANNEL;
+
+typedef struct
+{
+    uint64_t *lat;  // Delivery latency of every message of this type
+    uint64_t  count;
+} LATENCY;
+
+typedef struct
+{
+    int             rings;
+    SHM_RING        ring[MAX_RINGS];
+    SHM_MPMC        mpmc;
+    SHM_BCAST       bcast;
+    SHM_BCAST_SUB   bcast_sub;
+    SHM_PUBSUB      pubsub;
+    SHM_PUBSUB_SUB  pubsub_sub;
+    JOURNAL         journal;
+    JOURNAL_READER  journal_reader;
+    MSGQ            msgq;
+    MEMFD_CHAN      memfd;
+    SHM_CONFIG      config;
+    SHM_CONFIG_VIEW config_view;
+} CHANNELS;
+
+static CHANNELS ch;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Producer: open its own end of every channel and send n messages round-robin
+static void producer(const char *journal_dir, int memfd_sock, uint64_t n, int gap_us)
+{
+    SHM_RING           rings[MAX_RINGS];
+    SHM_MPMC           mpmc;
+    SHM_BCAST          bcast;
+    SHM_PUBSUB         ps;
+    JOURNAL            j;
+    MEMFD_CHAN         memfd;
+    SHM_CONFIG         cfg;
+    SHM_CONFIG_BUILDER b;
+    MEMFD_MSG          mm;
+    char               name[64];
+
+    for (int i = 0; i < ch.rings; i++)
+    {
+        snprintf(name, sizeof(name), RING_NAME, i);
+        if (shm_ring_open(&rings[i], name) != SHM_RING_SUCCESS)
+        {
+            _exit(1);
+        }
+    }
+    if (shm_mpmc_open(&mpmc, MPMC_NAME) != SHM_MPMC_SUCCESS || shm_bcast_open(&bcast, BCAST_NAME) != SHM_BCAST_SUCCESS ||
+        shm_pubsub_open(&ps, PUBSUB_NAME) != SHM_PUBSUB_SUCCESS || journal_open(&j, journal_dir, 0, 0, 0) != JOURNAL_SUCCESS ||
+        shm_config_open(&cfg, CONFIG_NAME) != SHM_CONFIG_SUCCESS)
+    {
+        _exit(1);
+    }
+    memfd_chan_from_socket(&memfd, memfd_sock);
+
+    for (uint64_t seq = 0; seq < n; seq++)
+    {
+        MSG      m = {seq, 0};
+        uint32_t delivered = 0;
+
+        for (int i = 0; i < ch.rings; i++)
+        {
+            m.sent_ns = now_ns();
+            while (shm_ring_write(&rings[i], &m, sizeof(m)) == SHM_RING_AGAIN)
+            {
+                shm_ring_wait_writable(&rings[i], sizeof(m), 100);
+            }
+        }
+        m.sent_ns = now_ns();
+        while (shm_mpmc_enqueue(&mpmc, &m, sizeof(m)) == SHM_MPMC_AGAIN)
+        {
+            shm_mpmc_wait_writable(&mpmc, 100);
+        }
+        m.sent_ns = now_ns();
+        while (shm_bcast_publish(&bcast, &m, sizeof(m)) == SHM_BCAST_AGAIN)
+        {
+            shm_bcast_wait_writable(&bcast, 100);
+        }
+        // A full inbox drops the message; publish again until it is taken
+        while (m.sent_ns = now_ns(), shm_pubsub_publish(&ps, "loop/msg", &m, sizeof(m), 0, &delivered) == SHM_PUBSUB_SUCCESS && delivered == 0)
+        {
+            usleep(10);
+        }
+        m.sent_ns = now_ns();
+        journal_append(&j, &m, sizeof(m));
+        m.sent_ns = now_ns();
+        msgq_send(&ch.msgq, MSGQ_PRIO_NORMAL, &m, sizeof(m));
+        if (memfd_chan_alloc(&memfd, sizeof(m), &mm) == MEMFD_CHAN_SUCCESS)
+        {
+            m.sent_ns = now_ns();
+            memcpy(mm.data, &m, sizeof(m));
+            mm.len = sizeof(m);
+            memfd_chan_send(&memfd, &mm);
+        }
+        if ((seq + 1) * UPDATES / n != seq * UPDATES / n)
+        {
+            shm_config_builder_init(&b);
+            shm_config_builder_add(&b, "loop.sent", SHM_CONFIG_INT, (int64_t)seq + 1, 0, NULL);
+            shm_config_publish(&cfg, &b);
+            shm_config_builder_free(&b);
+        }
+
+        // Nothing is left in a batch while the loop is idle
+        msgq_flush(&ch.msgq);
+        if (gap_us > 0)
+        {
+            usleep(gap_us);
+        }
+    }
+
+    for (int i = 0; i < ch.rings; i++)
+    {
+        shm_ring_close(&rings[i]);
+    }
+    shm_mpmc_close(&mpmc);
+    shm_bcast_close(&bcast);
+    shm_pubsub_close(&ps);
+    journal_close(&j);
+    shm_config_close(&cfg);
+    // Keep the socket open until the loop closes its end, so its releases have a reader
+    while (memfd_chan_recv(&memfd, &mm) == MEMFD_CHAN_SUCCESS)
+    {
+    }
+    memfd_chan_close(&memfd);
+    _exit(0);
+}
+
+// Check order and record the latency of one received message
+static void account(CHANNEL *c, LATENCY *lat, const void *data, size_t len, uint64_t now)
+{
+    MSG m;
+
+    if (len != sizeof(m))
+    {
+        c->errors++;
+        return;
+    }
+    memcpy(&m, data, sizeof(m));
+    c->errors += m.seq != c->received;
+    c->received++;
+    lat[c->type].lat[lat[c->type].count++] = now - m.sent_ns;
+}
+
+// Take everything the channel has; each try_* call re-arms its descriptor on AGAIN
+static void drain(CHANNEL *c, LATENCY *lat)
+{
+    uint8_t        buf[256];
+    uint32_t       len32;
+    size_t         len;
+    SHM_PUBSUB_MSG pm;
+    JOURNAL_RECORD rec;
+    MEMFD_MSG      mm;
+
+    switch (c->type)
+    {
+        case CH_RING:
+            while (shm_ring_try_read(c->handle, buf, sizeof(buf), &len32) == SHM_RING_SUCCESS)
+            {
+                account(c, lat, buf, len32, now_ns());
+            }
+            break;
+        case CH_MPMC:
+            while (shm_mpmc_try_dequeue(c->handle, buf, &len32) == SHM_MPMC_SUCCESS)
+            {
+                account(c, lat, buf, len32, now_ns());
+            }
+            break;
+        case CH_BCAST:
+            while (shm_bcast_try_read(c->handle, buf, sizeof(buf), &len32, NULL) == SHM_BCAST_SUCCESS)
+            {
+                account(c, lat, buf, len32, now_ns());
+            }
+            break;
+        case CH_PUBSUB:
+            while (shm_pubsub_try_recv(c->handle, &pm) == SHM_PUBSUB_SUCCESS)
+            {
+                account(c, lat, pm.data, pm.len, now_ns());
+            }
+            break;
+        case CH_JOURNAL:
+            while (journal_try_read(c->handle, &rec) == JOURNAL_SUCCESS)
+            {
+                account(c, lat, rec.data, rec.len, now_ns());
+            }
+            break;
+        case CH_MSGQ:
+            while (msgq_try_recv(c->handle, buf, sizeof(buf), &len, NULL) == MSGQ_SUCCESS)
+            {
+                account(c, lat, buf, len, now_ns());
+            }
+            break;
+        case CH_MEMFD:
+            while (memfd_chan_try_recv(c->handle, &mm) == MEMFD_CHAN_SUCCESS)
+            {
+                account(c, lat, mm.data, mm.len, now_ns());
+                memfd_chan_release(c->handle, &mm);
+            }
+            break;
+        case CH_CONFIG:
+            // Snapshots published in quick succession are seen once; count generations
+            while (shm_config_try_refresh(c->handle, &ch.config_view))
+            {
+                c->received = ch.config_view.generation;
+            }
+            break;
+        default: break;
+    }
+}
+
+static int add(int epfd, int fd, CHANNEL *c)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = c};
+
+    if (fd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        fprintf(stderr, "Unable to register %s\n", c->type < CH_TYPES ? type_names[c->type] : "timer");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *journal_dir = "event_loop_journal";
+    uint64_t    n = 2000;
+    int         gap_us = 200, msgq_poll_us = 1000, opt;
+    int         socks[2];
+    char        name[64];
+
+    ch.rings = 32;
+    while ((opt = getopt(argc, argv, "r:n:g:t:d:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': ch.rings = atoi(optarg); break;
+            case 'n': n = strtoull(optarg, NULL, 10); break;
+            case 'g': gap_us = atoi(optarg); break;
+            case 't': msgq_poll_us = atoi(optarg); break;
+            case 'd': journal_dir = optarg; break;
+            default: fprintf(stderr, "Usage: %s [-r rings] [-n messages] [-g gap_us] [-t msgq_poll_us] [-d journal_dir]\n", argv[0]); return 1;
+        }
+    }
+    if (ch.rings < 1 || ch.rings > MAX_RINGS || n < 1)
+    {
+        fprintf(stderr, "1 to %d rings, at least one message\n", MAX_RINGS);
+        return 1;
+    }
+
+    // Create every channel before the producer starts; it opens its own ends
+    for (int i = 0; i < ch.rings; i++)
+    {
+        snprintf(name, sizeof(name), RING_NAME, i);
+        if (shm_ring_create(&ch.ring[i], name, 64 * 1024) != SHM_RING_SUCCESS)
+        {
+            return 1;
+        }
+    }
+    if (shm_mpmc_create(&ch.mpmc, MPMC_NAME, 1024, sizeof(MSG)) != SHM_MPMC_SUCCESS ||
+        shm_bcast_create(&ch.bcast, BCAST_NAME, 1024, sizeof(MSG)) != SHM_BCAST_SUCCESS || shm_bcast_subscribe(&ch.bcast, &ch.bcast_sub, 1) != SHM_BCAST_SUCCESS ||
+        shm_pubsub_create(&ch.pubsub, PUBSUB_NAME) != SHM_PUBSUB_SUCCESS ||
+        shm_pubsub_subscribe(&ch.pubsub, "loop/#", 1024, sizeof(MSG), 0, &ch.pubsub_sub) != SHM_PUBSUB_SUCCESS ||
+        journal_open(&ch.journal, journal_dir, 0, 0, 0) != JOURNAL_SUCCESS ||
+        journal_reader_open(&ch.journal_reader, journal_dir, NULL, JOURNAL_FROM_NEWEST) != JOURNAL_SUCCESS ||
+        msgq_open(&ch.msgq, IPC_PRIVATE, 1, 100, 0) != MSGQ_SUCCESS || shm_config_create(&ch.config, CONFIG_NAME, 4096) != SHM_CONFIG_SUCCESS ||
+        shm_config_view_init(&ch.config, &ch.config_view) != SHM_CONFIG_SUCCESS || socketpair(AF_UNIX, SOCK_SEQPACKET, 0, socks) == -1)
+    {
+        return 1;
+    }
+    memfd_chan_from_socket(&ch.memfd, socks[0]);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(socks[0]);
+        producer(journal_dir, socks[1], n, gap_us);
+    }
+    close(socks[1]);
+
+    // One epoll set for all of them
+    int       epfd = epoll_create1(EPOLL_CLOEXEC);
+    int       nch = ch.rings + CH_TYPES - 1;
+    CHANNEL  *chans = calloc(nch + 1, sizeof(CHANNEL));
+    LATENCY   lat[CH_TYPES] = {{0}};
+    int       failed = epfd == -1 || chans == NULL;
+
+    for (int i = 0; i < ch.rings && !failed; i++)
+    {
+        chans[i] = (CHANNEL){CH_RING, &ch.ring[i], 0, 0};
+        failed |= add(epfd, shm_ring_pollfd(&ch.ring[i], 0), &chans[i]);
+    }
+    CHANNEL *c = chans + ch.rings;
+    if (!failed)
+    {
+        c[0] = (CHANNEL){CH_MPMC, &ch.mpmc, 0, 0};
+        c[1] = (CHANNEL){CH_BCAST, &ch.bcast_sub, 0, 0};
+        c[2] = (CHANNEL){CH_PUBSUB, &ch.pubsub_sub, 0, 0};
+        c[3] = (CHANNEL){CH_JOURNAL, &ch.journal_reader, 0, 0};
+        c[4] = (CHANNEL){CH_MSGQ, &ch.msgq, 0, 0};
+        c[5] = (CHANNEL){CH_MEMFD, &ch.memfd, 0, 0};
+        c[6] = (CHANNEL){CH_CONFIG, &ch.config, 0, 0};
+        c[7] = (CHANNEL){CH_STATS, NULL, 0, 0};
+        failed |= add(epfd, shm_mpmc_pollfd(&ch.mpmc, 0), &c[0]);
+        failed |= add(epfd, shm_bcast_sub_pollfd(&ch.bcast_sub), &c[1]);
+        failed |= add(epfd, shm_pubsub_pollfd(&ch.pubsub_sub), &c[2]);
+        failed |= add(epfd, journal_reader_pollfd(&ch.journal_reader), &c[3]);
+        failed |= add(epfd, msgq_pollfd(&ch.msgq, msgq_poll_us), &c[4]);
+        failed |= add(epfd, memfd_chan_fd(&ch.memfd), &c[5]);
+        failed |= add(epfd, shm_config_pollfd(&ch.config), &c[6]);
+    }
+    for (int t = 0; t < CH_TYPES && !failed; t++)
+    {
+        lat[t].lat = malloc(sizeof(uint64_t) * n * (t == CH_RING ? ch.rings : 1));
+        failed |= lat[t].lat == NULL;
+    }
+
+    struct itimerspec second = {{1, 0}, {1, 0}};
+    int               stats_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    failed |= stats_fd == -1 || timerfd_settime(stats_fd, 0, &second, NULL) == -1 || add(epfd, stats_fd, &c[7]);
+
+    // Drain everything once, which also arms every descriptor, then sleep in epoll
+    for (int i = 0; i < nch && !failed; i++)
+    {
+        drain(&chans[i], lat);
+    }
+
+    uint64_t start = now_ns(), wakes = 0, events = 0, idle_s = 0, last = 0;
+    uint64_t updates = n < UPDATES ? n : UPDATES;
+    while (!failed)
+    {
+        struct epoll_event ev[MAX_EVENTS];
+        uint64_t           total = 0;
+        int                done = 1;
+
+        for (int i = 0; i < nch; i++)
+        {
+            total += chans[i].received;
+            done &= chans[i].received >= (chans[i].type == CH_CONFIG ? updates : n);
+        }
+        if (done)
+        {
+            break;
+        }
+
+        int k = epoll_wait(epfd, ev, MAX_EVENTS, -1);
+        if (k == -1 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            failed = 1;
+        }
+        wakes++;
+        for (int e = 0; e < k; e++)
+        {
+            CHANNEL *cur = ev[e].data.ptr;
+            uint64_t expirations;
+
+            events++;
+            if (cur->type != CH_STATS)
+            {
+                drain(cur, lat);
+                continue;
+            }
+            if (read(stats_fd, &expirations, sizeof(expirations)) == -1)
+            {
+                expirations = 0;
+            }
+            // A journal writer that died mid-record sends no wake-up; look again
+            drain(&c[3], lat);
+            printf("  %llu messages received, %llu epoll wake-ups\n", (unsigned long long)total, (unsigned long long)wakes);
+            idle_s = total == last ? idle_s + 1 : 0;
+            last = total;
+            if (idle_s >= TIMEOUT_S)
+            {
+                fprintf(stderr, "No progress for %d s, giving up\n", TIMEOUT_S);
+                failed = 1;
+            }
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    memfd_chan_close(&ch.memfd);  // Lets the producer exit
+    waitpid(pid, NULL, 0);
+
+    printf("%d rings + 7 other channels, %llu messages each, %d us between rounds: %.2f s, %llu epoll wake-ups, %.1f events per wake-up\n", ch.rings,
+           (unsigned long long)n, gap_us, seconds, (unsigned long long)wakes, wakes ? (double)events / wakes : 0.0);
+    printf("%-12s %10s %10s %10s %10s\n", "channel", "received", "p50 us", "p99 us", "max us");
+    for (int t = 0; t < CH_TYPES && lat[t].lat != NULL; t++)
+    {
+        uint64_t received = 0;
+        int      errors = 0;
+
+        for (int i = 0; i < nch; i++)
+        {
+            received += chans[i].type == (CH_TYPE_E)t ? chans[i].received : 0;
+            errors += chans[i].type == (CH_TYPE_E)t ? chans[i].errors : 0;
+        }
+        if (lat[t].count == 0)
+        {
+            printf("%-12s %10llu %10s %10s %10s%s\n", type_names[t], (unsigned long long)received, "-", "-", "-", t == CH_CONFIG ? "  (snapshots)" : "");
+            continue;
+        }
+        qsort(lat[t].lat, lat[t].count, sizeof(uint64_t), cmp_u64);
+        printf("%-12s %10llu %10.1f %10.1f %10.1f%s\n", type_names[t], (unsigned long long)received, lat[t].lat[lat[t].count / 2] / 1e3,
+               lat[t].lat[lat[t].count * 99 / 100] / 1e3, lat[t].lat[lat[t].count - 1] / 1e3, errors ? "  OUT OF ORDER" : "");
+        failed |= errors != 0;
+    }
+    printf("  %s\n", failed ? "FAILED" : "ok");
+
+    for (int i = 0; i < ch.rings; i++)
+    {
+        shm_ring_close(&ch.ring[i]);
+    }
+    shm_mpmc_close(&ch.mpmc);
+    shm_bcast_unsubscribe(&ch.bcast_sub);
+    shm_bcast_close(&ch.bcast);
+    shm_pubsub_unsubscribe(&ch.pubsub_sub);
+    shm_pubsub_close(&ch.pubsub);
+    journal_reader_close(&ch.journal_reader);
+    journal_trim(&ch.journal, 1);
+    journal_close(&ch.journal);
+    msgq_close(&ch.msgq, 1);
+    shm_config_view_free(&ch.config_view);
+    shm_config_close(&ch.config);
+    for (int t = 0; t < CH_TYPES; t++)
+    {
+        free(lat[t].lat);
+    }
+    free(chans);
+    close(stats_fd);
+    close(epfd);
+    return failed;
+}
@@ -0,0 +1,197 @@
+/*
+ * Page backing for large shm rings: startup and steady-state cost per mode
+ *
+ * For each mode a ring of -s MB is created with shm_ring_create_ex() and measured:
+ *   create  - shm_ring_create_ex(), including any prefault or mlock
+ *   open    - shm_ring_open() of the same ring, i.e. what each reader pays
+ *   touch   - first write over the whole data area (page faults unless prefaulted)
+ *   faults  - minor page faults taken during the first write
+ *   rewrite - second full write, GB/s (no faults left; TLB reach still matters)
+ *   random  - dependent random 8-byte loads across the area, ns each (TLB-miss bound)
+ *   huge    - share of the mapping backed by huge pages, from /proc/self/smaps
+ *
+ * Modes the system cannot provide fall back with a warning; the "flags" column shows
+ * what actually took effect. hugetlb modes need reserved pages, e.g.
+ *   echo 160 | sudo tee /proc/sys/vm/nr_hugepages
+ * THP modes need huge pages allowed on the /dev/shm tmpfs, e.g.
+ *   sudo mount -o remount,huge=advise /dev/shm
+ *
+ * Usage:
+ *   ./hugeBench [-s size_mb] [-m 4k,4k+p,4k+p+l,thp,thp+p,huge,huge+p,huge+p+l]
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "shm_ring.h"
+
+#define RING_NAME     "/huge_bench"
+#define RANDOM_LOADS  2000000
+
+typedef struct
+{
+    const char *name;
+    uint32_t    flags;
+} MODE;
+
+static const MODE modes[] = {
+    {"4k", 0},
+    {"4k+p", SHM_RING_POPULATE},
+    {"4k+p+l", SHM_RING_POPULATE | SHM_RING_MLOCK},
+    {"thp", SHM_RING_THP},
+    {"thp+p", SHM_RING_THP | SHM_RING_POPULATE},
+    {"huge", SHM_RING_HUGETLB},
+    {"huge+p", SHM_RING_HUGETLB | SHM_RING_POPULATE},
+    {"huge+p+l", SHM_RING_HUGETLB | SHM_RING_POPULATE | SHM_RING_MLOCK},
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static long minor_faults(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+// Sum the smaps fields of the mapping that contains addr; returns huge-page-backed kB
+static long huge_kb(const void *addr, long *rss_kb)
+{
+    FILE *f = fopen("/proc/self/smaps", "r");
+    char  line[256];
+    int   inside = 0;
+    long  huge = 0, hugetlb = 0;
+
+    *rss_kb = 0;
+    if (f == NULL)
+    {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        unsigned long start, end;
+        long          kb;
+
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2 && strchr(line, ':') != NULL && line[0] != ' ')
+        {
+            inside = (uintptr_t)addr >= start && (uintptr_t)addr < end;
+        }
+        else if (inside && sscanf(line, "Rss: %ld", &kb) == 1)
+        {
+            *rss_kb = kb;
+        }
+        else if (inside && (sscanf(line, "ShmemPmdMapped: %ld", &kb) == 1 || sscanf(line, "FilePmdMapped: %ld", &kb) == 1))
+        {
+            huge += kb;
+        }
+        else if (inside && (sscanf(line, "Shared_Hugetlb: %ld", &kb) == 1 || sscanf(line, "Private_Hugetlb: %ld", &kb) == 1))
+        {
+            hugetlb += kb;  // hugetlbfs pages are not counted in Rss
+        }
+    }
+    fclose(f);
+    *rss_kb += hugetlb;
+    return huge + hugetlb;
+}
+
+static void run(const MODE *m, size_t size)
+{
+    SHM_RING w, r;
+    uint64_t t0, t1, t2, t3, t4, t5;
+    long     faults, rss_kb, hkb;
+    uint64_t x = 0, lcg = 1;
+
+    t0 = now_ns();
+    if (shm_ring_create_ex(&w, RING_NAME, size, m->flags) != SHM_RING_SUCCESS)
+    {
+        printf("%-9s create failed\n", m->name);
+        return;
+    }
+    t1 = now_ns();
+    if (shm_ring_open(&r, RING_NAME) != SHM_RING_SUCCESS)
+    {
+        shm_ring_close(&w);
+        return;
+    }
+    t2 = now_ns();
+
+    size_t cap = w.hdr->capacity;
+    faults = minor_faults();
+    memset(w.data, 1, cap);
+    t3 = now_ns();
+    faults = minor_faults() - faults;
+    memset(w.data, 2, cap);
+    t4 = now_ns();
+
+    // Each load's address depends on the previous value, so misses cannot overlap
+    uint64_t mask = (cap - 1) & ~(uint64_t)7;
+    for (int i = 0; i < RANDOM_LOADS; i++)
+    {
+        lcg = lcg * 6364136223846793005ull + 1442695040888963407ull;
+        x = *(volatile uint64_t *)(r.data + (((lcg >> 20) ^ x) & mask));
+    }
+    t5 = now_ns();
+
+    hkb = huge_kb(w.data, &rss_kb);
+    printf("%-9s %9.1f %9.1f %9.1f %9ld %9.2f %9.1f %7.0f%%  %s%s%s%s\n", m->name, (t1 - t0) / 1e6, (t2 - t1) / 1e6, (t3 - t2) / 1e6, faults,
+           cap / ((t4 - t3) / 1e9) / 1e9, (t5 - t4) / (double)RANDOM_LOADS, rss_kb > 0 ? 100.0 * hkb / rss_kb : 0.0,
+           w.flags & SHM_RING_HUGETLB ? "hugetlb " : "", w.flags & SHM_RING_THP ? "thp " : "", w.flags & SHM_RING_POPULATE ? "populate " : "",
+           w.flags & SHM_RING_MLOCK ? "mlock" : "");
+
+    shm_ring_close(&r);
+    shm_ring_close(&w);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t size = 256;
+    char  *list = NULL;
+    int    opt;
+
+    while ((opt = getopt(argc, argv, "s:m:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size = strtoull(optarg, NULL, 10); break;
+            case 'm': list = optarg; break;
+            default:
+                fprintf(stderr, "Usage: %s [-s size_mb] [-m 4k,4k+p,4k+p+l,thp,thp+p,huge,huge+p,huge+p+l]\n", argv[0]);
+                return 1;
+        }
+    }
+    size <<= 20;
+
+    printf("%zu MB ring, create/open/touch in ms, rewrite in GB/s, random load in ns\n", size >> 20);
+    printf("%-9s %9s %9s %9s %9s %9s %9s %8s  %s\n", "mode", "create", "open", "touch", "faults", "rewrite", "random", "huge", "flags");
+    fflush(stdout);
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+    {
+        if (list != NULL)
+        {
+            // Exact match against the comma-separated list
+            char *p = strstr(list, modes[i].name);
+            size_t n = strlen(modes[i].name);
+            while (p != NULL && ((p != list && p[-1] != ',') || (p[n] != '\0' && p[n] != ',')))
+            {
+                p = strstr(p + 1, modes[i].name);
+            }
+            if (p == NULL)
+            {
+                continue;
+            }
+        }
+        run(&modes[i], size);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,668 @@
+/*
+ * IPC mechanism benchmark: SysV message queue, shm ring, pipe, Unix stream and
+ * datagram sockets, eventfd
+ *
+ * For every mechanism, message size and CPU placement a child process is forked and
+ * two tests run over the same channel pair:
+ *   latency    - ping-pong, one-way time = round trip / 2, with a log2 histogram
+ *   throughput - parent streams messages to the child, which acks the last one
+ * eventfd carries only an 8-byte counter, so it runs the latency test only.
+ *
+ * Placements come from sysfs topology:
+ *   same    - both processes on one CPU
+ *   sibling - SMT siblings of one core
+ *   core    - two cores of one package
+ *   socket  - two packages
+ *   none    - left to the scheduler
+ *
+ * Usage:
+ *   ./ipcBench [-t msgq,shm,pipe,unix,dgram,eventfd] [-s 64,1024,16384] [-p same,sibling,core,socket,none]
+ *              [-l round_trips] [-b bytes] [-q]
+ *   Example: ./ipcBench -t shm,unix -s 64,4096 -p core,socket
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+#define RING_NAME_0  "/ipc_bench_0"
+#define RING_NAME_1  "/ipc_bench_1"
+#define RING_SIZE    (4 << 20)
+#define HIST_BUCKETS 40
+#define SPINS        2000
+#define MAX_LIST     16
+
+typedef enum
+{
+    T_MSGQ,
+    T_SHM,
+    T_PIPE,
+    T_UNIX,
+    T_DGRAM,
+    T_EVENTFD,
+    T_COUNT
+} TRANSPORT_E;
+
+static const char *transport_names[T_COUNT] = {"msgq", "shm", "pipe", "unix", "dgram", "eventfd"};
+
+typedef enum
+{
+    P_SAME,
+    P_SIBLING,
+    P_CORE,
+    P_SOCKET,
+    P_NONE,
+    P_COUNT
+} PLACEMENT_E;
+
+static const char *placement_names[P_COUNT] = {"same", "sibling", "core", "socket", "none"};
+
+// One bidirectional channel; direction 0 is parent -> child, 1 is child -> parent
+typedef struct
+{
+    TRANSPORT_E type;
+    int         rfd[2], wfd[2];
+    int         msqid;
+    SHM_RING    ring[2];
+    int         spins;  // shm: busy polls before sleeping on the futex
+} CHANNEL;
+
+typedef struct
+{
+    double   p50, p99, p999, max;
+    uint64_t hist[HIST_BUCKETS];
+} LATENCY;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pin_cpu(int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        {
+            perror("sched_setaffinity");
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Topology
+//-------------------------------------------------------------------------------------------------
+
+static int topo_attr(int cpu, const char *attr)
+{
+    char  path[128];
+    int   val = -1;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, attr);
+    fp = fopen(path, "r");
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%d", &val) != 1)
+        {
+            val = -1;
+        }
+        fclose(fp);
+    }
+    return val;
+}
+
+// CPU pair for a placement, or -1 if the machine has no such pair
+static int pick_pair(PLACEMENT_E placement, int *a, int *b)
+{
+    cpu_set_t set;
+    int       first = -1;
+
+    *a = *b = -1;
+    if (placement == P_NONE)
+    {
+        return 0;
+    }
+    if (sched_getaffinity(0, sizeof(set), &set) == -1)
+    {
+        return -1;
+    }
+    for (int c = 0; c < CPU_SETSIZE && first < 0; c++)
+    {
+        if (CPU_ISSET(c, &set))
+        {
+            first = c;
+        }
+    }
+    if (first < 0)
+    {
+        return -1;
+    }
+    if (placement == P_SAME)
+    {
+        *a = *b = first;
+        return 0;
+    }
+
+    int core = topo_attr(first, "core_id"), pkg = topo_attr(first, "physical_package_id");
+    for (int c = first + 1; c < CPU_SETSIZE; c++)
+    {
+        if (!CPU_ISSET(c, &set))
+        {
+            continue;
+        }
+        int same_core = topo_attr(c, "core_id") == core && topo_attr(c, "physical_package_id") == pkg;
+        int same_pkg = topo_attr(c, "physical_package_id") == pkg;
+        if ((placement == P_SIBLING && same_core) || (placement == P_CORE && same_pkg && !same_core) || (placement == P_SOCKET && !same_pkg))
+        {
+            *a = first;
+            *b = c;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Transports
+//-------------------------------------------------------------------------------------------------
+
+static int channel_open(CHANNEL *ch, TRANSPORT_E type)
+{
+    int sv[2], p[2][2];
+
+    memset(ch, 0, sizeof(*ch));
+    ch->type = type;
+    switch (type)
+    {
+        case T_MSGQ:
+            ch->msqid = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+            return ch->msqid == -1 ? -1 : 0;
+
+        case T_SHM:
+            if (shm_ring_create(&ch->ring[0], RING_NAME_0, RING_SIZE) != SHM_RING_SUCCESS)
+            {
+                return -1;
+            }
+            return shm_ring_create(&ch->ring[1], RING_NAME_1, RING_SIZE) == SHM_RING_SUCCESS ? 0 : -1;
+
+        case T_PIPE:
+            if (pipe(p[0]) == -1 || pipe(p[1]) == -1)
+            {
+                return -1;
+            }
+            for (int d = 0; d < 2; d++)
+            {
+                ch->rfd[d] = p[d][0];
+                ch->wfd[d] = p[d][1];
+            }
+            return 0;
+
+        case T_UNIX:
+        case T_DGRAM:
+            if (socketpair(AF_UNIX, type == T_UNIX ? SOCK_STREAM : SOCK_DGRAM, 0, sv) == -1)
+            {
+                return -1;
+            }
+            ch->wfd[0] = ch->rfd[1] = sv[0];  // Parent end
+            ch->wfd[1] = ch->rfd[0] = sv[1];  // Child end
+            return 0;
+
+        case T_EVENTFD:
+            for (int d = 0; d < 2; d++)
+            {
+                ch->rfd[d] = ch->wfd[d] = eventfd(0, 0);
+                if (ch->rfd[d] == -1)
+                {
+                    return -1;
+                }
+            }
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+static void channel_close(CHANNEL *ch)
+{
+    switch (ch->type)
+    {
+        case T_MSGQ:
+            msgctl(ch->msqid, IPC_RMID, NULL);
+            break;
+        case T_SHM:
+            shm_ring_close(&ch->ring[0]);
+            shm_ring_close(&ch->ring[1]);
+            break;
+        case T_UNIX:
+        case T_DGRAM:
+            close(ch->wfd[0]);
+            close(ch->wfd[1]);
+            break;
+        default:
+            for (int d = 0; d < 2; d++)
+            {
+                close(ch->rfd[d]);
+                if (ch->wfd[d] != ch->rfd[d])
+                {
+                    close(ch->wfd[d]);
+                }
+            }
+            break;
+    }
+}
+
+// Largest message the transport can carry in one piece (0 = any)
+static size_t channel_limit(TRANSPORT_E type)
+{
+    switch (type)
+    {
+        case T_MSGQ:
+        {
+            unsigned long max = 8192;
+            FILE         *fp = fopen("/proc/sys/kernel/msgmax", "r");
+            if (fp != NULL)
+            {
+                if (fscanf(fp, "%lu", &max) != 1)
+                {
+                    max = 8192;
+                }
+                fclose(fp);
+            }
+            return max;
+        }
+        case T_SHM:
+            return RING_SIZE / 2 - sizeof(uint32_t);
+        case T_DGRAM:
+            return 65536;
+        default:
+            return 0;
+    }
+}
+
+static int full_io(int fd, void *buf, size_t len, int is_write)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = is_write ? write(fd, (char *)buf + done, len - done) : read(fd, (char *)buf + done, len - done);
+        if (n <= 0)
+        {
+            if (n == -1 && errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+static int xsend(CHANNEL *ch, int dir, void *buf, size_t len)
+{
+    switch (ch->type)
+    {
+        case T_MSGQ:
+        {
+            long *msg = buf;  // Caller reserves a long in front of the payload
+            msg[-1] = dir + 1;
+            return msgsnd(ch->msqid, &msg[-1], len, 0);
+        }
+        case T_SHM:
+            if (shm_ring_wait_writable(&ch->ring[dir], len, -1) != SHM_RING_SUCCESS)
+            {
+                return -1;
+            }
+            return shm_ring_write(&ch->ring[dir], buf, len) == SHM_RING_SUCCESS ? 0 : -1;
+        case T_DGRAM:
+            return send(ch->wfd[dir], buf, len, 0) == (ssize_t)len ? 0 : -1;
+        case T_EVENTFD:
+        {
+            uint64_t one = 1;
+            return write(ch->wfd[dir], &one, sizeof(one)) == sizeof(one) ? 0 : -1;
+        }
+        default:
+            return full_io(ch->wfd[dir], buf, len, 1);
+    }
+}
+
+static int xrecv(CHANNEL *ch, int dir, void *buf, size_t len)
+{
+    switch (ch->type)
+    {
+        case T_MSGQ:
+        {
+            long *msg = buf;
+            return msgrcv(ch->msqid, &msg[-1], len, dir + 1, 0) == (ssize_t)len ? 0 : -1;
+        }
+        case T_SHM:
+        {
+            uint32_t got;
+            for (int spins = 0;; spins++)
+            {
+                int ret = shm_ring_read(&ch->ring[dir], buf, len, &got);
+                if (ret == SHM_RING_SUCCESS)
+                {
+                    return 0;
+                }
+                if (ret == SHM_RING_ERROR)
+                {
+                    return -1;
+                }
+                // Spin briefly like a latency-sensitive consumer would, then sleep
+                if (spins >= ch->spins && shm_ring_wait_readable(&ch->ring[dir], -1) != SHM_RING_SUCCESS)
+                {
+                    return -1;
+                }
+            }
+        }
+        case T_DGRAM:
+            return recv(ch->rfd[dir], buf, len, 0) == (ssize_t)len ? 0 : -1;
+        case T_EVENTFD:
+        {
+            uint64_t val;
+            return read(ch->rfd[dir], &val, sizeof(val)) == sizeof(val) ? 0 : -1;
+        }
+        default:
+            return full_io(ch->rfd[dir], buf, len, 0);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Tests
+//-------------------------------------------------------------------------------------------------
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void child_side(CHANNEL *ch, char *buf, size_t size, uint64_t rounds, uint64_t count, int cpu)
+{
+    pin_cpu(cpu);
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        if (xrecv(ch, 0, buf, size) != 0 || xsend(ch, 1, buf, size) != 0)
+        {
+            _exit(1);
+        }
+    }
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (xrecv(ch, 0, buf, size) != 0)
+        {
+            _exit(1);
+        }
+    }
+    if (count > 0 && xsend(ch, 1, buf, size) != 0)
+    {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// Returns 0 on success; fills lat and the throughput figures
+static int run_case(TRANSPORT_E type, size_t size, int cpu_a, int cpu_b, uint64_t rounds, uint64_t bytes, LATENCY *lat, double *mbps, double *mps)
+{
+    CHANNEL   ch;
+    char     *mem = malloc(size + sizeof(long) + 8);
+    char     *buf = mem + sizeof(long);
+    uint64_t *samples = malloc(rounds * sizeof(uint64_t));
+    uint64_t  count = type == T_EVENTFD ? 0 : (bytes / size > 1000 ? bytes / size : 1000);
+    pid_t     pid;
+    int       status, ok = 1;
+
+    if (mem == NULL || samples == NULL || channel_open(&ch, type) != 0)
+    {
+        perror(transport_names[type]);
+        free(mem);
+        free(samples);
+        return -1;
+    }
+    memset(buf, 0x5A, size);
+    ch.spins = cpu_a >= 0 && cpu_a == cpu_b ? 0 : SPINS;  // Spinning on a shared CPU only delays the peer
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        child_side(&ch, buf, size, rounds, count, cpu_b);
+    }
+    pin_cpu(cpu_a);
+
+    for (uint64_t i = 0; i < rounds && ok; i++)
+    {
+        uint64_t t0 = now_ns();
+        ok = xsend(&ch, 0, buf, size) == 0 && xrecv(&ch, 1, buf, size) == 0;
+        samples[i] = (now_ns() - t0) / 2;
+    }
+
+    uint64_t t0 = now_ns();
+    for (uint64_t i = 0; i < count && ok; i++)
+    {
+        ok = xsend(&ch, 0, buf, size) == 0;
+    }
+    if (count > 0 && ok)
+    {
+        ok = xrecv(&ch, 1, buf, size) == 0;
+    }
+    double secs = (now_ns() - t0) / 1e9;
+
+    waitpid(pid, &status, 0);
+    channel_close(&ch);
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "%s: transfer failed\n", transport_names[type]);
+        free(mem);
+        free(samples);
+        return -1;
+    }
+
+    memset(lat->hist, 0, sizeof(lat->hist));
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        int b = samples[i] ? 63 - __builtin_clzll(samples[i]) : 0;
+        lat->hist[b < HIST_BUCKETS ? b : HIST_BUCKETS - 1]++;
+    }
+    qsort(samples, rounds, sizeof(uint64_t), cmp_u64);
+    lat->p50 = samples[rounds / 2];
+    lat->p99 = samples[rounds * 99 / 100];
+    lat->p999 = samples[rounds * 999 / 1000];
+    lat->max = samples[rounds - 1];
+
+    *mbps = count ? count * (double)size / secs / 1e6 : 0;
+    *mps = count ? count / secs : 0;
+    free(mem);
+    free(samples);
+    return 0;
+}
+
+static void print_histogram(const LATENCY *lat, uint64_t rounds)
+{
+    uint64_t peak = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        peak = lat->hist[b] > peak ? lat->hist[b] : peak;
+    }
+    for (int b = 0; b < HIST_BUCKETS; b++)
+    {
+        if (lat->hist[b] == 0)
+        {
+            continue;
+        }
+        int bar = (int)(lat->hist[b] * 40 / peak);
+        printf("      %9llu - %9llu ns %6.2f%% %.*s\n", 1ull << b, (2ull << b) - 1, 100.0 * lat->hist[b] / rounds, bar > 0 ? bar : 1,
+               "########################################");
+    }
+}
+
+// Parse "a,b,c" against a name table into indexes; returns the count or -1
+static int parse_names(const char *arg, const char *const *names, int n, int *out)
+{
+    char  copy[256];
+    char *save = NULL;
+    int   count = 0;
+
+    snprintf(copy, sizeof(copy), "%s", arg);
+    for (char *tok = strtok_r(copy, ",", &save); tok != NULL && count < MAX_LIST; tok = strtok_r(NULL, ",", &save))
+    {
+        int found = -1;
+        for (int i = 0; i < n; i++)
+        {
+            if (strcmp(tok, names[i]) == 0)
+            {
+                found = i;
+            }
+        }
+        if (found < 0)
+        {
+            fprintf(stderr, "Unknown name: %s\n", tok);
+            return -1;
+        }
+        out[count++] = found;
+    }
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    int      transports[MAX_LIST], placements[MAX_LIST];
+    size_t   sizes[MAX_LIST];
+    int      nt, np, ns = 0;
+    char     size_list[256] = "64,1024,16384";
+    uint64_t rounds = 20000;
+    uint64_t bytes = 64ull << 20;
+    int      histograms = 1;
+    int      opt;
+
+    nt = parse_names("msgq,shm,pipe,unix,dgram,eventfd", transport_names, T_COUNT, transports);
+    np = parse_names("same,sibling,core,socket", placement_names, P_COUNT, placements);
+
+    while ((opt = getopt(argc, argv, "t:s:p:l:b:q")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                nt = parse_names(optarg, transport_names, T_COUNT, transports);
+                break;
+            case 'p':
+                np = parse_names(optarg, placement_names, P_COUNT, placements);
+                break;
+            case 's':
+                snprintf(size_list, sizeof(size_list), "%s", optarg);
+                break;
+            case 'l':
+                rounds = strtoull(optarg, NULL, 10);
+                break;
+            case 'b':
+                bytes = strtoull(optarg, NULL, 10);
+                break;
+            case 'q':
+                histograms = 0;
+                break;
+            default:
+                fprintf(stderr,
+                        "Usage: %s [-t msgq,shm,pipe,unix,dgram,eventfd] [-s 64,1024,16384] [-p same,sibling,core,socket,none] [-l round_trips] "
+                        "[-b bytes] [-q]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    for (char *save = NULL, *tok = strtok_r(size_list, ",", &save); tok != NULL && ns < MAX_LIST; tok = strtok_r(NULL, ",", &save))
+    {
+        sizes[ns] = strtoul(tok, NULL, 10);
+        if (sizes[ns] == 0)
+        {
+            fprintf(stderr, "Bad size: %s\n", tok);
+            return 1;
+        }
+        ns++;
+    }
+    if (nt <= 0 || np <= 0 || ns == 0 || rounds == 0)
+    {
+        return 1;
+    }
+
+    printf("%-8s %7s %-8s %10s %10s %10s %10s %12s %12s\n", "mech", "size", "cpus", "p50 ns", "p99 ns", "p99.9 ns", "max ns", "MB/s", "msg/s");
+    for (int p = 0; p < np; p++)
+    {
+        int cpu_a, cpu_b;
+        if (pick_pair((PLACEMENT_E)placements[p], &cpu_a, &cpu_b) != 0)
+        {
+            printf("-- placement %s: no such CPU pair on this machine, skipped\n", placement_names[placements[p]]);
+            continue;
+        }
+        if (cpu_a < 0)
+        {
+            printf("-- placement none (unpinned)\n");
+        }
+        else
+        {
+            printf("-- placement %s (CPU %d / CPU %d)\n", placement_names[placements[p]], cpu_a, cpu_b);
+        }
+
+        for (int t = 0; t < nt; t++)
+        {
+            TRANSPORT_E type = (TRANSPORT_E)transports[t];
+            size_t      limit = channel_limit(type);
+
+            for (int s = 0; s < ns; s++)
+            {
+                size_t  size = type == T_EVENTFD ? sizeof(uint64_t) : sizes[s];
+                LATENCY lat;
+                double  mbps, mps;
+
+                if (type == T_EVENTFD && s > 0)
+                {
+                    break;  // Fixed 8-byte counter: one row is enough
+                }
+                if (limit && size > limit)
+                {
+                    printf("%-8s %7zu %-8s   exceeds the %zu byte message limit\n", transport_names[type], size, placement_names[placements[p]], limit);
+                    continue;
+                }
+                if (run_case(type, size, cpu_a, cpu_b, rounds, bytes, &lat, &mbps, &mps) != 0)
+                {
+                    continue;
+                }
+                printf("%-8s %7zu %-8s %10.0f %10.0f %10.0f %10.0f", transport_names[type], size, placement_names[placements[p]], lat.p50, lat.p99,
+                       lat.p999, lat.max);
+                if (type == T_EVENTFD)
+                {
+                    printf(" %12s %12s\n", "-", "-");
+                }
+                else
+                {
+                    printf(" %12.1f %12.0f\n", mbps, mps);
+                }
+                if (histograms)
+                {
+                    print_histogram(&lat, rounds);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,880 @@
+/**
+ * @file    journal.c
+ * @brief   Persistent append-only event journal in memory-mapped segment files.
+ *
+ */
+
+#define _GNU_SOURCE  // sync_file_range()
+
+#include "journal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC   0x4C4E524Au  // "JRNL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_ALIGN   8
+#define JOURNAL_SUFFIX  ".jnl"
+
+// Record header word: size in the low 32 bits, writer pid above, state in the top bits
+#define REC_SIZE_MASK 0xFFFFFFFFull
+#define REC_PID_SHIFT 32
+#define REC_PID_MASK  0x3FFFFFFFull
+#define REC_PAD       (1ull << 62)  // Filler up to the end of the segment
+#define REC_COMMITTED (1ull << 63)
+
+#define STALL_CHECK 64  // Polls on an uncommitted record between checks of its writer
+
+typedef struct
+{
+    _Atomic uint64_t word;
+    uint64_t         timestamp_ns;
+} JOURNAL_REC_HDR;
+
+static inline uint64_t record_size(uint32_t len)
+{
+    return (sizeof(JOURNAL_REC_HDR) + (uint64_t)len + JOURNAL_ALIGN - 1) & ~(uint64_t)(JOURNAL_ALIGN - 1);
+}
+
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void segment_path(char *path, size_t size, const char *dir, uint64_t index)
+{
+    snprintf(path, size, "%s/%016llx" JOURNAL_SUFFIX, dir, (unsigned long long)index);
+}
+
+// Find the oldest and newest segment in the directory; returns the number of segments
+static int scan_segments(const char *dir, uint64_t *oldest, uint64_t *newest)
+{
+    DIR           *d = opendir(dir);
+    struct dirent *e;
+    int            count = 0;
+
+    if (d == NULL)
+    {
+        return 0;
+    }
+    while ((e = readdir(d)) != NULL)
+    {
+        char    *end;
+        uint64_t index = strtoull(e->d_name, &end, 16);
+
+        if (end != e->d_name + 16 || strcmp(end, JOURNAL_SUFFIX) != 0)
+        {
+            continue;
+        }
+        if (count == 0 || index < *oldest)
+        {
+            *oldest = index;
+        }
+        if (count == 0 || index > *newest)
+        {
+            *newest = index;
+        }
+        count++;
+    }
+    closedir(d);
+    return count;
+}
+
+// Map an existing segment; errno is ENOENT if it does not exist (yet, or any more)
+static int map_segment(const char *dir, uint64_t index, uint32_t flags, int *fd, uint8_t **base)
+{
+    char        path[JOURNAL_PATH_MAX + 32];
+    struct stat st;
+    void       *p;
+
+    segment_path(path, sizeof(path), dir, index);
+    *fd = open(path, O_RDWR);
+    if (*fd == -1)
+    {
+        return JOURNAL_ERROR;
+    }
+    if (fstat(*fd, &st) == -1 || st.st_size < 2 * JOURNAL_DATA_OFFSET)
+    {
+        fprintf(stderr, "journal: %s is truncated\n", path);
+        close(*fd);
+        errno = EINVAL;
+        return JOURNAL_ERROR;
+    }
+
+    p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED | (flags & JOURNAL_POPULATE ? MAP_POPULATE : 0), *fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("journal: mmap");
+        close(*fd);
+        return JOURNAL_ERROR;
+    }
+    JOURNAL_SEG_HDR *hdr = p;
+    atomic_thread_fence(memory_order_acquire);
+    if (hdr->magic != JOURNAL_MAGIC || hdr->version != JOURNAL_VERSION || hdr->segment_size != (uint64_t)st.st_size || hdr->index != index)
+    {
+        fprintf(stderr, "journal: %s is not a journal segment\n", path);
+        munmap(p, st.st_size);
+        close(*fd);
+        errno = EINVAL;
+        return JOURNAL_ERROR;
+    }
+    *base = p;
+    return JOURNAL_SUCCESS;
+}
+
+// Build a segment under a temporary name and link it into place, so nobody sees it
+// half-initialized. Losing the race to another creator is not an error.
+static int create_segment(const char *dir, uint64_t index, uint64_t segment_size, uint32_t flags)
+{
+    char             path[JOURNAL_PATH_MAX + 32];
+    char             tmp[JOURNAL_PATH_MAX + 48];
+    JOURNAL_SEG_HDR *hdr;
+    int              fd, rc;
+
+    segment_path(path, sizeof(path), dir, index);
+    snprintf(tmp, sizeof(tmp), "%s/.%016llx.%d.tmp", dir, (unsigned long long)index, (int)getpid());
+
+    fd = open(tmp, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1)
+    {
+        perror("journal: create segment");
+        return JOURNAL_ERROR;
+    }
+    // Allocate the blocks now, so appends never fault on a full disk (SIGBUS)
+    rc = posix_fallocate(fd, 0, segment_size);
+    if (rc != 0)
+    {
+        fprintf(stderr, "journal: fallocate %s: %s\n", tmp, strerror(rc));
+        close(fd);
+        unlink(tmp);
+        return JOURNAL_ERROR;
+    }
+    hdr = mmap(NULL, JOURNAL_DATA_OFFSET, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+    {
+        perror("journal: mmap");
+        close(fd);
+        unlink(tmp);
+        return JOURNAL_ERROR;
+    }
+
+    hdr->version = JOURNAL_VERSION;
+    hdr->segment_size = segment_size;
+    hdr->index = index;
+    shm_notify_init(&hdr->appended);
+    atomic_store_explicit(&hdr->tail, JOURNAL_DATA_OFFSET, memory_order_relaxed);
+    atomic_store_explicit(&hdr->synced, JOURNAL_DATA_OFFSET, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    hdr->magic = JOURNAL_MAGIC;
+    munmap(hdr, JOURNAL_DATA_OFFSET);
+
+    if (flags & JOURNAL_SYNC_DURABLE)
+    {
+        fdatasync(fd);
+    }
+    close(fd);
+
+    rc = link(tmp, path) == 0 || errno == EEXIST ? JOURNAL_SUCCESS : JOURNAL_ERROR;
+    if (rc != JOURNAL_SUCCESS)
+    {
+        perror("journal: link segment");
+    }
+    unlink(tmp);
+
+    if (rc == JOURNAL_SUCCESS && (flags & JOURNAL_SYNC_DURABLE))
+    {
+        // The new directory entry must survive a power loss too
+        int dfd = open(dir, O_RDONLY | O_DIRECTORY);
+        if (dfd != -1)
+        {
+            fsync(dfd);
+            close(dfd);
+        }
+    }
+    return rc;
+}
+
+static void writer_attach(JOURNAL *j, uint64_t index, int fd, uint8_t *base)
+{
+    j->index = index;
+    j->fd = fd;
+    j->base = base;
+    j->hdr = (JOURNAL_SEG_HDR *)base;
+    j->segment_size = j->hdr->segment_size;
+}
+
+static void writer_detach(JOURNAL *j)
+{
+    if (j->base != NULL)
+    {
+        munmap(j->base, j->segment_size);
+        close(j->fd);
+        j->base = NULL;
+        j->hdr = NULL;
+    }
+}
+
+// Write back [start, end) of the current segment: start it (async) or wait for it (durable)
+static void sync_range(JOURNAL *j, uint64_t start, uint64_t end)
+{
+    static long page;
+
+    if (page == 0)
+    {
+        page = sysconf(_SC_PAGESIZE);
+    }
+    start &= ~(uint64_t)(page - 1);
+    if (j->flags & JOURNAL_SYNC_DURABLE)
+    {
+        msync(j->base + start, end - start, MS_SYNC);
+    }
+    else
+    {
+        // msync(MS_ASYNC) does nothing on Linux; this actually queues the writeback
+        sync_file_range(j->fd, start, end - start, SYNC_FILE_RANGE_WRITE);
+    }
+}
+
+// Called after a commit ending at @p end: sync once a batch has built up. Exactly one
+// writer wins the CAS on the synced offset and syncs the batch. A record committed
+// after a batch that already covered its range syncs itself.
+static void maybe_sync(JOURNAL *j, uint64_t start, uint64_t end, int force)
+{
+    uint64_t synced = atomic_load_explicit(&j->hdr->synced, memory_order_relaxed);
+
+    if (synced >= end)
+    {
+        if (start < synced)
+        {
+            sync_range(j, start, end);
+        }
+        return;
+    }
+    if (!force && end - synced < j->sync_bytes)
+    {
+        return;
+    }
+    while (synced < end)
+    {
+        if (atomic_compare_exchange_weak_explicit(&j->hdr->synced, &synced, end, memory_order_relaxed, memory_order_relaxed))
+        {
+            sync_range(j, synced, end);
+            return;
+        }
+    }
+}
+
+// Move to the segment after the current one, creating it if this writer is first
+static int next_segment(JOURNAL *j)
+{
+    uint64_t         next = j->index + 1;
+    JOURNAL_SEG_HDR *old = j->hdr;
+    uint8_t         *base;
+    int              fd;
+
+    if (map_segment(j->dir, next, j->flags, &fd, &base) != JOURNAL_SUCCESS)
+    {
+        if (errno != ENOENT || create_segment(j->dir, next, j->segment_size, j->flags) != JOURNAL_SUCCESS ||
+            map_segment(j->dir, next, j->flags, &fd, &base) != JOURNAL_SUCCESS)
+        {
+            return JOURNAL_ERROR;
+        }
+        // Readers parked at the end of the old segment are waiting for this file
+        shm_notify_wake(&old->appended);
+    }
+    writer_detach(j);
+    writer_attach(j, next, fd, base);
+    return JOURNAL_SUCCESS;
+}
+
+// Claim @p size bytes at the end of the journal with a CAS on the first free record word
+static JOURNAL_REC_HDR *claim(JOURNAL *j, uint64_t size)
+{
+    for (;;)
+    {
+        uint64_t off = atomic_load_explicit(&j->hdr->tail, memory_order_acquire);
+        uint64_t room = j->segment_size - off;
+
+        if (room < sizeof(JOURNAL_REC_HDR))
+        {
+            if (next_segment(j) != JOURNAL_SUCCESS)
+            {
+                return NULL;
+            }
+            continue;
+        }
+
+        JOURNAL_REC_HDR *h = (JOURNAL_REC_HDR *)(j->base + off);
+        uint64_t         word = size <= room ? j->word | size : REC_PAD | REC_COMMITTED | room;
+        uint64_t         expected = 0;
+
+        if (atomic_compare_exchange_strong_explicit(&h->word, &expected, word, memory_order_acquire, memory_order_acquire))
+        {
+            atomic_compare_exchange_strong_explicit(&j->hdr->tail, &off, off + (word & REC_SIZE_MASK), memory_order_release, memory_order_relaxed);
+            if (size <= room)
+            {
+                return h;
+            }
+            // Closed the segment with a pad record
+            shm_notify_wake(&j->hdr->appended);
+            if (j->flags & (JOURNAL_SYNC_ASYNC | JOURNAL_SYNC_DURABLE))
+            {
+                maybe_sync(j, off, j->segment_size, 1);
+            }
+            if (next_segment(j) != JOURNAL_SUCCESS)
+            {
+                return NULL;
+            }
+            continue;
+        }
+
+        // Another writer got here first: move the hint past its record and retry
+        if ((expected & REC_SIZE_MASK) < sizeof(JOURNAL_REC_HDR) || (expected & REC_SIZE_MASK) > room)
+        {
+            fprintf(stderr, "journal: corrupt record at %016llx:%llu\n", (unsigned long long)j->index, (unsigned long long)off);
+            return NULL;
+        }
+        atomic_compare_exchange_strong_explicit(&j->hdr->tail, &off, off + (expected & REC_SIZE_MASK), memory_order_release, memory_order_relaxed);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open a journal for appending, creating the directory and first segment if
+ *        needed.
+ * @param[out] j Writer handle.
+ * @param[in] dir Journal directory.
+ * @param[in] segment_size Segment file size for a new journal (0 = default); an
+ *            existing journal keeps its own.
+ * @param[in] flags JOURNAL_SYNC_ASYNC or JOURNAL_SYNC_DURABLE, JOURNAL_POPULATE.
+ * @param[in] sync_bytes Data written between syncs (with a sync flag).
+ * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+ */
+int journal_open(JOURNAL *j, const char *dir, uint64_t segment_size, uint32_t flags, uint64_t sync_bytes)
+{
+    uint64_t oldest, newest = 0;
+    uint8_t *base;
+    int      fd;
+
+    memset(j, 0, sizeof(*j));
+    snprintf(j->dir, sizeof(j->dir), "%s", dir);
+    j->flags = flags;
+    j->sync_bytes = sync_bytes;
+    j->word = ((uint64_t)getpid() & REC_PID_MASK) << REC_PID_SHIFT;
+
+    if (segment_size == 0)
+    {
+        segment_size = JOURNAL_DEFAULT_SEGMENT;
+    }
+    segment_size = (segment_size + JOURNAL_DATA_OFFSET - 1) & ~(uint64_t)(JOURNAL_DATA_OFFSET - 1);
+    if (segment_size < 2 * JOURNAL_DATA_OFFSET || segment_size > (1ull << 32))
+    {
+        fprintf(stderr, "journal: segment size must be between 8 KB and 4 GB\n");
+        return JOURNAL_ERROR;
+    }
+
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+    {
+        perror("journal: mkdir");
+        return JOURNAL_ERROR;
+    }
+    if (scan_segments(dir, &oldest, &newest) == 0 && create_segment(dir, 0, segment_size, flags) != JOURNAL_SUCCESS)
+    {
+        return JOURNAL_ERROR;
+    }
+    if (map_segment(dir, newest, flags, &fd, &base) != JOURNAL_SUCCESS)
+    {
+        return JOURNAL_ERROR;
+    }
+    writer_attach(j, newest, fd, base);
+    return JOURNAL_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Sync what this handle's segment holds, then unmap it.
+ * @param[in,out] j Writer handle.
+ */
+void journal_close(JOURNAL *j)
+{
+    if (j->base != NULL && (j->flags & (JOURNAL_SYNC_ASYNC | JOURNAL_SYNC_DURABLE)))
+    {
+        journal_sync(j);
+    }
+    writer_detach(j);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest payload a record can carry.
+ * @param[in] j Writer handle.
+ * @return Maximum payload in bytes.
+ */
+uint32_t journal_max_payload(const JOURNAL *j)
+{
+    uint64_t max = j->segment_size - JOURNAL_DATA_OFFSET - sizeof(JOURNAL_REC_HDR);
+    return max > UINT32_MAX - 2 * JOURNAL_DATA_OFFSET ? UINT32_MAX - 2 * JOURNAL_DATA_OFFSET : (uint32_t)max;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Claim space for a record and return where to write its payload. Finish with
+ *        journal_commit(); one reservation per handle at a time.
+ * @param[in,out] j Writer handle.
+ * @param[in] len Payload size.
+ * @return Payload pointer, or NULL if @p len is too large or a segment cannot be created.
+ */
+void *journal_reserve(JOURNAL *j, uint32_t len)
+{
+    JOURNAL_REC_HDR *h;
+
+    if (len > journal_max_payload(j) || j->pending != NULL)
+    {
+        return NULL;
+    }
+    h = claim(j, record_size(len));
+    if (h == NULL)
+    {
+        return NULL;
+    }
+    h->timestamp_ns = realtime_ns();
+    j->pending = h;
+    return h + 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Make the reserved record visible to readers and sync if a batch is full.
+ * @param[in,out] j Writer handle.
+ */
+void journal_commit(JOURNAL *j)
+{
+    JOURNAL_REC_HDR *h = j->pending;
+    uint64_t         word, start;
+
+    if (h == NULL)
+    {
+        return;
+    }
+    word = atomic_load_explicit(&h->word, memory_order_relaxed);
+    atomic_store_explicit(&h->word, word | REC_COMMITTED, memory_order_release);
+    shm_notify_wake(&j->hdr->appended);
+
+    if (j->flags & (JOURNAL_SYNC_ASYNC | JOURNAL_SYNC_DURABLE))
+    {
+        start = (uint8_t *)h - j->base;
+        maybe_sync(j, start, start + (word & REC_SIZE_MASK), 0);
+    }
+    j->pending = NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Append a record (reserve, copy, commit).
+ * @param[in,out] j Writer handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size.
+ * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+ */
+int journal_append(JOURNAL *j, const void *data, uint32_t len)
+{
+    void *p = journal_reserve(j, len);
+
+    if (p == NULL)
+    {
+        return JOURNAL_ERROR;
+    }
+    memcpy(p, data, len);
+    journal_commit(j);
+    return JOURNAL_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Write the current segment back to disk and wait for it.
+ * @param[in,out] j Writer handle.
+ * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+ */
+int journal_sync(JOURNAL *j)
+{
+    uint64_t tail = atomic_load_explicit(&j->hdr->tail, memory_order_acquire);
+
+    if (msync(j->base, tail, MS_SYNC) == -1)
+    {
+        perror("journal: msync");
+        return JOURNAL_ERROR;
+    }
+    uint64_t synced = atomic_load_explicit(&j->hdr->synced, memory_order_relaxed);
+    while (synced < tail && !atomic_compare_exchange_weak_explicit(&j->hdr->synced, &synced, tail, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    return JOURNAL_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Delete the oldest segments, keeping the newest @p keep. Readers still on a
+ *        deleted segment finish it; readers behind it skip ahead.
+ * @param[in] j Writer handle.
+ * @param[in] keep Segments to keep (at least 1).
+ * @return Number of segments deleted.
+ */
+int journal_trim(JOURNAL *j, uint32_t keep)
+{
+    uint64_t oldest, newest;
+    int      deleted = 0;
+
+    if (keep == 0 || scan_segments(j->dir, &oldest, &newest) == 0)
+    {
+        return 0;
+    }
+    for (uint64_t i = oldest; i + keep <= newest; i++)
+    {
+        char path[JOURNAL_PATH_MAX + 32];
+
+        segment_path(path, sizeof(path), j->dir, i);
+        deleted += unlink(path) == 0;
+    }
+    return deleted;
+}
+
+static void reader_attach(JOURNAL_READER *r, uint64_t index, int fd, uint8_t *base)
+{
+    if (r->base != NULL)
+    {
+        shm_notify_poll_detach(&r->poll);
+        munmap(r->base, r->segment_size);
+        close(r->fd);
+    }
+    r->index = index;
+    r->fd = fd;
+    r->base = base;
+    r->hdr = (JOURNAL_SEG_HDR *)base;
+    r->segment_size = r->hdr->segment_size;
+    r->offset = JOURNAL_DATA_OFFSET;
+    r->stalls = 0;
+    madvise(base, r->segment_size, MADV_SEQUENTIAL);
+    if (r->poll.id != 0)
+    {
+        // The poller follows the reader; appends to the new segment wake it there
+        shm_notify_poll_attach(&r->poll, &r->hdr->appended);
+    }
+}
+
+// Go on to the next segment; skip ahead if the journal was trimmed past it
+static int reader_next(JOURNAL_READER *r)
+{
+    uint64_t next = r->index + 1, oldest, newest;
+    uint8_t *base;
+    int      fd;
+
+    if (map_segment(r->dir, next, r->flags, &fd, &base) == JOURNAL_SUCCESS)
+    {
+        reader_attach(r, next, fd, base);
+        return JOURNAL_SUCCESS;
+    }
+    if (errno != ENOENT)
+    {
+        return JOURNAL_ERROR;
+    }
+    if (scan_segments(r->dir, &oldest, &newest) > 0 && oldest > next && map_segment(r->dir, oldest, r->flags, &fd, &base) == JOURNAL_SUCCESS)
+    {
+        r->trimmed += oldest - next;
+        reader_attach(r, oldest, fd, base);
+        return JOURNAL_SUCCESS;
+    }
+    return JOURNAL_AGAIN;  // Not created yet
+}
+
+static int writer_dead(uint64_t word)
+{
+    pid_t pid = (pid_t)((word >> REC_PID_SHIFT) & REC_PID_MASK);
+    return kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+// Would journal_read() make progress?
+static int reader_ready(JOURNAL_READER *r)
+{
+    char     path[JOURNAL_PATH_MAX + 32];
+    uint64_t word = 0;
+
+    if (r->offset + sizeof(JOURNAL_REC_HDR) <= r->segment_size)
+    {
+        word = atomic_load_explicit(&((JOURNAL_REC_HDR *)(r->base + r->offset))->word, memory_order_acquire);
+        if (word != 0 && !(word & REC_PAD))
+        {
+            return (word & REC_COMMITTED) || writer_dead(word);
+        }
+        if (word == 0)
+        {
+            return 0;
+        }
+    }
+    // End of the segment: wait for the next one
+    segment_path(path, sizeof(path), r->dir, r->index + 1);
+    return access(path, F_OK) == 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open a reader on a journal.
+ * @param[out] r Reader handle.
+ * @param[in] dir Journal directory.
+ * @param[in] name Cursor name to resume from and keep the position in
+ *            (<dir>/<name>.cursor), or NULL for no persisted position.
+ * @param[in] from JOURNAL_FROM_OLDEST or JOURNAL_FROM_NEWEST, used when there is no
+ *            saved cursor.
+ * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+ */
+int journal_reader_open(JOURNAL_READER *r, const char *dir, const char *name, int from)
+{
+    uint64_t oldest, newest, start = 0;
+    uint8_t *base;
+    int      fd;
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->dir, sizeof(r->dir), "%s", dir);
+
+    if (name != NULL)
+    {
+        char path[JOURNAL_PATH_MAX + 80];
+        int  cfd;
+        void *p;
+
+        snprintf(path, sizeof(path), "%s/%s.cursor", dir, name);
+        cfd = open(path, O_CREAT | O_RDWR, 0644);
+        if (cfd == -1 || ftruncate(cfd, sizeof(uint64_t)) == -1)
+        {
+            perror("journal: cursor file");
+            if (cfd != -1)
+            {
+                close(cfd);
+            }
+            return JOURNAL_ERROR;
+        }
+        p = mmap(NULL, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, cfd, 0);
+        close(cfd);
+        if (p == MAP_FAILED)
+        {
+            perror("journal: mmap cursor");
+            return JOURNAL_ERROR;
+        }
+        r->cursor = p;
+        start = atomic_load_explicit(r->cursor, memory_order_relaxed);
+    }
+
+    if (scan_segments(dir, &oldest, &newest) == 0)
+    {
+        fprintf(stderr, "journal: no segments in %s\n", dir);
+        journal_reader_close(r);
+        return JOURNAL_ERROR;
+    }
+    if (map_segment(dir, start == 0 && from == JOURNAL_FROM_NEWEST ? newest : oldest, 0, &fd, &base) != JOURNAL_SUCCESS)
+    {
+        journal_reader_close(r);
+        return JOURNAL_ERROR;
+    }
+    reader_attach(r, start == 0 && from == JOURNAL_FROM_NEWEST ? newest : oldest, fd, base);
+
+    if (start != 0)
+    {
+        // Resume at the saved position, unless its segment has been trimmed
+        uint64_t index = start / r->segment_size;
+        if (index > r->index && map_segment(dir, index, 0, &fd, &base) == JOURNAL_SUCCESS)
+        {
+            reader_attach(r, index, fd, base);
+        }
+        if (index == r->index)
+        {
+            r->offset = start % r->segment_size;
+        }
+        else if (index < r->index)
+        {
+            r->trimmed += r->index - index;
+        }
+    }
+    else if (from == JOURNAL_FROM_NEWEST)
+    {
+        // Skip every record claimed so far
+        while (r->offset + sizeof(JOURNAL_REC_HDR) <= r->segment_size)
+        {
+            uint64_t word = atomic_load_explicit(&((JOURNAL_REC_HDR *)(r->base + r->offset))->word, memory_order_acquire);
+            if (word == 0 || (word & REC_SIZE_MASK) < sizeof(JOURNAL_REC_HDR))
+            {
+                break;
+            }
+            r->offset += word & REC_SIZE_MASK;
+        }
+    }
+    return JOURNAL_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Save the position and unmap.
+ * @param[in,out] r Reader handle.
+ */
+void journal_reader_close(JOURNAL_READER *r)
+{
+    shm_notify_poll_close(&r->poll);
+    if (r->cursor != NULL)
+    {
+        if (r->base != NULL)
+        {
+            atomic_store_explicit(r->cursor, r->index * r->segment_size + r->offset, memory_order_relaxed);
+        }
+        munmap((void *)r->cursor, sizeof(uint64_t));
+        r->cursor = NULL;
+    }
+    if (r->base != NULL)
+    {
+        munmap(r->base, r->segment_size);
+        close(r->fd);
+        r->base = NULL;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Return the next record without copying it.
+ * @param[in,out] r Reader handle.
+ * @param[out] rec Record; rec->data stays valid until the next read.
+ * @return JOURNAL_SUCCESS, JOURNAL_AGAIN at the end of the journal, JOURNAL_ERROR
+ *         on failure.
+ */
+int journal_read(JOURNAL_READER *r, JOURNAL_RECORD *rec)
+{
+    for (;;)
+    {
+        if (r->offset + sizeof(JOURNAL_REC_HDR) > r->segment_size)
+        {
+            int rc = reader_next(r);
+            if (rc != JOURNAL_SUCCESS)
+            {
+                return rc;
+            }
+            continue;
+        }
+
+        JOURNAL_REC_HDR *h = (JOURNAL_REC_HDR *)(r->base + r->offset);
+        uint64_t         word = atomic_load_explicit(&h->word, memory_order_acquire);
+        uint64_t         size = word & REC_SIZE_MASK;
+
+        if (word == 0)
+        {
+            return JOURNAL_AGAIN;
+        }
+        if (size < sizeof(JOURNAL_REC_HDR) || size > r->segment_size - r->offset)
+        {
+            fprintf(stderr, "journal: corrupt record at %016llx:%llu\n", (unsigned long long)r->index, (unsigned long long)r->offset);
+            return JOURNAL_ERROR;
+        }
+        if (!(word & REC_COMMITTED))
+        {
+            // Still being written, or its writer died before committing
+            if (++r->stalls % STALL_CHECK != 0 || !writer_dead(word))
+            {
+                return JOURNAL_AGAIN;
+            }
+            r->aborted++;
+        }
+        else if (!(word & REC_PAD))
+        {
+            rec->data = h + 1;
+            rec->len = (uint32_t)(size - sizeof(JOURNAL_REC_HDR));
+            rec->timestamp_ns = h->timestamp_ns;
+            rec->position = r->index * r->segment_size + r->offset;
+            if (r->cursor != NULL)
+            {
+                // The previous record is done; this one is returned again after a crash
+                atomic_store_explicit(r->cursor, rec->position, memory_order_relaxed);
+            }
+            r->offset += size;
+            r->stalls = 0;
+            return JOURNAL_SUCCESS;
+        }
+        r->offset += size;
+        r->stalls = 0;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Sleep until a record may be available.
+ * @param[in,out] r Reader handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return JOURNAL_SUCCESS, JOURNAL_AGAIN on timeout.
+ */
+int journal_reader_wait(JOURNAL_READER *r, int timeout_ms)
+{
+    uint32_t seq = shm_notify_prepare(&r->hdr->appended);
+
+    if (reader_ready(r))
+    {
+        shm_notify_cancel(&r->hdr->appended);
+        return JOURNAL_SUCCESS;
+    }
+    return shm_notify_wait(&r->hdr->appended, seq, timeout_ms) == SHM_NOTIFY_TIMEOUT ? JOURNAL_AGAIN : JOURNAL_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when a record may be
+ *        available. Created on first use.
+ * @param[in,out] r Reader handle.
+ * @return Descriptor (closed by journal_reader_close()), or -1 on failure.
+ */
+int journal_reader_pollfd(JOURNAL_READER *r)
+{
+    if (r->poll.id == 0)
+    {
+        if (shm_notify_poll_open(&r->poll) != SHM_NOTIFY_SUCCESS)
+        {
+            return -1;
+        }
+        if (shm_notify_poll_attach(&r->poll, &r->hdr->appended) != SHM_NOTIFY_SUCCESS)
+        {
+            shm_notify_poll_close(&r->poll);
+            return -1;
+        }
+    }
+    return r->poll.fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief journal_read() that arms the poll descriptor before returning JOURNAL_AGAIN.
+ * @param[in,out] r Reader handle.
+ * @param[out] rec Record; rec->data stays valid until the next read.
+ * @return JOURNAL_SUCCESS, JOURNAL_AGAIN at the end of the journal, JOURNAL_ERROR
+ *         on failure.
+ */
+int journal_try_read(JOURNAL_READER *r, JOURNAL_RECORD *rec)
+{
+    int ret = journal_read(r, rec);
+
+    while (ret == JOURNAL_AGAIN && r->poll.id != 0)
+    {
+        uint64_t index = r->index;
+
+        shm_notify_poll_arm(&r->poll);
+        ret = journal_read(r, rec);
+        if (r->index == index)
+        {
+            break;
+        }
+        // Moved to a new segment during the re-read: arm on that one's notifier
+    }
+    return ret;
+}
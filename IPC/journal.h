@@ -0,0 +1,277 @@
+/**
+ * @file    journal.h
+ * @brief   Persistent append-only event journal in memory-mapped segment files.
+ *
+ * A journal is a directory of fixed-size segment files (0000000000000000.jnl, ...).
+ * Writers map the newest segment and copy records straight into it; readers map the
+ * same files and tail them. Because the mapping is a shared file mapping, a record is
+ * in the page cache the moment it is written: it survives the writer crashing, and is
+ * on disk once the kernel (or an explicit sync) writes the page back.
+ *
+ * Segment layout:
+ *   header page - magic, segment size and index, futex notifier for tailing readers,
+ *                 tail hint, synced offset
+ *   records     - 16-byte header (size/state word, timestamp) + payload, padded to 8
+ *
+ * Any number of writer processes append concurrently without a lock. A writer claims
+ * space with one CAS on the header word of the first unclaimed record; the word holds
+ * the record size and the writer's pid, so the claim and the length become visible
+ * together and a claim is never lost, even if the writer dies right after it. The
+ * writer then copies the payload and sets the word's committed bit with a release
+ * store. The tail hint in the segment header only saves the scan: whoever sees it lag
+ * behind a claimed record moves it forward.
+ *
+ * When a record does not fit, the writer claims the rest of the segment as a pad
+ * record and moves to the next segment, creating it if it is the first to get there.
+ * A new segment is built under a temporary name and link()ed into place, so other
+ * processes only ever see complete segments.
+ *
+ * Readers walk the records in order. A record whose writer died before committing it
+ * is skipped once the pid is gone. A reader can keep its position in a small cursor
+ * file in the journal directory, so it resumes where it stopped after a restart
+ * (at-least-once: the record returned last before a crash is returned again).
+ *
+ * Syncing is per journal handle: JOURNAL_SYNC_ASYNC starts writeback of every
+ * sync_bytes of new data without waiting for it, JOURNAL_SYNC_DURABLE waits for it,
+ * and journal_sync() forces it. Without either flag only process crashes are covered,
+ * not power loss.
+ *
+ * An event loop tails the journal with journal_reader_pollfd() and journal_try_read().
+ * A writer that dies mid-record sends no wake-up, so the loop should also call
+ * journal_try_read() from a periodic timer to get past such a record.
+ *
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "shm_notify.h"
+
+/** Success return code */
+#define JOURNAL_SUCCESS 0
+/** Failure return code */
+#define JOURNAL_ERROR   1
+/** No new record yet (read) or wait timed out */
+#define JOURNAL_AGAIN   2
+
+#define JOURNAL_CACHE_LINE      64
+#define JOURNAL_PATH_MAX        256
+#define JOURNAL_DATA_OFFSET     4096               // Records start after the header page
+#define JOURNAL_DEFAULT_SEGMENT (64ull * 1024 * 1024)
+
+/** Start writeback of every sync_bytes of new data (sync_file_range), do not wait */
+#define JOURNAL_SYNC_ASYNC   0x1
+/** Write back every sync_bytes of new data and wait for it (msync MS_SYNC) */
+#define JOURNAL_SYNC_DURABLE 0x2
+/** Prefault each segment when it is mapped */
+#define JOURNAL_POPULATE     0x4
+
+/** journal_reader_open(): start at the oldest segment on disk */
+#define JOURNAL_FROM_OLDEST 0
+/** journal_reader_open(): start after the last record written so far */
+#define JOURNAL_FROM_NEWEST 1
+
+typedef struct
+{
+    alignas(JOURNAL_CACHE_LINE) uint32_t magic;
+    uint32_t version;
+    uint64_t segment_size;  // File size, header page included
+    uint64_t index;         // Position in the journal; also the file name
+
+    alignas(JOURNAL_CACHE_LINE) SHM_NOTIFY appended;  // Tailing readers sleep here
+    alignas(JOURNAL_CACHE_LINE) _Atomic uint64_t tail;    // Hint: offset at or before the first unclaimed record
+    alignas(JOURNAL_CACHE_LINE) _Atomic uint64_t synced;  // Offset up to which writeback was requested
+} JOURNAL_SEG_HDR;
+
+// Writer handle; one per thread
+typedef struct
+{
+    char             dir[JOURNAL_PATH_MAX];
+    uint64_t         segment_size;
+    uint64_t         sync_bytes;  // Sync batch for JOURNAL_SYNC_ASYNC / _DURABLE
+    uint32_t         flags;
+    uint64_t         word;        // Claim word: this pid, size added per record
+
+    int              fd;
+    uint64_t         index;       // Mapped segment
+    uint8_t         *base;
+    JOURNAL_SEG_HDR *hdr;
+    void            *pending;     // Record reserved and not yet committed
+} JOURNAL;
+
+// Reader handle; one per thread
+typedef struct
+{
+    char             dir[JOURNAL_PATH_MAX];
+    uint64_t         segment_size;
+    uint32_t         flags;
+
+    int              fd;
+    uint64_t         index;       // Mapped segment
+    uint64_t         offset;      // Next record in it
+    uint8_t         *base;
+    JOURNAL_SEG_HDR *hdr;
+
+    _Atomic uint64_t *cursor;     // Persisted position, NULL for an anonymous reader
+    uint32_t         stalls;      // Polls spent on one uncommitted record
+    uint64_t         aborted;     // Records skipped because their writer died mid-write
+    uint64_t         trimmed;     // Segments skipped because they were deleted unread
+    SHM_NOTIFY_POLL  poll;        // Event-loop poller, see journal_reader_pollfd()
+} JOURNAL_READER;
+
+typedef struct
+{
+    const void *data;          // Points into the mapped segment
+    uint32_t    len;
+    uint64_t    timestamp_ns;  // CLOCK_REALTIME at reserve time
+    uint64_t    position;      // index * segment_size + offset; increases along the journal
+} JOURNAL_RECORD;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open a journal for appending, creating the directory and first segment if
+     *        needed.
+     * @param[out] j Writer handle.
+     * @param[in] dir Journal directory.
+     * @param[in] segment_size Segment file size for a new journal (0 = default); an
+     *            existing journal keeps its own.
+     * @param[in] flags JOURNAL_SYNC_ASYNC or JOURNAL_SYNC_DURABLE, JOURNAL_POPULATE.
+     * @param[in] sync_bytes Data written between syncs (with a sync flag).
+     * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+     */
+    int journal_open(JOURNAL *j, const char *dir, uint64_t segment_size, uint32_t flags, uint64_t sync_bytes);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Sync what this handle's segment holds, then unmap it.
+     * @param[in,out] j Writer handle.
+     */
+    void journal_close(JOURNAL *j);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest payload a record can carry.
+     * @param[in] j Writer handle.
+     * @return Maximum payload in bytes.
+     */
+    uint32_t journal_max_payload(const JOURNAL *j);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Claim space for a record and return where to write its payload. Finish with
+     *        journal_commit(); one reservation per handle at a time.
+     * @param[in,out] j Writer handle.
+     * @param[in] len Payload size.
+     * @return Payload pointer, or NULL if @p len is too large or a segment cannot be created.
+     */
+    void *journal_reserve(JOURNAL *j, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Make the reserved record visible to readers and sync if a batch is full.
+     * @param[in,out] j Writer handle.
+     */
+    void journal_commit(JOURNAL *j);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Append a record (reserve, copy, commit).
+     * @param[in,out] j Writer handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size.
+     * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+     */
+    int journal_append(JOURNAL *j, const void *data, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Write the current segment back to disk and wait for it.
+     * @param[in,out] j Writer handle.
+     * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+     */
+    int journal_sync(JOURNAL *j);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Delete the oldest segments, keeping the newest @p keep. Readers still on a
+     *        deleted segment finish it; readers behind it skip ahead.
+     * @param[in] j Writer handle.
+     * @param[in] keep Segments to keep (at least 1).
+     * @return Number of segments deleted.
+     */
+    int journal_trim(JOURNAL *j, uint32_t keep);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open a reader on a journal.
+     * @param[out] r Reader handle.
+     * @param[in] dir Journal directory.
+     * @param[in] name Cursor name to resume from and keep the position in
+     *            (<dir>/<name>.cursor), or NULL for no persisted position.
+     * @param[in] from JOURNAL_FROM_OLDEST or JOURNAL_FROM_NEWEST, used when there is no
+     *            saved cursor.
+     * @return JOURNAL_SUCCESS on success, JOURNAL_ERROR on failure.
+     */
+    int journal_reader_open(JOURNAL_READER *r, const char *dir, const char *name, int from);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Save the position and unmap.
+     * @param[in,out] r Reader handle.
+     */
+    void journal_reader_close(JOURNAL_READER *r);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Return the next record without copying it.
+     * @param[in,out] r Reader handle.
+     * @param[out] rec Record; rec->data stays valid until the next read.
+     * @return JOURNAL_SUCCESS, JOURNAL_AGAIN at the end of the journal, JOURNAL_ERROR
+     *         on failure.
+     */
+    int journal_read(JOURNAL_READER *r, JOURNAL_RECORD *rec);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Sleep until a record may be available.
+     * @param[in,out] r Reader handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return JOURNAL_SUCCESS, JOURNAL_AGAIN on timeout.
+     */
+    int journal_reader_wait(JOURNAL_READER *r, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when a record may be
+     *        available. Created on first use.
+     * @param[in,out] r Reader handle.
+     * @return Descriptor (closed by journal_reader_close()), or -1 on failure.
+     */
+    int journal_reader_pollfd(JOURNAL_READER *r);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief journal_read() that arms the poll descriptor before returning JOURNAL_AGAIN.
+     * @param[in,out] r Reader handle.
+     * @param[out] rec Record; rec->data stays valid until the next read.
+     * @return JOURNAL_SUCCESS, JOURNAL_AGAIN at the end of the journal, JOURNAL_ERROR
+     *         on failure.
+     */
+    int journal_try_read(JOURNAL_READER *r, JOURNAL_RECORD *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // JOURNAL_H
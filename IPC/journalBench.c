@@ -0,0 +1,313 @@
+/*
+ * Event journal: append throughput of concurrent writers, with a tailing reader
+ *
+ * -w writer processes each append -n records of -s bytes to a journal in -d. Every
+ * record carries its writer id and sequence number; a reader process tails the
+ * journal while it is written and checks that each writer's records arrive complete
+ * and in order. The reader uses a named cursor and reopens it every 100000 records,
+ * so resuming from a saved position is checked along the way.
+ *
+ * With -k the first writer is killed (SIGKILL) halfway through. The reader must then
+ * still reach the end: its records so far must be intact and in order, and a record
+ * it left half-written is skipped.
+ *
+ * Sync modes: none (page cache only), async (start writeback every -b KB), durable
+ * (wait for writeback every -b KB). Put -d on a real disk to see their cost; on tmpfs
+ * they cost nothing.
+ *
+ * Usage:
+ *   ./journalBench [-d dir] [-w writers] [-n records] [-s size] [-z segment_mb] [-S none|async|durable] [-b sync_kb] [-p] [-k]
+ *
+ * Example:
+ *   ./journalBench -d /dev/shm/journal -w 4 -n 2000000 -s 256
+ *   ./journalBench -d /var/tmp/journal -S durable -b 1024 -k
+ *
+ */
+
+#include <dirent.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "journal.h"
+
+#define MAX_WRITERS   16
+#define REOPEN_EVERY  100000
+#define SPINS         256  // Reads attempted before sleeping on the journal
+#define END_SEQ       UINT64_MAX
+
+typedef struct
+{
+    uint32_t writer;
+    uint32_t size;
+    uint64_t seq;
+} EVENT;
+
+typedef struct
+{
+    uint64_t received[MAX_WRITERS];
+    uint64_t errors;
+    uint64_t aborted;
+    uint64_t reopened;
+    uint64_t max_lag_ns;
+    double   seconds;
+} STATS;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Remove the segments and cursors of a previous run
+static void clean_dir(const char *dir)
+{
+    DIR           *d = opendir(dir);
+    struct dirent *e;
+    char           path[JOURNAL_PATH_MAX + 256];
+
+    if (d == NULL)
+    {
+        return;
+    }
+    while ((e = readdir(d)) != NULL)
+    {
+        size_t n = strlen(e->d_name);
+        if ((n > 4 && strcmp(e->d_name + n - 4, ".jnl") == 0) || (n > 7 && strcmp(e->d_name + n - 7, ".cursor") == 0))
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+static void writer(const char *dir, uint32_t id, uint64_t n, uint32_t size, uint32_t flags, uint64_t sync_bytes)
+{
+    JOURNAL j;
+
+    if (journal_open(&j, dir, 0, flags, sync_bytes) != JOURNAL_SUCCESS)
+    {
+        _exit(1);
+    }
+    for (uint64_t seq = 0; seq <= n; seq++)
+    {
+        EVENT *e = journal_reserve(&j, size);
+        if (e == NULL)
+        {
+            _exit(1);
+        }
+        e->writer = id;
+        e->size = size;
+        e->seq = seq == n ? END_SEQ : seq;
+        memset(e + 1, (int)seq, size - sizeof(EVENT));
+        journal_commit(&j);
+    }
+    journal_close(&j);
+    _exit(0);
+}
+
+static void reader(const char *dir, int writers, STATS *st)
+{
+    JOURNAL_READER r;
+    JOURNAL_RECORD rec;
+    uint64_t       expected[MAX_WRITERS] = {0};
+    int            done = 0;
+    uint64_t       start = 0, total = 0;
+
+    if (journal_reader_open(&r, dir, "bench", JOURNAL_FROM_OLDEST) != JOURNAL_SUCCESS)
+    {
+        st->errors = 1;
+        _exit(1);
+    }
+
+    while (done < writers)
+    {
+        int ret = JOURNAL_AGAIN;
+
+        for (int i = 0; i < SPINS && ret == JOURNAL_AGAIN; i++)
+        {
+            ret = journal_read(&r, &rec);
+        }
+        if (ret == JOURNAL_AGAIN)
+        {
+            journal_reader_wait(&r, 100);
+            continue;
+        }
+        if (ret != JOURNAL_SUCCESS)
+        {
+            st->errors++;
+            break;
+        }
+
+        const EVENT *e = rec.data;
+        if (start == 0)
+        {
+            start = now_ns();
+        }
+        if (rec.len < sizeof(EVENT) || e->writer >= (uint32_t)writers || e->size != rec.len)
+        {
+            st->errors++;
+            continue;
+        }
+        if (e->seq == END_SEQ)
+        {
+            done++;
+            continue;
+        }
+        if (e->seq != expected[e->writer])
+        {
+            st->errors++;
+        }
+        expected[e->writer] = e->seq + 1;
+        st->received[e->writer]++;
+
+        uint64_t lag = realtime_ns() - rec.timestamp_ns;
+        st->max_lag_ns = lag > st->max_lag_ns ? lag : st->max_lag_ns;
+
+        if (++total % REOPEN_EVERY == 0)
+        {
+            st->aborted += r.aborted;
+            journal_reader_close(&r);
+            if (journal_reader_open(&r, dir, "bench", JOURNAL_FROM_OLDEST) != JOURNAL_SUCCESS)
+            {
+                st->errors++;
+                break;
+            }
+            st->reopened++;
+        }
+    }
+    st->seconds = (now_ns() - start) / 1e9;
+    st->aborted += r.aborted;
+    journal_reader_close(&r);
+    _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = "journal_bench";
+    const char *mode = "none";
+    int         writers = 2, kill_one = 0, opt;
+    uint64_t    n = 1000000, segment_mb = 64, sync_kb = 1024;
+    uint32_t    size = 128, flags = 0;
+
+    while ((opt = getopt(argc, argv, "d:w:n:s:z:S:b:pk")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': dir = optarg; break;
+            case 'w': writers = atoi(optarg); break;
+            case 'n': n = strtoull(optarg, NULL, 10); break;
+            case 's': size = (uint32_t)atoi(optarg); break;
+            case 'z': segment_mb = strtoull(optarg, NULL, 10); break;
+            case 'S': mode = optarg; break;
+            case 'b': sync_kb = strtoull(optarg, NULL, 10); break;
+            case 'p': flags |= JOURNAL_POPULATE; break;
+            case 'k': kill_one = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-d dir] [-w writers] [-n records] [-s size] [-z segment_mb] [-S none|async|durable] [-b sync_kb] [-p] [-k]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (writers < 1 || writers > MAX_WRITERS || size < sizeof(EVENT))
+    {
+        fprintf(stderr, "1 to %d writers, records of at least %zu bytes\n", MAX_WRITERS, sizeof(EVENT));
+        return 1;
+    }
+    flags |= strcmp(mode, "async") == 0 ? JOURNAL_SYNC_ASYNC : strcmp(mode, "durable") == 0 ? JOURNAL_SYNC_DURABLE : 0;
+
+    // Start from an empty journal with the requested segment size
+    JOURNAL j;
+    clean_dir(dir);
+    if (journal_open(&j, dir, segment_mb << 20, flags, sync_kb << 10) != JOURNAL_SUCCESS)
+    {
+        return 1;
+    }
+
+    STATS *st = mmap(NULL, sizeof(STATS), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pid_t  pids[MAX_WRITERS], rpid;
+
+    memset(st, 0, sizeof(*st));
+    fflush(stdout);
+    rpid = fork();
+    if (rpid == 0)
+    {
+        reader(dir, writers, st);
+    }
+
+    uint64_t start = now_ns();
+    for (int w = 0; w < writers; w++)
+    {
+        pids[w] = fork();
+        if (pids[w] == 0)
+        {
+            writer(dir, (uint32_t)w, n, size, flags, sync_kb << 10);
+        }
+    }
+
+    if (kill_one)
+    {
+        // Kill writer 0 once it is about halfway
+        while (st->received[0] < n / 2 && waitpid(pids[0], NULL, WNOHANG) == 0)
+        {
+            usleep(100);
+        }
+        kill(pids[0], SIGKILL);
+    }
+    int failed = 0, status;
+    for (int w = 0; w < writers; w++)
+    {
+        waitpid(pids[w], &status, 0);
+        failed |= w > 0 || !kill_one ? !WIFEXITED(status) || WEXITSTATUS(status) != 0 : 0;
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    if (kill_one)
+    {
+        // Stand in for the dead writer's end marker
+        EVENT e = {0, sizeof(EVENT), END_SEQ};
+        journal_append(&j, &e, sizeof(e));
+    }
+    waitpid(rpid, NULL, 0);
+
+    uint64_t appended = 0, segments = 0;
+    for (int w = 0; w < writers; w++)
+    {
+        appended += w == 0 && kill_one ? st->received[0] : n;
+        failed |= (w > 0 || !kill_one) && st->received[w] != n;
+    }
+    DIR           *d = opendir(dir);
+    struct dirent *e;
+    while (d != NULL && (e = readdir(d)) != NULL)
+    {
+        segments += strstr(e->d_name, ".jnl") != NULL && e->d_name[0] != '.';
+    }
+    if (d != NULL)
+    {
+        closedir(d);
+    }
+
+    printf("%d writers x %llu records of %u bytes, sync %s%s\n", writers, (unsigned long long)n, size, mode, kill_one ? ", writer 0 killed" : "");
+    printf("  append: %.2f M records/s, %.2f GB/s into %llu segment(s) of %llu MB\n", appended / seconds / 1e6, appended * (double)size / seconds / 1e9,
+           (unsigned long long)segments, (unsigned long long)(j.segment_size >> 20));
+    printf("  tail:   %.2f M records/s, max lag %.1f ms, cursor reopened %llu times, %llu aborted record(s) skipped\n",
+           appended / st->seconds / 1e6, st->max_lag_ns / 1e6, (unsigned long long)st->reopened, (unsigned long long)st->aborted);
+    printf("  %s\n", failed || st->errors ? "FAILED" : "ok");
+
+    journal_close(&j);
+    return failed || st->errors;
+}
@@ -0,0 +1,377 @@
+/*
+ * Contended process-shared lock benchmark
+ *
+ * P processes share one small record (8 counters that are always equal) and each
+ * performs the same number of operations on it. A write increments every counter; a
+ * read copies the record and checks the counters are equal, so a torn read is caught.
+ *
+ *   pthread    - plain PTHREAD_PROCESS_SHARED mutex (the old sharedMutexProcess setup)
+ *   robust     - SHM_MUTEX (robust, owner-death recovery)
+ *   pt-rwlock  - pthread rwlock, process-shared, writer-preferring
+ *   rwlock     - SHM_RWLOCK
+ *   seqlock    - SHM_SEQLOCK readers, writers serialized by an SHM_MUTEX
+ *
+ * Before the runs, a child dies holding the robust mutex and then the rwlock, and the
+ * parent checks that it gets them back with SHM_SYNC_RECOVERED. Then a child dies
+ * while waiting for the rwlock, and a reader must still get in.
+ *
+ * Usage:
+ *   ./lockBench [-P 1,2,4,8] [-n ops_per_process] [-r read_percent]
+ *   Example: ./lockBench -P 2,8 -n 1000000 -r 95
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_sync.h"
+
+#define MAX_PROCS 64
+#define COUNTERS  8
+
+typedef enum
+{
+    L_PTHREAD,
+    L_ROBUST,
+    L_PT_RWLOCK,
+    L_RWLOCK,
+    L_SEQLOCK,
+    L_COUNT
+} LOCK_E;
+
+static const char *lock_names[L_COUNT] = {"pthread", "robust", "pt-rwlock", "rwlock", "seqlock"};
+
+typedef struct
+{
+    pthread_mutex_t  plain;
+    pthread_rwlock_t pt_rw;
+    SHM_MUTEX        mutex;
+    SHM_RWLOCK       rw;
+    SHM_SEQLOCK      seq;
+    uint64_t         data[COUNTERS];
+    _Atomic uint64_t torn;    // Reads that saw unequal counters
+    _Atomic uint64_t writes;  // Writes performed, to check the final counters
+} SHARED;
+
+static SHARED *sh;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void init_locks(void)
+{
+    pthread_mutexattr_t  mattr;
+    pthread_rwlockattr_t rattr;
+
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutex_init(&sh->plain, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_rwlockattr_init(&rattr);
+    pthread_rwlockattr_setpshared(&rattr, PTHREAD_PROCESS_SHARED);
+    pthread_rwlockattr_setkind_np(&rattr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&sh->pt_rw, &rattr);
+    pthread_rwlockattr_destroy(&rattr);
+
+    shm_mutex_init(&sh->mutex);
+    shm_rwlock_init(&sh->rw);
+    shm_seqlock_init(&sh->seq);
+    memset(sh->data, 0, sizeof(sh->data));
+    atomic_store(&sh->torn, 0);
+    atomic_store(&sh->writes, 0);
+}
+
+static void write_record(void)
+{
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        sh->data[i]++;
+    }
+}
+
+static void check_record(const uint64_t *copy)
+{
+    for (int i = 1; i < COUNTERS; i++)
+    {
+        if (copy[i] != copy[0])
+        {
+            atomic_fetch_add(&sh->torn, 1);
+            return;
+        }
+    }
+}
+
+static void worker(LOCK_E type, int id, uint64_t ops, int read_pct)
+{
+    uint64_t copy[COUNTERS];
+    uint64_t rng = 0x9E3779B97F4A7C15ull * (id + 1);
+    uint64_t writes = 0;
+
+    for (uint64_t i = 0; i < ops; i++)
+    {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        int is_read = (int)(rng % 100) < read_pct;
+
+        switch (type)
+        {
+            case L_PTHREAD:
+            case L_ROBUST:
+                // Mutexes serialize reads too
+                type == L_PTHREAD ? pthread_mutex_lock(&sh->plain) : shm_mutex_lock(&sh->mutex);
+                if (is_read)
+                {
+                    memcpy(copy, sh->data, sizeof(copy));
+                }
+                else
+                {
+                    write_record();
+                }
+                type == L_PTHREAD ? pthread_mutex_unlock(&sh->plain) : shm_mutex_unlock(&sh->mutex);
+                break;
+
+            case L_PT_RWLOCK:
+                is_read ? pthread_rwlock_rdlock(&sh->pt_rw) : pthread_rwlock_wrlock(&sh->pt_rw);
+                is_read ? (void)memcpy(copy, sh->data, sizeof(copy)) : write_record();
+                pthread_rwlock_unlock(&sh->pt_rw);
+                break;
+
+            case L_RWLOCK:
+                if (is_read)
+                {
+                    shm_rwlock_rdlock(&sh->rw);
+                    memcpy(copy, sh->data, sizeof(copy));
+                    shm_rwlock_rdunlock(&sh->rw);
+                }
+                else
+                {
+                    shm_rwlock_wrlock(&sh->rw);
+                    write_record();
+                    shm_rwlock_wrunlock(&sh->rw);
+                }
+                break;
+
+            case L_SEQLOCK:
+                if (is_read)
+                {
+                    shm_seqlock_read(&sh->seq, copy, sh->data, sizeof(copy));
+                }
+                else
+                {
+                    shm_mutex_lock(&sh->mutex);
+                    shm_seqlock_write_begin(&sh->seq);
+                    write_record();
+                    shm_seqlock_write_end(&sh->seq);
+                    shm_mutex_unlock(&sh->mutex);
+                }
+                break;
+
+            default:
+                break;
+        }
+        if (is_read)
+        {
+            check_record(copy);
+        }
+        else
+        {
+            writes++;
+        }
+    }
+    atomic_fetch_add(&sh->writes, writes);
+}
+
+// Returns operations per second, or 0 if the final state is wrong
+static double run(LOCK_E type, int procs, uint64_t ops, int read_pct)
+{
+    pid_t pids[MAX_PROCS];
+    int   gate[2];
+    char  c;
+
+    init_locks();
+    if (pipe(gate) == -1)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    for (int i = 0; i < procs; i++)
+    {
+        if ((pids[i] = fork()) == 0)
+        {
+            close(gate[1]);
+            while (read(gate[0], &c, 1) > 0)
+            {
+            }
+            worker(type, i, ops, read_pct);
+            _exit(0);
+        }
+    }
+    close(gate[0]);
+
+    uint64_t start = now_ns();
+    close(gate[1]);
+    for (int i = 0; i < procs; i++)
+    {
+        waitpid(pids[i], NULL, 0);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    if (atomic_load(&sh->torn) != 0 || sh->data[0] != atomic_load(&sh->writes))
+    {
+        fprintf(stderr, "%s: %llu torn reads, counter %llu after %llu writes\n", lock_names[type], (unsigned long long)atomic_load(&sh->torn),
+                (unsigned long long)sh->data[0], (unsigned long long)atomic_load(&sh->writes));
+        return 0;
+    }
+    return procs * ops / (elapsed / 1e9);
+}
+
+// A child takes the lock and dies; the parent must get it back
+static int check_recovery(int use_rwlock)
+{
+    int   status;
+    pid_t pid;
+
+    init_locks();
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        use_rwlock ? shm_rwlock_wrlock(&sh->rw) : shm_mutex_lock(&sh->mutex);
+        sh->data[0] = 1;  // Half-way through an update
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+
+    int ret = use_rwlock ? shm_rwlock_wrlock(&sh->rw) : shm_mutex_lock(&sh->mutex);
+    if (ret == SHM_SYNC_RECOVERED)
+    {
+        memset(sh->data, 0, sizeof(sh->data));  // Repair
+    }
+    use_rwlock ? shm_rwlock_wrunlock(&sh->rw) : (void)shm_mutex_unlock(&sh->mutex);
+    return ret == SHM_SYNC_RECOVERED;
+}
+
+// A writer dies while waiting for the rwlock; its slot must not keep readers out for good
+static int check_dead_waiter(void)
+{
+    int   status;
+    pid_t waiter, reader;
+
+    init_locks();
+    shm_rwlock_wrlock(&sh->rw);
+    fflush(stdout);
+    waiter = fork();
+    if (waiter == 0)
+    {
+        shm_rwlock_wrlock(&sh->rw);  // Blocks: we hold it
+        _exit(0);
+    }
+    usleep(100 * 1000);  // Let it register as waiting
+    kill(waiter, SIGKILL);
+    waitpid(waiter, &status, 0);
+    shm_rwlock_wrunlock(&sh->rw);
+
+    reader = fork();
+    if (reader == 0)
+    {
+        shm_rwlock_rdlock(&sh->rw);
+        shm_rwlock_rdunlock(&sh->rw);
+        _exit(0);
+    }
+    for (int ms = 0; ms < 2000; ms += 10)
+    {
+        if (waitpid(reader, &status, WNOHANG) == reader)
+        {
+            return 1;
+        }
+        usleep(10 * 1000);
+    }
+    kill(reader, SIGKILL);
+    waitpid(reader, &status, 0);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char     list[128] = "1,2,4,8";
+    uint64_t ops = 500000;
+    int      read_pct = 90;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "P:n:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'P':
+                snprintf(list, sizeof(list), "%s", optarg);
+                break;
+            case 'n':
+                ops = strtoull(optarg, NULL, 10);
+                break;
+            case 'r':
+                read_pct = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-P 1,2,4,8] [-n ops_per_process] [-r read_percent]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (read_pct < 0 || read_pct > 100)
+    {
+        fprintf(stderr, "Read percentage must be 0..100\n");
+        return 1;
+    }
+
+    sh = mmap(NULL, sizeof(SHARED), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    printf("Owner-death recovery: mutex %s, rwlock %s, rwlock waiter %s\n", check_recovery(0) ? "ok" : "FAILED", check_recovery(1) ? "ok" : "FAILED",
+           check_dead_waiter() ? "ok" : "FAILED");
+    printf("%llu ops per process, %d%% reads (Mops/s)\n", (unsigned long long)ops, read_pct);
+    printf("%6s", "procs");
+    for (int t = 0; t < L_COUNT; t++)
+    {
+        printf(" %10s", lock_names[t]);
+    }
+    printf("\n");
+
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        int procs = atoi(tok);
+        if (procs < 1 || procs > MAX_PROCS)
+        {
+            fprintf(stderr, "Process count must be 1..%d\n", MAX_PROCS);
+            return 1;
+        }
+        printf("%6d", procs);
+        for (int t = 0; t < L_COUNT; t++)
+        {
+            printf(" %10.2f", run((LOCK_E)t, procs, ops, read_pct) / 1e6);
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    munmap(sh, sizeof(SHARED));
+    return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Large payload handoff: sealed memfd pool vs copying through a Unix socket
+ *
+ * For each payload size a child process receives the same number of payloads over
+ *   memfd   - memfd_chan: payload written in place, only a header and (once per pool
+ *             buffer) a descriptor cross the socket
+ *   socket  - the payload bytes themselves, written to and read from a stream socketpair
+ * Every payload carries its sequence number in its first and last 8 bytes, and the
+ * receiver checks both.
+ *
+ * Usage:
+ *   ./memfdBench [-s 65536,1048576,16777216] [-b total_bytes] [-f]
+ *   -f fills every payload (models producing the data) instead of stamping its ends only
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memfd_chan.h"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stamp(uint8_t *p, size_t size, uint64_t seq, int fill)
+{
+    if (fill)
+    {
+        memset(p, (int)seq, size);
+    }
+    memcpy(p, &seq, sizeof(seq));
+    memcpy(p + size - sizeof(seq), &seq, sizeof(seq));
+}
+
+static int check(const uint8_t *p, size_t size, uint64_t seq)
+{
+    uint64_t head, tail;
+    memcpy(&head, p, sizeof(head));
+    memcpy(&tail, p + size - sizeof(tail), sizeof(tail));
+    return head == seq && tail == seq;
+}
+
+static int full_io(int fd, void *buf, size_t len, int is_write)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = is_write ? write(fd, (char *)buf + done, len - done) : read(fd, (char *)buf + done, len - done);
+        if (n <= 0)
+        {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+// Returns payloads per second, or 0 on a failed check
+static double run_memfd(size_t size, uint64_t count, int fill, MEMFD_CHAN *stats)
+{
+    int   sv[2];
+    int   status;
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        MEMFD_CHAN rx;
+        MEMFD_MSG  msg;
+
+        close(sv[0]);
+        memfd_chan_from_socket(&rx, sv[1]);
+        for (uint64_t seq = 0; seq < count; seq++)
+        {
+            if (memfd_chan_recv(&rx, &msg) != MEMFD_CHAN_SUCCESS || msg.len != size || !check(msg.data, msg.len, seq))
+            {
+                fprintf(stderr, "memfd: bad payload %llu\n", (unsigned long long)seq);
+                _exit(1);
+            }
+            memfd_chan_release(&rx, &msg);
+        }
+        memfd_chan_close(&rx);
+        _exit(0);
+    }
+
+    MEMFD_CHAN tx;
+    MEMFD_MSG  msg;
+
+    close(sv[1]);
+    memfd_chan_from_socket(&tx, sv[0]);
+    uint64_t start = now_ns();
+    for (uint64_t seq = 0; seq < count; seq++)
+    {
+        if (memfd_chan_alloc(&tx, size, &msg) != MEMFD_CHAN_SUCCESS)
+        {
+            exit(1);
+        }
+        stamp(msg.data, size, seq, fill);
+        msg.len = size;
+        if (memfd_chan_send(&tx, &msg) != MEMFD_CHAN_SUCCESS)
+        {
+            exit(1);
+        }
+    }
+    waitpid(pid, &status, 0);
+    uint64_t elapsed = now_ns() - start;
+
+    *stats = tx;
+    memfd_chan_close(&tx);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? count / (elapsed / 1e9) : 0;
+}
+
+static double run_socket(size_t size, uint64_t count, int fill)
+{
+    int      sv[2];
+    int      status;
+    pid_t    pid;
+    uint8_t *buf = malloc(size);
+
+    if (buf == NULL || socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        close(sv[0]);
+        for (uint64_t seq = 0; seq < count; seq++)
+        {
+            if (full_io(sv[1], buf, size, 0) != 0 || !check(buf, size, seq))
+            {
+                fprintf(stderr, "socket: bad payload %llu\n", (unsigned long long)seq);
+                _exit(1);
+            }
+        }
+        _exit(0);
+    }
+
+    close(sv[1]);
+    memset(buf, 0, size);
+    uint64_t start = now_ns();
+    for (uint64_t seq = 0; seq < count; seq++)
+    {
+        stamp(buf, size, seq, fill);
+        if (full_io(sv[0], buf, size, 1) != 0)
+        {
+            perror("write");
+            exit(1);
+        }
+    }
+    waitpid(pid, &status, 0);
+    uint64_t elapsed = now_ns() - start;
+
+    close(sv[0]);
+    free(buf);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? count / (elapsed / 1e9) : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    char     list[256] = "65536,1048576,16777216";
+    uint64_t total = 2ull << 30;
+    int      fill = 0;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "s:b:f")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                snprintf(list, sizeof(list), "%s", optarg);
+                break;
+            case 'b':
+                total = strtoull(optarg, NULL, 10);
+                break;
+            case 'f':
+                fill = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s 65536,1048576,16777216] [-b total_bytes] [-f]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    printf("%.0f MB per size, payloads %s\n", total / 1e6, fill ? "filled" : "stamped at both ends");
+    printf("%10s %8s %12s %10s %12s %10s %8s %6s %8s\n", "size", "count", "memfd msg/s", "GB/s", "socket msg/s", "GB/s", "speedup", "fds", "reused");
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        size_t     size = strtoul(tok, NULL, 10);
+        uint64_t   count = total / size > 64 ? total / size : 64;
+        MEMFD_CHAN stats;
+
+        if (size < 2 * sizeof(uint64_t))
+        {
+            fprintf(stderr, "Size must be at least %zu\n", 2 * sizeof(uint64_t));
+            return 1;
+        }
+        double memfd = run_memfd(size, count, fill, &stats);
+        double sock = run_socket(size, count, fill);
+        printf("%10zu %8llu %12.0f %10.2f %12.0f %10.2f %7.1fx %6llu %8llu\n", size, (unsigned long long)count, memfd, memfd * size / 1e9, sock,
+               sock * size / 1e9, sock > 0 ? memfd / sock : 0, (unsigned long long)stats.attached, (unsigned long long)stats.recycled);
+    }
+    return 0;
+}
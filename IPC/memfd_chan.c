@@ -0,0 +1,626 @@
+/**
+ * @file    memfd_chan.c
+ * @brief   Zero-copy handoff of large, variable-size payloads in sealed memfds over a
+ *          Unix socket.
+ *
+ */
+
+#define _GNU_SOURCE  // memfd_create, F_ADD_SEALS
+
+#include "memfd_chan.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010  // Linux 5.1
+#endif
+
+#define MEMFD_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL)
+
+typedef enum
+{
+    WIRE_PAYLOAD = 1,  // Sender -> receiver: buffer id holds len bytes (fd attached on first use)
+    WIRE_RELEASE,      // Receiver -> sender: buffer id is free again
+    WIRE_DROP          // Sender -> receiver: buffer id is being replaced, unmap it
+} WIRE_TYPE_E;
+
+typedef struct
+{
+    uint32_t type;
+    uint32_t id;
+    uint64_t len;
+    uint64_t size;
+} WIRE_MSG;
+
+static void init_bufs(MEMFD_CHAN *ch)
+{
+    memset(ch->bufs, 0, sizeof(ch->bufs));
+    for (int i = 0; i < MEMFD_CHAN_MAX_BUFS; i++)
+    {
+        ch->bufs[i].fd = -1;
+    }
+    ch->sent = ch->attached = ch->recycled = 0;
+}
+
+static void free_buf(MEMFD_BUF *b)
+{
+    if (b->map != NULL)
+    {
+        munmap(b->map, b->size);
+    }
+    if (b->fd >= 0)
+    {
+        close(b->fd);
+    }
+    memset(b, 0, sizeof(*b));
+    b->fd = -1;
+}
+
+static int send_wire(MEMFD_CHAN *ch, const WIRE_MSG *w, int fd)
+{
+    char           ctrl[CMSG_SPACE(sizeof(int))];
+    struct iovec   iov = {(void *)w, sizeof(*w)};
+    struct msghdr  mh;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (fd >= 0)
+    {
+        memset(ctrl, 0, sizeof(ctrl));
+        mh.msg_control = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    }
+
+    while (sendmsg(ch->sock, &mh, MSG_NOSIGNAL) == -1)
+    {
+        if (errno == EPIPE || errno == ECONNRESET)
+        {
+            return MEMFD_CHAN_CLOSED;
+        }
+        if (errno != EINTR)
+        {
+            perror("sendmsg");
+            return MEMFD_CHAN_ERROR;
+        }
+    }
+    return MEMFD_CHAN_SUCCESS;
+}
+
+// Receive one header; *fd is the passed descriptor or -1
+static int recv_wire(MEMFD_CHAN *ch, WIRE_MSG *w, int *fd, int nonblock)
+{
+    char          ctrl[CMSG_SPACE(sizeof(int))];
+    struct iovec  iov = {w, sizeof(*w)};
+    struct msghdr mh;
+    ssize_t       n;
+
+    *fd = -1;
+    for (;;)
+    {
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+
+        n = recvmsg(ch->sock, &mh, MSG_CMSG_CLOEXEC | (nonblock ? MSG_DONTWAIT : 0));
+        if (n >= 0)
+        {
+            break;
+        }
+        if (nonblock && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return MEMFD_CHAN_AGAIN;
+        }
+        if (errno == ECONNRESET)
+        {
+            return MEMFD_CHAN_CLOSED;
+        }
+        if (errno != EINTR)
+        {
+            perror("recvmsg");
+            return MEMFD_CHAN_ERROR;
+        }
+    }
+    if (n == 0)
+    {
+        return MEMFD_CHAN_CLOSED;
+    }
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm))
+    {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+        {
+            memcpy(fd, CMSG_DATA(cm), sizeof(int));
+        }
+    }
+    if (n != sizeof(*w) || (mh.msg_flags & MSG_CTRUNC))
+    {
+        fprintf(stderr, "memfd_chan: malformed message\n");
+        if (*fd >= 0)
+        {
+            close(*fd);
+            *fd = -1;
+        }
+        return MEMFD_CHAN_ERROR;
+    }
+    return MEMFD_CHAN_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create a listening SOCK_SEQPACKET socket at @p path (removing a stale one).
+ * @param[in] path Filesystem path of the socket.
+ * @return Listening descriptor, or -1 on failure.
+ */
+int memfd_chan_listen(const char *path)
+{
+    struct sockaddr_un addr;
+    int                fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if (fd == -1)
+    {
+        perror("socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, 4) == -1)
+    {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Accept one peer on a listening socket.
+ * @param[out] ch Channel.
+ * @param[in] listen_fd Descriptor from memfd_chan_listen().
+ * @return MEMFD_CHAN_SUCCESS on success, MEMFD_CHAN_ERROR on failure.
+ */
+int memfd_chan_accept(MEMFD_CHAN *ch, int listen_fd)
+{
+    int fd;
+
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) == -1)
+    {
+        if (errno != EINTR)
+        {
+            perror("accept");
+            return MEMFD_CHAN_ERROR;
+        }
+    }
+    memfd_chan_from_socket(ch, fd);
+    return MEMFD_CHAN_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Connect to a listening peer.
+ * @param[out] ch Channel.
+ * @param[in] path Filesystem path of the socket.
+ * @return MEMFD_CHAN_SUCCESS on success, MEMFD_CHAN_ERROR on failure.
+ */
+int memfd_chan_connect(MEMFD_CHAN *ch, const char *path)
+{
+    struct sockaddr_un addr;
+    int                fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if (fd == -1)
+    {
+        perror("socket");
+        return MEMFD_CHAN_ERROR;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        perror("connect");
+        close(fd);
+        return MEMFD_CHAN_ERROR;
+    }
+    memfd_chan_from_socket(ch, fd);
+    return MEMFD_CHAN_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Wrap an already connected SOCK_SEQPACKET socket (e.g. one end of a socketpair).
+ * @param[out] ch Channel.
+ * @param[in] sock Connected socket; the channel closes it.
+ */
+void memfd_chan_from_socket(MEMFD_CHAN *ch, int sock)
+{
+    ch->sock = sock;
+    init_bufs(ch);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get the channel's socket for epoll: readable when a payload (receiving end) or
+ *        a release (sending end) is waiting.
+ * @param[in] ch Channel.
+ * @return Socket descriptor.
+ */
+int memfd_chan_fd(const MEMFD_CHAN *ch)
+{
+    return ch->sock;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Close the socket and free every buffer and mapping.
+ * @param[in,out] ch Channel.
+ */
+void memfd_chan_close(MEMFD_CHAN *ch)
+{
+    for (int i = 0; i < MEMFD_CHAN_MAX_BUFS; i++)
+    {
+        free_buf(&ch->bufs[i]);
+    }
+    if (ch->sock >= 0)
+    {
+        close(ch->sock);
+        ch->sock = -1;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Sending end
+//-------------------------------------------------------------------------------------------------
+
+static size_t pool_size(size_t size)
+{
+    size_t s = MEMFD_CHAN_MIN_SIZE;
+    while (s < size)
+    {
+        s <<= 1;
+    }
+    return s;
+}
+
+// Create and seal a memfd of @p size in slot @p b, keeping our writable mapping
+static int create_buf(MEMFD_BUF *b, size_t size)
+{
+    b->fd = memfd_create("memfd_chan", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (b->fd == -1)
+    {
+        perror("memfd_create");
+        return MEMFD_CHAN_ERROR;
+    }
+    if (ftruncate(b->fd, size) == -1)
+    {
+        perror("ftruncate");
+        free_buf(b);
+        return MEMFD_CHAN_ERROR;
+    }
+    b->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+    if (b->map == MAP_FAILED)
+    {
+        perror("mmap");
+        b->map = NULL;
+        free_buf(b);
+        return MEMFD_CHAN_ERROR;
+    }
+    b->size = size;
+
+    // Sealed after our mapping exists: it stays writable, new ones cannot be
+    if (fcntl(b->fd, F_ADD_SEALS, MEMFD_SEALS) == -1)
+    {
+        perror("F_ADD_SEALS");
+        free_buf(b);
+        return MEMFD_CHAN_ERROR;
+    }
+    return MEMFD_CHAN_SUCCESS;
+}
+
+// Apply pending releases; with @p block, wait for at least one message first
+static int drain_releases(MEMFD_CHAN *ch, int block)
+{
+    for (;;)
+    {
+        WIRE_MSG w;
+        int      fd;
+        int      ret = recv_wire(ch, &w, &fd, !block);
+
+        if (ret == MEMFD_CHAN_AGAIN)
+        {
+            return MEMFD_CHAN_SUCCESS;
+        }
+        if (ret != MEMFD_CHAN_SUCCESS)
+        {
+            return ret;
+        }
+        if (fd >= 0)
+        {
+            close(fd);  // The receiving end never passes descriptors
+        }
+        if (w.type == WIRE_RELEASE && w.id < MEMFD_CHAN_MAX_BUFS)
+        {
+            ch->bufs[w.id].in_use = 0;
+        }
+        block = 0;
+    }
+}
+
+static void fill_msg(MEMFD_CHAN *ch, int id, MEMFD_MSG *msg)
+{
+    ch->bufs[id].in_use = 1;
+    msg->id = (uint32_t)id;
+    msg->data = ch->bufs[id].map;
+    msg->size = ch->bufs[id].size;
+    msg->len = 0;
+}
+
+// Find or create a free buffer; with @p block, wait for a release when the pool is exhausted
+static int allocate(MEMFD_CHAN *ch, size_t size, MEMFD_MSG *msg, int block)
+{
+    int ret = drain_releases(ch, 0);
+
+    while (ret == MEMFD_CHAN_SUCCESS)
+    {
+        int best = -1, empty = -1, small = -1;
+
+        for (int i = 0; i < MEMFD_CHAN_MAX_BUFS; i++)
+        {
+            MEMFD_BUF *b = &ch->bufs[i];
+            if (b->fd < 0)
+            {
+                empty = empty < 0 ? i : empty;
+            }
+            else if (!b->in_use && b->size >= size && (best < 0 || b->size < ch->bufs[best].size))
+            {
+                best = i;
+            }
+            else if (!b->in_use && b->size < size)
+            {
+                small = i;
+            }
+        }
+
+        if (best >= 0)
+        {
+            ch->recycled++;
+            fill_msg(ch, best, msg);
+            return MEMFD_CHAN_SUCCESS;
+        }
+        if (empty < 0 && small >= 0)
+        {
+            // Pool is full of buffers too small for this payload: replace one
+            WIRE_MSG w = {WIRE_DROP, (uint32_t)small, 0, 0};
+            if (ch->bufs[small].peer_has && (ret = send_wire(ch, &w, -1)) != MEMFD_CHAN_SUCCESS)
+            {
+                return ret;
+            }
+            free_buf(&ch->bufs[small]);
+            empty = small;
+        }
+        if (empty >= 0)
+        {
+            if (create_buf(&ch->bufs[empty], pool_size(size)) != MEMFD_CHAN_SUCCESS)
+            {
+                return MEMFD_CHAN_ERROR;
+            }
+            fill_msg(ch, empty, msg);
+            return MEMFD_CHAN_SUCCESS;
+        }
+        if (!block)
+        {
+            return MEMFD_CHAN_AGAIN;
+        }
+        ret = drain_releases(ch, 1);  // Everything is with the peer
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a writable pool buffer of at least @p size bytes (sending end). Reuses a
+ *        released buffer when one fits; blocks for a release when the pool is exhausted.
+ * @param[in,out] ch Channel.
+ * @param[in] size Bytes needed.
+ * @param[out] msg Buffer id, data pointer and capacity; set msg->len before sending.
+ * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+ */
+int memfd_chan_alloc(MEMFD_CHAN *ch, size_t size, MEMFD_MSG *msg)
+{
+    return allocate(ch, size, msg, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief memfd_chan_alloc() that returns MEMFD_CHAN_AGAIN instead of blocking when every
+ *        buffer is with the peer; retry once memfd_chan_fd() is readable.
+ * @param[in,out] ch Channel.
+ * @param[in] size Bytes needed.
+ * @param[out] msg Buffer id, data pointer and capacity; set msg->len before sending.
+ * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_AGAIN, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+ */
+int memfd_chan_try_alloc(MEMFD_CHAN *ch, size_t size, MEMFD_MSG *msg)
+{
+    return allocate(ch, size, msg, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Hand a filled buffer to the peer (sending end). The buffer belongs to the peer
+ *        until it releases it; do not write to it meanwhile.
+ * @param[in,out] ch Channel.
+ * @param[in] msg Buffer from memfd_chan_alloc() with len set.
+ * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+ */
+int memfd_chan_send(MEMFD_CHAN *ch, const MEMFD_MSG *msg)
+{
+    MEMFD_BUF *b;
+    WIRE_MSG   w;
+    int        ret;
+
+    if (msg->id >= MEMFD_CHAN_MAX_BUFS || (b = &ch->bufs[msg->id])->fd < 0 || !b->in_use || msg->len > b->size)
+    {
+        fprintf(stderr, "memfd_chan: bad buffer %u\n", msg->id);
+        return MEMFD_CHAN_ERROR;
+    }
+
+    w.type = WIRE_PAYLOAD;
+    w.id = msg->id;
+    w.len = msg->len;
+    w.size = b->size;
+    ret = send_wire(ch, &w, b->peer_has ? -1 : b->fd);
+    if (ret == MEMFD_CHAN_SUCCESS)
+    {
+        ch->attached += !b->peer_has;
+        ch->sent++;
+        b->peer_has = 1;
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Receiving end
+//-------------------------------------------------------------------------------------------------
+
+// Map a descriptor passed for buffer @p id after checking it is safe to map
+static int attach_buf(MEMFD_BUF *b, int fd, size_t size)
+{
+    struct stat st;
+    int         seals = fcntl(fd, F_GET_SEALS);
+
+    if (seals == -1 || (seals & MEMFD_SEALS) != MEMFD_SEALS || fstat(fd, &st) == -1 || (size_t)st.st_size != size)
+    {
+        fprintf(stderr, "memfd_chan: rejected a descriptor that is not a sealed memfd of %zu bytes\n", size);
+        close(fd);
+        return MEMFD_CHAN_ERROR;
+    }
+
+    free_buf(b);
+    b->map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (b->map == MAP_FAILED)
+    {
+        perror("mmap");
+        b->map = NULL;
+        close(fd);
+        return MEMFD_CHAN_ERROR;
+    }
+    b->fd = fd;
+    b->size = size;
+    return MEMFD_CHAN_SUCCESS;
+}
+
+// Take the next payload header, skipping control messages
+static int receive(MEMFD_CHAN *ch, MEMFD_MSG *msg, int nonblock)
+{
+    for (;;)
+    {
+        WIRE_MSG   w;
+        MEMFD_BUF *b;
+        int        fd;
+        int        ret = recv_wire(ch, &w, &fd, nonblock);
+
+        if (ret != MEMFD_CHAN_SUCCESS)
+        {
+            return ret;
+        }
+        if (w.id >= MEMFD_CHAN_MAX_BUFS)
+        {
+            fprintf(stderr, "memfd_chan: bad buffer %u\n", w.id);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return MEMFD_CHAN_ERROR;
+        }
+        b = &ch->bufs[w.id];
+
+        if (w.type == WIRE_DROP)
+        {
+            free_buf(b);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            continue;
+        }
+        if (w.type != WIRE_PAYLOAD)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            continue;
+        }
+
+        if (fd >= 0 && attach_buf(b, fd, w.size) != MEMFD_CHAN_SUCCESS)
+        {
+            return MEMFD_CHAN_ERROR;
+        }
+        if (b->map == NULL || w.len > b->size)
+        {
+            fprintf(stderr, "memfd_chan: payload for unknown or too small buffer %u\n", w.id);
+            return MEMFD_CHAN_ERROR;
+        }
+
+        msg->id = w.id;
+        msg->data = b->map;
+        msg->len = w.len;
+        msg->size = b->size;
+        ch->sent++;
+        return MEMFD_CHAN_SUCCESS;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Receive the next payload (receiving end), mapped read-only in place.
+ * @param[in,out] ch Channel.
+ * @param[out] msg Payload; valid until memfd_chan_release().
+ * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+ */
+int memfd_chan_recv(MEMFD_CHAN *ch, MEMFD_MSG *msg)
+{
+    return receive(ch, msg, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief memfd_chan_recv() that returns MEMFD_CHAN_AGAIN instead of blocking.
+ * @param[in,out] ch Channel.
+ * @param[out] msg Payload; valid until memfd_chan_release().
+ * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_AGAIN, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+ */
+int memfd_chan_try_recv(MEMFD_CHAN *ch, MEMFD_MSG *msg)
+{
+    return receive(ch, msg, 1);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Give a received buffer back to the sender's pool (receiving end).
+ * @param[in,out] ch Channel.
+ * @param[in] msg Payload from memfd_chan_recv().
+ * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+ */
+int memfd_chan_release(MEMFD_CHAN *ch, const MEMFD_MSG *msg)
+{
+    WIRE_MSG w = {WIRE_RELEASE, msg->id, 0, 0};
+    return send_wire(ch, &w, -1);
+}
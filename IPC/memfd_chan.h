@@ -0,0 +1,191 @@
+/**
+ * @file    memfd_chan.h
+ * @brief   Zero-copy handoff of large, variable-size payloads in sealed memfds over a
+ *          Unix socket.
+ *
+ * The sending end owns a pool of memfds. A payload is written straight into a pool
+ * buffer (memfd_chan_alloc()) and handed over with memfd_chan_send(); only a small
+ * header crosses the socket. The descriptor itself is passed with SCM_RIGHTS the first
+ * time the peer sees a buffer; after that the peer keeps its read-only mapping cached
+ * and later messages carry just the buffer id. The receiver hands a buffer back with
+ * memfd_chan_release(), which returns it to the sender's pool.
+ *
+ * Every pool memfd is sealed before it is shared:
+ *   F_SEAL_SHRINK | F_SEAL_GROW - the size never changes, so a mapping never SIGBUSes
+ *   F_SEAL_FUTURE_WRITE         - nobody can create a new writable mapping; only the
+ *                                 sender's own mapping (made before sealing) can write
+ *   F_SEAL_SEAL                 - the seals cannot be changed
+ * The receiver checks the seals before mapping a descriptor and rejects it otherwise.
+ *
+ * A channel carries payloads in one direction: one end sends, the other receives. The
+ * socket is SOCK_SEQPACKET, so headers keep their boundaries and arrive in order.
+ *
+ * The socket is the channel's pollable descriptor (memfd_chan_fd()). An event loop
+ * waits for it to become readable and then calls memfd_chan_try_recv() on the
+ * receiving end, or memfd_chan_try_alloc() on a sending end whose pool ran dry.
+ *
+ */
+
+#ifndef MEMFD_CHAN_H
+#define MEMFD_CHAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Success return code */
+#define MEMFD_CHAN_SUCCESS 0
+/** Failure return code */
+#define MEMFD_CHAN_ERROR   1
+/** Peer closed the channel */
+#define MEMFD_CHAN_CLOSED  2
+/** Non-blocking call found nothing to do */
+#define MEMFD_CHAN_AGAIN   3
+
+/** Buffers per channel (pool size on the sender, mapping cache on the receiver) */
+#define MEMFD_CHAN_MAX_BUFS 32
+/** Smallest pool buffer; larger ones are rounded up to a power of two */
+#define MEMFD_CHAN_MIN_SIZE (64 * 1024)
+
+typedef struct
+{
+    int    fd;
+    void  *map;      // Sender: read-write, receiver: read-only
+    size_t size;     // Sealed memfd size
+    int    in_use;   // Sender: allocated or with the peer
+    int    peer_has; // Sender: the peer has this descriptor cached
+} MEMFD_BUF;
+
+typedef struct
+{
+    uint32_t    id;    // Buffer id, pass to memfd_chan_send() / memfd_chan_release()
+    void       *data;  // Payload (read-only on the receiving end)
+    size_t      len;   // Payload bytes
+    size_t      size;  // Buffer capacity
+} MEMFD_MSG;
+
+typedef struct
+{
+    int       sock;
+    MEMFD_BUF bufs[MEMFD_CHAN_MAX_BUFS];
+    uint64_t  sent, attached, recycled;  // Statistics: payloads, descriptors passed, pool reuses
+} MEMFD_CHAN;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create a listening SOCK_SEQPACKET socket at @p path (removing a stale one).
+     * @param[in] path Filesystem path of the socket.
+     * @return Listening descriptor, or -1 on failure.
+     */
+    int memfd_chan_listen(const char *path);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Accept one peer on a listening socket.
+     * @param[out] ch Channel.
+     * @param[in] listen_fd Descriptor from memfd_chan_listen().
+     * @return MEMFD_CHAN_SUCCESS on success, MEMFD_CHAN_ERROR on failure.
+     */
+    int memfd_chan_accept(MEMFD_CHAN *ch, int listen_fd);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Connect to a listening peer.
+     * @param[out] ch Channel.
+     * @param[in] path Filesystem path of the socket.
+     * @return MEMFD_CHAN_SUCCESS on success, MEMFD_CHAN_ERROR on failure.
+     */
+    int memfd_chan_connect(MEMFD_CHAN *ch, const char *path);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Wrap an already connected SOCK_SEQPACKET socket (e.g. one end of a socketpair).
+     * @param[out] ch Channel.
+     * @param[in] sock Connected socket; the channel closes it.
+     */
+    void memfd_chan_from_socket(MEMFD_CHAN *ch, int sock);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get the channel's socket for epoll: readable when a payload (receiving end) or
+     *        a release (sending end) is waiting.
+     * @param[in] ch Channel.
+     * @return Socket descriptor.
+     */
+    int memfd_chan_fd(const MEMFD_CHAN *ch);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Close the socket and free every buffer and mapping.
+     * @param[in,out] ch Channel.
+     */
+    void memfd_chan_close(MEMFD_CHAN *ch);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a writable pool buffer of at least @p size bytes (sending end). Reuses a
+     *        released buffer when one fits; blocks for a release when the pool is exhausted.
+     * @param[in,out] ch Channel.
+     * @param[in] size Bytes needed.
+     * @param[out] msg Buffer id, data pointer and capacity; set msg->len before sending.
+     * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+     */
+    int memfd_chan_alloc(MEMFD_CHAN *ch, size_t size, MEMFD_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief memfd_chan_alloc() that returns MEMFD_CHAN_AGAIN instead of blocking when every
+     *        buffer is with the peer; retry once memfd_chan_fd() is readable.
+     * @param[in,out] ch Channel.
+     * @param[in] size Bytes needed.
+     * @param[out] msg Buffer id, data pointer and capacity; set msg->len before sending.
+     * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_AGAIN, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+     */
+    int memfd_chan_try_alloc(MEMFD_CHAN *ch, size_t size, MEMFD_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Hand a filled buffer to the peer (sending end). The buffer belongs to the peer
+     *        until it releases it; do not write to it meanwhile.
+     * @param[in,out] ch Channel.
+     * @param[in] msg Buffer from memfd_chan_alloc() with len set.
+     * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+     */
+    int memfd_chan_send(MEMFD_CHAN *ch, const MEMFD_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Receive the next payload (receiving end), mapped read-only in place.
+     * @param[in,out] ch Channel.
+     * @param[out] msg Payload; valid until memfd_chan_release().
+     * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+     */
+    int memfd_chan_recv(MEMFD_CHAN *ch, MEMFD_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief memfd_chan_recv() that returns MEMFD_CHAN_AGAIN instead of blocking.
+     * @param[in,out] ch Channel.
+     * @param[out] msg Payload; valid until memfd_chan_release().
+     * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_AGAIN, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+     */
+    int memfd_chan_try_recv(MEMFD_CHAN *ch, MEMFD_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Give a received buffer back to the sender's pool (receiving end).
+     * @param[in,out] ch Channel.
+     * @param[in] msg Payload from memfd_chan_recv().
+     * @return MEMFD_CHAN_SUCCESS, MEMFD_CHAN_CLOSED, or MEMFD_CHAN_ERROR.
+     */
+    int memfd_chan_release(MEMFD_CHAN *ch, const MEMFD_MSG *msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MEMFD_CHAN_H
@@ -0,0 +1,360 @@
+/*
+ * Shared-memory MPMC queue vs SysV message queue
+ *
+ * For each producer count, P producer and C consumer processes move the same total
+ * number of messages through (a) the shm MPMC queue, in batches, and (b) a SysV
+ * message queue with msgsnd/msgrcv sending only the used length. Consumers stop on a
+ * zero-length message; a checksum over all messages verifies nothing was lost or
+ * duplicated.
+ *
+ * Usage:
+ *   ./mpmcBench [-P 1,4,16] [-C consumers] [-n messages] [-s size] [-b batch] [-q slots]
+ *   Example: ./mpmcBench -P 1,4,16 -C 4 -n 8000000 -s 32 -b 16
+ *
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/msg.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_mpmc.h"
+
+#define QUEUE_NAME    "/shm_mpmc_bench"
+#define MAX_PROCS     64
+#define MAX_BATCH     256
+#define MAX_SIZE      4096
+#define WAIT_TIMEOUT  100  // ms; a safety net, wakeups normally come from the peer
+
+typedef struct
+{
+    uint32_t producer;
+    uint32_t seq;
+} BENCH_MSG;
+
+typedef struct
+{
+    long mtype;
+    char mtext[MAX_SIZE];
+} SYSV_MSG;
+
+typedef struct
+{
+    _Atomic uint64_t consumed;
+    _Atomic uint64_t checksum;
+} BENCH_STATS;
+
+static BENCH_STATS *stats;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t msg_value(const void *data)
+{
+    BENCH_MSG m;
+    memcpy(&m, data, sizeof(m));
+    return ((uint64_t)m.producer << 32 | m.seq) + 1;
+}
+
+static uint64_t expected_checksum(int producers, uint64_t per_producer)
+{
+    uint64_t sum = 0;
+    for (int p = 0; p < producers; p++)
+    {
+        // Sum of ((p << 32) | seq) + 1 over seq = 0 .. per_producer - 1
+        sum += per_producer * (((uint64_t)p << 32) + 1) + per_producer * (per_producer - 1) / 2;
+    }
+    return sum;
+}
+
+// Children block on the gate until the parent closes its write end
+static void wait_gate(int gate)
+{
+    char c;
+    while (read(gate, &c, 1) > 0)
+    {
+    }
+    close(gate);
+}
+
+static void shm_producer(SHM_MPMC *q, int id, uint64_t count, uint32_t size, int batch)
+{
+    static uint8_t msgs[MAX_BATCH][MAX_SIZE];
+    uint32_t       lens[MAX_BATCH];
+    uint64_t       seq = 0;
+
+    while (seq < count)
+    {
+        size_t n = count - seq < (uint64_t)batch ? count - seq : (size_t)batch;
+        size_t done = 0;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            BENCH_MSG m = {(uint32_t)id, (uint32_t)(seq + i)};
+            memcpy(msgs[i], &m, sizeof(m));
+            lens[i] = size;
+        }
+        while (done < n)
+        {
+            size_t k = shm_mpmc_enqueue_batch(q, msgs[done], MAX_SIZE, lens + done, n - done);
+            if (k == 0)
+            {
+                shm_mpmc_wait_writable(q, WAIT_TIMEOUT);
+            }
+            done += k;
+        }
+        seq += n;
+    }
+}
+
+static void shm_consumer(SHM_MPMC *q, int batch)
+{
+    static uint8_t bufs[MAX_BATCH][MAX_SIZE];
+    uint32_t       lens[MAX_BATCH];
+
+    for (;;)
+    {
+        size_t   k = shm_mpmc_dequeue_batch(q, bufs, MAX_SIZE, lens, batch);
+        uint64_t sum = 0, n = 0;
+
+        if (k == 0)
+        {
+            shm_mpmc_wait_readable(q, WAIT_TIMEOUT);
+            continue;
+        }
+        for (size_t i = 0; i < k; i++)
+        {
+            if (lens[i] == 0)
+            {
+                // Stop marker. Markers are queued after all data, so whatever this batch
+                // took behind it are other consumers' markers: put them back
+                atomic_fetch_add(&stats->consumed, n);
+                atomic_fetch_add(&stats->checksum, sum);
+                for (size_t j = i + 1; j < k; j++)
+                {
+                    while (shm_mpmc_enqueue(q, bufs[j], lens[j]) != SHM_MPMC_SUCCESS)
+                    {
+                        shm_mpmc_wait_writable(q, WAIT_TIMEOUT);
+                    }
+                }
+                return;
+            }
+            sum += msg_value(bufs[i]);
+            n++;
+        }
+        atomic_fetch_add(&stats->consumed, n);
+        atomic_fetch_add(&stats->checksum, sum);
+    }
+}
+
+static void sysv_producer(int qid, int id, uint64_t count, uint32_t size)
+{
+    SYSV_MSG msg;
+
+    msg.mtype = 1;
+    memset(msg.mtext, 0, size);
+    for (uint64_t seq = 0; seq < count; seq++)
+    {
+        BENCH_MSG m = {(uint32_t)id, (uint32_t)seq};
+        memcpy(msg.mtext, &m, sizeof(m));
+        if (msgsnd(qid, &msg, size, 0) == -1)
+        {
+            perror("msgsnd");
+            _exit(1);
+        }
+    }
+}
+
+static void sysv_consumer(int qid)
+{
+    SYSV_MSG msg;
+    uint64_t sum = 0, n = 0;
+
+    for (;;)
+    {
+        ssize_t len = msgrcv(qid, &msg, sizeof(msg.mtext), 0, 0);
+        if (len == -1)
+        {
+            perror("msgrcv");
+            _exit(1);
+        }
+        if (len == 0)
+        {
+            break;
+        }
+        sum += msg_value(msg.mtext);
+        n++;
+    }
+    atomic_fetch_add(&stats->consumed, n);
+    atomic_fetch_add(&stats->checksum, sum);
+}
+
+// Runs one configuration; use_shm selects the transport. Returns messages per second.
+static double run(int use_shm, int producers, int consumers, uint64_t total, uint32_t size, int batch, uint32_t slots)
+{
+    SHM_MPMC q;
+    int      qid = -1;
+    int      gate[2];
+    pid_t    prod[MAX_PROCS], cons[MAX_PROCS];
+    uint64_t per_producer = total / producers;
+    SYSV_MSG stop = {1, {0}};
+
+    if (use_shm ? shm_mpmc_create(&q, QUEUE_NAME, slots, size) != SHM_MPMC_SUCCESS : (qid = msgget(IPC_PRIVATE, IPC_CREAT | 0600)) == -1)
+    {
+        perror("queue");
+        exit(1);
+    }
+    if (pipe(gate) == -1)
+    {
+        perror("pipe");
+        exit(1);
+    }
+    atomic_store(&stats->consumed, 0);
+    atomic_store(&stats->checksum, 0);
+    fflush(stdout);
+
+    // Children use the inherited mapping and leave through _exit(), so only the parent unlinks
+    for (int i = 0; i < consumers; i++)
+    {
+        if ((cons[i] = fork()) == 0)
+        {
+            close(gate[1]);
+            wait_gate(gate[0]);
+            use_shm ? shm_consumer(&q, batch) : sysv_consumer(qid);
+            _exit(0);
+        }
+    }
+    for (int i = 0; i < producers; i++)
+    {
+        if ((prod[i] = fork()) == 0)
+        {
+            close(gate[1]);
+            wait_gate(gate[0]);
+            use_shm ? shm_producer(&q, i, per_producer, size, batch) : sysv_producer(qid, i, per_producer, size);
+            _exit(0);
+        }
+    }
+    close(gate[0]);
+
+    uint64_t start = now_ns();
+    close(gate[1]);
+    for (int i = 0; i < producers; i++)
+    {
+        waitpid(prod[i], NULL, 0);
+    }
+    for (int i = 0; i < consumers; i++)
+    {
+        if (use_shm)
+        {
+            while (shm_mpmc_enqueue(&q, "", 0) != SHM_MPMC_SUCCESS)
+            {
+                shm_mpmc_wait_writable(&q, WAIT_TIMEOUT);
+            }
+        }
+        else if (msgsnd(qid, &stop, 0, 0) == -1)
+        {
+            perror("msgsnd");
+        }
+    }
+    for (int i = 0; i < consumers; i++)
+    {
+        waitpid(cons[i], NULL, 0);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    if (atomic_load(&stats->consumed) != per_producer * producers || atomic_load(&stats->checksum) != expected_checksum(producers, per_producer))
+    {
+        fprintf(stderr, "%s: lost or duplicated messages (%llu of %llu)\n", use_shm ? "shm" : "msgq", (unsigned long long)atomic_load(&stats->consumed),
+                (unsigned long long)(per_producer * producers));
+        exit(1);
+    }
+
+    if (use_shm)
+    {
+        shm_mpmc_close(&q);
+    }
+    else
+    {
+        msgctl(qid, IPC_RMID, NULL);
+    }
+    return per_producer * producers / (elapsed / 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+    char     list[128] = "1,4,16";
+    int      consumers = 4;
+    uint64_t total = 4000000;
+    uint32_t size = 32;
+    int      batch = 16;
+    uint32_t slots = 4096;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "P:C:n:s:b:q:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'P':
+                snprintf(list, sizeof(list), "%s", optarg);
+                break;
+            case 'C':
+                consumers = atoi(optarg);
+                break;
+            case 'n':
+                total = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                size = (uint32_t)atoi(optarg);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'q':
+                slots = (uint32_t)atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-P 1,4,16] [-C consumers] [-n messages] [-s size] [-b batch] [-q slots]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (consumers < 1 || consumers > MAX_PROCS || size < sizeof(BENCH_MSG) || size > MAX_SIZE || batch < 1 || batch > MAX_BATCH)
+    {
+        fprintf(stderr, "Need 1..%d consumers, size %zu..%d and batch 1..%d\n", MAX_PROCS, sizeof(BENCH_MSG), MAX_SIZE, MAX_BATCH);
+        return 1;
+    }
+
+    stats = mmap(NULL, sizeof(BENCH_STATS), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+
+    printf("%llu messages of %u bytes, %d consumers, shm batch %d, %u slots\n", (unsigned long long)total, size, consumers, batch, slots);
+    printf("%10s %14s %14s %8s\n", "producers", "shm Mmsg/s", "msgq Mmsg/s", "speedup");
+    for (char *save = NULL, *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        int producers = atoi(tok);
+        if (producers < 1 || producers > MAX_PROCS)
+        {
+            fprintf(stderr, "Producer count must be 1..%d\n", MAX_PROCS);
+            return 1;
+        }
+        double shm = run(1, producers, consumers, total, size, batch, slots);
+        double msgq = run(0, producers, consumers, total, size, batch, slots);
+        printf("%10d %14.2f %14.2f %7.1fx\n", producers, shm / 1e6, msgq / 1e6, shm / msgq);
+    }
+
+    munmap(stats, sizeof(BENCH_STATS));
+    return 0;
+}
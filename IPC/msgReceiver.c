@@ -2,28 +2,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
 
-#define QUEUE_KEY 1234
-#define MAX_TEXT  100
+#include "msgq.h"
 
-struct message
-{
-    long msg_type;            // Message type
-    char msg_text[MAX_TEXT];  // Message text
-};
+#define QUEUE_KEY 1234
+#define MAX_TEXT  8192
 
-int msg_id;
+MSGQ queue;
 
 // Signal handler for cleanup
 void cleanup(int signum)
 {
     printf("\nReceiver terminating. Cleaning up...\n");
-    if (msgctl(msg_id, IPC_RMID, NULL) == -1)
-    {
-        perror("msgctl");
-    }
+    msgq_close(&queue, 1);
     exit(0);
 }
 
@@ -33,10 +24,8 @@ int main()
     signal(SIGINT, cleanup);
 
     // Access the message queue
-    msg_id = msgget(QUEUE_KEY, 0666);
-    if (msg_id == -1)
+    if (msgq_open(&queue, QUEUE_KEY, 0, 0, 0) != MSGQ_SUCCESS)
     {
-        perror("msgget");
         exit(1);
     }
 
@@ -44,17 +33,18 @@ int main()
 
     while (1)
     {
-        struct message msg;
+        static const char *lanes[] = {"", "control", "normal", "bulk"};
+        char               text[MAX_TEXT];
+        size_t             len;
+        MSGQ_PRIO_E        prio;
 
-        // Receive a message of type 1
-        if (msgrcv(msg_id, &msg, sizeof(msg.msg_text), 1, 0) == -1)
-        {
-            perror("msgrcv");
-        }
-        else
+        // Control messages come out first, then normal, then bulk
+        if (msgq_recv(&queue, text, sizeof(text), &len, &prio) != MSGQ_SUCCESS)
         {
-            printf("Message received: %s\n", msg.msg_text);
+            printf("Receive failed, queue removed?\n");
+            cleanup(0);
         }
+        printf("Message received [%s]: %.*s\n", lanes[prio], (int)len, text);
     }
 
     return 0;
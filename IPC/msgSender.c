@@ -2,32 +2,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
 
-#define QUEUE_KEY 1234
-#define MAX_TEXT  100
+#include "msgq.h"
 
-struct message
-{
-    long msg_type;            // Message type
-    char msg_text[MAX_TEXT];  // Message text
-};
+#define QUEUE_KEY 1234
+#define MAX_TEXT  1024
 
-int msg_id;
+MSGQ queue;
 
 // Signal handler for cleanup
 void cleanup(int signum)
 {
     printf("\nSender terminating. Cleaning up...\n");
-    if (msgctl(msg_id, IPC_RMID, NULL) == -1)
-    {
-        perror("msgctl");
-    }
-    else
-    {
-        printf("Message queue removed.\n");
-    }
+    msgq_close(&queue, 1);
+    printf("Message queue removed.\n");
     exit(0);
 }
 
@@ -36,33 +24,41 @@ int main()
     // Set up signal handler
     signal(SIGINT, cleanup);
 
-    // Create or access the message queue
-    msg_id = msgget(QUEUE_KEY, IPC_CREAT | 0666);
-    if (msg_id == -1)
+    // Create or access the message queue; interactive input is sent without batching
+    if (msgq_open(&queue, QUEUE_KEY, 1, 0, 0) != MSGQ_SUCCESS)
     {
-        perror("msgget");
         exit(1);
     }
 
-    printf("Sender started. Enter messages to send.\n");
+    printf("Sender started. Enter messages to send (prefix '!' for control priority).\n");
 
     while (1)
     {
-        struct message msg;
-        msg.msg_type = 1;  // Default message type
+        char        text[MAX_TEXT];
+        MSGQ_PRIO_E prio = MSGQ_PRIO_NORMAL;
+        const char *body = text;
+        MSGQ_STATS  st;
 
         printf("Enter message: ");
-        fgets(msg.msg_text, MAX_TEXT, stdin);
-        msg.msg_text[strcspn(msg.msg_text, "\n")] = '\0';  // Remove newline
+        if (fgets(text, MAX_TEXT, stdin) == NULL)
+        {
+            cleanup(0);
+        }
+        text[strcspn(text, "\n")] = '\0';  // Remove newline
+        if (text[0] == '!')
+        {
+            prio = MSGQ_PRIO_CONTROL;  // Overtakes anything still queued
+            body++;
+        }
 
-        // Send the message
-        if (msgsnd(msg_id, &msg, sizeof(msg.msg_text), 0) == -1)
+        // Send only the used length
+        if (msgq_send(&queue, prio, body, strlen(body)) != MSGQ_SUCCESS)
         {
-            perror("msgsnd");
+            printf("Send failed: %s\n", body);
         }
-        else
+        else if (msgq_stats(&queue, &st) == MSGQ_SUCCESS)
         {
-            printf("Message sent: %s\n", msg.msg_text);
+            printf("Message sent: %s (queue depth %lu, %zu of %zu bytes free)\n", body, st.depth, st.headroom, st.limit);
         }
     }
 
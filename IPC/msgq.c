@@ -0,0 +1,475 @@
+/**
+ * @file    msgq.c
+ * @brief   Variable-length, batched SysV message queue layer with priority lanes.
+ *
+ */
+
+#include "msgq.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/msg.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MSGQ_DEFAULT_MSGMAX 8192  // Linux default for kernel.msgmax
+#define MSGQ_RECORD_HDR     sizeof(uint32_t)
+#define MSGQ_POLL_US        1000  // msgq_pollfd() interval without batching
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static size_t read_msgmax(void)
+{
+    unsigned long val = 0;
+    FILE         *fp = fopen("/proc/sys/kernel/msgmax", "r");
+
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%lu", &val) != 1)
+        {
+            val = 0;
+        }
+        fclose(fp);
+    }
+    return val > MSGQ_RECORD_HDR ? val : MSGQ_DEFAULT_MSGMAX;
+}
+
+static MSGQ_BUF *alloc_buf(size_t msgmax)
+{
+    return malloc(sizeof(MSGQ_BUF) + msgmax);
+}
+
+static int flush_lane(MSGQ *q, int lane)
+{
+    MSGQ_LANE *l = &q->tx[lane];
+
+    if (l->count == 0)
+    {
+        return MSGQ_SUCCESS;
+    }
+
+    l->buf->mtype = lane + 1;
+    while (msgsnd(q->id, l->buf, l->used, q->nonblock ? IPC_NOWAIT : 0) == -1)
+    {
+        if (errno == EAGAIN)
+        {
+            return MSGQ_AGAIN;
+        }
+        if (errno != EINTR)
+        {
+            perror("msgsnd");
+            return MSGQ_ERROR;
+        }
+    }
+
+    q->sent_calls++;
+    l->used = 0;
+    l->count = 0;
+    return MSGQ_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open (or create) a SysV queue and allocate the batch buffers.
+ * @param[out] q Queue handle.
+ * @param[in] key SysV key, e.g. 1234.
+ * @param[in] create Non-zero to create the queue if missing.
+ * @param[in] flush_us Batch window in microseconds for normal and bulk lanes; 0 sends each message at once.
+ * @param[in] nonblock Non-zero to return MSGQ_AGAIN instead of blocking.
+ * @return MSGQ_SUCCESS on success, MSGQ_ERROR on failure.
+ */
+int msgq_open(MSGQ *q, key_t key, int create, int flush_us, int nonblock)
+{
+    memset(q, 0, sizeof(*q));
+    q->timer_fd = -1;
+    q->flush_us = flush_us;
+    q->nonblock = nonblock;
+    q->msgmax = read_msgmax();
+
+    q->id = msgget(key, create ? IPC_CREAT | 0666 : 0666);
+    if (q->id == -1)
+    {
+        perror("msgget");
+        return MSGQ_ERROR;
+    }
+
+    int ok = (q->scratch = alloc_buf(q->msgmax)) != NULL;
+    for (int i = 0; i < MSGQ_PRIO_COUNT; i++)
+    {
+        q->tx[i].buf = alloc_buf(q->msgmax);
+        q->rx[i].buf = alloc_buf(q->msgmax);
+        ok = ok && q->tx[i].buf != NULL && q->rx[i].buf != NULL;
+    }
+    if (!ok)
+    {
+        perror("malloc");
+        msgq_close(q, 0);
+        return MSGQ_ERROR;
+    }
+    return MSGQ_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Flush pending batches, free buffers and optionally remove the queue.
+ * @param[in,out] q Queue handle.
+ * @param[in] remove Non-zero to remove the kernel queue (IPC_RMID).
+ */
+void msgq_close(MSGQ *q, int remove)
+{
+    msgq_flush(q);
+    for (int i = 0; i < MSGQ_PRIO_COUNT; i++)
+    {
+        free(q->tx[i].buf);
+        free(q->rx[i].buf);
+        q->tx[i].buf = q->rx[i].buf = NULL;
+    }
+    free(q->scratch);
+    q->scratch = NULL;
+    if (q->timer_fd >= 0)
+    {
+        close(q->timer_fd);
+        q->timer_fd = -1;
+    }
+
+    if (remove && q->id != -1 && msgctl(q->id, IPC_RMID, NULL) == -1)
+    {
+        perror("msgctl");
+    }
+    q->id = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Send one message on a priority lane.
+ * @param[in,out] q Queue handle.
+ * @param[in] prio MSGQ_PRIO_CONTROL, MSGQ_PRIO_NORMAL or MSGQ_PRIO_BULK.
+ * @param[in] data Payload.
+ * @param[in] len Payload size, at most kernel.msgmax minus 4.
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN if the queue is full (non-blocking), MSGQ_ERROR on failure.
+ */
+int msgq_send(MSGQ *q, MSGQ_PRIO_E prio, const void *data, size_t len)
+{
+    int        lane = prio - 1;
+    int        immediate = prio == MSGQ_PRIO_CONTROL || q->flush_us == 0;
+    MSGQ_LANE *l;
+    uint32_t   hdr = (uint32_t)len;
+    int        ret;
+
+    if (prio < MSGQ_PRIO_CONTROL || prio > MSGQ_PRIO_BULK || len + MSGQ_RECORD_HDR > q->msgmax)
+    {
+        return MSGQ_ERROR;
+    }
+    l = &q->tx[lane];
+
+    // Make room first; on failure the message is not accepted
+    if (l->used + MSGQ_RECORD_HDR + len > q->msgmax && (ret = flush_lane(q, lane)) != MSGQ_SUCCESS)
+    {
+        return ret;
+    }
+
+    memcpy(l->buf->mtext + l->used, &hdr, MSGQ_RECORD_HDR);
+    memcpy(l->buf->mtext + l->used + MSGQ_RECORD_HDR, data, len);
+    l->used += MSGQ_RECORD_HDR + len;
+    if (l->count++ == 0)
+    {
+        l->first_ns = now_ns();
+    }
+
+    if (immediate)
+    {
+        ret = flush_lane(q, lane);
+        if (ret != MSGQ_SUCCESS)
+        {
+            // Unbatched lanes never keep messages behind: take it back
+            l->used -= MSGQ_RECORD_HDR + len;
+            l->count--;
+            return ret;
+        }
+        q->sent_msgs++;
+        return MSGQ_SUCCESS;
+    }
+
+    q->sent_msgs++;
+    ret = msgq_flush_expired(q);
+    return ret == MSGQ_ERROR ? MSGQ_ERROR : MSGQ_SUCCESS;  // AGAIN: accepted, still batched
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Send every partial batch now, control lane first.
+ * @param[in,out] q Queue handle.
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN or MSGQ_ERROR.
+ */
+int msgq_flush(MSGQ *q)
+{
+    for (int i = 0; i < MSGQ_PRIO_COUNT; i++)
+    {
+        int ret = flush_lane(q, i);
+        if (ret != MSGQ_SUCCESS)
+        {
+            return ret;
+        }
+    }
+    return MSGQ_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Send the batches whose flush window has passed.
+ * @param[in,out] q Queue handle.
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN or MSGQ_ERROR.
+ */
+int msgq_flush_expired(MSGQ *q)
+{
+    uint64_t now = now_ns();
+
+    for (int i = 0; i < MSGQ_PRIO_COUNT; i++)
+    {
+        if (q->tx[i].count > 0 && now - q->tx[i].first_ns >= (uint64_t)q->flush_us * 1000)
+        {
+            int ret = flush_lane(q, i);
+            if (ret != MSGQ_SUCCESS)
+            {
+                return ret;
+            }
+        }
+    }
+    return MSGQ_SUCCESS;
+}
+
+// Next message, highest priority first; waits in msgrcv() only if @p nonblock is 0
+static int receive(MSGQ *q, void *buf, size_t size, size_t *len, MSGQ_PRIO_E *prio, int nonblock)
+{
+    for (;;)
+    {
+        int best = -1;
+
+        for (int i = 0; i < MSGQ_PRIO_COUNT && best < 0; i++)
+        {
+            if (q->rx[i].off < q->rx[i].used)
+            {
+                best = i;
+            }
+        }
+
+        // Pull in anything more urgent than the best batch already unpacked. Those
+        // lanes are empty, so the scratch buffer can be swapped straight in.
+        if (best != 0)
+        {
+            long    want = best < 0 ? -MSGQ_PRIO_COUNT : -best;
+            int     flags = (best >= 0 || nonblock) ? IPC_NOWAIT : 0;
+            ssize_t n = msgrcv(q->id, q->scratch, q->msgmax, want, flags);
+
+            if (n >= 0)
+            {
+                long type = q->scratch->mtype;
+                if (type < MSGQ_PRIO_CONTROL || type > MSGQ_PRIO_BULK)
+                {
+                    continue;  // Not ours (e.g. a legacy sender); drop it
+                }
+                MSGQ_BUF *tmp = q->rx[type - 1].buf;
+                q->rx[type - 1].buf = q->scratch;
+                q->rx[type - 1].used = (size_t)n;
+                q->rx[type - 1].off = 0;
+                q->scratch = tmp;
+                q->recv_calls++;
+                continue;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != ENOMSG && errno != EAGAIN)
+            {
+                perror("msgrcv");
+                return MSGQ_ERROR;
+            }
+            if (best < 0)
+            {
+                return MSGQ_AGAIN;
+            }
+        }
+
+        MSGQ_LANE *l = &q->rx[best];
+        uint32_t   rec;
+
+        memcpy(&rec, l->buf->mtext + l->off, MSGQ_RECORD_HDR);
+        if (l->off + MSGQ_RECORD_HDR + rec > l->used)
+        {
+            fprintf(stderr, "msgq: malformed batch on lane %d, dropped\n", best + 1);
+            l->off = l->used;
+            continue;
+        }
+        *len = rec;
+        if (rec > size)
+        {
+            return MSGQ_ERROR;
+        }
+        memcpy(buf, l->buf->mtext + l->off + MSGQ_RECORD_HDR, rec);
+        l->off += MSGQ_RECORD_HDR + rec;
+        if (prio != NULL)
+        {
+            *prio = (MSGQ_PRIO_E)(best + 1);
+        }
+        q->recv_msgs++;
+        return MSGQ_SUCCESS;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Receive the next message, highest priority first.
+ * @param[in,out] q Queue handle.
+ * @param[out] buf Destination buffer.
+ * @param[in] size Size of @p buf.
+ * @param[out] len Payload size.
+ * @param[out] prio Lane the message was sent on (may be NULL).
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN if empty (non-blocking), MSGQ_ERROR on failure.
+ */
+int msgq_recv(MSGQ *q, void *buf, size_t size, size_t *len, MSGQ_PRIO_E *prio)
+{
+    return receive(q, buf, size, len, prio, q->nonblock);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a timerfd for epoll that fires every @p interval_us. Created on first use.
+ * @param[in,out] q Queue handle.
+ * @param[in] interval_us Poll interval in microseconds; 0 uses the flush window
+ *            (1 ms without batching).
+ * @return Descriptor (closed by msgq_close()), or -1 on failure.
+ */
+int msgq_pollfd(MSGQ *q, int interval_us)
+{
+    struct itimerspec its;
+
+    if (q->timer_fd >= 0)
+    {
+        return q->timer_fd;
+    }
+    interval_us = interval_us > 0 ? interval_us : q->flush_us > 0 ? q->flush_us : MSGQ_POLL_US;
+    its.it_interval.tv_sec = interval_us / 1000000;
+    its.it_interval.tv_nsec = (long)(interval_us % 1000000) * 1000;
+    its.it_value = its.it_interval;
+
+    q->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (q->timer_fd == -1 || timerfd_settime(q->timer_fd, 0, &its, NULL) == -1)
+    {
+        perror("timerfd");
+        if (q->timer_fd >= 0)
+        {
+            close(q->timer_fd);
+            q->timer_fd = -1;
+        }
+        return -1;
+    }
+    return q->timer_fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Consume pending timer ticks (so the descriptor stops polling readable) and send
+ *        the expired batches without blocking. Call when the msgq_pollfd() timer fires
+ *        on a sending handle.
+ * @param[in,out] q Queue handle.
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN if the queue is full, MSGQ_ERROR on failure.
+ */
+int msgq_try_flush(MSGQ *q)
+{
+    int      nonblock = q->nonblock;
+    uint64_t expirations;
+    int      ret;
+
+    if (q->timer_fd >= 0 && read(q->timer_fd, &expirations, sizeof(expirations)) == -1 && errno != EAGAIN)
+    {
+        perror("read");
+    }
+    // flush_lane() takes IPC_NOWAIT from the handle
+    q->nonblock = 1;
+    ret = msgq_flush_expired(q);
+    q->nonblock = nonblock;
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief msgq_send() that never blocks, whatever the handle was opened with.
+ * @param[in,out] q Queue handle.
+ * @param[in] prio MSGQ_PRIO_CONTROL, MSGQ_PRIO_NORMAL or MSGQ_PRIO_BULK.
+ * @param[in] data Payload.
+ * @param[in] len Payload size, at most kernel.msgmax minus 4.
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN if the queue is full, MSGQ_ERROR on failure.
+ */
+int msgq_try_send(MSGQ *q, MSGQ_PRIO_E prio, const void *data, size_t len)
+{
+    int nonblock = q->nonblock;
+    int ret;
+
+    q->nonblock = 1;
+    ret = msgq_send(q, prio, data, len);
+    q->nonblock = nonblock;
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief msgq_recv() that never blocks. When the queue is empty it also does what
+ *        msgq_try_flush() does, so a receiving loop only has to drain until MSGQ_AGAIN.
+ * @param[in,out] q Queue handle.
+ * @param[out] buf Destination buffer.
+ * @param[in] size Size of @p buf.
+ * @param[out] len Payload size.
+ * @param[out] prio Lane the message was sent on (may be NULL).
+ * @return MSGQ_SUCCESS, MSGQ_AGAIN if empty, MSGQ_ERROR on failure or if @p buf is
+ *         too small.
+ */
+int msgq_try_recv(MSGQ *q, void *buf, size_t size, size_t *len, MSGQ_PRIO_E *prio)
+{
+    int ret = receive(q, buf, size, len, prio, 1);
+
+    if (ret == MSGQ_AGAIN)
+    {
+        // A message sent after this receive arrives by the next tick
+        msgq_try_flush(q);
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Report kernel queue depth and headroom plus this handle's counters.
+ * @param[in] q Queue handle.
+ * @param[out] st Statistics.
+ * @return MSGQ_SUCCESS on success, MSGQ_ERROR on failure.
+ */
+int msgq_stats(const MSGQ *q, MSGQ_STATS *st)
+{
+    struct msqid_ds ds;
+
+    if (msgctl(q->id, IPC_STAT, &ds) == -1)
+    {
+        perror("msgctl");
+        return MSGQ_ERROR;
+    }
+
+    st->depth = ds.msg_qnum;
+    st->bytes = ds.msg_cbytes;
+    st->limit = ds.msg_qbytes;
+    st->headroom = ds.msg_qbytes > ds.msg_cbytes ? ds.msg_qbytes - ds.msg_cbytes : 0;
+    st->msgmax = q->msgmax;
+    st->sent_msgs = q->sent_msgs;
+    st->sent_calls = q->sent_calls;
+    st->recv_msgs = q->recv_msgs;
+    st->recv_calls = q->recv_calls;
+    return MSGQ_SUCCESS;
+}
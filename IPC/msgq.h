@@ -0,0 +1,209 @@
+/**
+ * @file    msgq.h
+ * @brief   Variable-length, batched SysV message queue layer with priority lanes.
+ *
+ * Each priority is a SysV msg_type (1 = control, 2 = normal, 3 = bulk). The receiver
+ * asks for msgtyp -MSGQ_PRIO_BULK, which makes the kernel hand out the lowest type
+ * first, so queued control messages overtake normal and bulk traffic.
+ *
+ * Control messages go out immediately. Normal and bulk messages are packed into one
+ * msgsnd per lane ([uint32 length][payload] records) until the batch is full or the
+ * flush window since its first message has passed. Only the used bytes are sent.
+ * A sender that may go idle must call msgq_flush_expired() (or msgq_flush()) so a
+ * partial batch doesn't wait for the next send.
+ *
+ * A SysV queue has no file descriptor, so an event loop cannot be woken by it.
+ * msgq_pollfd() instead returns a periodic timerfd; whenever it fires, a receiving loop
+ * drains the queue with msgq_try_recv() and a sending loop calls msgq_try_flush().
+ * Both consume the tick and send expired batches without blocking. The timer interval
+ * bounds the added receive latency.
+ *
+ */
+
+#ifndef MSGQ_H
+#define MSGQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/** Success return code */
+#define MSGQ_SUCCESS 0
+/** Failure return code */
+#define MSGQ_ERROR   1
+/** Queue full (send) or empty (receive) in non-blocking mode */
+#define MSGQ_AGAIN   2
+
+typedef enum
+{
+    MSGQ_PRIO_CONTROL = 1,
+    MSGQ_PRIO_NORMAL = 2,
+    MSGQ_PRIO_BULK = 3,
+    MSGQ_PRIO_COUNT = 3
+} MSGQ_PRIO_E;
+
+typedef struct
+{
+    long    mtype;
+    uint8_t mtext[];
+} MSGQ_BUF;
+
+typedef struct
+{
+    MSGQ_BUF *buf;
+    size_t    used;      // Bytes packed into buf->mtext
+    size_t    off;       // Receive: next record to hand out
+    uint32_t  count;     // Messages in the batch
+    uint64_t  first_ns;  // Send: when the first message was packed
+} MSGQ_LANE;
+
+typedef struct
+{
+    unsigned long depth;       // Queued kernel messages (batches count once)
+    size_t        bytes;       // Bytes queued in the kernel
+    size_t        limit;       // msg_qbytes
+    size_t        headroom;    // limit - bytes
+    size_t        msgmax;      // Largest single msgsnd (kernel.msgmax)
+    uint64_t      sent_msgs;   // Messages handed to msgq_send()
+    uint64_t      sent_calls;  // msgsnd() calls they needed
+    uint64_t      recv_msgs;
+    uint64_t      recv_calls;
+} MSGQ_STATS;
+
+typedef struct
+{
+    int       id;
+    int       nonblock;  // IPC_NOWAIT on send/receive
+    int       flush_us;  // Batch window for normal/bulk, 0 = no batching
+    size_t    msgmax;    // Batch capacity
+    MSGQ_LANE tx[MSGQ_PRIO_COUNT];
+    MSGQ_LANE rx[MSGQ_PRIO_COUNT];
+    MSGQ_BUF *scratch;   // Receive buffer swapped into rx[] by type
+    int       timer_fd;  // Event-loop tick, see msgq_pollfd(); -1 until created
+    uint64_t  sent_msgs, sent_calls, recv_msgs, recv_calls;
+} MSGQ;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open (or create) a SysV queue and allocate the batch buffers.
+     * @param[out] q Queue handle.
+     * @param[in] key SysV key, e.g. 1234.
+     * @param[in] create Non-zero to create the queue if missing.
+     * @param[in] flush_us Batch window in microseconds for normal and bulk lanes; 0 sends each message at once.
+     * @param[in] nonblock Non-zero to return MSGQ_AGAIN instead of blocking.
+     * @return MSGQ_SUCCESS on success, MSGQ_ERROR on failure.
+     */
+    int msgq_open(MSGQ *q, key_t key, int create, int flush_us, int nonblock);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Flush pending batches, free buffers and optionally remove the queue.
+     * @param[in,out] q Queue handle.
+     * @param[in] remove Non-zero to remove the kernel queue (IPC_RMID).
+     */
+    void msgq_close(MSGQ *q, int remove);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Send one message on a priority lane.
+     * @param[in,out] q Queue handle.
+     * @param[in] prio MSGQ_PRIO_CONTROL, MSGQ_PRIO_NORMAL or MSGQ_PRIO_BULK.
+     * @param[in] data Payload.
+     * @param[in] len Payload size, at most kernel.msgmax minus 4.
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN if the queue is full (non-blocking), MSGQ_ERROR on failure.
+     */
+    int msgq_send(MSGQ *q, MSGQ_PRIO_E prio, const void *data, size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Send every partial batch now, control lane first.
+     * @param[in,out] q Queue handle.
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN or MSGQ_ERROR.
+     */
+    int msgq_flush(MSGQ *q);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Send the batches whose flush window has passed. Call periodically when idle.
+     * @param[in,out] q Queue handle.
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN or MSGQ_ERROR.
+     */
+    int msgq_flush_expired(MSGQ *q);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Receive the next message, highest priority first.
+     * @param[in,out] q Queue handle.
+     * @param[out] buf Destination buffer.
+     * @param[in] size Size of @p buf.
+     * @param[out] len Payload size.
+     * @param[out] prio Lane the message was sent on (may be NULL).
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN if empty (non-blocking), MSGQ_ERROR on failure or
+     *         if @p buf is too small (the message is kept and @p len holds its size).
+     */
+    int msgq_recv(MSGQ *q, void *buf, size_t size, size_t *len, MSGQ_PRIO_E *prio);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a timerfd for epoll that fires every @p interval_us. Created on first use.
+     * @param[in,out] q Queue handle.
+     * @param[in] interval_us Poll interval in microseconds; 0 uses the flush window
+     *            (1 ms without batching).
+     * @return Descriptor (closed by msgq_close()), or -1 on failure.
+     */
+    int msgq_pollfd(MSGQ *q, int interval_us);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Consume pending timer ticks (so the descriptor stops polling readable) and send
+     *        the expired batches without blocking. Call when the msgq_pollfd() timer fires
+     *        on a sending handle.
+     * @param[in,out] q Queue handle.
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN if the queue is full, MSGQ_ERROR on failure.
+     */
+    int msgq_try_flush(MSGQ *q);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief msgq_send() that never blocks, whatever the handle was opened with.
+     * @param[in,out] q Queue handle.
+     * @param[in] prio MSGQ_PRIO_CONTROL, MSGQ_PRIO_NORMAL or MSGQ_PRIO_BULK.
+     * @param[in] data Payload.
+     * @param[in] len Payload size, at most kernel.msgmax minus 4.
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN if the queue is full, MSGQ_ERROR on failure.
+     */
+    int msgq_try_send(MSGQ *q, MSGQ_PRIO_E prio, const void *data, size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief msgq_recv() that never blocks. When the queue is empty it also does what
+     *        msgq_try_flush() does, so a receiving loop only has to drain until MSGQ_AGAIN.
+     * @param[in,out] q Queue handle.
+     * @param[out] buf Destination buffer.
+     * @param[in] size Size of @p buf.
+     * @param[out] len Payload size.
+     * @param[out] prio Lane the message was sent on (may be NULL).
+     * @return MSGQ_SUCCESS, MSGQ_AGAIN if empty, MSGQ_ERROR on failure or if @p buf is
+     *         too small.
+     */
+    int msgq_try_recv(MSGQ *q, void *buf, size_t size, size_t *len, MSGQ_PRIO_E *prio);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Report kernel queue depth and headroom plus this handle's counters.
+     * @param[in] q Queue handle.
+     * @param[out] st Statistics.
+     * @return MSGQ_SUCCESS on success, MSGQ_ERROR on failure.
+     */
+    int msgq_stats(const MSGQ *q, MSGQ_STATS *st);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // MSGQ_H
@@ -0,0 +1,234 @@
+/*
+ * Local pub/sub broker: owns the subscription directory, cleans up after dead
+ * subscribers, and optionally bridges topics to an MQTT broker
+ *
+ * Messages between local processes never pass through here; publishers write straight
+ * into subscriber inboxes (shm_pubsub.c). The broker only:
+ *   - creates the directory segment that publishers and subscribers open
+ *   - once a second, removes subscriptions whose process died
+ *   - with the MQTT bridge built in, forwards local topics matching -o filters to MQTT
+ *     and publishes MQTT messages matching -i filters locally
+ *
+ * The bridge needs libmosquitto (sudo apt install libmosquitto-dev) and MQTT 5 for its
+ * no-local subscriptions, so messages it forwards are not echoed back.
+ *
+ * Usage:
+ *   ./pubsubBroker [-n /pubsub] [-h mqtt_host] [-p mqtt_port] [-o out_filter]... [-i in_filter]...
+ *
+ * Example:
+ *   ./pubsubBroker
+ *   ./pubsubBroker -h localhost -o 'telemetry/#' -i 'cmd/+/set'
+ *
+ */
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef PUBSUB_MQTT
+#include <mosquitto.h>
+#include <mqtt_protocol.h>
+#endif
+
+#include "shm_pubsub.h"
+
+#define DIR_NAME    "/pubsub"
+#define MAX_FILTERS 16
+#define MAX_PAYLOAD 65536
+
+static volatile sig_atomic_t running = 1;
+
+#ifdef PUBSUB_MQTT
+typedef struct
+{
+    SHM_PUBSUB *in;       // Handle for the mosquitto thread's local publishes
+    char      **filters;  // -i filters, NULL-terminated
+} BRIDGE;
+#endif
+
+static void stop(int signum)
+{
+    (void)signum;
+    running = 0;
+}
+
+#ifdef PUBSUB_MQTT
+// Called on the mosquitto network thread, which publishes through its own handle
+static void on_mqtt_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg, const mosquitto_property *props)
+{
+    BRIDGE  *bridge = obj;
+    uint32_t delivered;
+
+    (void)mosq;
+    (void)props;
+    shm_pubsub_publish(bridge->in, msg->topic, msg->payload, (uint32_t)msg->payloadlen, SHM_PUBSUB_BRIDGED, &delivered);
+}
+
+static void on_mqtt_connect(struct mosquitto *mosq, void *obj, int rc, int flags, const mosquitto_property *props)
+{
+    BRIDGE *bridge = obj;
+
+    (void)flags;
+    (void)props;
+    if (rc != 0)
+    {
+        fprintf(stderr, "MQTT connect failed: %s\n", mosquitto_connack_string(rc));
+        return;
+    }
+    for (int i = 0; bridge->filters[i] != NULL; i++)
+    {
+        mosquitto_subscribe_v5(mosq, NULL, bridge->filters[i], 0, MQTT_SUB_OPT_NO_LOCAL, NULL);
+    }
+    printf("MQTT bridge connected\n");
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+    const char    *name = DIR_NAME;
+    const char    *host = NULL;
+    int            port = 1883;
+    char          *out[MAX_FILTERS + 1] = {0};
+    char          *in[MAX_FILTERS + 1] = {0};
+    int            n_out = 0, n_in = 0;
+    int            opt;
+    SHM_PUBSUB     ps;
+    SHM_PUBSUB_SUB bridge_out[MAX_FILTERS];
+
+    while ((opt = getopt(argc, argv, "n:h:p:o:i:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n': name = optarg; break;
+            case 'h': host = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'o':
+                if (n_out < MAX_FILTERS)
+                {
+                    out[n_out++] = optarg;
+                }
+                break;
+            case 'i':
+                if (n_in < MAX_FILTERS)
+                {
+                    in[n_in++] = optarg;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n name] [-h mqtt_host] [-p mqtt_port] [-o out_filter]... [-i in_filter]...\n", argv[0]);
+                return 1;
+        }
+    }
+#ifndef PUBSUB_MQTT
+    if (host != NULL || n_out > 0 || n_in > 0)
+    {
+        fprintf(stderr, "MQTT bridge not built in; compile with -DPUBSUB_MQTT -lmosquitto\n");
+        return 1;
+    }
+    (void)port;
+    (void)in;
+#endif
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    if (shm_pubsub_create(&ps, name) != SHM_PUBSUB_SUCCESS)
+    {
+        return 1;
+    }
+    printf("Broker serving %s\n", name);
+
+#ifdef PUBSUB_MQTT
+    SHM_PUBSUB        in_ps;
+    BRIDGE            bridge = {&in_ps, in};
+    struct mosquitto *mosq = NULL;
+
+    if (host != NULL)
+    {
+        mosquitto_lib_init();
+        if (shm_pubsub_open(&in_ps, name) != SHM_PUBSUB_SUCCESS || (mosq = mosquitto_new(NULL, true, &bridge)) == NULL)
+        {
+            shm_pubsub_close(&ps);
+            return 1;
+        }
+        mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+        mosquitto_connect_v5_callback_set(mosq, on_mqtt_connect);
+        mosquitto_message_v5_callback_set(mosq, on_mqtt_message);
+        if (mosquitto_connect(mosq, host, port, 60) != MOSQ_ERR_SUCCESS || mosquitto_loop_start(mosq) != MOSQ_ERR_SUCCESS)
+        {
+            fprintf(stderr, "Unable to reach MQTT broker %s:%d\n", host, port);
+            shm_pubsub_close(&ps);
+            return 1;
+        }
+    }
+#endif
+
+    // Local side of the outbound bridge; skips what came in from MQTT
+    for (int i = 0; i < n_out; i++)
+    {
+        if (shm_pubsub_subscribe(&ps, out[i], 1024, MAX_PAYLOAD, SHM_PUBSUB_NO_BRIDGED, &bridge_out[i]) != SHM_PUBSUB_SUCCESS)
+        {
+            n_out = i;
+            running = 0;
+        }
+    }
+
+    while (running)
+    {
+        int reaped = shm_pubsub_reap(&ps);
+        if (reaped > 0)
+        {
+            printf("Removed %d subscription(s) of exited processes\n", reaped);
+        }
+        if (n_out == 0)
+        {
+            sleep(1);
+            continue;
+        }
+
+        // Forward for up to a second, then reap again
+        for (int tick = 0; tick < 100 && running; tick++)
+        {
+            int idle = 1;
+            for (int i = 0; i < n_out; i++)
+            {
+                SHM_PUBSUB_MSG msg;
+                while (shm_pubsub_recv(&bridge_out[i], &msg) == SHM_PUBSUB_SUCCESS)
+                {
+                    idle = 0;
+#ifdef PUBSUB_MQTT
+                    if (mosq != NULL)
+                    {
+                        mosquitto_publish(mosq, NULL, msg.topic, (int)msg.len, msg.data, 0, false);
+                    }
+#endif
+                }
+            }
+            if (idle)
+            {
+                shm_pubsub_wait(&bridge_out[tick % n_out], 10);
+            }
+        }
+    }
+
+    printf("\nBroker terminating\n");
+    for (int i = 0; i < n_out; i++)
+    {
+        shm_pubsub_unsubscribe(&bridge_out[i]);
+    }
+#ifdef PUBSUB_MQTT
+    if (mosq != NULL)
+    {
+        mosquitto_disconnect(mosq);
+        mosquitto_loop_stop(mosq, false);
+        mosquitto_destroy(mosq);
+        shm_pubsub_close(&in_ps);
+        mosquitto_lib_cleanup();
+    }
+#endif
+    shm_pubsub_close(&ps);
+    return 0;
+}
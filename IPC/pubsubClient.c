@@ -0,0 +1,307 @@
+/*
+ * Command-line client for the local pub/sub service (shm_pubsub.c)
+ *
+ * Start ./pubsubBroker first; it creates the directory this client opens.
+ *
+ * Usage:
+ *   ./pubsubClient pub <topic> <message> [count]
+ *   ./pubsubClient sub <filter> [filter...]      # prints topic, payload and delivery delay
+ *   ./pubsubClient stats                         # subscriptions with delivered/dropped counts
+ *   ./pubsubClient bench [round_trips]           # latency ping-pong and fan-out throughput
+ *
+ * Example:
+ *   ./pubsubClient sub 'camera/+/status' &
+ *   ./pubsubClient pub camera/3/status online
+ *
+ */
+
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_pubsub.h"
+
+#define DIR_NAME    "/pubsub"
+#define MAX_FILTERS 8
+#define SPINS       2000  // Polls before sleeping on the inbox futex
+#define FANOUT_SUBS 4
+#define FANOUT_MSGS 200000
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int signum)
+{
+    (void)signum;
+    running = 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Poll briefly, then sleep until a message arrives
+static int next_msg(SHM_PUBSUB_SUB *sub, SHM_PUBSUB_MSG *msg)
+{
+    for (;;)
+    {
+        for (int i = 0; i < SPINS; i++)
+        {
+            if (shm_pubsub_recv(sub, msg) == SHM_PUBSUB_SUCCESS)
+            {
+                return SHM_PUBSUB_SUCCESS;
+            }
+        }
+        if (shm_pubsub_wait(sub, 1000) == SHM_PUBSUB_ERROR || !running)
+        {
+            return SHM_PUBSUB_ERROR;
+        }
+    }
+}
+
+static int subscribe(SHM_PUBSUB *ps, char **filters, int n)
+{
+    SHM_PUBSUB_SUB subs[MAX_FILTERS];
+
+    n = n > MAX_FILTERS ? MAX_FILTERS : n;
+    for (int i = 0; i < n; i++)
+    {
+        if (shm_pubsub_subscribe(ps, filters[i], 256, 4096, 0, &subs[i]) != SHM_PUBSUB_SUCCESS)
+        {
+            return 1;
+        }
+    }
+    printf("Subscribed; waiting for messages (Ctrl+C to stop)\n");
+    fflush(stdout);
+
+    while (running)
+    {
+        int got = 0;
+        for (int i = 0; i < n; i++)
+        {
+            SHM_PUBSUB_MSG msg;
+            while (shm_pubsub_recv(&subs[i], &msg) == SHM_PUBSUB_SUCCESS)
+            {
+                printf("%s: %.*s  (%.1f us%s)\n", msg.topic, (int)msg.len, (const char *)msg.data, (now_ns() - msg.published_ns) / 1e3,
+                       msg.flags & SHM_PUBSUB_BRIDGED ? ", via MQTT" : "");
+                got = 1;
+            }
+        }
+        fflush(stdout);
+        if (!got)
+        {
+            shm_pubsub_wait(&subs[0], n > 1 ? 10 : 500);
+        }
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        shm_pubsub_unsubscribe(&subs[i]);
+    }
+    return 0;
+}
+
+static void stats(SHM_PUBSUB *ps)
+{
+    printf("%3s %7s %-32s %12s %10s\n", "#", "pid", "filter", "delivered", "dropped");
+    for (int i = 0; i < SHM_PUBSUB_MAX_SUBS; i++)
+    {
+        SHM_PUBSUB_ENTRY *e = &ps->dir->subs[i];
+        if (atomic_load(&e->state) == SHM_PUBSUB_ACTIVE)
+        {
+            printf("%3d %7d %-32s %12llu %10llu\n", i, (int)atomic_load(&e->pid), e->filter, (unsigned long long)atomic_load(&e->delivered),
+                   (unsigned long long)atomic_load(&e->dropped));
+        }
+    }
+}
+
+static int bench(SHM_PUBSUB *ps, int rounds)
+{
+    SHM_PUBSUB_SUB  pong;
+    SHM_PUBSUB_MSG  msg;
+    uint64_t       *lat = malloc(sizeof(uint64_t) * rounds);
+    int             pipefd[2];
+    char            ready;
+    pid_t           pid;
+
+    if (lat == NULL || pipe(pipefd) == -1 || shm_pubsub_subscribe(ps, "bench/pong", 64, 64, 0, &pong) != SHM_PUBSUB_SUCCESS)
+    {
+        return 1;
+    }
+
+    // Latency: the child answers every bench/ping with a bench/pong
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        SHM_PUBSUB     cps;
+        SHM_PUBSUB_SUB ping;
+
+        if (shm_pubsub_open(&cps, DIR_NAME) != SHM_PUBSUB_SUCCESS || shm_pubsub_subscribe(&cps, "bench/+", 64, 64, 0, &ping) != SHM_PUBSUB_SUCCESS)
+        {
+            _exit(1);
+        }
+        write(pipefd[1], "r", 1);
+        for (int i = 0; i < rounds && next_msg(&ping, &msg) == SHM_PUBSUB_SUCCESS;)
+        {
+            if (strcmp(msg.topic, "bench/ping") == 0)
+            {
+                shm_pubsub_publish(&cps, "bench/pong", msg.data, msg.len, 0, NULL);
+                i++;
+            }
+        }
+        shm_pubsub_unsubscribe(&ping);
+        shm_pubsub_close(&cps);
+        _exit(0);
+    }
+    if (read(pipefd[0], &ready, 1) != 1)
+    {
+        return 1;
+    }
+
+    for (int i = 0; i < rounds; i++)
+    {
+        uint64_t t0 = now_ns();
+        shm_pubsub_publish(ps, "bench/ping", &t0, sizeof(t0), 0, NULL);
+        if (next_msg(&pong, &msg) != SHM_PUBSUB_SUCCESS)
+        {
+            break;
+        }
+        lat[i] = (now_ns() - t0) / 2;
+    }
+    waitpid(pid, NULL, 0);
+    qsort(lat, rounds, sizeof(lat[0]), cmp_u64);
+    printf("one-way latency over %d round trips: p50 %.2f us, p99 %.2f us, max %.2f us\n", rounds, lat[rounds / 2] / 1e3, lat[rounds * 99 / 100] / 1e3,
+           lat[rounds - 1] / 1e3);
+    shm_pubsub_unsubscribe(&pong);
+
+    // Fan-out: one publisher, FANOUT_SUBS wildcard subscribers
+    for (int s = 0; s < FANOUT_SUBS; s++)
+    {
+        if (fork() == 0)
+        {
+            SHM_PUBSUB     cps;
+            SHM_PUBSUB_SUB sub;
+            uint64_t       n = 0;
+
+            if (shm_pubsub_open(&cps, DIR_NAME) != SHM_PUBSUB_SUCCESS || shm_pubsub_subscribe(&cps, "fanout/#", 4096, 64, 0, &sub) != SHM_PUBSUB_SUCCESS)
+            {
+                _exit(1);
+            }
+            write(pipefd[1], "r", 1);
+            while (next_msg(&sub, &msg) == SHM_PUBSUB_SUCCESS && msg.len > 0)
+            {
+                n++;
+            }
+            shm_pubsub_unsubscribe(&sub);
+            shm_pubsub_close(&cps);
+            write(pipefd[1], &n, sizeof(n));
+            _exit(0);
+        }
+    }
+    for (int s = 0; s < FANOUT_SUBS; s++)
+    {
+        if (read(pipefd[0], &ready, 1) != 1)
+        {
+            return 1;
+        }
+    }
+
+    // An inbox that is full drops the message; yield so the subscribers can catch up
+    uint64_t start = now_ns(), dropped = 0, received = 0;
+    for (uint64_t i = 0; i < FANOUT_MSGS; i++)
+    {
+        uint32_t delivered = 0;
+        shm_pubsub_publish(ps, "fanout/cam/0", &i, sizeof(i), 0, &delivered);
+        if (delivered < FANOUT_SUBS)
+        {
+            dropped += FANOUT_SUBS - delivered;
+            sched_yield();
+        }
+    }
+    // An empty payload ends the run; repeat until every subscriber has it
+    for (uint32_t delivered = 0; delivered < FANOUT_SUBS;)
+    {
+        uint32_t now = 0;
+        shm_pubsub_publish(ps, "fanout/end", "", 0, 0, &now);
+        delivered += now;
+        sched_yield();
+    }
+    for (int s = 0; s < FANOUT_SUBS; s++)
+    {
+        uint64_t n;
+        if (read(pipefd[0], &n, sizeof(n)) == sizeof(n))
+        {
+            received += n;
+        }
+    }
+    double seconds = (now_ns() - start) / 1e9;
+    while (wait(NULL) > 0)
+    {
+    }
+    printf("fan-out to %d subscribers: %.0f messages/s published, %.0f deliveries/s, %llu dropped on full inboxes\n", FANOUT_SUBS,
+           FANOUT_MSGS / seconds, received / seconds, (unsigned long long)dropped);
+    free(lat);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    SHM_PUBSUB ps;
+    int        ret = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s pub <topic> <message> [count] | sub <filter>... | stats | bench [round_trips]\n", argv[0]);
+        return 1;
+    }
+    signal(SIGINT, stop);
+    if (shm_pubsub_open(&ps, DIR_NAME) != SHM_PUBSUB_SUCCESS)
+    {
+        return 1;
+    }
+
+    if (strcmp(argv[1], "pub") == 0 && argc >= 4)
+    {
+        int      count = argc > 4 ? atoi(argv[4]) : 1;
+        uint32_t delivered = 0;
+        for (int i = 0; i < count && ret == 0; i++)
+        {
+            ret = shm_pubsub_publish(&ps, argv[2], argv[3], strlen(argv[3]), 0, &delivered) != SHM_PUBSUB_SUCCESS;
+        }
+        printf("Delivered to %u subscriber(s)\n", delivered);
+    }
+    else if (strcmp(argv[1], "sub") == 0 && argc >= 3)
+    {
+        ret = subscribe(&ps, argv + 2, argc - 2);
+    }
+    else if (strcmp(argv[1], "stats") == 0)
+    {
+        stats(&ps);
+    }
+    else if (strcmp(argv[1], "bench") == 0)
+    {
+        ret = bench(&ps, argc > 2 ? atoi(argv[2]) : 100000);
+    }
+    else
+    {
+        fprintf(stderr, "Unknown command %s\n", argv[1]);
+        ret = 1;
+    }
+
+    shm_pubsub_close(&ps);
+    return ret;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file    sharedMutex.h
+ * @brief   Segment shared by sharedMutexProcess1 (creator) and sharedMutexProcess2.
+ *
+ */
+
+#ifndef SHARED_MUTEX_H
+#define SHARED_MUTEX_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "shm_sync.h"
+
+#define SHM_NAME     "/mutex_shm"
+#define SHARED_MAGIC 0x4D555458u  // "MUTX", stored last by the creator
+
+typedef struct
+{
+    _Atomic uint32_t magic;
+    SHM_MUTEX        lock;
+    int              counter;  // Protected by lock
+} SHARED_STATE;
+
+#endif  // SHARED_MUTEX_H
@@ -1,59 +1,93 @@
+#include <errno.h>
 #include <fcntl.h>
-#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define SHM_NAME "/mutex_shm"
+#include "sharedMutex.h"
 
 int main()
 {
-    // Open or create shared memory
-    int shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
+    // Create the shared memory; a segment left by a crashed run is reused as is
+    int created = 1;
+    int shm_fd = shm_open(SHM_NAME, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (shm_fd == -1 && errno == EEXIST)
+    {
+        created = 0;
+        shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
+    }
     if (shm_fd == -1)
     {
         perror("shm_open");
         return 1;
     }
 
-    // Set the size of shared memory
-    ftruncate(shm_fd, sizeof(pthread_mutex_t));
+    // Set the size of shared memory. A run that crashed before its ftruncate leaves an
+    // empty segment, so size whatever we opened, not only a new one.
+    struct stat st;
+    if (fstat(shm_fd, &st) == -1)
+    {
+        perror("fstat");
+        return 1;
+    }
+    if ((size_t)st.st_size < sizeof(SHARED_STATE) && ftruncate(shm_fd, sizeof(SHARED_STATE)) == -1)
+    {
+        perror("ftruncate");
+        return 1;
+    }
 
     // Map the shared memory
-    pthread_mutex_t *mutex = (pthread_mutex_t *)mmap(NULL, sizeof(pthread_mutex_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (mutex == MAP_FAILED)
+    SHARED_STATE *state = (SHARED_STATE *)mmap(NULL, sizeof(SHARED_STATE), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (state == MAP_FAILED)
     {
         perror("mmap");
         return 1;
     }
 
-    // Initialize the mutex in shared memory (this is done only once)
-    pthread_mutexattr_t attr;
-    pthread_mutexattr_init(&attr);
-    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-    pthread_mutex_init(mutex, &attr);
+    // Initialize the robust mutex only in a new segment: re-initializing a mutex that
+    // another process may hold is undefined. Publishing the magic last tells process 2
+    // it can use the lock.
+    if (created || atomic_load(&state->magic) != SHARED_MAGIC)
+    {
+        if (shm_mutex_init(&state->lock) != SHM_SYNC_SUCCESS)
+        {
+            return 1;
+        }
+        state->counter = 0;
+        atomic_store(&state->magic, SHARED_MAGIC);
+    }
 
     printf("Process 1: Waiting to lock mutex...\n");
 
-    // Lock the mutex
-    pthread_mutex_lock(mutex);
-    printf("Process 1: Locked the mutex.\n");
+    // Lock the mutex; if its owner died, we get it back and repair the shared data
+    int ret = shm_mutex_lock(&state->lock);
+    if (ret == SHM_SYNC_ERROR)
+    {
+        return 1;
+    }
+    if (ret == SHM_SYNC_RECOVERED)
+    {
+        printf("Process 1: Previous owner died holding the mutex, recovered it.\n");
+    }
+    printf("Process 1: Locked the mutex (counter %d).\n", ++state->counter);
 
-    // Simulate work
+    // Simulate work (press Ctrl-C now: process 2 recovers the mutex instead of hanging)
     sleep(10);
 
     printf("Process 1: Unlocking the mutex.\n");
 
     // Unlock the mutex
-    pthread_mutex_unlock(mutex);
+    shm_mutex_unlock(&state->lock);
 
     // Clean up
-    munmap(mutex, sizeof(pthread_mutex_t));
+    munmap(state, sizeof(SHARED_STATE));
     close(shm_fd);
 
-    // Unlink shared memory to remove the file from /dev/shm
+    // Only the creator removes the name from /dev/shm. Process 2 never unlinks, so a
+    // running process 2 keeps its mapping and nothing pulls the segment out from under
+    // this process.
     shm_unlink(SHM_NAME);
     return 0;
 }
@@ -1,12 +1,11 @@
 #include <fcntl.h>
-#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-#define SHM_NAME "/mutex_shm"
+#include "sharedMutex.h"
 
 int main()
 {
@@ -18,19 +17,40 @@ int main()
         return 1;
     }
 
+    // Wait until process 1 has sized the segment; touching an empty one raises SIGBUS
+    struct stat st;
+    while (fstat(shm_fd, &st) == 0 && (size_t)st.st_size < sizeof(SHARED_STATE))
+    {
+        usleep(1000);
+    }
+
     // Map the shared memory
-    pthread_mutex_t *mutex = (pthread_mutex_t *)mmap(NULL, sizeof(pthread_mutex_t), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (mutex == MAP_FAILED)
+    SHARED_STATE *state = (SHARED_STATE *)mmap(NULL, sizeof(SHARED_STATE), PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+    if (state == MAP_FAILED)
     {
         perror("mmap");
         return 1;
     }
 
+    // Wait until process 1 has initialized the mutex
+    while (atomic_load(&state->magic) != SHARED_MAGIC)
+    {
+        usleep(1000);
+    }
+
     printf("Process 2: Waiting to lock mutex...\n");
 
-    // Lock the mutex
-    pthread_mutex_lock(mutex);
-    printf("Process 2: Locked the mutex.\n");
+    // Lock the mutex; if process 1 died holding it, we get it back and repair the shared data
+    int ret = shm_mutex_lock(&state->lock);
+    if (ret == SHM_SYNC_ERROR)
+    {
+        return 1;
+    }
+    if (ret == SHM_SYNC_RECOVERED)
+    {
+        printf("Process 2: Process 1 died holding the mutex, recovered it.\n");
+    }
+    printf("Process 2: Locked the mutex (counter %d).\n", ++state->counter);
 
     // Simulate work
     sleep(2);
@@ -38,13 +58,10 @@ int main()
     printf("Process 2: Unlocking the mutex.\n");
 
     // Unlock the mutex
-    pthread_mutex_unlock(mutex);
+    shm_mutex_unlock(&state->lock);
 
-    // Clean up
-    munmap(mutex, sizeof(pthread_mutex_t));
+    // Clean up; the segment belongs to process 1, which unlinks it
+    munmap(state, sizeof(SHARED_STATE));
     close(shm_fd);
-
-    // Unlink shared memory to remove the file from /dev/shm
-    shm_unlink(SHM_NAME);
     return 0;
 }
@@ -1,60 +1,78 @@
-#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 #include <unistd.h>
 
+#include "shm_ring.h"
+
 #define SHM_NAME "/my_shared_memory"
-#define SHM_SIZE 1024
 
-int   shm_fd;
-char *shm_ptr;
+SHM_RING ring;
 
 // Signal handler for cleanup
 void cleanup(int signum)
 {
     printf("\nReader terminating. Cleaning up...\n");
-    if (munmap(shm_ptr, SHM_SIZE) == -1)
-    {
-        perror("munmap");
-    }
-    if (close(shm_fd) == -1)
-    {
-        perror("close");
-    }
+    shm_ring_close(&ring);  // The writer owns the name; the reader only unmaps
     printf("Cleanup complete. Goodbye!\n");
     exit(0);
 }
 
-int main()
+// Attach to the ring created by the writer, waiting for one if it is not running
+void attach(void)
 {
-    // Set up signal handler
-    signal(SIGINT, cleanup);
+    int ret, waiting = 0;
 
-    // Open the shared memory object
-    shm_fd = shm_open(SHM_NAME, O_RDWR, 0666);
-    if (shm_fd == -1)
+    while ((ret = shm_ring_open(&ring, SHM_NAME)) == SHM_RING_AGAIN)
     {
-        perror("shm_open");
-        exit(1);
+        if (!waiting)
+        {
+            printf("Waiting for the writer...\n");
+            waiting = 1;
+        }
+        usleep(200000);
     }
-
-    // Map the shared memory object into the process's address space
-    shm_ptr = mmap(0, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (shm_ptr == MAP_FAILED)
+    if (ret != SHM_RING_SUCCESS)
     {
-        perror("mmap");
         exit(1);
     }
+}
 
+int main()
+{
+    // Set up signal handler
+    signal(SIGINT, cleanup);
+
+    attach();
     printf("Reader started. Reading from shared memory.\n");
 
     while (1)
     {
-        printf("Data read: %s\n", shm_ptr);
-        sleep(1);  // Avoid excessive CPU usage
+        uint32_t    len;
+        const char *text;
+
+        // Sleep in the kernel until the writer publishes; no polling, no idle CPU
+        int ret = shm_ring_wait_readable(&ring, -1);
+        if (ret == SHM_RING_CLOSED)
+        {
+            // The writer quit or was restarted: follow the name to its next ring
+            printf("Writer closed the ring, reattaching.\n");
+            shm_ring_close(&ring);
+            attach();
+            continue;
+        }
+        if (ret != SHM_RING_SUCCESS)
+        {
+            cleanup(0);
+        }
+
+        // Drain everything written since the last wakeup, each record once
+        while ((text = shm_ring_peek(&ring, &len)) != NULL)
+        {
+            printf("Data read: %.*s\n", (int)len, text);
+            shm_ring_release(&ring, 1);
+        }
     }
 
     return 0;
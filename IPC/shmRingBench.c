@@ -0,0 +1,429 @@
+/*
+ * Throughput and latency benchmark for the shared-memory SPSC ring
+ *
+ * Throughput: a forked consumer drains N records of a fixed size while the parent
+ * produces them; each record carries a sequence number that the consumer checks.
+ * Latency: ping-pong over two rings, reported as half the round trip.
+ * Wakeup: the consumer sleeps in shm_ring_wait_readable() and the producer sends a
+ * timestamp every -i microseconds; reports wake latency and the consumer's CPU time.
+ *
+ * Usage:
+ *   ./shmRingBench [-n messages] [-s size] [-c capacity] [-b batch] [-l round_trips]
+ *                  [-w wakeups] [-i interval_us] [-p cpu,cpu]
+ *   Example: ./shmRingBench -n 100000000 -s 16 -b 32 -p 2,3
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shm_ring.h"
+
+#define RING_NAME "/shm_ring_bench"
+#define PING_NAME "/shm_ring_ping"
+#define PONG_NAME "/shm_ring_pong"
+#define WAKE_NAME "/shm_ring_wake"
+#define SPINS     1024  // Busy-wait iterations before yielding (matters on few cores)
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void pin_cpu(int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1)
+        {
+            perror("sched_setaffinity");
+        }
+    }
+}
+
+static void backoff(unsigned *spins)
+{
+    if (++*spins >= SPINS)
+    {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_percentiles(const char *what, uint64_t *samples, uint64_t n)
+{
+    qsort(samples, n, sizeof(uint64_t), cmp_u64);
+    printf("%s over %llu samples: p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n", what, (unsigned long long)n,
+           (unsigned long long)samples[n / 2], (unsigned long long)samples[n * 99 / 100], (unsigned long long)samples[n * 999 / 1000],
+           (unsigned long long)samples[n - 1]);
+}
+
+static int consumer(uint64_t count, int batch, int cpu, int ready_fd)
+{
+    SHM_RING ring;
+    uint64_t expected = 0;
+    unsigned spins = 0;
+
+    pin_cpu(cpu);
+    if (shm_ring_open(&ring, RING_NAME) != SHM_RING_SUCCESS)
+    {
+        return 1;
+    }
+    if (write(ready_fd, "r", 1) != 1)
+    {
+        return 1;
+    }
+
+    while (expected < count)
+    {
+        uint32_t    len;
+        const void *rec = shm_ring_peek(&ring, &len);
+
+        if (rec == NULL)
+        {
+            backoff(&spins);
+            continue;
+        }
+        if (len >= sizeof(uint64_t))
+        {
+            uint64_t seq;
+            memcpy(&seq, rec, sizeof(seq));
+            if (seq != expected)
+            {
+                fprintf(stderr, "Consumer: expected record %llu, got %llu\n", (unsigned long long)expected, (unsigned long long)seq);
+                return 1;
+            }
+        }
+        expected++;
+        shm_ring_release(&ring, expected % batch == 0 || expected == count);
+    }
+
+    shm_ring_close(&ring);
+    return 0;
+}
+
+static void run_throughput(uint64_t count, uint32_t size, size_t capacity, int batch, int cpu_p, int cpu_c)
+{
+    SHM_RING ring;
+    int      ready[2];
+    char     c;
+    pid_t    pid;
+    unsigned spins = 0;
+
+    if (shm_ring_create(&ring, RING_NAME, capacity) != SHM_RING_SUCCESS || pipe(ready) == -1)
+    {
+        exit(1);
+    }
+    if (size > shm_ring_max_record(&ring))
+    {
+        fprintf(stderr, "Record size %u exceeds ring maximum %u\n", size, shm_ring_max_record(&ring));
+        exit(1);
+    }
+
+    fflush(stdout);  // Don't let the child inherit buffered output
+    pid = fork();
+    if (pid == 0)
+    {
+        close(ready[0]);
+        _exit(consumer(count, batch, cpu_c, ready[1]));
+    }
+    close(ready[1]);
+    pin_cpu(cpu_p);
+    if (read(ready[0], &c, 1) != 1)
+    {
+        fprintf(stderr, "Consumer failed to start\n");
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    for (uint64_t seq = 0; seq < count;)
+    {
+        void *dst = shm_ring_reserve(&ring, size);
+        if (dst == NULL)
+        {
+            backoff(&spins);
+            continue;
+        }
+        if (size >= sizeof(uint64_t))
+        {
+            memcpy(dst, &seq, sizeof(seq));
+        }
+        seq++;
+        shm_ring_commit(&ring, size, seq % batch == 0 || seq == count);
+    }
+    while (atomic_load_explicit(&ring.hdr->tail, memory_order_acquire) != ring.local_head)
+    {
+        backoff(&spins);
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Consumer failed\n");
+        exit(1);
+    }
+
+    double secs = elapsed / 1e9;
+    printf("Throughput: %llu x %u B in %.3f s = %.2f M msg/s, %.1f MB/s (batch %d, ring %u B)\n", (unsigned long long)count, size, secs,
+           count / secs / 1e6, (double)count * size / secs / 1e6, batch, ring.hdr->capacity);
+
+    close(ready[0]);
+    shm_ring_close(&ring);
+}
+
+static int echo(uint64_t rounds, int cpu, int ready_fd)
+{
+    SHM_RING ping, pong;
+    uint64_t ts;
+    uint32_t len;
+    unsigned spins = 0;
+
+    pin_cpu(cpu);
+    if (shm_ring_open(&ping, PING_NAME) != SHM_RING_SUCCESS || shm_ring_open(&pong, PONG_NAME) != SHM_RING_SUCCESS)
+    {
+        return 1;
+    }
+    if (write(ready_fd, "r", 1) != 1)
+    {
+        return 1;
+    }
+
+    for (uint64_t i = 0; i < rounds;)
+    {
+        if (shm_ring_read(&ping, &ts, sizeof(ts), &len) != SHM_RING_SUCCESS)
+        {
+            backoff(&spins);
+            continue;
+        }
+        while (shm_ring_write(&pong, &ts, sizeof(ts)) != SHM_RING_SUCCESS)
+        {
+            backoff(&spins);
+        }
+        i++;
+    }
+
+    shm_ring_close(&ping);
+    shm_ring_close(&pong);
+    return 0;
+}
+
+static void run_latency(uint64_t rounds, int cpu_p, int cpu_c)
+{
+    SHM_RING  ping, pong;
+    uint64_t *samples = malloc(rounds * sizeof(uint64_t));
+    int       ready[2];
+    char      c;
+    pid_t     pid;
+
+    if (samples == NULL || shm_ring_create(&ping, PING_NAME, 4096) != SHM_RING_SUCCESS ||
+        shm_ring_create(&pong, PONG_NAME, 4096) != SHM_RING_SUCCESS || pipe(ready) == -1)
+    {
+        exit(1);
+    }
+
+    fflush(stdout);  // Don't let the child inherit buffered output
+    pid = fork();
+    if (pid == 0)
+    {
+        close(ready[0]);
+        _exit(echo(rounds, cpu_c, ready[1]));
+    }
+    close(ready[1]);
+    pin_cpu(cpu_p);
+    if (read(ready[0], &c, 1) != 1)
+    {
+        fprintf(stderr, "Echo process failed to start\n");
+        exit(1);
+    }
+
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        uint64_t ts = now_ns(), back;
+        uint32_t len;
+        unsigned spins = 0;
+
+        while (shm_ring_write(&ping, &ts, sizeof(ts)) != SHM_RING_SUCCESS)
+        {
+            backoff(&spins);
+        }
+        while (shm_ring_read(&pong, &back, sizeof(back), &len) != SHM_RING_SUCCESS)
+        {
+            backoff(&spins);
+        }
+        samples[i] = (now_ns() - back) / 2;
+    }
+    waitpid(pid, NULL, 0);
+
+    print_percentiles("One-way latency", samples, rounds);
+
+    free(samples);
+    close(ready[0]);
+    shm_ring_close(&ping);
+    shm_ring_close(&pong);
+}
+
+static int sleeper(uint64_t wakeups, int cpu, int ready_fd)
+{
+    SHM_RING      ring;
+    uint64_t     *samples = malloc(wakeups * sizeof(uint64_t));
+    uint64_t      start;
+    struct rusage ru;
+
+    pin_cpu(cpu);
+    if (samples == NULL || shm_ring_open(&ring, WAKE_NAME) != SHM_RING_SUCCESS)
+    {
+        return 1;
+    }
+    if (write(ready_fd, "r", 1) != 1)
+    {
+        return 1;
+    }
+
+    start = now_ns();
+    for (uint64_t i = 0; i < wakeups; i++)
+    {
+        uint64_t ts;
+        uint32_t len;
+
+        if (shm_ring_wait_readable(&ring, -1) != SHM_RING_SUCCESS || shm_ring_read(&ring, &ts, sizeof(ts), &len) != SHM_RING_SUCCESS)
+        {
+            return 1;
+        }
+        samples[i] = now_ns() - ts;
+    }
+
+    getrusage(RUSAGE_SELF, &ru);
+    print_percentiles("Wake latency", samples, wakeups);
+    printf("Consumer CPU while mostly idle: %.2f ms user + %.2f ms sys over %.0f ms\n", ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3,
+           ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3, (now_ns() - start) / 1e6);
+    fflush(stdout);  // The child leaves through _exit()
+
+    free(samples);
+    shm_ring_close(&ring);
+    return 0;
+}
+
+static void run_wakeup(uint64_t wakeups, int interval_us, int cpu_p, int cpu_c)
+{
+    SHM_RING ring;
+    int      ready[2];
+    char     c;
+    pid_t    pid;
+
+    if (shm_ring_create(&ring, WAKE_NAME, 4096) != SHM_RING_SUCCESS || pipe(ready) == -1)
+    {
+        exit(1);
+    }
+
+    fflush(stdout);  // Don't let the child inherit buffered output
+    pid = fork();
+    if (pid == 0)
+    {
+        close(ready[0]);
+        _exit(sleeper(wakeups, cpu_c, ready[1]));
+    }
+    close(ready[1]);
+    pin_cpu(cpu_p);
+    if (read(ready[0], &c, 1) != 1)
+    {
+        fprintf(stderr, "Sleeper failed to start\n");
+        exit(1);
+    }
+
+    for (uint64_t i = 0; i < wakeups; i++)
+    {
+        usleep(interval_us);  // Long enough for the consumer to fall asleep again
+
+        uint64_t ts = now_ns();
+        if (shm_ring_wait_writable(&ring, sizeof(ts), -1) != SHM_RING_SUCCESS || shm_ring_write(&ring, &ts, sizeof(ts)) != SHM_RING_SUCCESS)
+        {
+            exit(1);
+        }
+    }
+    waitpid(pid, NULL, 0);
+
+    close(ready[0]);
+    shm_ring_close(&ring);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = 50000000;
+    uint32_t size = 16;
+    size_t   capacity = 1 << 20;
+    int      batch = 32;
+    uint64_t rounds = 1000000;
+    uint64_t wakeups = 10000;
+    int      interval_us = 200;
+    int      cpu_p = -1, cpu_c = -1;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "n:s:c:b:l:w:i:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                count = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                size = (uint32_t)atoi(optarg);
+                break;
+            case 'c':
+                capacity = strtoul(optarg, NULL, 10);
+                break;
+            case 'b':
+                batch = atoi(optarg);
+                break;
+            case 'l':
+                rounds = strtoull(optarg, NULL, 10);
+                break;
+            case 'w':
+                wakeups = strtoull(optarg, NULL, 10);
+                break;
+            case 'i':
+                interval_us = atoi(optarg);
+                break;
+            case 'p':
+                if (sscanf(optarg, "%d,%d", &cpu_p, &cpu_c) != 2)
+                {
+                    fprintf(stderr, "-p expects producer,consumer CPUs\n");
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n messages] [-s size] [-c capacity] [-b batch] [-l round_trips] [-w wakeups] [-i interval_us] [-p cpu,cpu]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (batch < 1 || count == 0 || rounds == 0 || wakeups == 0)
+    {
+        fprintf(stderr, "Batch, message and round trip counts must be positive\n");
+        return 1;
+    }
+
+    run_throughput(count, size, capacity, batch, cpu_p, cpu_c);
+    run_latency(rounds, cpu_p, cpu_c);
+    run_wakeup(wakeups, interval_us, cpu_p, cpu_c);
+    return 0;
+}
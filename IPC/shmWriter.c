@@ -1,76 +1,79 @@
-#include <fcntl.h>
+#include <getopt.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <unistd.h>
+
+#include "shm_ring.h"
 
 #define SHM_NAME "/my_shared_memory"
-#define SHM_SIZE 1024
+#define SHM_SIZE 65536  // Ring data area
+#define MAX_LINE 1024
 
-int   shm_fd;
-char *shm_ptr;
+SHM_RING ring;
 
 // Signal handler for cleanup
 void cleanup(int signum)
 {
     printf("\nWriter terminating. Cleaning up...\n");
-    if (munmap(shm_ptr, SHM_SIZE) == -1)
-    {
-        perror("munmap");
-    }
-    if (close(shm_fd) == -1)
-    {
-        perror("close");
-    }
-    if (shm_unlink(SHM_NAME) == -1)
-    {
-        perror("shm_unlink");
-    }
+    shm_ring_close(&ring);  // Also unlinks: the writer created the ring
     printf("Cleanup complete. Goodbye!\n");
     exit(0);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
-    // Set up signal handler
-    signal(SIGINT, cleanup);
+    size_t   size = SHM_SIZE;
+    uint32_t flags = 0;
+    int      opt;
 
-    // Create or open the shared memory object
-    shm_fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0666);
-    if (shm_fd == -1)
+    // Page backing for large rings: -H hugetlbfs, -T transparent huge pages,
+    // -p prefault, -l mlock, -s ring size in bytes
+    while ((opt = getopt(argc, argv, "HTpls:")) != -1)
     {
-        perror("shm_open");
-        exit(1);
+        switch (opt)
+        {
+            case 'H': flags |= SHM_RING_HUGETLB; break;
+            case 'T': flags |= SHM_RING_THP; break;
+            case 'p': flags |= SHM_RING_POPULATE; break;
+            case 'l': flags |= SHM_RING_MLOCK; break;
+            case 's': size = strtoull(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Usage: %s [-H] [-T] [-p] [-l] [-s ring_bytes]\n", argv[0]);
+                return 1;
+        }
     }
 
-    // Set the size of the shared memory object
-    if (ftruncate(shm_fd, SHM_SIZE) == -1)
-    {
-        perror("ftruncate");
-        exit(1);
-    }
+    // Set up signal handler
+    signal(SIGINT, cleanup);
 
-    // Map the shared memory object into the process's address space
-    shm_ptr = mmap(0, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
-    if (shm_ptr == MAP_FAILED)
+    // Create the ring in shared memory; every line becomes one record
+    if (shm_ring_create_ex(&ring, SHM_NAME, size, flags) != SHM_RING_SUCCESS)
     {
-        perror("mmap");
         exit(1);
     }
 
-    printf("Writer started. Enter text to write to shared memory.\n");
+    printf("Writer started (%u byte ring%s%s%s%s). Enter text to write to shared memory.\n", ring.hdr->capacity,
+           ring.flags & SHM_RING_HUGETLB ? ", hugetlbfs" : "", ring.flags & SHM_RING_THP ? ", THP" : "",
+           ring.flags & SHM_RING_POPULATE ? ", prefaulted" : "", ring.flags & SHM_RING_MLOCK ? ", locked" : "");
 
     while (1)
     {
-        char buffer[SHM_SIZE];
+        char buffer[MAX_LINE];
         printf("Enter text: ");
-        fgets(buffer, SHM_SIZE, stdin);
+        if (fgets(buffer, MAX_LINE, stdin) == NULL)
+        {
+            cleanup(0);
+        }
         buffer[strcspn(buffer, "\n")] = '\0';  // Remove newline
-        strncpy(shm_ptr, buffer, SHM_SIZE);
+
+        // Only the used length is copied; the reader sees each line exactly once
+        if (shm_ring_write(&ring, buffer, strlen(buffer) + 1) != SHM_RING_SUCCESS)
+        {
+            printf("Ring full, reader is not keeping up. Data dropped: %s\n", buffer);
+            continue;
+        }
         printf("Data written: %s\n", buffer);
-        sleep(1);  // Avoid excessive CPU usage
     }
 
     return 0;
@@ -0,0 +1,578 @@
+/**
+ * @file    shm_bcast.c
+ * @brief   Single-producer broadcast ring in POSIX shared memory: every consumer sees
+ *          every message, each at its own pace.
+ *
+ */
+
+#include "shm_bcast.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_BCAST_MAGIC 0x42434153u  // "BCAS"
+#define PROBE_MS        100          // How often a gated producer checks for dead consumers
+#define REAPING         ((pid_t)-1)  // Consumer pid while its slot is being freed
+
+typedef struct
+{
+    _Atomic uint64_t stamp;  // 2n+1 while message n is written, 2n+2 once published
+    uint32_t         len;
+    uint32_t         reserved;
+    uint8_t          data[];
+} SHM_BCAST_SLOT;
+
+static inline SHM_BCAST_SLOT *slot_at(const SHM_BCAST *b, uint64_t seq)
+{
+    return (SHM_BCAST_SLOT *)(b->slots + (seq & b->mask) * b->hdr->stride);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int map_ring(SHM_BCAST *b, size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, b->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return SHM_BCAST_ERROR;
+    }
+    b->hdr = (SHM_BCAST_HDR *)p;
+    b->slots = (uint8_t *)p + sizeof(SHM_BCAST_HDR);
+    b->map_size = size;
+    return SHM_BCAST_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) a named broadcast ring (producer side).
+ * @param[out] b Ring handle.
+ * @param[in] name POSIX shm name.
+ * @param[in] slots Number of messages kept; rounded up to a power of two.
+ * @param[in] slot_size Maximum message size in bytes.
+ * @return SHM_BCAST_SUCCESS on success, SHM_BCAST_ERROR on failure.
+ */
+int shm_bcast_create(SHM_BCAST *b, const char *name, uint32_t slots, uint32_t slot_size)
+{
+    uint32_t n = 2;
+    uint32_t stride = (sizeof(SHM_BCAST_SLOT) + slot_size + SHM_BCAST_CACHE_LINE - 1) & ~(uint32_t)(SHM_BCAST_CACHE_LINE - 1);
+    size_t   size;
+
+    while (n < slots && n < (1u << 30))
+    {
+        n <<= 1;
+    }
+    size = sizeof(SHM_BCAST_HDR) + (size_t)n * stride;
+
+    memset(b, 0, sizeof(*b));
+    snprintf(b->name, sizeof(b->name), "%s", name);
+
+    shm_unlink(name);  // Replace, never truncate: a process may still map the old segment
+    b->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (b->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_BCAST_ERROR;
+    }
+    if (ftruncate(b->fd, size) == -1)
+    {
+        perror("ftruncate");
+        close(b->fd);
+        return SHM_BCAST_ERROR;
+    }
+    if (map_ring(b, size) != SHM_BCAST_SUCCESS)
+    {
+        close(b->fd);
+        return SHM_BCAST_ERROR;
+    }
+
+    b->hdr->slots = n;
+    b->hdr->slot_size = slot_size;
+    b->hdr->stride = stride;
+    b->mask = n - 1;
+    shm_notify_init(&b->hdr->readable);
+    shm_notify_init(&b->hdr->writable);
+    atomic_thread_fence(memory_order_release);
+    b->hdr->magic = SHM_BCAST_MAGIC;
+
+    b->gate = UINT64_MAX;
+    b->owner = 1;
+    return SHM_BCAST_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open a ring created by the producer (consumer side).
+ * @param[out] b Ring handle.
+ * @param[in] name POSIX shm name.
+ * @return SHM_BCAST_SUCCESS on success, SHM_BCAST_ERROR on failure.
+ */
+int shm_bcast_open(SHM_BCAST *b, const char *name)
+{
+    struct stat st;
+
+    memset(b, 0, sizeof(*b));
+    snprintf(b->name, sizeof(b->name), "%s", name);
+
+    b->fd = shm_open(name, O_RDWR, 0666);
+    if (b->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_BCAST_ERROR;
+    }
+    if (fstat(b->fd, &st) == -1 || (size_t)st.st_size <= sizeof(SHM_BCAST_HDR) || map_ring(b, st.st_size) != SHM_BCAST_SUCCESS)
+    {
+        fprintf(stderr, "shm_bcast: cannot map %s\n", name);
+        close(b->fd);
+        return SHM_BCAST_ERROR;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (b->hdr->magic != SHM_BCAST_MAGIC || sizeof(SHM_BCAST_HDR) + (size_t)b->hdr->slots * b->hdr->stride != (size_t)st.st_size)
+    {
+        fprintf(stderr, "shm_bcast: %s is not an initialized ring\n", name);
+        munmap(b->hdr, b->map_size);
+        close(b->fd);
+        return SHM_BCAST_ERROR;
+    }
+    b->mask = b->hdr->slots - 1;
+    b->gate = UINT64_MAX;
+    return SHM_BCAST_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Unmap the ring. The creating process also unlinks the name.
+ * @param[in,out] b Ring handle.
+ */
+void shm_bcast_close(SHM_BCAST *b)
+{
+    shm_notify_poll_close(&b->poll);
+    if (b->hdr != NULL && munmap(b->hdr, b->map_size) == -1)
+    {
+        perror("munmap");
+    }
+    if (b->fd >= 0 && close(b->fd) == -1)
+    {
+        perror("close");
+    }
+    if (b->owner && shm_unlink(b->name) == -1)
+    {
+        perror("shm_unlink");
+    }
+    b->hdr = NULL;
+    b->fd = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Producer
+//-------------------------------------------------------------------------------------------------
+
+// Slowest gating cursor, UINT64_MAX if no consumer gates the producer
+static uint64_t min_gating(const SHM_BCAST *b)
+{
+    uint64_t min = UINT64_MAX;
+
+    for (int i = 0; i < SHM_BCAST_MAX_CONSUMERS; i++)
+    {
+        SHM_BCAST_CONSUMER *c = &b->hdr->consumers[i];
+        if (atomic_load_explicit(&c->active, memory_order_acquire) && c->gating)
+        {
+            uint64_t cur = atomic_load_explicit(&c->cursor, memory_order_acquire);
+            min = cur < min ? cur : min;
+        }
+    }
+    return min;
+}
+
+static int has_room(SHM_BCAST *b)
+{
+    uint32_t epoch = atomic_load(&b->hdr->epoch);
+
+    if (epoch != b->gate_epoch)
+    {
+        b->gate_epoch = epoch;
+        b->gate = min_gating(b);
+    }
+    if (b->gate != UINT64_MAX && b->head - b->gate >= b->hdr->slots)
+    {
+        b->gate = min_gating(b);  // Cached value is stale; look again before giving up
+        return b->gate == UINT64_MAX || b->head - b->gate < b->hdr->slots;
+    }
+    return 1;
+}
+
+// Free the slots of consumers, gating or lossy, whose process no longer exists. The pid
+// is swapped for REAPING first, so a slot is never freed under a consumer that just took it.
+static void reap_dead(SHM_BCAST *b)
+{
+    for (int i = 0; i < SHM_BCAST_MAX_CONSUMERS; i++)
+    {
+        SHM_BCAST_CONSUMER *c = &b->hdr->consumers[i];
+        pid_t               pid = atomic_load(&c->pid);
+
+        if (pid > 0 && kill(pid, 0) == -1 && errno == ESRCH && atomic_compare_exchange_strong(&c->pid, &pid, REAPING))
+        {
+            fprintf(stderr, "shm_bcast: %s consumer %d (pid %d) died, slot freed\n", c->gating ? "gating" : "lossy", i, (int)pid);
+            atomic_store(&c->active, 0);
+            atomic_fetch_add(&b->hdr->epoch, 1);
+            atomic_store(&c->pid, 0);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Publish one message to every consumer (single producer only).
+ * @param[in,out] b Ring handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size, at most slot_size.
+ * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN if a gating consumer is a full ring
+ *         behind, SHM_BCAST_ERROR if @p len is too large.
+ */
+int shm_bcast_publish(SHM_BCAST *b, const void *data, uint32_t len)
+{
+    uint64_t        seq = b->head;
+    SHM_BCAST_SLOT *slot = slot_at(b, seq);
+
+    if (len > b->hdr->slot_size)
+    {
+        return SHM_BCAST_ERROR;
+    }
+    if (!has_room(b))
+    {
+        return SHM_BCAST_AGAIN;
+    }
+
+    // Odd stamp first: a lossy reader still copying the old message will notice
+    atomic_store_explicit(&slot->stamp, 2 * seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->len = len;
+    memcpy(slot->data, data, len);
+    atomic_store_explicit(&slot->stamp, 2 * seq + 2, memory_order_release);
+
+    b->head = seq + 1;
+    atomic_store_explicit(&b->hdr->head, seq + 1, memory_order_release);
+    shm_notify_wake(&b->hdr->readable);
+    return SHM_BCAST_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Block until the next publish fits. Drops gating consumers whose process died.
+ * @param[in,out] b Ring handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN on timeout, SHM_BCAST_ERROR on failure.
+ */
+int shm_bcast_wait_writable(SHM_BCAST *b, int timeout_ms)
+{
+    SHM_NOTIFY *n = &b->hdr->writable;
+    int64_t     deadline = now_ms() + timeout_ms;
+
+    while (!has_room(b))
+    {
+        uint32_t seq = shm_notify_prepare(n);
+        int      remaining = timeout_ms < 0 ? PROBE_MS : (int)(deadline - now_ms());
+
+        if (has_room(b))
+        {
+            shm_notify_cancel(n);
+            break;
+        }
+        if (timeout_ms >= 0 && remaining <= 0)
+        {
+            shm_notify_cancel(n);
+            return SHM_BCAST_AGAIN;
+        }
+        int ret = shm_notify_wait(n, seq, remaining < PROBE_MS ? remaining : PROBE_MS);
+        if (ret == SHM_NOTIFY_ERROR)
+        {
+            return SHM_BCAST_ERROR;
+        }
+        if (ret == SHM_NOTIFY_TIMEOUT)
+        {
+            reap_dead(b);  // Nobody advanced for a while: maybe nobody can
+        }
+    }
+    return SHM_BCAST_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when a gating consumer
+ *        may have made room (producer side). Created on first use.
+ * @param[in,out] b Ring handle.
+ * @return Descriptor (closed by shm_bcast_close()), or -1 on failure.
+ */
+int shm_bcast_pollfd(SHM_BCAST *b)
+{
+    if (b->poll.id == 0)
+    {
+        if (shm_notify_poll_open(&b->poll) != SHM_NOTIFY_SUCCESS)
+        {
+            return -1;
+        }
+        if (shm_notify_poll_attach(&b->poll, &b->hdr->writable) != SHM_NOTIFY_SUCCESS)
+        {
+            shm_notify_poll_close(&b->poll);
+            return -1;
+        }
+    }
+    return b->poll.fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_bcast_publish() that drops dead gating consumers and arms the poll
+ *        descriptor before returning SHM_BCAST_AGAIN.
+ * @param[in,out] b Ring handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size, at most slot_size.
+ * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN if a gating consumer is a full ring
+ *         behind, SHM_BCAST_ERROR if @p len is too large.
+ */
+int shm_bcast_try_publish(SHM_BCAST *b, const void *data, uint32_t len)
+{
+    int ret = shm_bcast_publish(b, data, len);
+
+    if (ret == SHM_BCAST_AGAIN)
+    {
+        // No timed wait runs here to notice a dead consumer, so check on every stall
+        reap_dead(b);
+        if (b->poll.id != 0)
+        {
+            shm_notify_poll_arm(&b->poll);
+        }
+        ret = shm_bcast_publish(b, data, len);
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Consumers
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Register a consumer. It starts at the next message to be published.
+ * @param[in,out] b Ring handle.
+ * @param[out] sub Consumer handle.
+ * @param[in] gating Non-zero for backpressure, zero for a lossy consumer.
+ * @return SHM_BCAST_SUCCESS, or SHM_BCAST_ERROR if all consumer slots are taken.
+ */
+int shm_bcast_subscribe(SHM_BCAST *b, SHM_BCAST_SUB *sub, int gating)
+{
+    // A second pass runs after freeing the slots of consumers that died
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < SHM_BCAST_MAX_CONSUMERS; i++)
+        {
+            SHM_BCAST_CONSUMER *c = &b->hdr->consumers[i];
+            pid_t               expected = 0;
+
+            // The pid claims the slot; active publishes it to the producer once filled in
+            if (!atomic_compare_exchange_strong(&c->pid, &expected, getpid()))
+            {
+                continue;
+            }
+            sub->ring = b;
+            sub->index = i;
+            sub->poll.id = 0;
+            c->gating = gating != 0;
+            atomic_store(&c->lost, 0);
+            atomic_store(&c->cursor, atomic_load(&b->hdr->head));
+            atomic_store(&c->active, 1);
+            atomic_fetch_add(&b->hdr->epoch, 1);  // seq_cst: the head load below cannot move above it
+
+            // Only now does the producer see the consumer, so start from a head read after
+            // that: anything published before it could already be lapped. The earlier
+            // cursor only made the producer wait on a slightly older position meanwhile.
+            sub->cursor = atomic_load(&b->hdr->head);
+            atomic_store(&c->cursor, sub->cursor);
+            return SHM_BCAST_SUCCESS;
+        }
+        reap_dead(b);
+    }
+    fprintf(stderr, "shm_bcast: all %d consumer slots are taken\n", SHM_BCAST_MAX_CONSUMERS);
+    return SHM_BCAST_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Deregister a consumer; a gating consumer stops holding the producer back.
+ * @param[in,out] sub Consumer handle.
+ */
+void shm_bcast_unsubscribe(SHM_BCAST_SUB *sub)
+{
+    SHM_BCAST_CONSUMER *c = &sub->ring->hdr->consumers[sub->index];
+
+    shm_notify_poll_close(&sub->poll);
+    atomic_store(&c->active, 0);
+    atomic_fetch_add(&sub->ring->hdr->epoch, 1);
+    atomic_store(&c->pid, 0);
+    shm_notify_wake(&sub->ring->hdr->writable);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Copy the next message out of the ring.
+ * @param[in,out] sub Consumer handle.
+ * @param[out] buf Destination buffer.
+ * @param[in] size Size of @p buf.
+ * @param[out] len Payload size.
+ * @param[out] seq Sequence number of the message (may be NULL).
+ * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN if caught up, SHM_BCAST_OVERRUN if
+ *         messages were lost (nothing copied; *len holds how many; read again),
+ *         SHM_BCAST_ERROR if @p buf is too small.
+ */
+int shm_bcast_read(SHM_BCAST_SUB *sub, void *buf, uint32_t size, uint32_t *len, uint64_t *seq)
+{
+    SHM_BCAST          *b = sub->ring;
+    SHM_BCAST_CONSUMER *c = &b->hdr->consumers[sub->index];
+    uint64_t            s = sub->cursor;
+    SHM_BCAST_SLOT     *slot = slot_at(b, s);
+    uint64_t            want = 2 * s + 2;
+    uint64_t            stamp = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+
+    if (stamp < want)
+    {
+        return SHM_BCAST_AGAIN;  // Not published yet (2s+1: being written)
+    }
+    if (stamp == want)
+    {
+        uint32_t l = slot->len;
+
+        if (l <= size)
+        {
+            memcpy(buf, slot->data, l);
+        }
+        // Keep the copy above the re-check
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->stamp, memory_order_relaxed) == want)
+        {
+            *len = l;
+            if (l > size)
+            {
+                return SHM_BCAST_ERROR;
+            }
+            if (seq != NULL)
+            {
+                *seq = s;
+            }
+            sub->cursor = s + 1;
+            atomic_store_explicit(&c->cursor, s + 1, memory_order_release);
+            if (c->gating)
+            {
+                shm_notify_wake(&b->hdr->writable);
+            }
+            return SHM_BCAST_SUCCESS;
+        }
+    }
+
+    // Overwritten by a later lap: skip to the oldest message that is still intact (the
+    // slot at head - slots may be being rewritten right now)
+    uint64_t head = atomic_load_explicit(&b->hdr->head, memory_order_acquire);
+    uint64_t oldest = head + 1 > b->hdr->slots ? head + 1 - b->hdr->slots : 0;
+    uint64_t lost = oldest > s ? oldest - s : 1;
+
+    sub->cursor = s + lost;
+    atomic_store_explicit(&c->cursor, sub->cursor, memory_order_release);
+    atomic_fetch_add_explicit(&c->lost, lost, memory_order_relaxed);
+    *len = lost > UINT32_MAX ? UINT32_MAX : (uint32_t)lost;
+    return SHM_BCAST_OVERRUN;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Block until a message is available for this consumer.
+ * @param[in,out] sub Consumer handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN on timeout, SHM_BCAST_ERROR on failure.
+ */
+int shm_bcast_wait_readable(SHM_BCAST_SUB *sub, int timeout_ms)
+{
+    SHM_BCAST_HDR *hdr = sub->ring->hdr;
+    SHM_NOTIFY    *n = &hdr->readable;
+    int64_t        deadline = now_ms() + timeout_ms;
+
+    while (atomic_load_explicit(&hdr->head, memory_order_acquire) <= sub->cursor)
+    {
+        uint32_t seq = shm_notify_prepare(n);
+        int      remaining = timeout_ms < 0 ? -1 : (int)(deadline - now_ms());
+
+        if (atomic_load_explicit(&hdr->head, memory_order_acquire) > sub->cursor)
+        {
+            shm_notify_cancel(n);
+            break;
+        }
+        if (timeout_ms >= 0 && remaining <= 0)
+        {
+            shm_notify_cancel(n);
+            return SHM_BCAST_AGAIN;
+        }
+        if (shm_notify_wait(n, seq, remaining) == SHM_NOTIFY_ERROR)
+        {
+            return SHM_BCAST_ERROR;
+        }
+    }
+    return SHM_BCAST_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when a message may be
+ *        available for this consumer. Created on first use.
+ * @param[in,out] sub Consumer handle.
+ * @return Descriptor (closed by shm_bcast_unsubscribe()), or -1 on failure.
+ */
+int shm_bcast_sub_pollfd(SHM_BCAST_SUB *sub)
+{
+    if (sub->poll.id == 0)
+    {
+        if (shm_notify_poll_open(&sub->poll) != SHM_NOTIFY_SUCCESS)
+        {
+            return -1;
+        }
+        if (shm_notify_poll_attach(&sub->poll, &sub->ring->hdr->readable) != SHM_NOTIFY_SUCCESS)
+        {
+            shm_notify_poll_close(&sub->poll);
+            return -1;
+        }
+    }
+    return sub->poll.fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_bcast_read() that arms the poll descriptor before returning
+ *        SHM_BCAST_AGAIN.
+ * @param[in,out] sub Consumer handle.
+ * @param[out] buf Destination buffer.
+ * @param[in] size Size of @p buf.
+ * @param[out] len Payload size.
+ * @param[out] seq Sequence number of the message (may be NULL).
+ * @return As shm_bcast_read().
+ */
+int shm_bcast_try_read(SHM_BCAST_SUB *sub, void *buf, uint32_t size, uint32_t *len, uint64_t *seq)
+{
+    int ret = shm_bcast_read(sub, buf, size, len, seq);
+
+    if (ret == SHM_BCAST_AGAIN && sub->poll.id != 0)
+    {
+        shm_notify_poll_arm(&sub->poll);
+        ret = shm_bcast_read(sub, buf, size, len, seq);
+    }
+    return ret;
+}
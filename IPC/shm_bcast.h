@@ -0,0 +1,243 @@
+/**
+ * @file    shm_bcast.h
+ * @brief   Single-producer broadcast ring in POSIX shared memory: every consumer sees
+ *          every message, each at its own pace.
+ *
+ * Disruptor-style: the producer claims sequence numbers 0, 1, 2, ... and writes message
+ * n into slot n & mask. Nothing is removed by reading; each consumer keeps its own
+ * cursor (next sequence to read) in a per-consumer cache line in the header.
+ *
+ * Consumers subscribe as either
+ *   gating - the producer never overwrites a message this consumer has not read, so
+ *            the slowest gating consumer applies backpressure (publish returns AGAIN)
+ *   lossy  - never slows the producer; if it falls more than a ring behind, its next
+ *            read returns SHM_BCAST_OVERRUN with the number of messages it missed and
+ *            continues from the oldest message still in the ring
+ *
+ * Every slot carries a stamp: 2n+1 while message n is being written, 2n+2 once it is
+ * published. A reader copies the payload and re-checks the stamp, so a lossy reader
+ * that is overtaken mid-copy never returns a torn message.
+ *
+ * The producer caches the slowest gating cursor and only rescans the consumer table
+ * when the ring looks full or the set of gating consumers changed. A consumer that
+ * dies, gating or lossy, has its slot freed when the producer next waits for room, or
+ * when a subscribe finds every slot taken.
+ *
+ * For an event loop, shm_bcast_pollfd() (producer) and shm_bcast_sub_pollfd()
+ * (consumer) return descriptors that pair with shm_bcast_try_publish() and
+ * shm_bcast_try_read(); see shm_notify.h for how they are armed.
+ *
+ */
+
+#ifndef SHM_BCAST_H
+#define SHM_BCAST_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "shm_notify.h"
+
+/** Success return code */
+#define SHM_BCAST_SUCCESS 0
+/** Failure return code */
+#define SHM_BCAST_ERROR   1
+/** Ring full for a gating consumer (publish) or nothing new (read); try again later */
+#define SHM_BCAST_AGAIN   2
+/** Lossy consumer fell behind; messages were skipped */
+#define SHM_BCAST_OVERRUN 3
+
+#define SHM_BCAST_CACHE_LINE    64
+#define SHM_BCAST_NAME_MAX      64
+#define SHM_BCAST_MAX_CONSUMERS 32
+
+typedef struct
+{
+    alignas(SHM_BCAST_CACHE_LINE) _Atomic uint32_t active;
+    uint32_t         gating;  // Producer waits for this consumer
+    _Atomic pid_t    pid;
+    _Atomic uint64_t cursor;  // Next sequence this consumer will read
+    _Atomic uint64_t lost;    // Messages skipped after overruns
+} SHM_BCAST_CONSUMER;
+
+typedef struct
+{
+    alignas(SHM_BCAST_CACHE_LINE) uint32_t magic;
+    uint32_t slots;      // Power of two
+    uint32_t slot_size;  // Maximum payload per message
+    uint32_t stride;     // Bytes per slot, cache-line multiple
+
+    alignas(SHM_BCAST_CACHE_LINE) _Atomic uint64_t head;   // Next sequence to publish
+    alignas(SHM_BCAST_CACHE_LINE) _Atomic uint32_t epoch;  // Bumped when the gating set changes
+
+    alignas(SHM_BCAST_CACHE_LINE) SHM_NOTIFY readable;  // Consumers sleep here when caught up
+    alignas(SHM_BCAST_CACHE_LINE) SHM_NOTIFY writable;  // Producer sleeps here when gated
+
+    SHM_BCAST_CONSUMER consumers[SHM_BCAST_MAX_CONSUMERS];
+} SHM_BCAST_HDR;
+
+typedef struct
+{
+    SHM_BCAST_HDR  *hdr;
+    uint8_t        *slots;
+    uint64_t        mask;
+    uint64_t        head;        // Producer: next sequence
+    uint64_t        gate;        // Producer: cached slowest gating cursor (UINT64_MAX = none)
+    uint32_t        gate_epoch;  // Producer: epoch the cached gate was computed at
+    size_t          map_size;
+    int             fd;
+    int             owner;  // Created the segment; unlinks it on close
+    char            name[SHM_BCAST_NAME_MAX];
+    SHM_NOTIFY_POLL poll;   // Producer's event-loop poller, see shm_bcast_pollfd()
+} SHM_BCAST;
+
+typedef struct
+{
+    SHM_BCAST      *ring;
+    int             index;   // Slot in hdr->consumers
+    uint64_t        cursor;  // Next sequence to read
+    SHM_NOTIFY_POLL poll;    // Event-loop poller, see shm_bcast_sub_pollfd()
+} SHM_BCAST_SUB;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) a named broadcast ring (producer side).
+     * @param[out] b Ring handle.
+     * @param[in] name POSIX shm name.
+     * @param[in] slots Number of messages kept; rounded up to a power of two.
+     * @param[in] slot_size Maximum message size in bytes.
+     * @return SHM_BCAST_SUCCESS on success, SHM_BCAST_ERROR on failure.
+     */
+    int shm_bcast_create(SHM_BCAST *b, const char *name, uint32_t slots, uint32_t slot_size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open a ring created by the producer (consumer side).
+     * @param[out] b Ring handle.
+     * @param[in] name POSIX shm name.
+     * @return SHM_BCAST_SUCCESS on success, SHM_BCAST_ERROR on failure.
+     */
+    int shm_bcast_open(SHM_BCAST *b, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Unmap the ring. The creating process also unlinks the name.
+     * @param[in,out] b Ring handle.
+     */
+    void shm_bcast_close(SHM_BCAST *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Publish one message to every consumer (single producer only).
+     * @param[in,out] b Ring handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size, at most slot_size.
+     * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN if a gating consumer is a full ring
+     *         behind, SHM_BCAST_ERROR if @p len is too large.
+     */
+    int shm_bcast_publish(SHM_BCAST *b, const void *data, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Block until the next publish fits. Drops gating consumers whose process died.
+     * @param[in,out] b Ring handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN on timeout, SHM_BCAST_ERROR on failure.
+     */
+    int shm_bcast_wait_writable(SHM_BCAST *b, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when a gating consumer
+     *        may have made room (producer side). Created on first use.
+     * @param[in,out] b Ring handle.
+     * @return Descriptor (closed by shm_bcast_close()), or -1 on failure.
+     */
+    int shm_bcast_pollfd(SHM_BCAST *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_bcast_publish() that drops dead gating consumers and arms the poll
+     *        descriptor before returning SHM_BCAST_AGAIN.
+     * @param[in,out] b Ring handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size, at most slot_size.
+     * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN if a gating consumer is a full ring
+     *         behind, SHM_BCAST_ERROR if @p len is too large.
+     */
+    int shm_bcast_try_publish(SHM_BCAST *b, const void *data, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Register a consumer. It starts at the next message to be published.
+     * @param[in,out] b Ring handle.
+     * @param[out] sub Consumer handle.
+     * @param[in] gating Non-zero for backpressure, zero for a lossy consumer.
+     * @return SHM_BCAST_SUCCESS, or SHM_BCAST_ERROR if all consumer slots are taken.
+     */
+    int shm_bcast_subscribe(SHM_BCAST *b, SHM_BCAST_SUB *sub, int gating);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Deregister a consumer; a gating consumer stops holding the producer back.
+     * @param[in,out] sub Consumer handle.
+     */
+    void shm_bcast_unsubscribe(SHM_BCAST_SUB *sub);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Copy the next message out of the ring.
+     * @param[in,out] sub Consumer handle.
+     * @param[out] buf Destination buffer.
+     * @param[in] size Size of @p buf.
+     * @param[out] len Payload size.
+     * @param[out] seq Sequence number of the message (may be NULL).
+     * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN if caught up, SHM_BCAST_OVERRUN if
+     *         messages were lost (nothing copied; *len holds how many; read again),
+     *         SHM_BCAST_ERROR if @p buf is too small.
+     */
+    int shm_bcast_read(SHM_BCAST_SUB *sub, void *buf, uint32_t size, uint32_t *len, uint64_t *seq);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Block until a message is available for this consumer.
+     * @param[in,out] sub Consumer handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_BCAST_SUCCESS, SHM_BCAST_AGAIN on timeout, SHM_BCAST_ERROR on failure.
+     */
+    int shm_bcast_wait_readable(SHM_BCAST_SUB *sub, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when a message may be
+     *        available for this consumer. Created on first use.
+     * @param[in,out] sub Consumer handle.
+     * @return Descriptor (closed by shm_bcast_unsubscribe()), or -1 on failure.
+     */
+    int shm_bcast_sub_pollfd(SHM_BCAST_SUB *sub);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_bcast_read() that arms the poll descriptor before returning
+     *        SHM_BCAST_AGAIN.
+     * @param[in,out] sub Consumer handle.
+     * @param[out] buf Destination buffer.
+     * @param[in] size Size of @p buf.
+     * @param[out] len Payload size.
+     * @param[out] seq Sequence number of the message (may be NULL).
+     * @return As shm_bcast_read().
+     */
+    int shm_bcast_try_read(SHM_BCAST_SUB *sub, void *buf, uint32_t size, uint32_t *len, uint64_t *seq);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_BCAST_H
@@ -0,0 +1,630 @@
+/**
+ * @file    shm_config.c
+ * @brief   Shared configuration snapshot: one publisher, any number of lock-free readers.
+ *
+ */
+
+#define _GNU_SOURCE  // qsort_r
+
+#include "shm_config.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_CONFIG_MAGIC 0x43464731u  // "CFG1"
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint8_t *slot_at(const SHM_CONFIG *cfg, uint64_t generation)
+{
+    return cfg->slots + (generation & 1) * cfg->hdr->slot_size;
+}
+
+static int map_config(SHM_CONFIG *cfg, size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cfg->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return SHM_CONFIG_ERROR;
+    }
+    cfg->hdr = (SHM_CONFIG_HDR *)p;
+    cfg->slots = (uint8_t *)p + sizeof(SHM_CONFIG_HDR);
+    cfg->map_size = size;
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) a named config segment with an empty snapshot.
+ * @param[out] cfg Config handle.
+ * @param[in] name POSIX shm name, e.g. "/app_config".
+ * @param[in] slot_size Largest snapshot in bytes.
+ * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on failure.
+ */
+int shm_config_create(SHM_CONFIG *cfg, const char *name, size_t slot_size)
+{
+    SHM_CONFIG_SNAP empty = {0, sizeof(SHM_CONFIG_SNAP), 0, now_ns()};
+    size_t          slot = (slot_size + SHM_CONFIG_CACHE_LINE - 1) & ~(size_t)(SHM_CONFIG_CACHE_LINE - 1);
+    size_t          size;
+
+    if (slot < sizeof(SHM_CONFIG_SNAP) || slot > UINT32_MAX)
+    {
+        fprintf(stderr, "shm_config: bad slot size %zu\n", slot_size);
+        return SHM_CONFIG_ERROR;
+    }
+    size = sizeof(SHM_CONFIG_HDR) + 2 * slot;
+
+    memset(cfg, 0, sizeof(*cfg));
+    snprintf(cfg->name, sizeof(cfg->name), "%s", name);
+
+    shm_unlink(name);  // Replace, never truncate: a process may still map the old segment
+    cfg->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (cfg->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_CONFIG_ERROR;
+    }
+    if (ftruncate(cfg->fd, size) == -1)
+    {
+        perror("ftruncate");
+        close(cfg->fd);
+        return SHM_CONFIG_ERROR;
+    }
+    if (map_config(cfg, size) != SHM_CONFIG_SUCCESS)
+    {
+        close(cfg->fd);
+        return SHM_CONFIG_ERROR;
+    }
+
+    cfg->hdr->slot_size = (uint32_t)slot;
+    atomic_store_explicit(&cfg->hdr->generation, 0, memory_order_relaxed);
+    shm_notify_init(&cfg->hdr->changed);
+    shm_seqlock_init(&cfg->hdr->slot_seq[0]);
+    shm_seqlock_init(&cfg->hdr->slot_seq[1]);
+    memcpy(slot_at(cfg, 0), &empty, sizeof(empty));
+    atomic_thread_fence(memory_order_release);
+    cfg->hdr->magic = SHM_CONFIG_MAGIC;
+
+    cfg->owner = 1;
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open a config segment created by the publisher.
+ * @param[out] cfg Config handle.
+ * @param[in] name POSIX shm name.
+ * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on failure.
+ */
+int shm_config_open(SHM_CONFIG *cfg, const char *name)
+{
+    struct stat st;
+
+    memset(cfg, 0, sizeof(*cfg));
+    snprintf(cfg->name, sizeof(cfg->name), "%s", name);
+
+    cfg->fd = shm_open(name, O_RDWR, 0666);
+    if (cfg->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_CONFIG_ERROR;
+    }
+    if (fstat(cfg->fd, &st) == -1 || (size_t)st.st_size <= sizeof(SHM_CONFIG_HDR))
+    {
+        fprintf(stderr, "shm_config: %s is not a config segment\n", name);
+        close(cfg->fd);
+        return SHM_CONFIG_ERROR;
+    }
+    if (map_config(cfg, st.st_size) != SHM_CONFIG_SUCCESS)
+    {
+        close(cfg->fd);
+        return SHM_CONFIG_ERROR;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (cfg->hdr->magic != SHM_CONFIG_MAGIC || sizeof(SHM_CONFIG_HDR) + 2 * (size_t)cfg->hdr->slot_size > cfg->map_size)
+    {
+        fprintf(stderr, "shm_config: %s is not initialized\n", name);
+        munmap(cfg->hdr, cfg->map_size);
+        close(cfg->fd);
+        return SHM_CONFIG_ERROR;
+    }
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Unmap the segment; the creator also unlinks it.
+ * @param[in,out] cfg Config handle.
+ */
+void shm_config_close(SHM_CONFIG *cfg)
+{
+    shm_notify_poll_close(&cfg->poll);
+    if (cfg->hdr != NULL)
+    {
+        munmap(cfg->hdr, cfg->map_size);
+        cfg->hdr = NULL;
+    }
+    if (cfg->fd >= 0)
+    {
+        close(cfg->fd);
+        cfg->fd = -1;
+    }
+    if (cfg->owner)
+    {
+        shm_unlink(cfg->name);
+        cfg->owner = 0;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Publisher
+//-------------------------------------------------------------------------------------------------
+
+// Copy a string into the pool; returns its pool offset or -1
+static int64_t pool_add(SHM_CONFIG_BUILDER *b, const char *s)
+{
+    size_t len = strlen(s) + 1;
+
+    if (b->pool_used + len > b->pool_cap)
+    {
+        size_t cap = b->pool_cap ? b->pool_cap : 1024;
+        while (cap < b->pool_used + len)
+        {
+            cap *= 2;
+        }
+        char *pool = realloc(b->pool, cap);
+        if (pool == NULL)
+        {
+            return -1;
+        }
+        b->pool = pool;
+        b->pool_cap = cap;
+    }
+    memcpy(b->pool + b->pool_used, s, len);
+    b->pool_used += len;
+    return (int64_t)(b->pool_used - len);
+}
+
+static int cmp_entry(const void *a, const void *b, void *pool)
+{
+    return strcmp((const char *)pool + ((const SHM_CONFIG_ENTRY *)a)->key, (const char *)pool + ((const SHM_CONFIG_ENTRY *)b)->key);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Start an empty entry list.
+ * @param[out] b Builder.
+ */
+void shm_config_builder_init(SHM_CONFIG_BUILDER *b)
+{
+    memset(b, 0, sizeof(*b));
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Add one entry.
+ * @param[in,out] b Builder.
+ * @param[in] key Dotted key.
+ * @param[in] type Value type.
+ * @param[in] i Value for SHM_CONFIG_INT / SHM_CONFIG_BOOL.
+ * @param[in] d Value for SHM_CONFIG_DOUBLE.
+ * @param[in] s Value for SHM_CONFIG_STRING (NULL otherwise).
+ * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on allocation failure.
+ */
+int shm_config_builder_add(SHM_CONFIG_BUILDER *b, const char *key, SHM_CONFIG_TYPE_E type, int64_t i, double d, const char *s)
+{
+    SHM_CONFIG_ENTRY e;
+    int64_t          off;
+
+    if (b->count == b->cap)
+    {
+        size_t            cap = b->cap ? b->cap * 2 : 64;
+        SHM_CONFIG_ENTRY *entries = realloc(b->entries, cap * sizeof(SHM_CONFIG_ENTRY));
+        if (entries == NULL)
+        {
+            return SHM_CONFIG_ERROR;
+        }
+        b->entries = entries;
+        b->cap = cap;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.type = type;
+    if ((off = pool_add(b, key)) < 0)
+    {
+        return SHM_CONFIG_ERROR;
+    }
+    e.key = (uint32_t)off;
+    switch (type)
+    {
+        case SHM_CONFIG_INT:
+        case SHM_CONFIG_BOOL:
+            e.v.i = i;
+            break;
+        case SHM_CONFIG_DOUBLE:
+            e.v.d = d;
+            break;
+        case SHM_CONFIG_STRING:
+            if ((off = pool_add(b, s != NULL ? s : "")) < 0)
+            {
+                return SHM_CONFIG_ERROR;
+            }
+            e.v.s.off = (uint32_t)off;
+            e.v.s.len = (uint32_t)strlen(b->pool + off);
+            break;
+        default:
+            break;
+    }
+    b->entries[b->count++] = e;
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Drop all entries and free the builder's memory.
+ * @param[in,out] b Builder.
+ */
+void shm_config_builder_free(SHM_CONFIG_BUILDER *b)
+{
+    free(b->entries);
+    free(b->pool);
+    memset(b, 0, sizeof(*b));
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Publish the builder's entries as the next snapshot (single publisher only).
+ * @param[in,out] cfg Config handle.
+ * @param[in,out] b Builder; its entries are sorted in place.
+ * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR if the snapshot does not fit
+ *         or a key appears twice.
+ */
+int shm_config_publish(SHM_CONFIG *cfg, SHM_CONFIG_BUILDER *b)
+{
+    size_t          base = sizeof(SHM_CONFIG_SNAP) + b->count * sizeof(SHM_CONFIG_ENTRY);
+    size_t          bytes = base + b->pool_used;
+    uint64_t        next = atomic_load_explicit(&cfg->hdr->generation, memory_order_relaxed) + 1;
+    SHM_SEQLOCK    *seq = &cfg->hdr->slot_seq[next & 1];
+    uint8_t        *slot = slot_at(cfg, next);
+    SHM_CONFIG_SNAP snap;
+
+    if (bytes > cfg->hdr->slot_size)
+    {
+        fprintf(stderr, "shm_config: snapshot of %zu bytes exceeds the %u byte slot\n", bytes, cfg->hdr->slot_size);
+        return SHM_CONFIG_ERROR;
+    }
+    if (b->count > 1)
+    {
+        qsort_r(b->entries, b->count, sizeof(SHM_CONFIG_ENTRY), cmp_entry, b->pool);
+    }
+    for (size_t i = 1; i < b->count; i++)
+    {
+        if (cmp_entry(&b->entries[i - 1], &b->entries[i], b->pool) == 0)
+        {
+            fprintf(stderr, "shm_config: duplicate key %s\n", b->pool + b->entries[i].key);
+            return SHM_CONFIG_ERROR;
+        }
+    }
+
+    snap.count = (uint32_t)b->count;
+    snap.bytes = (uint32_t)bytes;
+    snap.generation = next;
+    snap.published_ns = now_ns();
+
+    // Readers of the current snapshot use the other slot; this seqlock only catches a
+    // reader that is still copying the snapshot before it
+    shm_seqlock_write_begin(seq);
+    memcpy(slot, &snap, sizeof(snap));
+    for (size_t i = 0; i < b->count; i++)
+    {
+        SHM_CONFIG_ENTRY e = b->entries[i];
+        e.key += (uint32_t)base;
+        if (e.type == SHM_CONFIG_STRING)
+        {
+            e.v.s.off += (uint32_t)base;
+        }
+        memcpy(slot + sizeof(SHM_CONFIG_SNAP) + i * sizeof(SHM_CONFIG_ENTRY), &e, sizeof(e));
+    }
+    memcpy(slot + base, b->pool, b->pool_used);
+    shm_seqlock_write_end(seq);
+
+    atomic_store_explicit(&cfg->hdr->generation, next, memory_order_release);
+    shm_notify_wake(&cfg->hdr->changed);
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Readers
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Current generation (one atomic load).
+ * @param[in] cfg Config handle.
+ * @return Generation; 0 until the first publish.
+ */
+uint64_t shm_config_generation(const SHM_CONFIG *cfg)
+{
+    return atomic_load_explicit(&cfg->hdr->generation, memory_order_acquire);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Sleep until the generation differs from @p generation.
+ * @param[in,out] cfg Config handle.
+ * @param[in] generation Generation the caller already has.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_CONFIG_SUCCESS on a new snapshot, SHM_CONFIG_AGAIN on timeout,
+ *         SHM_CONFIG_ERROR on failure.
+ */
+int shm_config_wait(SHM_CONFIG *cfg, uint64_t generation, int timeout_ms)
+{
+    SHM_NOTIFY *n = &cfg->hdr->changed;
+    int64_t     deadline = (int64_t)(now_ns() / 1000000) + timeout_ms;
+
+    while (shm_config_generation(cfg) == generation)
+    {
+        uint32_t seq = shm_notify_prepare(n);
+        int      remaining = timeout_ms < 0 ? -1 : (int)(deadline - (int64_t)(now_ns() / 1000000));
+
+        if (shm_config_generation(cfg) != generation)
+        {
+            shm_notify_cancel(n);
+            break;
+        }
+        if (timeout_ms >= 0 && remaining <= 0)
+        {
+            shm_notify_cancel(n);
+            return SHM_CONFIG_AGAIN;
+        }
+        if (shm_notify_wait(n, seq, remaining) == SHM_NOTIFY_ERROR)
+        {
+            return SHM_CONFIG_ERROR;
+        }
+    }
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Allocate a private view sized for the segment's slots.
+ * @param[in] cfg Config handle.
+ * @param[out] view View.
+ * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on allocation failure.
+ */
+int shm_config_view_init(const SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view)
+{
+    memset(view, 0, sizeof(*view));
+    view->size = cfg->hdr->slot_size;
+    view->buf = malloc(view->size);
+    if (view->buf == NULL)
+    {
+        perror("malloc");
+        return SHM_CONFIG_ERROR;
+    }
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Free a view.
+ * @param[in,out] view View.
+ */
+void shm_config_view_free(SHM_CONFIG_VIEW *view)
+{
+    free(view->buf);
+    memset(view, 0, sizeof(*view));
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Bring the view up to the current snapshot.
+ * @param[in] cfg Config handle.
+ * @param[in,out] view View.
+ * @return 1 if the view changed, 0 if it was already current.
+ */
+int shm_config_refresh(const SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view)
+{
+    for (;;)
+    {
+        uint64_t        gen = shm_config_generation(cfg);
+        SHM_SEQLOCK    *seq = &cfg->hdr->slot_seq[gen & 1];
+        const uint8_t  *slot = slot_at(cfg, gen);
+        SHM_CONFIG_SNAP snap;
+
+        if (view->valid && gen == view->generation)
+        {
+            return 0;
+        }
+
+        uint32_t s = shm_seqlock_read_begin(seq);
+        memcpy(&snap, slot, sizeof(snap));
+        if (snap.bytes < sizeof(SHM_CONFIG_SNAP) || snap.bytes > view->size)
+        {
+            snap.bytes = sizeof(SHM_CONFIG_SNAP);  // Torn header; the retry below catches it
+        }
+        memcpy(view->buf, slot, snap.bytes);
+        if (shm_seqlock_read_retry(seq, s))
+        {
+            continue;
+        }
+
+        // The slot may already hold a newer snapshot than gen; it is consistent either way
+        memcpy(&snap, view->buf, sizeof(snap));
+        if (snap.bytes < sizeof(SHM_CONFIG_SNAP) + (size_t)snap.count * sizeof(SHM_CONFIG_ENTRY))
+        {
+            fprintf(stderr, "shm_config: malformed snapshot %llu\n", (unsigned long long)snap.generation);
+            snap.count = 0;
+            memcpy(view->buf, &snap, sizeof(snap));
+        }
+        view->generation = snap.generation;
+        view->valid = 1;
+        return 1;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when a new snapshot may
+ *        have been published. Created on first use.
+ * @param[in,out] cfg Config handle.
+ * @return Descriptor (closed by shm_config_close()), or -1 on failure.
+ */
+int shm_config_pollfd(SHM_CONFIG *cfg)
+{
+    if (cfg->poll.id == 0)
+    {
+        if (shm_notify_poll_open(&cfg->poll) != SHM_NOTIFY_SUCCESS)
+        {
+            return -1;
+        }
+        if (shm_notify_poll_attach(&cfg->poll, &cfg->hdr->changed) != SHM_NOTIFY_SUCCESS)
+        {
+            shm_notify_poll_close(&cfg->poll);
+            return -1;
+        }
+    }
+    return cfg->poll.fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_config_refresh() that arms the poll descriptor when the view is current.
+ * @param[in,out] cfg Config handle.
+ * @param[in,out] view View.
+ * @return 1 if the view changed, 0 if it was already current.
+ */
+int shm_config_try_refresh(SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view)
+{
+    int changed = shm_config_refresh(cfg, view);
+
+    if (!changed && cfg->poll.id != 0)
+    {
+        shm_notify_poll_arm(&cfg->poll);
+        changed = shm_config_refresh(cfg, view);
+    }
+    return changed;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Find an entry in the view.
+ * @param[in] view View.
+ * @param[in] key Dotted key.
+ * @return Entry, or NULL if the key is absent.
+ */
+const SHM_CONFIG_ENTRY *shm_config_find(const SHM_CONFIG_VIEW *view, const char *key)
+{
+    const SHM_CONFIG_SNAP  *snap = (const SHM_CONFIG_SNAP *)view->buf;
+    const SHM_CONFIG_ENTRY *entries = (const SHM_CONFIG_ENTRY *)(view->buf + sizeof(SHM_CONFIG_SNAP));
+    size_t                  lo = 0, hi;
+
+    if (!view->valid)
+    {
+        return NULL;
+    }
+    hi = snap->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int    c = strcmp(key, (const char *)view->buf + entries[mid].key);
+        if (c == 0)
+        {
+            return &entries[mid];
+        }
+        if (c < 0)
+        {
+            hi = mid;
+        }
+        else
+        {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get an integer (or boolean) value.
+ * @param[in] view View.
+ * @param[in] key Dotted key.
+ * @param[out] val Value.
+ * @return SHM_CONFIG_SUCCESS, or SHM_CONFIG_ERROR if missing or of another type.
+ */
+int shm_config_get_int(const SHM_CONFIG_VIEW *view, const char *key, int64_t *val)
+{
+    const SHM_CONFIG_ENTRY *e = shm_config_find(view, key);
+
+    if (e == NULL || (e->type != SHM_CONFIG_INT && e->type != SHM_CONFIG_BOOL))
+    {
+        return SHM_CONFIG_ERROR;
+    }
+    *val = e->v.i;
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a floating-point value (integers are converted).
+ * @param[in] view View.
+ * @param[in] key Dotted key.
+ * @param[out] val Value.
+ * @return SHM_CONFIG_SUCCESS, or SHM_CONFIG_ERROR if missing or of another type.
+ */
+int shm_config_get_double(const SHM_CONFIG_VIEW *view, const char *key, double *val)
+{
+    const SHM_CONFIG_ENTRY *e = shm_config_find(view, key);
+
+    if (e == NULL || (e->type != SHM_CONFIG_DOUBLE && e->type != SHM_CONFIG_INT))
+    {
+        return SHM_CONFIG_ERROR;
+    }
+    *val = e->type == SHM_CONFIG_DOUBLE ? e->v.d : (double)e->v.i;
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a string value.
+ * @param[in] view View.
+ * @param[in] key Dotted key.
+ * @param[out] val NUL-terminated value, valid until the next refresh of @p view.
+ * @return SHM_CONFIG_SUCCESS, or SHM_CONFIG_ERROR if missing or of another type.
+ */
+int shm_config_get_string(const SHM_CONFIG_VIEW *view, const char *key, const char **val)
+{
+    const SHM_CONFIG_ENTRY *e = shm_config_find(view, key);
+
+    if (e == NULL || e->type != SHM_CONFIG_STRING)
+    {
+        return SHM_CONFIG_ERROR;
+    }
+    *val = (const char *)view->buf + e->v.s.off;
+    return SHM_CONFIG_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Key of an entry.
+ * @param[in] view View.
+ * @param[in] e Entry of @p view.
+ * @return NUL-terminated key.
+ */
+const char *shm_config_key(const SHM_CONFIG_VIEW *view, const SHM_CONFIG_ENTRY *e)
+{
+    return (const char *)view->buf + e->key;
+}
@@ -0,0 +1,297 @@
+/**
+ * @file    shm_config.h
+ * @brief   Shared configuration snapshot: one publisher, any number of lock-free readers.
+ *
+ * The publisher flattens its configuration into typed key/value entries ("camera.0.url"
+ * -> string) and publishes them as one binary snapshot: a header, an entry table sorted
+ * by key, then a string pool. The segment holds two snapshot slots, each guarded by a
+ * seqlock (shm_sync.h). Publish n is written into slot n & 1 and then made current by
+ * bumping the generation, so readers of the previous snapshot are never disturbed by
+ * the next update. A reader only retries if two updates land while it is copying.
+ *
+ * Readers keep a private SHM_CONFIG_VIEW:
+ *   - shm_config_refresh() costs one atomic load when nothing changed, and a memcpy of
+ *     the used bytes when it did.
+ *   - Lookups are a binary search over the private copy.
+ * No locks, no system calls and no file I/O on the read path. shm_config_wait() sleeps
+ * on a futex until the next publish, for readers that prefer to block; an event loop
+ * registers shm_config_pollfd() and calls shm_config_try_refresh() when it fires.
+ *
+ */
+
+#ifndef SHM_CONFIG_H
+#define SHM_CONFIG_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shm_notify.h"
+#include "shm_sync.h"
+
+/** Success return code */
+#define SHM_CONFIG_SUCCESS 0
+/** Failure return code (also: key not found or of another type) */
+#define SHM_CONFIG_ERROR   1
+/** Wait timed out with no new snapshot */
+#define SHM_CONFIG_AGAIN   2
+
+#define SHM_CONFIG_CACHE_LINE 64
+#define SHM_CONFIG_NAME_MAX   64
+
+typedef enum
+{
+    SHM_CONFIG_INT = 1,
+    SHM_CONFIG_BOOL,
+    SHM_CONFIG_DOUBLE,
+    SHM_CONFIG_STRING,
+    SHM_CONFIG_NULL
+} SHM_CONFIG_TYPE_E;
+
+typedef struct
+{
+    uint32_t key;   // Offset of the NUL-terminated key from the snapshot start
+    uint32_t type;  // SHM_CONFIG_TYPE_E
+    union
+    {
+        int64_t i;  // INT and BOOL
+        double  d;
+        struct
+        {
+            uint32_t off;  // NUL-terminated, from the snapshot start
+            uint32_t len;
+        } s;
+    } v;
+} SHM_CONFIG_ENTRY;
+
+typedef struct
+{
+    uint32_t count;         // Entries, sorted by key
+    uint32_t bytes;         // Used bytes including this header
+    uint64_t generation;
+    uint64_t published_ns;  // CLOCK_MONOTONIC time of the publish
+} SHM_CONFIG_SNAP;
+
+typedef struct
+{
+    alignas(SHM_CONFIG_CACHE_LINE) uint32_t magic;
+    uint32_t slot_size;
+
+    alignas(SHM_CONFIG_CACHE_LINE) _Atomic uint64_t generation;  // Current slot is generation & 1
+    SHM_NOTIFY  changed;
+    SHM_SEQLOCK slot_seq[2];
+} SHM_CONFIG_HDR;
+
+typedef struct
+{
+    SHM_CONFIG_HDR *hdr;
+    uint8_t        *slots;
+    size_t          map_size;
+    int             fd;
+    int             owner;  // Created the segment; unlinks it on close
+    char            name[SHM_CONFIG_NAME_MAX];
+    SHM_NOTIFY_POLL poll;   // Event-loop poller, see shm_config_pollfd()
+} SHM_CONFIG;
+
+// Publisher-side list of entries, serialized by shm_config_publish()
+typedef struct
+{
+    SHM_CONFIG_ENTRY *entries;  // String offsets point into pool until published
+    size_t            count, cap;
+    char             *pool;
+    size_t            pool_used, pool_cap;
+} SHM_CONFIG_BUILDER;
+
+// Reader-side private copy of the current snapshot
+typedef struct
+{
+    uint8_t  *buf;
+    size_t    size;
+    uint64_t  generation;
+    int       valid;
+} SHM_CONFIG_VIEW;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) a named config segment with an empty snapshot.
+     * @param[out] cfg Config handle.
+     * @param[in] name POSIX shm name, e.g. "/app_config".
+     * @param[in] slot_size Largest snapshot in bytes.
+     * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on failure.
+     */
+    int shm_config_create(SHM_CONFIG *cfg, const char *name, size_t slot_size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open a config segment created by the publisher.
+     * @param[out] cfg Config handle.
+     * @param[in] name POSIX shm name.
+     * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on failure.
+     */
+    int shm_config_open(SHM_CONFIG *cfg, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Unmap the segment; the creator also unlinks it.
+     * @param[in,out] cfg Config handle.
+     */
+    void shm_config_close(SHM_CONFIG *cfg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Start an empty entry list.
+     * @param[out] b Builder.
+     */
+    void shm_config_builder_init(SHM_CONFIG_BUILDER *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Add one entry.
+     * @param[in,out] b Builder.
+     * @param[in] key Dotted key.
+     * @param[in] type Value type.
+     * @param[in] i Value for SHM_CONFIG_INT / SHM_CONFIG_BOOL.
+     * @param[in] d Value for SHM_CONFIG_DOUBLE.
+     * @param[in] s Value for SHM_CONFIG_STRING (NULL otherwise).
+     * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on allocation failure.
+     */
+    int shm_config_builder_add(SHM_CONFIG_BUILDER *b, const char *key, SHM_CONFIG_TYPE_E type, int64_t i, double d, const char *s);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Drop all entries and free the builder's memory.
+     * @param[in,out] b Builder.
+     */
+    void shm_config_builder_free(SHM_CONFIG_BUILDER *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Publish the builder's entries as the next snapshot (single publisher only).
+     * @param[in,out] cfg Config handle.
+     * @param[in,out] b Builder; its entries are sorted in place.
+     * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR if the snapshot does not fit
+     *         or a key appears twice.
+     */
+    int shm_config_publish(SHM_CONFIG *cfg, SHM_CONFIG_BUILDER *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Current generation (one atomic load).
+     * @param[in] cfg Config handle.
+     * @return Generation; 0 until the first publish.
+     */
+    uint64_t shm_config_generation(const SHM_CONFIG *cfg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Sleep until the generation differs from @p generation.
+     * @param[in,out] cfg Config handle.
+     * @param[in] generation Generation the caller already has.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_CONFIG_SUCCESS on a new snapshot, SHM_CONFIG_AGAIN on timeout,
+     *         SHM_CONFIG_ERROR on failure.
+     */
+    int shm_config_wait(SHM_CONFIG *cfg, uint64_t generation, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Allocate a private view sized for the segment's slots.
+     * @param[in] cfg Config handle.
+     * @param[out] view View.
+     * @return SHM_CONFIG_SUCCESS on success, SHM_CONFIG_ERROR on allocation failure.
+     */
+    int shm_config_view_init(const SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Free a view.
+     * @param[in,out] view View.
+     */
+    void shm_config_view_free(SHM_CONFIG_VIEW *view);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Bring the view up to the current snapshot.
+     * @param[in] cfg Config handle.
+     * @param[in,out] view View.
+     * @return 1 if the view changed, 0 if it was already current.
+     */
+    int shm_config_refresh(const SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when a new snapshot may
+     *        have been published. Created on first use.
+     * @param[in,out] cfg Config handle.
+     * @return Descriptor (closed by shm_config_close()), or -1 on failure.
+     */
+    int shm_config_pollfd(SHM_CONFIG *cfg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_config_refresh() that arms the poll descriptor when the view is current.
+     * @param[in,out] cfg Config handle.
+     * @param[in,out] view View.
+     * @return 1 if the view changed, 0 if it was already current.
+     */
+    int shm_config_try_refresh(SHM_CONFIG *cfg, SHM_CONFIG_VIEW *view);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Find an entry in the view.
+     * @param[in] view View.
+     * @param[in] key Dotted key.
+     * @return Entry, or NULL if the key is absent.
+     */
+    const SHM_CONFIG_ENTRY *shm_config_find(const SHM_CONFIG_VIEW *view, const char *key);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get an integer (or boolean) value.
+     * @param[in] view View.
+     * @param[in] key Dotted key.
+     * @param[out] val Value.
+     * @return SHM_CONFIG_SUCCESS, or SHM_CONFIG_ERROR if missing or of another type.
+     */
+    int shm_config_get_int(const SHM_CONFIG_VIEW *view, const char *key, int64_t *val);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a floating-point value (integers are converted).
+     * @param[in] view View.
+     * @param[in] key Dotted key.
+     * @param[out] val Value.
+     * @return SHM_CONFIG_SUCCESS, or SHM_CONFIG_ERROR if missing or of another type.
+     */
+    int shm_config_get_double(const SHM_CONFIG_VIEW *view, const char *key, double *val);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a string value.
+     * @param[in] view View.
+     * @param[in] key Dotted key.
+     * @param[out] val NUL-terminated value, valid until the next refresh of @p view.
+     * @return SHM_CONFIG_SUCCESS, or SHM_CONFIG_ERROR if missing or of another type.
+     */
+    int shm_config_get_string(const SHM_CONFIG_VIEW *view, const char *key, const char **val);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Key of an entry.
+     * @param[in] view View.
+     * @param[in] e Entry of @p view.
+     * @return NUL-terminated key.
+     */
+    const char *shm_config_key(const SHM_CONFIG_VIEW *view, const SHM_CONFIG_ENTRY *e);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_CONFIG_H
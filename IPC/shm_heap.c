@@ -0,0 +1,497 @@
+/**
+ * @file    shm_heap.c
+ * @brief   Variable-size allocator inside a POSIX shared memory segment, addressed by
+ *          offsets so linked structures work in every process that maps it.
+ *
+ */
+
+#include "shm_heap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_HEAP_MAGIC   0x48454150u  // "HEAP"
+#define ATTACH_WAIT_MS   1000         // How long attach waits for a racing creator
+#define MAX_SEGMENT_SIZE ((uint64_t)SHM_HEAP_ALIGN << 32)
+
+// Size classes: 16, 32, then 48 * 2^k and 64 * 2^k up to 64 KB
+static uint32_t class_size(int c)
+{
+    if (c < 2)
+    {
+        return 16u << c;
+    }
+    return ((c & 1) ? 64u : 48u) << ((c - 2) / 2);
+}
+
+static int class_of(size_t size)
+{
+    if (size <= 32)
+    {
+        return size <= 16 ? 0 : 1;
+    }
+    // size is in (2^(p-1), 2^p]: either 3 * 2^(p-2) or 2^p
+    int p = 64 - __builtin_clzll(size - 1);
+    return size <= (3ull << (p - 2)) ? 2 * p - 10 : 2 * p - 9;
+}
+
+static inline uint32_t *link_of(const SHM_HEAP *h, uint32_t index)
+{
+    return (uint32_t *)(h->base + (size_t)index * SHM_HEAP_ALIGN);
+}
+
+static int map_heap(SHM_HEAP *h, size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, h->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return SHM_HEAP_ERROR;
+    }
+    h->hdr = (SHM_HEAP_HDR *)p;
+    h->base = (uint8_t *)p;
+    h->map_size = size;
+    return SHM_HEAP_SUCCESS;
+}
+
+// Lay out and initialize a freshly truncated segment; the magic goes in last
+static int init_heap(SHM_HEAP *h, size_t size)
+{
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t slabs = (size - sizeof(SHM_HEAP_HDR)) / (SHM_HEAP_SLAB_SIZE + 1);
+    uint64_t arena;
+
+    // The slab table grows with the slab count; drop slabs until table + arena fit
+    for (;;)
+    {
+        arena = (sizeof(SHM_HEAP_HDR) + slabs + page - 1) & ~(page - 1);
+        if (slabs == 0 || arena + slabs * SHM_HEAP_SLAB_SIZE <= size)
+        {
+            break;
+        }
+        slabs--;
+    }
+    if (slabs == 0)
+    {
+        fprintf(stderr, "shm_heap: %zu bytes is too small for one slab\n", size);
+        return SHM_HEAP_ERROR;
+    }
+
+    h->hdr->slab_count = (uint32_t)slabs;
+    h->hdr->size = size;
+    h->hdr->arena = arena;
+    atomic_store_explicit(&h->hdr->slabs_used, 0, memory_order_relaxed);
+    atomic_store_explicit(&h->hdr->root, 0, memory_order_relaxed);
+    for (int c = 0; c < SHM_HEAP_CLASSES; c++)
+    {
+        atomic_store_explicit(&h->hdr->classes[c].head, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->hdr->classes[c].in_use, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->hdr->classes[c].slabs, 0, memory_order_relaxed);
+        h->hdr->classes[c].size = class_size(c);
+    }
+    memset(h->hdr->slab_class, 0, slabs);
+    atomic_thread_fence(memory_order_release);
+    h->hdr->magic = SHM_HEAP_MAGIC;
+    return SHM_HEAP_SUCCESS;
+}
+
+// Map an existing segment; wait_ms > 0 tolerates a creator that is still initializing
+static int open_heap(SHM_HEAP *h, const char *name, int wait_ms)
+{
+    struct stat     st;
+    struct timespec pause = {0, 1000000};
+
+    h->fd = shm_open(name, O_RDWR, 0666);
+    if (h->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_HEAP_ERROR;
+    }
+    for (int waited = 0;; waited++)
+    {
+        if (fstat(h->fd, &st) == -1)
+        {
+            perror("fstat");
+            close(h->fd);
+            return SHM_HEAP_ERROR;
+        }
+        if ((size_t)st.st_size > sizeof(SHM_HEAP_HDR) || waited >= wait_ms)
+        {
+            break;
+        }
+        nanosleep(&pause, NULL);
+    }
+    if ((size_t)st.st_size <= sizeof(SHM_HEAP_HDR) || map_heap(h, st.st_size) != SHM_HEAP_SUCCESS)
+    {
+        fprintf(stderr, "shm_heap: %s is not a heap segment\n", name);
+        close(h->fd);
+        return SHM_HEAP_ERROR;
+    }
+    for (int waited = 0; *(volatile uint32_t *)&h->hdr->magic != SHM_HEAP_MAGIC && waited < wait_ms; waited++)
+    {
+        nanosleep(&pause, NULL);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (h->hdr->magic != SHM_HEAP_MAGIC || h->hdr->size != (uint64_t)st.st_size)
+    {
+        fprintf(stderr, "shm_heap: %s is not an initialized heap (creator died? unlink it)\n", name);
+        munmap(h->hdr, h->map_size);
+        close(h->fd);
+        return SHM_HEAP_ERROR;
+    }
+    return SHM_HEAP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) a named heap segment.
+ * @param[out] h Heap handle.
+ * @param[in] name POSIX shm name.
+ * @param[in] size Segment size in bytes (at most 64 GB).
+ * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+ */
+int shm_heap_create(SHM_HEAP *h, const char *name, size_t size)
+{
+    memset(h, 0, sizeof(*h));
+    snprintf(h->name, sizeof(h->name), "%s", name);
+
+    if (size > MAX_SEGMENT_SIZE)
+    {
+        fprintf(stderr, "shm_heap: segment larger than %llu bytes\n", (unsigned long long)MAX_SEGMENT_SIZE);
+        return SHM_HEAP_ERROR;
+    }
+    shm_unlink(name);  // Replace, never truncate: a process may still map the old segment
+    h->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (h->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_HEAP_ERROR;
+    }
+    if (ftruncate(h->fd, size) == -1)
+    {
+        perror("ftruncate");
+        close(h->fd);
+        return SHM_HEAP_ERROR;
+    }
+    if (size <= sizeof(SHM_HEAP_HDR) || map_heap(h, size) != SHM_HEAP_SUCCESS || init_heap(h, size) != SHM_HEAP_SUCCESS)
+    {
+        if (h->hdr != NULL)
+        {
+            munmap(h->hdr, h->map_size);
+        }
+        close(h->fd);
+        shm_unlink(name);
+        return SHM_HEAP_ERROR;
+    }
+    h->owner = 1;
+    return SHM_HEAP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open an existing heap segment.
+ * @param[out] h Heap handle.
+ * @param[in] name POSIX shm name.
+ * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+ */
+int shm_heap_open(SHM_HEAP *h, const char *name)
+{
+    memset(h, 0, sizeof(*h));
+    snprintf(h->name, sizeof(h->name), "%s", name);
+    return open_heap(h, name, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open the heap if it exists, otherwise create it. Safe when several processes
+ *        race to attach; exactly one initializes. The segment outlives every process
+ *        (remove it with shm_heap_unlink()).
+ * @param[out] h Heap handle.
+ * @param[in] name POSIX shm name.
+ * @param[in] size Segment size used when creating.
+ * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+ */
+int shm_heap_attach(SHM_HEAP *h, const char *name, size_t size)
+{
+    memset(h, 0, sizeof(*h));
+    snprintf(h->name, sizeof(h->name), "%s", name);
+
+    if (size > MAX_SEGMENT_SIZE || size <= sizeof(SHM_HEAP_HDR))
+    {
+        fprintf(stderr, "shm_heap: bad segment size %zu\n", size);
+        return SHM_HEAP_ERROR;
+    }
+    // O_EXCL picks the one process that initializes; everyone else waits for its magic
+    h->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (h->fd == -1)
+    {
+        if (errno != EEXIST)
+        {
+            perror("shm_open");
+            return SHM_HEAP_ERROR;
+        }
+        return open_heap(h, name, ATTACH_WAIT_MS);
+    }
+    if (ftruncate(h->fd, size) == -1 || map_heap(h, size) != SHM_HEAP_SUCCESS || init_heap(h, size) != SHM_HEAP_SUCCESS)
+    {
+        if (h->hdr != NULL)
+        {
+            munmap(h->hdr, h->map_size);
+        }
+        close(h->fd);
+        shm_unlink(name);
+        return SHM_HEAP_ERROR;
+    }
+    return SHM_HEAP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Unmap the heap. A heap made by shm_heap_create() is also unlinked.
+ * @param[in,out] h Heap handle.
+ */
+void shm_heap_close(SHM_HEAP *h)
+{
+    if (h->hdr != NULL && munmap(h->hdr, h->map_size) == -1)
+    {
+        perror("munmap");
+    }
+    if (h->fd >= 0 && close(h->fd) == -1)
+    {
+        perror("close");
+    }
+    if (h->owner && shm_unlink(h->name) == -1)
+    {
+        perror("shm_unlink");
+    }
+    h->hdr = NULL;
+    h->base = NULL;
+    h->fd = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Remove a heap segment name; mapped processes keep their mapping.
+ * @param[in] name POSIX shm name.
+ * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+ */
+int shm_heap_unlink(const char *name)
+{
+    if (shm_unlink(name) == -1)
+    {
+        perror("shm_unlink");
+        return SHM_HEAP_ERROR;
+    }
+    return SHM_HEAP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Allocation
+//-------------------------------------------------------------------------------------------------
+
+// Claim the next unused slab for class c, split it into blocks and splice the chain onto
+// the class's free list with one CAS
+static int refill(SHM_HEAP *h, int c)
+{
+    SHM_HEAP_HDR   *hdr = h->hdr;
+    SHM_HEAP_CLASS *cl = &hdr->classes[c];
+    uint32_t        slab = atomic_load_explicit(&hdr->slabs_used, memory_order_relaxed);
+
+    do
+    {
+        if (slab >= hdr->slab_count)
+        {
+            return SHM_HEAP_ERROR;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&hdr->slabs_used, &slab, slab + 1, memory_order_relaxed, memory_order_relaxed));
+
+    uint32_t size = cl->size;
+    uint32_t units = size / SHM_HEAP_ALIGN;
+    uint32_t count = SHM_HEAP_SLAB_SIZE / size;
+    uint32_t first = (uint32_t)((hdr->arena + (uint64_t)slab * SHM_HEAP_SLAB_SIZE) / SHM_HEAP_ALIGN);
+    uint32_t last = first + (count - 1) * units;
+
+    __atomic_store_n(&hdr->slab_class[slab], (uint8_t)(c + 1), __ATOMIC_RELAXED);
+    for (uint32_t i = first; i < last; i += units)
+    {
+        *link_of(h, i) = i + units;
+    }
+
+    // The release CAS publishes the links and the slab's class together
+    uint64_t head = atomic_load_explicit(&cl->head, memory_order_relaxed);
+    do
+    {
+        *link_of(h, last) = (uint32_t)head;
+    } while (!atomic_compare_exchange_weak_explicit(&cl->head, &head, (((head >> 32) + 1) << 32) | first, memory_order_release, memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&cl->slabs, 1, memory_order_relaxed);
+    return SHM_HEAP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Allocate a block of at least @p size bytes, 16-byte aligned.
+ * @param[in] h Heap handle.
+ * @param[in] size Bytes needed, 1 to SHM_HEAP_MAX_ALLOC.
+ * @return Offset of the block, or 0 if the size is invalid or the heap is full.
+ */
+SHM_OFF shm_heap_alloc(SHM_HEAP *h, size_t size)
+{
+    if (size == 0 || size > SHM_HEAP_MAX_ALLOC)
+    {
+        return 0;
+    }
+
+    SHM_HEAP_CLASS *cl = &h->hdr->classes[class_of(size)];
+    uint64_t        head = atomic_load_explicit(&cl->head, memory_order_acquire);
+
+    for (;;)
+    {
+        uint32_t index = (uint32_t)head;
+
+        if (index == 0)
+        {
+            if (refill(h, (int)(cl - h->hdr->classes)) != SHM_HEAP_SUCCESS)
+            {
+                // Another process may have refilled or freed meanwhile
+                head = atomic_load_explicit(&cl->head, memory_order_acquire);
+                if ((uint32_t)head == 0)
+                {
+                    return 0;
+                }
+                continue;
+            }
+            head = atomic_load_explicit(&cl->head, memory_order_acquire);
+            continue;
+        }
+
+        // The block may already be someone else's; a stale link just fails the CAS
+        uint32_t next = __atomic_load_n(link_of(h, index), __ATOMIC_RELAXED);
+        uint64_t want = (((head >> 32) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&cl->head, &head, want, memory_order_acquire, memory_order_acquire))
+        {
+            atomic_fetch_add_explicit(&cl->in_use, 1, memory_order_relaxed);
+            return (SHM_OFF)index * SHM_HEAP_ALIGN;
+        }
+    }
+}
+
+// Class of the block at off, or -1 if off is not a block start in an assigned slab
+static int block_class(const SHM_HEAP *h, SHM_OFF off)
+{
+    const SHM_HEAP_HDR *hdr = h->hdr;
+
+    if (off < hdr->arena || off >= hdr->arena + (uint64_t)hdr->slab_count * SHM_HEAP_SLAB_SIZE)
+    {
+        return -1;
+    }
+    uint64_t rel = off - hdr->arena;
+    int      c = __atomic_load_n(&hdr->slab_class[rel / SHM_HEAP_SLAB_SIZE], __ATOMIC_RELAXED) - 1;
+
+    if (c < 0 || (rel % SHM_HEAP_SLAB_SIZE) % hdr->classes[c].size != 0)
+    {
+        return -1;
+    }
+    return c;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Return a block to its size class. Freeing 0 does nothing.
+ * @param[in] h Heap handle.
+ * @param[in] off Offset from shm_heap_alloc().
+ * @return SHM_HEAP_SUCCESS, or SHM_HEAP_ERROR if @p off is not a block start.
+ */
+int shm_heap_free(SHM_HEAP *h, SHM_OFF off)
+{
+    if (off == 0)
+    {
+        return SHM_HEAP_SUCCESS;
+    }
+
+    int c = block_class(h, off);
+    if (c < 0)
+    {
+        fprintf(stderr, "shm_heap: free of %llu, not an allocated block\n", (unsigned long long)off);
+        return SHM_HEAP_ERROR;
+    }
+
+    SHM_HEAP_CLASS *cl = &h->hdr->classes[c];
+    uint32_t        index = (uint32_t)(off / SHM_HEAP_ALIGN);
+    uint64_t        head = atomic_load_explicit(&cl->head, memory_order_relaxed);
+
+    do
+    {
+        __atomic_store_n(link_of(h, index), (uint32_t)head, __ATOMIC_RELAXED);
+    } while (!atomic_compare_exchange_weak_explicit(&cl->head, &head, (((head >> 32) + 1) << 32) | index, memory_order_release, memory_order_relaxed));
+
+    atomic_fetch_sub_explicit(&cl->in_use, 1, memory_order_relaxed);
+    return SHM_HEAP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Usable size of an allocated block (its class size).
+ * @param[in] h Heap handle.
+ * @param[in] off Offset from shm_heap_alloc().
+ * @return Block size in bytes, or 0 if @p off is not in an assigned slab.
+ */
+size_t shm_heap_usable_size(const SHM_HEAP *h, SHM_OFF off)
+{
+    int c = block_class(h, off);
+    return c < 0 ? 0 : h->hdr->classes[c].size;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get the application's root object, the entry point other processes look up.
+ * @param[in] h Heap handle.
+ * @return Root offset, or 0 if none was set.
+ */
+SHM_OFF shm_heap_root(const SHM_HEAP *h)
+{
+    return atomic_load_explicit(&h->hdr->root, memory_order_acquire);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Set the root object if it is still @p expected (compare-and-swap), so racing
+ *        processes agree on a single root.
+ * @param[in] h Heap handle.
+ * @param[in] expected Root the caller last saw, usually 0.
+ * @param[in] root New root.
+ * @return SHM_HEAP_SUCCESS if installed, SHM_HEAP_ERROR if another root was there.
+ */
+int shm_heap_set_root(SHM_HEAP *h, SHM_OFF expected, SHM_OFF root)
+{
+    return atomic_compare_exchange_strong_explicit(&h->hdr->root, &expected, root, memory_order_acq_rel, memory_order_acquire) ? SHM_HEAP_SUCCESS
+                                                                                                                               : SHM_HEAP_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Snapshot the slab and per-class usage counters.
+ * @param[in] h Heap handle.
+ * @param[out] stats Counters.
+ */
+void shm_heap_stats(const SHM_HEAP *h, SHM_HEAP_STATS *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->slabs_total = h->hdr->slab_count;
+    stats->slabs_used = atomic_load(&h->hdr->slabs_used);
+    for (int c = 0; c < SHM_HEAP_CLASSES; c++)
+    {
+        const SHM_HEAP_CLASS *cl = &h->hdr->classes[c];
+
+        stats->classes[c].size = cl->size;
+        stats->classes[c].slabs = atomic_load(&cl->slabs);
+        stats->classes[c].in_use = atomic_load(&cl->in_use);
+        stats->bytes_in_use += stats->classes[c].in_use * cl->size;
+    }
+}
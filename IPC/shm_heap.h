@@ -0,0 +1,232 @@
+/**
+ * @file    shm_heap.h
+ * @brief   Variable-size allocator inside a POSIX shared memory segment, addressed by
+ *          offsets so linked structures work in every process that maps it.
+ *
+ * Each process may map the segment at a different address, so shared structures store
+ * SHM_OFF values (byte offsets from the segment start, 0 = null) instead of pointers and
+ * convert with shm_heap_ptr() / shm_heap_off() on access.
+ *
+ * Memory is carved into 64 KB slabs. A slab is assigned to one size class the first time
+ * that class runs dry and is split into equal blocks (16, 32, 48, 64, 96, 128, ... 64 KB:
+ * powers of two and the midpoints between them). Each class keeps a lock-free LIFO free
+ * list; alloc and free are one compare-and-swap on the class's list head, so allocation
+ * takes nanoseconds and never enters the kernel.
+ *
+ * The list head is tagged: 32 bits of block index (in 16-byte units) and a 32-bit counter
+ * bumped on every change. A pop that read a stale next link therefore fails its CAS
+ * instead of corrupting the list (the ABA problem).
+ *
+ * Crash safety: every change to the allocator state is a single atomic operation, so a
+ * process killed at any instruction leaves the free lists and slab table consistent. The
+ * worst case is a leak: blocks the dead process held, or one slab it was carving.
+ * Slabs stay with their class once assigned; freed blocks return to that class only.
+ *
+ * The heap does not lock the structures built in it; protect those with shm_sync.h.
+ *
+ */
+
+#ifndef SHM_HEAP_H
+#define SHM_HEAP_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Success return code */
+#define SHM_HEAP_SUCCESS 0
+/** Failure return code */
+#define SHM_HEAP_ERROR   1
+
+#define SHM_HEAP_CACHE_LINE 64
+#define SHM_HEAP_NAME_MAX   64
+/** Block alignment and the unit of free-list indices */
+#define SHM_HEAP_ALIGN      16
+/** Slab size, also the largest allocation */
+#define SHM_HEAP_SLAB_SIZE  (64 * 1024)
+#define SHM_HEAP_MAX_ALLOC  SHM_HEAP_SLAB_SIZE
+#define SHM_HEAP_CLASSES    24
+
+/** Offset of an object from the segment start; 0 is the null offset */
+typedef uint64_t SHM_OFF;
+
+typedef struct
+{
+    alignas(SHM_HEAP_CACHE_LINE) _Atomic uint64_t head;  // Tag << 32 | block index (0 = empty)
+    _Atomic uint64_t in_use;                             // Allocated blocks (statistics)
+    _Atomic uint32_t slabs;                              // Slabs assigned to this class
+    uint32_t         size;                               // Block size in bytes
+} SHM_HEAP_CLASS;
+
+typedef struct
+{
+    alignas(SHM_HEAP_CACHE_LINE) uint32_t magic;
+    uint32_t slab_count;  // Slabs in the arena
+    uint64_t size;        // Segment size in bytes
+    uint64_t arena;       // Offset of slab 0
+
+    alignas(SHM_HEAP_CACHE_LINE) _Atomic uint32_t slabs_used;  // Bump index of the next free slab
+    _Atomic SHM_OFF root;                                      // Application's top-level object
+
+    SHM_HEAP_CLASS classes[SHM_HEAP_CLASSES];
+    uint8_t        slab_class[];  // Per slab: class index + 1, 0 while unassigned
+} SHM_HEAP_HDR;
+
+typedef struct
+{
+    SHM_HEAP_HDR *hdr;
+    uint8_t      *base;
+    size_t        map_size;
+    int           fd;
+    int           owner;  // Created the segment and unlinks it on close
+    char          name[SHM_HEAP_NAME_MAX];
+} SHM_HEAP;
+
+typedef struct
+{
+    uint32_t slabs_total;
+    uint32_t slabs_used;
+    uint64_t bytes_in_use;  // Sum of block sizes handed out
+    struct
+    {
+        uint32_t size;
+        uint32_t slabs;
+        uint64_t in_use;
+    } classes[SHM_HEAP_CLASSES];
+} SHM_HEAP_STATS;
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Convert an offset to a pointer in this process.
+ * @param[in] h Heap handle.
+ * @param[in] off Offset from shm_heap_alloc(), or 0.
+ * @return Pointer, or NULL for the null offset.
+ */
+static inline void *shm_heap_ptr(const SHM_HEAP *h, SHM_OFF off)
+{
+    return off ? h->base + off : NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Convert a pointer into the segment back to an offset.
+ * @param[in] h Heap handle.
+ * @param[in] p Pointer into the segment, or NULL.
+ * @return Offset, or 0 for NULL.
+ */
+static inline SHM_OFF shm_heap_off(const SHM_HEAP *h, const void *p)
+{
+    return p ? (SHM_OFF)((const uint8_t *)p - h->base) : 0;
+}
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) a named heap segment.
+     * @param[out] h Heap handle.
+     * @param[in] name POSIX shm name.
+     * @param[in] size Segment size in bytes (at most 64 GB).
+     * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+     */
+    int shm_heap_create(SHM_HEAP *h, const char *name, size_t size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open an existing heap segment.
+     * @param[out] h Heap handle.
+     * @param[in] name POSIX shm name.
+     * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+     */
+    int shm_heap_open(SHM_HEAP *h, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open the heap if it exists, otherwise create it. Safe when several processes
+     *        race to attach; exactly one initializes. The segment outlives every process
+     *        (remove it with shm_heap_unlink()).
+     * @param[out] h Heap handle.
+     * @param[in] name POSIX shm name.
+     * @param[in] size Segment size used when creating.
+     * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+     */
+    int shm_heap_attach(SHM_HEAP *h, const char *name, size_t size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Unmap the heap. A heap made by shm_heap_create() is also unlinked.
+     * @param[in,out] h Heap handle.
+     */
+    void shm_heap_close(SHM_HEAP *h);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Remove a heap segment name; mapped processes keep their mapping.
+     * @param[in] name POSIX shm name.
+     * @return SHM_HEAP_SUCCESS on success, SHM_HEAP_ERROR on failure.
+     */
+    int shm_heap_unlink(const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Allocate a block of at least @p size bytes, 16-byte aligned.
+     * @param[in] h Heap handle.
+     * @param[in] size Bytes needed, 1 to SHM_HEAP_MAX_ALLOC.
+     * @return Offset of the block, or 0 if the size is invalid or the heap is full.
+     */
+    SHM_OFF shm_heap_alloc(SHM_HEAP *h, size_t size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Return a block to its size class. Freeing 0 does nothing.
+     * @param[in] h Heap handle.
+     * @param[in] off Offset from shm_heap_alloc().
+     * @return SHM_HEAP_SUCCESS, or SHM_HEAP_ERROR if @p off is not a block start.
+     */
+    int shm_heap_free(SHM_HEAP *h, SHM_OFF off);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Usable size of an allocated block (its class size).
+     * @param[in] h Heap handle.
+     * @param[in] off Offset from shm_heap_alloc().
+     * @return Block size in bytes, or 0 if @p off is not in an assigned slab.
+     */
+    size_t shm_heap_usable_size(const SHM_HEAP *h, SHM_OFF off);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get the application's root object, the entry point other processes look up.
+     * @param[in] h Heap handle.
+     * @return Root offset, or 0 if none was set.
+     */
+    SHM_OFF shm_heap_root(const SHM_HEAP *h);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Set the root object if it is still @p expected (compare-and-swap), so racing
+     *        processes agree on a single root.
+     * @param[in] h Heap handle.
+     * @param[in] expected Root the caller last saw, usually 0.
+     * @param[in] root New root.
+     * @return SHM_HEAP_SUCCESS if installed, SHM_HEAP_ERROR if another root was there.
+     */
+    int shm_heap_set_root(SHM_HEAP *h, SHM_OFF expected, SHM_OFF root);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Snapshot the slab and per-class usage counters.
+     * @param[in] h Heap handle.
+     * @param[out] stats Counters.
+     */
+    void shm_heap_stats(const SHM_HEAP *h, SHM_HEAP_STATS *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_HEAP_H
@@ -0,0 +1,492 @@
+/**
+ * @file    shm_mpmc.c
+ * @brief   Bounded multi-producer/multi-consumer queue in POSIX shared memory.
+ *
+ */
+
+#include "shm_mpmc.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_MPMC_MAGIC 0x4D504D43u  // "MPMC"
+
+typedef struct
+{
+    _Atomic uint64_t seq;
+    uint32_t         len;
+    uint32_t         reserved;
+    uint8_t          data[];
+} SHM_MPMC_SLOT;
+
+static inline SHM_MPMC_SLOT *slot_at(const SHM_MPMC *q, uint64_t pos)
+{
+    return (SHM_MPMC_SLOT *)(q->slots + (pos & q->mask) * q->hdr->stride);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int map_queue(SHM_MPMC *q, size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, q->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return SHM_MPMC_ERROR;
+    }
+    q->hdr = (SHM_MPMC_HDR *)p;
+    q->slots = (uint8_t *)p + sizeof(SHM_MPMC_HDR);
+    q->map_size = size;
+    return SHM_MPMC_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) a named queue.
+ * @param[out] q Queue handle.
+ * @param[in] name POSIX shm name.
+ * @param[in] slots Number of slots; rounded up to a power of two.
+ * @param[in] slot_size Maximum message size in bytes.
+ * @return SHM_MPMC_SUCCESS on success, SHM_MPMC_ERROR on failure.
+ */
+int shm_mpmc_create(SHM_MPMC *q, const char *name, uint32_t slots, uint32_t slot_size)
+{
+    uint32_t n = 2;
+    uint32_t stride = (sizeof(SHM_MPMC_SLOT) + slot_size + SHM_MPMC_CACHE_LINE - 1) & ~(uint32_t)(SHM_MPMC_CACHE_LINE - 1);
+    size_t   size;
+
+    while (n < slots && n < (1u << 30))
+    {
+        n <<= 1;
+    }
+    size = sizeof(SHM_MPMC_HDR) + (size_t)n * stride;
+
+    memset(q, 0, sizeof(*q));
+    snprintf(q->name, sizeof(q->name), "%s", name);
+
+    shm_unlink(name);  // Replace, never truncate: a process may still map the old segment
+    q->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (q->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_MPMC_ERROR;
+    }
+    if (ftruncate(q->fd, size) == -1)
+    {
+        perror("ftruncate");
+        close(q->fd);
+        return SHM_MPMC_ERROR;
+    }
+    if (map_queue(q, size) != SHM_MPMC_SUCCESS)
+    {
+        close(q->fd);
+        return SHM_MPMC_ERROR;
+    }
+
+    q->hdr->slots = n;
+    q->hdr->slot_size = slot_size;
+    q->hdr->stride = stride;
+    q->mask = n - 1;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        atomic_store_explicit(&slot_at(q, i)->seq, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&q->hdr->enqueue_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->hdr->dequeue_pos, 0, memory_order_relaxed);
+    shm_notify_init(&q->hdr->readable);
+    shm_notify_init(&q->hdr->writable);
+    atomic_thread_fence(memory_order_release);
+    q->hdr->magic = SHM_MPMC_MAGIC;
+
+    q->owner = 1;
+    return SHM_MPMC_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open a queue created by another process.
+ * @param[out] q Queue handle.
+ * @param[in] name POSIX shm name.
+ * @return SHM_MPMC_SUCCESS on success, SHM_MPMC_ERROR on failure.
+ */
+int shm_mpmc_open(SHM_MPMC *q, const char *name)
+{
+    struct stat st;
+
+    memset(q, 0, sizeof(*q));
+    snprintf(q->name, sizeof(q->name), "%s", name);
+
+    q->fd = shm_open(name, O_RDWR, 0666);
+    if (q->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_MPMC_ERROR;
+    }
+    if (fstat(q->fd, &st) == -1 || (size_t)st.st_size <= sizeof(SHM_MPMC_HDR) || map_queue(q, st.st_size) != SHM_MPMC_SUCCESS)
+    {
+        fprintf(stderr, "shm_mpmc: cannot map %s\n", name);
+        close(q->fd);
+        return SHM_MPMC_ERROR;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (q->hdr->magic != SHM_MPMC_MAGIC || sizeof(SHM_MPMC_HDR) + (size_t)q->hdr->slots * q->hdr->stride != (size_t)st.st_size)
+    {
+        fprintf(stderr, "shm_mpmc: %s is not an initialized queue\n", name);
+        munmap(q->hdr, q->map_size);
+        close(q->fd);
+        return SHM_MPMC_ERROR;
+    }
+    q->mask = q->hdr->slots - 1;
+    return SHM_MPMC_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Unmap the queue. The creating process also unlinks the name.
+ * @param[in,out] q Queue handle.
+ */
+void shm_mpmc_close(SHM_MPMC *q)
+{
+    shm_notify_poll_close(&q->poll);
+    if (q->hdr != NULL && munmap(q->hdr, q->map_size) == -1)
+    {
+        perror("munmap");
+    }
+    if (q->fd >= 0 && close(q->fd) == -1)
+    {
+        perror("close");
+    }
+    if (q->owner && shm_unlink(q->name) == -1)
+    {
+        perror("shm_unlink");
+    }
+    q->hdr = NULL;
+    q->fd = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Enqueue one message.
+ * @param[in,out] q Queue handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size, at most the slot size.
+ * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN if full, SHM_MPMC_ERROR if len is too large.
+ */
+int shm_mpmc_enqueue(SHM_MPMC *q, const void *data, uint32_t len)
+{
+    uint64_t       pos = atomic_load_explicit(&q->hdr->enqueue_pos, memory_order_relaxed);
+    SHM_MPMC_SLOT *slot;
+
+    if (len > q->hdr->slot_size)
+    {
+        return SHM_MPMC_ERROR;
+    }
+
+    for (;;)
+    {
+        slot = slot_at(q, pos);
+        int64_t diff = (int64_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&q->hdr->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return SHM_MPMC_AGAIN;  // Slot still holds the message from one lap ago
+        }
+        else
+        {
+            pos = atomic_load_explicit(&q->hdr->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->len = len;
+    memcpy(slot->data, data, len);
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    shm_notify_wake(&q->hdr->readable);
+    return SHM_MPMC_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Dequeue one message.
+ * @param[in,out] q Queue handle.
+ * @param[out] buf Destination; must hold the slot size.
+ * @param[out] len Payload size.
+ * @return SHM_MPMC_SUCCESS or SHM_MPMC_AGAIN if empty.
+ */
+int shm_mpmc_dequeue(SHM_MPMC *q, void *buf, uint32_t *len)
+{
+    uint64_t       pos = atomic_load_explicit(&q->hdr->dequeue_pos, memory_order_relaxed);
+    SHM_MPMC_SLOT *slot;
+
+    for (;;)
+    {
+        slot = slot_at(q, pos);
+        int64_t diff = (int64_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - (pos + 1));
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&q->hdr->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return SHM_MPMC_AGAIN;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&q->hdr->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    *len = slot->len;
+    memcpy(buf, slot->data, slot->len);
+    atomic_store_explicit(&slot->seq, pos + q->mask + 1, memory_order_release);
+    shm_notify_wake(&q->hdr->writable);
+    return SHM_MPMC_SUCCESS;
+}
+
+// Claim up to n consecutive slots whose sequence equals position + offset. Slots that
+// pass the check stay in that state until the position CAS, since only the side that
+// owns the position can change them. Returns the claimed count and the first position.
+static size_t claim(SHM_MPMC *q, _Atomic uint64_t *position, uint64_t offset, size_t n, uint64_t *first)
+{
+    uint64_t pos = atomic_load_explicit(position, memory_order_relaxed);
+
+    for (;;)
+    {
+        size_t k = 0;
+
+        while (k < n && atomic_load_explicit(&slot_at(q, pos + k)->seq, memory_order_acquire) == pos + k + offset)
+        {
+            k++;
+        }
+        if (k == 0)
+        {
+            int64_t diff = (int64_t)(atomic_load_explicit(&slot_at(q, pos)->seq, memory_order_acquire) - (pos + offset));
+            if (diff < 0)
+            {
+                return 0;
+            }
+            pos = atomic_load_explicit(position, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(position, &pos, pos + k, memory_order_relaxed, memory_order_relaxed))
+        {
+            *first = pos;
+            return k;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Enqueue up to @p n messages with one position update.
+ * @param[in,out] q Queue handle.
+ * @param[in] msgs First message; message i starts at msgs + i * stride.
+ * @param[in] stride Distance between messages in @p msgs.
+ * @param[in] lens Payload size of each message, each at most the slot size.
+ * @param[in] n Number of messages.
+ * @return Number of messages enqueued (0 if full), in order from the first.
+ */
+size_t shm_mpmc_enqueue_batch(SHM_MPMC *q, const void *msgs, size_t stride, const uint32_t *lens, size_t n)
+{
+    uint64_t pos;
+    size_t   k;
+
+    // Stop in front of an oversized message; the caller sees it as a short count
+    for (k = 0; k < n && lens[k] <= q->hdr->slot_size; k++)
+    {
+    }
+    if (k == 0 || (k = claim(q, &q->hdr->enqueue_pos, 0, k, &pos)) == 0)
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < k; i++)
+    {
+        SHM_MPMC_SLOT *slot = slot_at(q, pos + i);
+        slot->len = lens[i];
+        memcpy(slot->data, (const uint8_t *)msgs + i * stride, lens[i]);
+        atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+    }
+    shm_notify_wake(&q->hdr->readable);
+    return k;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Dequeue up to @p n messages with one position update.
+ * @param[in,out] q Queue handle.
+ * @param[out] bufs Destination; message i is copied to bufs + i * stride.
+ * @param[in] stride Distance between buffers, at least the slot size.
+ * @param[out] lens Payload size of each message.
+ * @param[in] n Maximum number of messages.
+ * @return Number of messages dequeued (0 if empty).
+ */
+size_t shm_mpmc_dequeue_batch(SHM_MPMC *q, void *bufs, size_t stride, uint32_t *lens, size_t n)
+{
+    uint64_t pos;
+    size_t   k = n > 0 ? claim(q, &q->hdr->dequeue_pos, 1, n, &pos) : 0;
+
+    for (size_t i = 0; i < k; i++)
+    {
+        SHM_MPMC_SLOT *slot = slot_at(q, pos + i);
+        lens[i] = slot->len;
+        memcpy((uint8_t *)bufs + i * stride, slot->data, slot->len);
+        atomic_store_explicit(&slot->seq, pos + i + q->mask + 1, memory_order_release);
+    }
+    if (k > 0)
+    {
+        shm_notify_wake(&q->hdr->writable);
+    }
+    return k;
+}
+
+// Sleep on @p n until ready() holds, a wake arrives or the timeout expires
+static int wait_for(SHM_MPMC *q, SHM_NOTIFY *n, int (*ready)(const SHM_MPMC *), int timeout_ms)
+{
+    int64_t deadline = now_ms() + timeout_ms;
+
+    while (!ready(q))
+    {
+        uint32_t seq = shm_notify_prepare(n);
+        int      remaining = timeout_ms < 0 ? -1 : (int)(deadline - now_ms());
+
+        if (ready(q))
+        {
+            shm_notify_cancel(n);
+            break;
+        }
+        if (timeout_ms >= 0 && remaining <= 0)
+        {
+            shm_notify_cancel(n);
+            return SHM_MPMC_AGAIN;
+        }
+        if (shm_notify_wait(n, seq, remaining) == SHM_NOTIFY_ERROR)
+        {
+            return SHM_MPMC_ERROR;
+        }
+    }
+    return SHM_MPMC_SUCCESS;
+}
+
+static int has_message(const SHM_MPMC *q)
+{
+    uint64_t pos = atomic_load_explicit(&q->hdr->dequeue_pos, memory_order_relaxed);
+    return (int64_t)(atomic_load_explicit(&slot_at(q, pos)->seq, memory_order_acquire) - (pos + 1)) >= 0;
+}
+
+static int has_space(const SHM_MPMC *q)
+{
+    uint64_t pos = atomic_load_explicit(&q->hdr->enqueue_pos, memory_order_relaxed);
+    return (int64_t)(atomic_load_explicit(&slot_at(q, pos)->seq, memory_order_acquire) - pos) >= 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Block until a message is (probably) available.
+ * @param[in,out] q Queue handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN on timeout, SHM_MPMC_ERROR on failure.
+ */
+int shm_mpmc_wait_readable(SHM_MPMC *q, int timeout_ms)
+{
+    return wait_for(q, &q->hdr->readable, has_message, timeout_ms);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Block until a slot is (probably) free.
+ * @param[in,out] q Queue handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN on timeout, SHM_MPMC_ERROR on failure.
+ */
+int shm_mpmc_wait_writable(SHM_MPMC *q, int timeout_ms)
+{
+    return wait_for(q, &q->hdr->writable, has_space, timeout_ms);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when the queue may have a
+ *        message (consumer) or a free slot (producer). Created on first use.
+ * @param[in,out] q Queue handle.
+ * @param[in] writable 0 for a consumer, 1 for a producer.
+ * @return Descriptor (closed by shm_mpmc_close()), or -1 on failure.
+ */
+int shm_mpmc_pollfd(SHM_MPMC *q, int writable)
+{
+    if (q->poll.id == 0)
+    {
+        if (shm_notify_poll_open(&q->poll) != SHM_NOTIFY_SUCCESS)
+        {
+            return -1;
+        }
+        if (shm_notify_poll_attach(&q->poll, writable ? &q->hdr->writable : &q->hdr->readable) != SHM_NOTIFY_SUCCESS)
+        {
+            shm_notify_poll_close(&q->poll);
+            return -1;
+        }
+    }
+    return q->poll.fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_mpmc_enqueue() that arms the poll descriptor before returning SHM_MPMC_AGAIN.
+ * @param[in,out] q Queue handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size, at most the slot size.
+ * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN if full, SHM_MPMC_ERROR if len is too large.
+ */
+int shm_mpmc_try_enqueue(SHM_MPMC *q, const void *data, uint32_t len)
+{
+    int ret = shm_mpmc_enqueue(q, data, len);
+
+    if (ret == SHM_MPMC_AGAIN && q->poll.id != 0)
+    {
+        shm_notify_poll_arm(&q->poll);
+        ret = shm_mpmc_enqueue(q, data, len);
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_mpmc_dequeue() that arms the poll descriptor before returning SHM_MPMC_AGAIN.
+ * @param[in,out] q Queue handle.
+ * @param[out] buf Destination, at least the slot size.
+ * @param[out] len Payload size.
+ * @return SHM_MPMC_SUCCESS, or SHM_MPMC_AGAIN if empty.
+ */
+int shm_mpmc_try_dequeue(SHM_MPMC *q, void *buf, uint32_t *len)
+{
+    int ret = shm_mpmc_dequeue(q, buf, len);
+
+    if (ret == SHM_MPMC_AGAIN && q->poll.id != 0)
+    {
+        // A message enqueued between the dequeue and the arming is caught by the retry
+        shm_notify_poll_arm(&q->poll);
+        ret = shm_mpmc_dequeue(q, buf, len);
+    }
+    return ret;
+}
@@ -0,0 +1,197 @@
+/**
+ * @file    shm_mpmc.h
+ * @brief   Bounded multi-producer/multi-consumer queue in POSIX shared memory.
+ *
+ * Vyukov's bounded queue: every slot carries a sequence number that tells producers
+ * and consumers whose turn it is, so each side only contends on its own position
+ * counter (one CAS per operation, or per batch) and never on the other side's.
+ *
+ *   slot free for position p   : seq == p
+ *   slot filled for position p : seq == p + 1
+ *   consumer hands slot back   : seq = p + slots
+ *
+ * Slots have a fixed payload size chosen at creation; a message carries only its
+ * used length. A batch claims a run of consecutive ready slots with one CAS, and
+ * returns how many it got, so batches never wait for a slow peer.
+ *
+ * Event loops use shm_mpmc_pollfd() and shm_mpmc_try_enqueue()/shm_mpmc_try_dequeue(),
+ * which arm the descriptor whenever they return SHM_MPMC_AGAIN (see shm_notify.h).
+ *
+ */
+
+#ifndef SHM_MPMC_H
+#define SHM_MPMC_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shm_notify.h"
+
+/** Success return code */
+#define SHM_MPMC_SUCCESS 0
+/** Failure return code */
+#define SHM_MPMC_ERROR   1
+/** Queue full (enqueue) or empty (dequeue); try again later */
+#define SHM_MPMC_AGAIN   2
+
+#define SHM_MPMC_CACHE_LINE 64
+#define SHM_MPMC_NAME_MAX   64
+
+typedef struct
+{
+    alignas(SHM_MPMC_CACHE_LINE) uint32_t magic;
+    uint32_t slots;      // Power of two
+    uint32_t slot_size;  // Maximum payload per message
+    uint32_t stride;     // Bytes per slot, cache-line multiple
+
+    alignas(SHM_MPMC_CACHE_LINE) _Atomic uint64_t enqueue_pos;
+    alignas(SHM_MPMC_CACHE_LINE) _Atomic uint64_t dequeue_pos;
+
+    alignas(SHM_MPMC_CACHE_LINE) SHM_NOTIFY readable;  // Consumers sleep here when empty
+    alignas(SHM_MPMC_CACHE_LINE) SHM_NOTIFY writable;  // Producers sleep here when full
+} SHM_MPMC_HDR;
+
+typedef struct
+{
+    SHM_MPMC_HDR   *hdr;
+    uint8_t        *slots;
+    uint64_t        mask;
+    size_t          map_size;
+    int             fd;
+    int             owner;  // Created the segment; unlinks it on close
+    char            name[SHM_MPMC_NAME_MAX];
+    SHM_NOTIFY_POLL poll;   // Event-loop poller, see shm_mpmc_pollfd()
+} SHM_MPMC;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) a named queue.
+     * @param[out] q Queue handle.
+     * @param[in] name POSIX shm name.
+     * @param[in] slots Number of slots; rounded up to a power of two.
+     * @param[in] slot_size Maximum message size in bytes.
+     * @return SHM_MPMC_SUCCESS on success, SHM_MPMC_ERROR on failure.
+     */
+    int shm_mpmc_create(SHM_MPMC *q, const char *name, uint32_t slots, uint32_t slot_size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open a queue created by another process.
+     * @param[out] q Queue handle.
+     * @param[in] name POSIX shm name.
+     * @return SHM_MPMC_SUCCESS on success, SHM_MPMC_ERROR on failure.
+     */
+    int shm_mpmc_open(SHM_MPMC *q, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Unmap the queue. The creating process also unlinks the name.
+     * @param[in,out] q Queue handle.
+     */
+    void shm_mpmc_close(SHM_MPMC *q);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Enqueue one message.
+     * @param[in,out] q Queue handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size, at most the slot size.
+     * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN if full, SHM_MPMC_ERROR if len is too large.
+     */
+    int shm_mpmc_enqueue(SHM_MPMC *q, const void *data, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Dequeue one message.
+     * @param[in,out] q Queue handle.
+     * @param[out] buf Destination; must hold the slot size.
+     * @param[out] len Payload size.
+     * @return SHM_MPMC_SUCCESS or SHM_MPMC_AGAIN if empty.
+     */
+    int shm_mpmc_dequeue(SHM_MPMC *q, void *buf, uint32_t *len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Enqueue up to @p n messages with one position update.
+     * @param[in,out] q Queue handle.
+     * @param[in] msgs First message; message i starts at msgs + i * stride.
+     * @param[in] stride Distance between messages in @p msgs.
+     * @param[in] lens Payload size of each message, each at most the slot size.
+     * @param[in] n Number of messages.
+     * @return Number of messages enqueued (0 if full), in order from the first.
+     */
+    size_t shm_mpmc_enqueue_batch(SHM_MPMC *q, const void *msgs, size_t stride, const uint32_t *lens, size_t n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Dequeue up to @p n messages with one position update.
+     * @param[in,out] q Queue handle.
+     * @param[out] bufs Destination; message i is copied to bufs + i * stride.
+     * @param[in] stride Distance between buffers, at least the slot size.
+     * @param[out] lens Payload size of each message.
+     * @param[in] n Maximum number of messages.
+     * @return Number of messages dequeued (0 if empty).
+     */
+    size_t shm_mpmc_dequeue_batch(SHM_MPMC *q, void *bufs, size_t stride, uint32_t *lens, size_t n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Block until a message is (probably) available. Another consumer may take it
+     *        first, so retry the dequeue and wait again on SHM_MPMC_AGAIN.
+     * @param[in,out] q Queue handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN on timeout, SHM_MPMC_ERROR on failure.
+     */
+    int shm_mpmc_wait_readable(SHM_MPMC *q, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Block until a slot is (probably) free; see shm_mpmc_wait_readable().
+     * @param[in,out] q Queue handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN on timeout, SHM_MPMC_ERROR on failure.
+     */
+    int shm_mpmc_wait_writable(SHM_MPMC *q, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when the queue may have a
+     *        message (consumer) or a free slot (producer). Created on first use.
+     * @param[in,out] q Queue handle.
+     * @param[in] writable 0 for a consumer, 1 for a producer.
+     * @return Descriptor (closed by shm_mpmc_close()), or -1 on failure.
+     */
+    int shm_mpmc_pollfd(SHM_MPMC *q, int writable);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_mpmc_enqueue() that arms the poll descriptor before returning SHM_MPMC_AGAIN.
+     * @param[in,out] q Queue handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size, at most the slot size.
+     * @return SHM_MPMC_SUCCESS, SHM_MPMC_AGAIN if full, SHM_MPMC_ERROR if len is too large.
+     */
+    int shm_mpmc_try_enqueue(SHM_MPMC *q, const void *data, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_mpmc_dequeue() that arms the poll descriptor before returning SHM_MPMC_AGAIN.
+     * @param[in,out] q Queue handle.
+     * @param[out] buf Destination, at least the slot size.
+     * @param[out] len Payload size.
+     * @return SHM_MPMC_SUCCESS, or SHM_MPMC_AGAIN if empty.
+     */
+    int shm_mpmc_try_dequeue(SHM_MPMC *q, void *buf, uint32_t *len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_MPMC_H
@@ -0,0 +1,307 @@
+/**
+ * @file    shm_notify.c
+ * @brief   Futex-based wakeups for shared-memory consumers and producers.
+ *
+ */
+
+#include "shm_notify.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static _Atomic int wake_sock = -1;  // Unbound socket this process sends wake datagrams from
+
+// Not FUTEX_PRIVATE_FLAG: the word is shared between processes
+static long futex(_Atomic uint32_t *uaddr, int op, uint32_t val, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, (uint32_t *)uaddr, op, val, timeout, NULL, 0);
+}
+
+static socklen_t poll_addr(struct sockaddr_un *addr, uint32_t id)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // Abstract namespace: leading NUL, no file, gone when the socket is closed
+    int len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "shm_notify.%08x", id);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+// Send an empty datagram to poller @p id; returns 0 if its socket no longer exists
+static int poke(uint32_t id)
+{
+    struct sockaddr_un addr;
+    socklen_t          len = poll_addr(&addr, id);
+    int                fd = atomic_load_explicit(&wake_sock, memory_order_acquire);
+
+    if (fd < 0)
+    {
+        int expected = -1;
+        fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            return 1;
+        }
+        if (!atomic_compare_exchange_strong(&wake_sock, &expected, fd))
+        {
+            close(fd);  // Another thread created it first
+            fd = expected;
+        }
+    }
+    // EAGAIN: the poller's queue is full, so it is readable already
+    return sendto(fd, "", 0, MSG_DONTWAIT, (struct sockaddr *)&addr, len) == 0 || errno != ECONNREFUSED;
+}
+
+static void wake_pollers(SHM_NOTIFY *n)
+{
+    uint32_t armed = atomic_exchange_explicit(&n->armed, 0, memory_order_acquire);
+
+    for (int i = 0; armed != 0; i++, armed >>= 1)
+    {
+        uint32_t id = atomic_load_explicit(&n->pollers[i], memory_order_relaxed);
+        if ((armed & 1) && id != 0 && !poke(id))
+        {
+            // Its process died without detaching: free the slot
+            atomic_compare_exchange_strong(&n->pollers[i], &id, 0);
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize a notifier in shared memory (creator only).
+ * @param[out] n Notifier.
+ */
+void shm_notify_init(SHM_NOTIFY *n)
+{
+    atomic_store(&n->seq, 0);
+    atomic_store(&n->waiters, 0);
+    atomic_store(&n->armed, 0);
+    for (int i = 0; i < SHM_NOTIFY_POLLERS; i++)
+    {
+        atomic_store(&n->pollers[i], 0);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Register as a waiter. Re-check the wait condition afterwards.
+ * @param[in,out] n Notifier.
+ * @return Sequence snapshot to pass to shm_notify_wait().
+ */
+uint32_t shm_notify_prepare(SHM_NOTIFY *n)
+{
+    uint32_t seq = atomic_load_explicit(&n->seq, memory_order_acquire);
+
+    // seq_cst RMW: the caller's re-check cannot be reordered before the registration
+    atomic_fetch_add_explicit(&n->waiters, 1, memory_order_seq_cst);
+    return seq;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Deregister after the re-check found the condition already met.
+ * @param[in,out] n Notifier.
+ */
+void shm_notify_cancel(SHM_NOTIFY *n)
+{
+    atomic_fetch_sub_explicit(&n->waiters, 1, memory_order_relaxed);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Sleep until woken after @p seq was taken, then deregister.
+ * @param[in,out] n Notifier.
+ * @param[in] seq Value returned by shm_notify_prepare().
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_NOTIFY_SUCCESS, SHM_NOTIFY_TIMEOUT or SHM_NOTIFY_ERROR.
+ */
+int shm_notify_wait(SHM_NOTIFY *n, uint32_t seq, int timeout_ms)
+{
+    struct timespec ts, *tsp = NULL;
+    int             ret = SHM_NOTIFY_SUCCESS;
+
+    if (timeout_ms >= 0)
+    {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+        tsp = &ts;
+    }
+
+    // EAGAIN: a wake happened between prepare and here. EINTR: let the caller re-check.
+    if (futex(&n->seq, FUTEX_WAIT, seq, tsp) == -1 && errno != EAGAIN && errno != EINTR)
+    {
+        if (errno == ETIMEDOUT)
+        {
+            ret = SHM_NOTIFY_TIMEOUT;
+        }
+        else
+        {
+            perror("futex");
+            ret = SHM_NOTIFY_ERROR;
+        }
+    }
+
+    atomic_fetch_sub_explicit(&n->waiters, 1, memory_order_relaxed);
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Wake all registered waiters and armed pollers.
+ * @param[in,out] n Notifier.
+ */
+void shm_notify_wake(SHM_NOTIFY *n)
+{
+    // Pairs with the RMW in shm_notify_prepare() / shm_notify_poll_arm(): publish before
+    // looking for waiters
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&n->armed, memory_order_relaxed) != 0)
+    {
+        wake_pollers(n);
+    }
+    if (atomic_load_explicit(&n->waiters, memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&n->seq, 1, memory_order_release);
+    futex(&n->seq, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create a poller: a non-blocking datagram socket to add to epoll.
+ * @param[out] p Poller.
+ * @return SHM_NOTIFY_SUCCESS on success, SHM_NOTIFY_ERROR on failure.
+ */
+int shm_notify_poll_open(SHM_NOTIFY_POLL *p)
+{
+    struct sockaddr_un addr;
+
+    memset(p, 0, sizeof(*p));
+    p->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (p->fd < 0)
+    {
+        perror("shm_notify: socket");
+        return SHM_NOTIFY_ERROR;
+    }
+    // A random id; retry the rare collision with a live poller
+    for (int tries = 0; tries < 16; tries++)
+    {
+        if (getrandom(&p->id, sizeof(p->id), 0) != sizeof(p->id) || p->id == 0)
+        {
+            continue;
+        }
+        if (bind(p->fd, (struct sockaddr *)&addr, poll_addr(&addr, p->id)) == 0)
+        {
+            return SHM_NOTIFY_SUCCESS;
+        }
+        if (errno != EADDRINUSE)
+        {
+            break;
+        }
+    }
+    perror("shm_notify: bind");
+    close(p->fd);
+    p->fd = -1;
+    p->id = 0;
+    return SHM_NOTIFY_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Register the poller with a notifier, leaving any previous one.
+ * @param[in,out] p Poller.
+ * @param[in,out] n Notifier in shared memory.
+ * @return SHM_NOTIFY_SUCCESS, or SHM_NOTIFY_ERROR if all slots hold live pollers.
+ */
+int shm_notify_poll_attach(SHM_NOTIFY_POLL *p, SHM_NOTIFY *n)
+{
+    shm_notify_poll_detach(p);
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (int i = 0; i < SHM_NOTIFY_POLLERS; i++)
+        {
+            uint32_t expected = 0;
+            if (atomic_compare_exchange_strong(&n->pollers[i], &expected, p->id))
+            {
+                p->n = n;
+                p->slot = i;
+                return SHM_NOTIFY_SUCCESS;
+            }
+        }
+        // All taken: free the slots of pollers that are gone, then try once more
+        for (int i = 0; i < SHM_NOTIFY_POLLERS; i++)
+        {
+            uint32_t id = atomic_load(&n->pollers[i]);
+            if (id != 0 && !poke(id))
+            {
+                atomic_compare_exchange_strong(&n->pollers[i], &id, 0);
+            }
+        }
+    }
+    fprintf(stderr, "shm_notify: all %d poller slots in use\n", SHM_NOTIFY_POLLERS);
+    return SHM_NOTIFY_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Leave the notifier the poller is attached to.
+ * @param[in,out] p Poller.
+ */
+void shm_notify_poll_detach(SHM_NOTIFY_POLL *p)
+{
+    if (p->n != NULL)
+    {
+        uint32_t id = p->id;
+        atomic_fetch_and(&p->n->armed, ~(1u << p->slot));
+        atomic_compare_exchange_strong(&p->n->pollers[p->slot], &id, 0);
+        p->n = NULL;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Drain the socket and ask for a datagram on the next wake. Re-check the
+ *        condition afterwards.
+ * @param[in,out] p Poller.
+ */
+void shm_notify_poll_arm(SHM_NOTIFY_POLL *p)
+{
+    char c;
+
+    while (recv(p->fd, &c, sizeof(c), MSG_DONTWAIT) >= 0)
+    {
+    }
+    if (p->n != NULL)
+    {
+        // seq_cst RMW: the caller's re-check cannot be reordered before the arming
+        atomic_fetch_or_explicit(&p->n->armed, 1u << p->slot, memory_order_seq_cst);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Detach and close the socket.
+ * @param[in,out] p Poller.
+ */
+void shm_notify_poll_close(SHM_NOTIFY_POLL *p)
+{
+    if (p->id == 0)
+    {
+        return;  // Never opened
+    }
+    shm_notify_poll_detach(p);
+    close(p->fd);
+    p->fd = -1;
+    p->id = 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file    shm_notify.h
+ * @brief   Futex-based wakeups for shared-memory consumers and producers.
+ *
+ * An SHM_NOTIFY lives inside a shared segment next to the data it guards. A side that
+ * finds nothing to do registers as a waiter, re-checks its condition and sleeps in
+ * FUTEX_WAIT; the other side signals after publishing, but only enters the kernel
+ * when a waiter is registered, so the uncontended path is a fence and one load.
+ *
+ * Waiter:
+ *   while (!condition())
+ *   {
+ *       uint32_t seq = shm_notify_prepare(n);
+ *       if (condition()) { shm_notify_cancel(n); break; }
+ *       shm_notify_wait(n, seq, timeout_ms);
+ *   }
+ *
+ * Signaller:
+ *   publish(); shm_notify_wake(n);
+ *
+ * The waiter's registration and the signaller's publish are both followed by a full
+ * fence, so either the waiter's re-check sees the data or the signaller sees the
+ * waiter; the sequence number closes the window between re-check and FUTEX_WAIT.
+ *
+ * A futex cannot be put in an epoll set, so a process that serves many channels from
+ * one event loop uses a poller instead: a non-blocking datagram socket bound to an
+ * abstract address ("shm_notify.<id>"), registered in one of the notifier's
+ * SHM_NOTIFY_POLLERS slots. The same handshake applies, with arming in place of
+ * prepare and epoll in place of FUTEX_WAIT:
+ *
+ * Event loop:
+ *   shm_notify_poll_open(&p); shm_notify_poll_attach(&p, n);  // add p.fd to epoll
+ *   on p.fd readable, and once at start:
+ *       for (;;)
+ *       {
+ *           while (condition()) consume();
+ *           shm_notify_poll_arm(&p);
+ *           if (!condition()) break;  // else data raced the arm, go again
+ *       }
+ *
+ * shm_notify_wake() sends one empty datagram to each armed poller and disarms it, so a
+ * burst of publishes costs one send per arm, not one per message. Slots of pollers
+ * whose process died are reclaimed when a send to them is refused.
+ *
+ */
+
+#ifndef SHM_NOTIFY_H
+#define SHM_NOTIFY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/** Success return code */
+#define SHM_NOTIFY_SUCCESS 0
+/** Failure return code */
+#define SHM_NOTIFY_ERROR   1
+/** Timed out */
+#define SHM_NOTIFY_TIMEOUT 2
+
+/** Pollers one notifier can serve at a time */
+#define SHM_NOTIFY_POLLERS 5
+
+typedef struct
+{
+    _Atomic uint32_t seq;      // Futex word, bumped by every wake that finds waiters
+    _Atomic uint32_t waiters;  // Registered sleepers
+    _Atomic uint32_t armed;    // Bit i: pollers[i] wants a datagram on the next wake
+    _Atomic uint32_t pollers[SHM_NOTIFY_POLLERS];  // Poller ids, 0 = free slot
+} SHM_NOTIFY;
+
+// Process-local end of a poller: the socket to put in epoll
+typedef struct
+{
+    int         fd;    // Readable once a wake hits an armed registration
+    uint32_t    id;    // Abstract address "shm_notify.<id>", 0 = not open
+    SHM_NOTIFY *n;     // Notifier it is attached to, NULL if none
+    int         slot;  // Index in n->pollers
+} SHM_NOTIFY_POLL;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize a notifier in shared memory (creator only).
+     * @param[out] n Notifier.
+     */
+    void shm_notify_init(SHM_NOTIFY *n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Register as a waiter. Re-check the wait condition afterwards.
+     * @param[in,out] n Notifier.
+     * @return Sequence snapshot to pass to shm_notify_wait().
+     */
+    uint32_t shm_notify_prepare(SHM_NOTIFY *n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Deregister after the re-check found the condition already met.
+     * @param[in,out] n Notifier.
+     */
+    void shm_notify_cancel(SHM_NOTIFY *n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Sleep until woken after @p seq was taken, then deregister.
+     * @param[in,out] n Notifier.
+     * @param[in] seq Value returned by shm_notify_prepare().
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_NOTIFY_SUCCESS when woken (or already signalled), SHM_NOTIFY_TIMEOUT,
+     *         SHM_NOTIFY_ERROR on an unexpected futex error.
+     */
+    int shm_notify_wait(SHM_NOTIFY *n, uint32_t seq, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Wake all registered waiters. Call after publishing; costs a fence and a load
+     *        when nobody waits.
+     * @param[in,out] n Notifier.
+     */
+    void shm_notify_wake(SHM_NOTIFY *n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create a poller: a non-blocking datagram socket to add to epoll.
+     * @param[out] p Poller.
+     * @return SHM_NOTIFY_SUCCESS on success, SHM_NOTIFY_ERROR on failure.
+     */
+    int shm_notify_poll_open(SHM_NOTIFY_POLL *p);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Register the poller with a notifier, leaving any previous one. The socket
+     *        (and its epoll registration) stays the same.
+     * @param[in,out] p Poller.
+     * @param[in,out] n Notifier in shared memory.
+     * @return SHM_NOTIFY_SUCCESS, or SHM_NOTIFY_ERROR if all slots hold live pollers.
+     */
+    int shm_notify_poll_attach(SHM_NOTIFY_POLL *p, SHM_NOTIFY *n);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Leave the notifier the poller is attached to.
+     * @param[in,out] p Poller.
+     */
+    void shm_notify_poll_detach(SHM_NOTIFY_POLL *p);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Drain the socket and ask for a datagram on the next wake. Re-check the
+     *        condition afterwards, exactly as after shm_notify_prepare().
+     * @param[in,out] p Poller.
+     */
+    void shm_notify_poll_arm(SHM_NOTIFY_POLL *p);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Detach and close the socket. Does nothing for a zeroed, never opened poller.
+     * @param[in,out] p Poller.
+     */
+    void shm_notify_poll_close(SHM_NOTIFY_POLL *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_NOTIFY_H
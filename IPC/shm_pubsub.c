@@ -0,0 +1,595 @@
+/**
+ * @file    shm_pubsub.c
+ * @brief   Same-host publish/subscribe over shared memory, with MQTT-style topics.
+ *
+ */
+
+#include "shm_pubsub.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_PUBSUB_MAGIC 0x50535542u  // "PSUB"
+
+// Inbox message: header, NUL-terminated topic, payload
+typedef struct
+{
+    uint64_t published_ns;
+    uint32_t len;
+    uint16_t topic_len;  // Including the NUL
+    uint16_t flags;
+} WIRE_HDR;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint32_t topic_hash(const char *s)
+{
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*s)
+    {
+        h = (h ^ (uint8_t)*s++) * 16777619u;
+    }
+    return h;
+}
+
+static int valid_topic(const char *topic)
+{
+    size_t len = strlen(topic);
+    return len > 0 && len < SHM_PUBSUB_TOPIC_MAX && strpbrk(topic, "+#") == NULL;
+}
+
+// '+' must be a whole level; '#' must be the whole last level
+static int valid_filter(const char *filter)
+{
+    size_t len = strlen(filter);
+
+    if (len == 0 || len >= SHM_PUBSUB_TOPIC_MAX)
+    {
+        return 0;
+    }
+    for (const char *p = filter; *p; p++)
+    {
+        int level_start = p == filter || p[-1] == '/';
+        int level_end = p[1] == '\0' || p[1] == '/';
+
+        if (*p == '+' && !(level_start && level_end))
+        {
+            return 0;
+        }
+        if (*p == '#' && !(level_start && p[1] == '\0'))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int map_dir(SHM_PUBSUB *ps, size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ps->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return SHM_PUBSUB_ERROR;
+    }
+    ps->dir = (SHM_PUBSUB_DIR *)p;
+    ps->map_size = size;
+    ps->generation = UINT32_MAX;  // Forces a refresh on the first publish
+    return SHM_PUBSUB_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) the subscription directory (broker side).
+ * @param[out] ps Pub/sub handle.
+ * @param[in] name POSIX shm name, e.g. "/pubsub".
+ * @return SHM_PUBSUB_SUCCESS on success, SHM_PUBSUB_ERROR on failure.
+ */
+int shm_pubsub_create(SHM_PUBSUB *ps, const char *name)
+{
+    memset(ps, 0, sizeof(*ps));
+    snprintf(ps->name, sizeof(ps->name), "%s", name);
+
+    shm_unlink(name);  // Replace, never truncate: a process may still map the old segment
+    ps->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (ps->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_PUBSUB_ERROR;
+    }
+    if (ftruncate(ps->fd, sizeof(SHM_PUBSUB_DIR)) == -1)
+    {
+        perror("ftruncate");
+        close(ps->fd);
+        return SHM_PUBSUB_ERROR;
+    }
+    if (map_dir(ps, sizeof(SHM_PUBSUB_DIR)) != SHM_PUBSUB_SUCCESS)
+    {
+        close(ps->fd);
+        return SHM_PUBSUB_ERROR;
+    }
+
+    ps->dir->broker = getpid();
+    atomic_store_explicit(&ps->dir->generation, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    ps->dir->magic = SHM_PUBSUB_MAGIC;
+
+    ps->owner = 1;
+    return SHM_PUBSUB_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open the directory created by the broker (publishers and subscribers). One
+ *        handle per thread.
+ * @param[out] ps Pub/sub handle.
+ * @param[in] name POSIX shm name.
+ * @return SHM_PUBSUB_SUCCESS on success, SHM_PUBSUB_ERROR on failure.
+ */
+int shm_pubsub_open(SHM_PUBSUB *ps, const char *name)
+{
+    struct stat st;
+
+    memset(ps, 0, sizeof(*ps));
+    snprintf(ps->name, sizeof(ps->name), "%s", name);
+
+    ps->fd = shm_open(name, O_RDWR, 0666);
+    if (ps->fd == -1)
+    {
+        perror("shm_open (is the broker running?)");
+        return SHM_PUBSUB_ERROR;
+    }
+    if (fstat(ps->fd, &st) == -1 || (size_t)st.st_size != sizeof(SHM_PUBSUB_DIR) || map_dir(ps, st.st_size) != SHM_PUBSUB_SUCCESS)
+    {
+        fprintf(stderr, "shm_pubsub: %s is not a pub/sub directory\n", name);
+        close(ps->fd);
+        return SHM_PUBSUB_ERROR;
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (ps->dir->magic != SHM_PUBSUB_MAGIC)
+    {
+        fprintf(stderr, "shm_pubsub: %s is not initialized\n", name);
+        munmap(ps->dir, ps->map_size);
+        close(ps->fd);
+        return SHM_PUBSUB_ERROR;
+    }
+    return SHM_PUBSUB_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Close every inbox this handle opened and unmap the directory. The broker
+ *        also unlinks it. Unsubscribe first.
+ * @param[in,out] ps Pub/sub handle.
+ */
+void shm_pubsub_close(SHM_PUBSUB *ps)
+{
+    for (int i = 0; i < SHM_PUBSUB_MAX_SUBS; i++)
+    {
+        if (ps->inbox_open[i])
+        {
+            shm_mpmc_close(&ps->inbox[i]);
+            ps->inbox_open[i] = 0;
+        }
+    }
+    free(ps->scratch);
+    ps->scratch = NULL;
+
+    if (ps->dir != NULL && munmap(ps->dir, ps->map_size) == -1)
+    {
+        perror("munmap");
+    }
+    if (ps->fd >= 0 && close(ps->fd) == -1)
+    {
+        perror("close");
+    }
+    if (ps->owner && shm_unlink(ps->name) == -1)
+    {
+        perror("shm_unlink");
+    }
+    ps->dir = NULL;
+    ps->fd = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Check a topic against an MQTT-style filter ('+' one level, trailing '#' the rest).
+ * @param[in] filter Topic filter.
+ * @param[in] topic Concrete topic (no wildcards).
+ * @return 1 if the topic matches, 0 otherwise.
+ */
+int shm_pubsub_match(const char *filter, const char *topic)
+{
+    const char *f = filter;
+    const char *t = topic;
+
+    for (;;)
+    {
+        if (f[0] == '#')
+        {
+            return 1;
+        }
+        if (f[0] == '+')
+        {
+            f++;
+            while (*t != '\0' && *t != '/')
+            {
+                t++;
+            }
+        }
+        else
+        {
+            while (*f != '\0' && *f != '/' && *f == *t)
+            {
+                f++;
+                t++;
+            }
+            if ((*f != '\0' && *f != '/') || (*t != '\0' && *t != '/'))
+            {
+                return 0;
+            }
+        }
+
+        // Both at the end of a level
+        if (*f == '\0')
+        {
+            return *t == '\0';
+        }
+        if (*t == '\0')
+        {
+            return strcmp(f, "/#") == 0;  // "a/#" also matches "a"
+        }
+        f++;
+        t++;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Publisher
+//-------------------------------------------------------------------------------------------------
+
+// The subscription set changed: drop inboxes whose subscription is gone or was replaced
+static void refresh(SHM_PUBSUB *ps, uint32_t generation)
+{
+    for (int i = 0; i < SHM_PUBSUB_MAX_SUBS; i++)
+    {
+        SHM_PUBSUB_ENTRY *e = &ps->dir->subs[i];
+
+        if (ps->inbox_open[i] &&
+            (atomic_load_explicit(&e->state, memory_order_acquire) != SHM_PUBSUB_ACTIVE || e->incarnation != ps->inbox_incarnation[i]))
+        {
+            shm_mpmc_close(&ps->inbox[i]);
+            ps->inbox_open[i] = 0;
+        }
+    }
+    ps->generation = generation;
+}
+
+static uint64_t route(SHM_PUBSUB *ps, const char *topic, uint32_t generation)
+{
+    uint32_t          hash = topic_hash(topic);
+    SHM_PUBSUB_ROUTE *r = &ps->routes[hash % SHM_PUBSUB_ROUTES];
+
+    if (r->generation == generation && r->hash == hash && strcmp(r->topic, topic) == 0)
+    {
+        return r->mask;
+    }
+
+    r->mask = 0;
+    for (int i = 0; i < SHM_PUBSUB_MAX_SUBS; i++)
+    {
+        SHM_PUBSUB_ENTRY *e = &ps->dir->subs[i];
+        if (atomic_load_explicit(&e->state, memory_order_acquire) == SHM_PUBSUB_ACTIVE && shm_pubsub_match(e->filter, topic))
+        {
+            r->mask |= 1ull << i;
+        }
+    }
+    r->generation = generation;
+    r->hash = hash;
+    snprintf(r->topic, sizeof(r->topic), "%s", topic);
+    return r->mask;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Deliver a message to every subscription whose filter matches @p topic.
+ * @param[in,out] ps Pub/sub handle.
+ * @param[in] topic Topic, no wildcards, shorter than SHM_PUBSUB_TOPIC_MAX.
+ * @param[in] data Payload.
+ * @param[in] len Payload size.
+ * @param[in] flags 0, or SHM_PUBSUB_BRIDGED for messages injected by the bridge.
+ * @param[out] delivered Number of inboxes that took the message (may be NULL).
+ * @return SHM_PUBSUB_SUCCESS (also with no subscribers), SHM_PUBSUB_ERROR on a bad topic.
+ */
+int shm_pubsub_publish(SHM_PUBSUB *ps, const char *topic, const void *data, uint32_t len, uint32_t flags, uint32_t *delivered)
+{
+    uint32_t generation = atomic_load_explicit(&ps->dir->generation, memory_order_acquire);
+    uint32_t count = 0;
+    uint64_t mask;
+
+    if (delivered != NULL)
+    {
+        *delivered = 0;
+    }
+    if (!valid_topic(topic))
+    {
+        fprintf(stderr, "shm_pubsub: invalid topic \"%s\"\n", topic);
+        return SHM_PUBSUB_ERROR;
+    }
+    if (generation != ps->generation)
+    {
+        refresh(ps, generation);
+    }
+    mask = route(ps, topic, generation);
+    if (mask == 0)
+    {
+        return SHM_PUBSUB_SUCCESS;
+    }
+
+    // Assemble once, copy into each inbox
+    uint16_t topic_len = (uint16_t)(strlen(topic) + 1);
+    size_t   size = sizeof(WIRE_HDR) + topic_len + len;
+    if (size > ps->scratch_size)
+    {
+        uint8_t *p = realloc(ps->scratch, size);
+        if (p == NULL)
+        {
+            return SHM_PUBSUB_ERROR;
+        }
+        ps->scratch = p;
+        ps->scratch_size = size;
+    }
+    WIRE_HDR hdr = {now_ns(), len, topic_len, (uint16_t)flags};
+    memcpy(ps->scratch, &hdr, sizeof(hdr));
+    memcpy(ps->scratch + sizeof(hdr), topic, topic_len);
+    memcpy(ps->scratch + sizeof(hdr) + topic_len, data, len);
+
+    for (; mask != 0; mask &= mask - 1)
+    {
+        int               i = __builtin_ctzll(mask);
+        SHM_PUBSUB_ENTRY *e = &ps->dir->subs[i];
+
+        if ((flags & SHM_PUBSUB_BRIDGED) && (e->flags & SHM_PUBSUB_NO_BRIDGED))
+        {
+            continue;
+        }
+        if (size > e->slot_size)
+        {
+            atomic_fetch_add_explicit(&e->dropped, 1, memory_order_relaxed);
+            continue;
+        }
+        if (!ps->inbox_open[i])
+        {
+            if (shm_mpmc_open(&ps->inbox[i], e->inbox) != SHM_MPMC_SUCCESS)
+            {
+                continue;  // Unsubscribing right now
+            }
+            ps->inbox_open[i] = 1;
+            ps->inbox_incarnation[i] = e->incarnation;
+        }
+        if (shm_mpmc_enqueue(&ps->inbox[i], ps->scratch, (uint32_t)size) == SHM_MPMC_SUCCESS)
+        {
+            atomic_fetch_add_explicit(&e->delivered, 1, memory_order_relaxed);
+            count++;
+        }
+        else
+        {
+            atomic_fetch_add_explicit(&e->dropped, 1, memory_order_relaxed);
+        }
+    }
+
+    if (delivered != NULL)
+    {
+        *delivered = count;
+    }
+    return SHM_PUBSUB_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Subscriber
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Subscribe: create an inbox and register it under @p filter.
+ * @param[in,out] ps Pub/sub handle.
+ * @param[in] filter MQTT-style topic filter.
+ * @param[in] queue_len Inbox capacity in messages.
+ * @param[in] max_payload Largest payload accepted; bigger messages are dropped.
+ * @param[in] flags 0, or SHM_PUBSUB_NO_BRIDGED.
+ * @param[out] sub Subscription handle.
+ * @return SHM_PUBSUB_SUCCESS, or SHM_PUBSUB_ERROR (bad filter, table full).
+ */
+int shm_pubsub_subscribe(SHM_PUBSUB *ps, const char *filter, uint32_t queue_len, uint32_t max_payload, uint32_t flags, SHM_PUBSUB_SUB *sub)
+{
+    uint32_t slot_size = (sizeof(WIRE_HDR) + SHM_PUBSUB_TOPIC_MAX + max_payload + 7) & ~7u;
+
+    if (!valid_filter(filter))
+    {
+        fprintf(stderr, "shm_pubsub: invalid filter \"%s\"\n", filter);
+        return SHM_PUBSUB_ERROR;
+    }
+
+    for (int i = 0; i < SHM_PUBSUB_MAX_SUBS; i++)
+    {
+        SHM_PUBSUB_ENTRY *e = &ps->dir->subs[i];
+        uint32_t          expected = SHM_PUBSUB_FREE;
+
+        if (!atomic_compare_exchange_strong(&e->state, &expected, SHM_PUBSUB_CLAIMED))
+        {
+            continue;
+        }
+
+        // CLAIMED keeps publishers away until the inbox exists
+        atomic_store(&e->pid, getpid());
+        e->incarnation++;
+        e->flags = flags;
+        e->slot_size = slot_size;
+        atomic_store(&e->delivered, 0);
+        atomic_store(&e->dropped, 0);
+        snprintf(e->filter, sizeof(e->filter), "%s", filter);
+        snprintf(e->inbox, sizeof(e->inbox), "/ps.%.40s.%d.%u", ps->name + (ps->name[0] == '/'), i, e->incarnation);
+
+        sub->ps = ps;
+        sub->index = i;
+        sub->buf = malloc(slot_size);
+        if (sub->buf == NULL || shm_mpmc_create(&sub->inbox, e->inbox, queue_len, slot_size) != SHM_MPMC_SUCCESS)
+        {
+            free(sub->buf);
+            atomic_store(&e->state, SHM_PUBSUB_FREE);
+            return SHM_PUBSUB_ERROR;
+        }
+
+        atomic_store_explicit(&e->state, SHM_PUBSUB_ACTIVE, memory_order_release);
+        atomic_fetch_add(&ps->dir->generation, 1);
+        return SHM_PUBSUB_SUCCESS;
+    }
+    fprintf(stderr, "shm_pubsub: all %d subscriptions are in use\n", SHM_PUBSUB_MAX_SUBS);
+    return SHM_PUBSUB_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Remove the subscription and destroy its inbox.
+ * @param[in,out] sub Subscription handle.
+ */
+void shm_pubsub_unsubscribe(SHM_PUBSUB_SUB *sub)
+{
+    SHM_PUBSUB_ENTRY *e = &sub->ps->dir->subs[sub->index];
+
+    // Publishers stop routing here first; one still holding the mapping writes harmlessly
+    atomic_store(&e->state, SHM_PUBSUB_CLAIMED);
+    atomic_fetch_add(&sub->ps->dir->generation, 1);
+    shm_mpmc_close(&sub->inbox);
+    free(sub->buf);
+    sub->buf = NULL;
+    atomic_store(&e->pid, 0);
+    atomic_store_explicit(&e->state, SHM_PUBSUB_FREE, memory_order_release);
+}
+
+// Point msg at the message just dequeued into sub->buf
+static void unpack(SHM_PUBSUB_SUB *sub, SHM_PUBSUB_MSG *msg)
+{
+    WIRE_HDR hdr;
+
+    memcpy(&hdr, sub->buf, sizeof(hdr));
+    msg->topic = (const char *)sub->buf + sizeof(hdr);
+    msg->data = sub->buf + sizeof(hdr) + hdr.topic_len;
+    msg->len = hdr.len;
+    msg->flags = hdr.flags;
+    msg->published_ns = hdr.published_ns;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Take the next message from the inbox without blocking.
+ * @param[in,out] sub Subscription handle.
+ * @param[out] msg Message; its pointers stay valid until the next recv.
+ * @return SHM_PUBSUB_SUCCESS, or SHM_PUBSUB_AGAIN if the inbox is empty.
+ */
+int shm_pubsub_recv(SHM_PUBSUB_SUB *sub, SHM_PUBSUB_MSG *msg)
+{
+    uint32_t len;
+
+    if (shm_mpmc_dequeue(&sub->inbox, sub->buf, &len) != SHM_MPMC_SUCCESS)
+    {
+        return SHM_PUBSUB_AGAIN;
+    }
+    unpack(sub, msg);
+    return SHM_PUBSUB_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Sleep until the inbox has a message.
+ * @param[in,out] sub Subscription handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_PUBSUB_SUCCESS, SHM_PUBSUB_AGAIN on timeout, SHM_PUBSUB_ERROR on failure.
+ */
+int shm_pubsub_wait(SHM_PUBSUB_SUB *sub, int timeout_ms)
+{
+    switch (shm_mpmc_wait_readable(&sub->inbox, timeout_ms))
+    {
+        case SHM_MPMC_SUCCESS: return SHM_PUBSUB_SUCCESS;
+        case SHM_MPMC_AGAIN: return SHM_PUBSUB_AGAIN;
+        default: return SHM_PUBSUB_ERROR;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when the inbox may have a
+ *        message. Created on first use.
+ * @param[in,out] sub Subscription handle.
+ * @return Descriptor (closed by shm_pubsub_unsubscribe()), or -1 on failure.
+ */
+int shm_pubsub_pollfd(SHM_PUBSUB_SUB *sub)
+{
+    return shm_mpmc_pollfd(&sub->inbox, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_pubsub_recv() that arms the poll descriptor before returning
+ *        SHM_PUBSUB_AGAIN.
+ * @param[in,out] sub Subscription handle.
+ * @param[out] msg Message; its pointers stay valid until the next recv.
+ * @return SHM_PUBSUB_SUCCESS, or SHM_PUBSUB_AGAIN if the inbox is empty.
+ */
+int shm_pubsub_try_recv(SHM_PUBSUB_SUB *sub, SHM_PUBSUB_MSG *msg)
+{
+    uint32_t len;
+
+    if (shm_mpmc_try_dequeue(&sub->inbox, sub->buf, &len) != SHM_MPMC_SUCCESS)
+    {
+        return SHM_PUBSUB_AGAIN;
+    }
+    unpack(sub, msg);
+    return SHM_PUBSUB_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Free the entries of subscribers that died and unlink their inboxes (broker).
+ * @param[in,out] ps Pub/sub handle.
+ * @return Number of subscriptions removed.
+ */
+int shm_pubsub_reap(SHM_PUBSUB *ps)
+{
+    int reaped = 0;
+
+    for (int i = 0; i < SHM_PUBSUB_MAX_SUBS; i++)
+    {
+        SHM_PUBSUB_ENTRY *e = &ps->dir->subs[i];
+        pid_t             pid = atomic_load(&e->pid);
+
+        if (atomic_load(&e->state) == SHM_PUBSUB_FREE || pid <= 0 || kill(pid, 0) == 0 || errno != ESRCH)
+        {
+            continue;
+        }
+        atomic_store(&e->state, SHM_PUBSUB_CLAIMED);
+        atomic_fetch_add(&ps->dir->generation, 1);
+        if (shm_unlink(e->inbox) == -1 && errno != ENOENT)
+        {
+            perror("shm_unlink");
+        }
+        atomic_store(&e->pid, 0);
+        atomic_store_explicit(&e->state, SHM_PUBSUB_FREE, memory_order_release);
+        reaped++;
+    }
+    return reaped;
+}
@@ -0,0 +1,254 @@
+/**
+ * @file    shm_pubsub.h
+ * @brief   Same-host publish/subscribe over shared memory, with MQTT-style topics.
+ *
+ * A directory segment (created by the broker, pubsubBroker.c) lists the active
+ * subscriptions: a topic filter and the name of the subscriber's inbox. An inbox is an
+ * shm_mpmc queue owned by the subscriber; any number of publishers enqueue into it.
+ *
+ * Publishing goes straight from the publisher into each matching inbox, no broker hop
+ * and no socket: match the topic against the directory, copy the message into every
+ * matching inbox, and wake the subscriber through the inbox's futex notifier only if it
+ * sleeps. The match result is cached per topic until the directory changes, so a
+ * steady publisher pays one atomic load for routing.
+ *
+ * Topic filters follow MQTT: levels are separated by '/', '+' matches exactly one
+ * level, and a trailing '#' matches any number of remaining levels (including none).
+ *   "camera/+/status" matches "camera/3/status"
+ *   "telemetry/#"     matches "telemetry" and "telemetry/cpu/0"
+ *
+ * Delivery is at-most-once: a full inbox or a message larger than the subscriber's slot
+ * is dropped and counted in the subscription's directory entry. The broker removes
+ * subscriptions of processes that died and can bridge chosen topics to an MQTT broker.
+ *
+ * A subscriber driven by an event loop registers shm_pubsub_pollfd() and drains the
+ * inbox with shm_pubsub_try_recv().
+ *
+ */
+
+#ifndef SHM_PUBSUB_H
+#define SHM_PUBSUB_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "shm_mpmc.h"
+
+/** Success return code */
+#define SHM_PUBSUB_SUCCESS 0
+/** Failure return code */
+#define SHM_PUBSUB_ERROR   1
+/** Nothing received (recv) or wait timed out */
+#define SHM_PUBSUB_AGAIN   2
+
+#define SHM_PUBSUB_CACHE_LINE 64
+#define SHM_PUBSUB_NAME_MAX   64
+#define SHM_PUBSUB_TOPIC_MAX  128
+#define SHM_PUBSUB_MAX_SUBS   64
+#define SHM_PUBSUB_ROUTES     64  // Per-publisher topic cache entries
+
+/** Message came in through the MQTT bridge */
+#define SHM_PUBSUB_BRIDGED    0x1
+/** Subscription flag: skip messages that came in through the bridge (loop guard) */
+#define SHM_PUBSUB_NO_BRIDGED 0x1
+
+typedef enum
+{
+    SHM_PUBSUB_FREE = 0,
+    SHM_PUBSUB_CLAIMED,  // Being set up or torn down; publishers skip it
+    SHM_PUBSUB_ACTIVE
+} SHM_PUBSUB_STATE_E;
+
+typedef struct
+{
+    alignas(SHM_PUBSUB_CACHE_LINE) _Atomic uint32_t state;  // SHM_PUBSUB_STATE_E
+    _Atomic pid_t    pid;
+    uint32_t         incarnation;  // Bumped on every subscribe, part of the inbox name
+    uint32_t         flags;        // SHM_PUBSUB_NO_BRIDGED
+    uint32_t         slot_size;    // Largest message (header + topic + payload) the inbox takes
+    _Atomic uint64_t delivered;
+    _Atomic uint64_t dropped;      // Inbox full or message too large
+    char             filter[SHM_PUBSUB_TOPIC_MAX];
+    char             inbox[SHM_PUBSUB_NAME_MAX];
+} SHM_PUBSUB_ENTRY;
+
+typedef struct
+{
+    alignas(SHM_PUBSUB_CACHE_LINE) uint32_t magic;
+    pid_t broker;
+
+    alignas(SHM_PUBSUB_CACHE_LINE) _Atomic uint32_t generation;  // Bumped when subscriptions change
+    SHM_PUBSUB_ENTRY subs[SHM_PUBSUB_MAX_SUBS];
+} SHM_PUBSUB_DIR;
+
+// Publisher-side cache: which subscriptions a topic matched at a given generation
+typedef struct
+{
+    uint32_t generation;
+    uint32_t hash;
+    uint64_t mask;  // Bit i: subs[i] matches
+    char     topic[SHM_PUBSUB_TOPIC_MAX];
+} SHM_PUBSUB_ROUTE;
+
+typedef struct
+{
+    SHM_PUBSUB_DIR  *dir;
+    size_t           map_size;
+    int              fd;
+    int              owner;  // Created the directory; unlinks it on close
+    char             name[SHM_PUBSUB_NAME_MAX];
+
+    // Publisher state: inboxes opened lazily and re-checked when the generation changes
+    uint32_t         generation;
+    SHM_MPMC         inbox[SHM_PUBSUB_MAX_SUBS];
+    uint32_t         inbox_incarnation[SHM_PUBSUB_MAX_SUBS];
+    uint8_t          inbox_open[SHM_PUBSUB_MAX_SUBS];
+    SHM_PUBSUB_ROUTE routes[SHM_PUBSUB_ROUTES];
+    uint8_t         *scratch;  // Message being assembled
+    size_t           scratch_size;
+} SHM_PUBSUB;
+
+typedef struct
+{
+    SHM_PUBSUB *ps;
+    int         index;  // Entry in dir->subs
+    SHM_MPMC    inbox;
+    uint8_t    *buf;    // Last received message; SHM_PUBSUB_MSG points into it
+} SHM_PUBSUB_SUB;
+
+typedef struct
+{
+    const char *topic;
+    const void *data;
+    uint32_t    len;
+    uint32_t    flags;         // SHM_PUBSUB_BRIDGED
+    uint64_t    published_ns;  // CLOCK_MONOTONIC time of the publish
+} SHM_PUBSUB_MSG;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) the subscription directory (broker side).
+     * @param[out] ps Pub/sub handle.
+     * @param[in] name POSIX shm name, e.g. "/pubsub".
+     * @return SHM_PUBSUB_SUCCESS on success, SHM_PUBSUB_ERROR on failure.
+     */
+    int shm_pubsub_create(SHM_PUBSUB *ps, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open the directory created by the broker (publishers and subscribers). One
+     *        handle per thread.
+     * @param[out] ps Pub/sub handle.
+     * @param[in] name POSIX shm name.
+     * @return SHM_PUBSUB_SUCCESS on success, SHM_PUBSUB_ERROR on failure.
+     */
+    int shm_pubsub_open(SHM_PUBSUB *ps, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Close every inbox this handle opened and unmap the directory. The broker
+     *        also unlinks it. Unsubscribe first.
+     * @param[in,out] ps Pub/sub handle.
+     */
+    void shm_pubsub_close(SHM_PUBSUB *ps);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Check a topic against an MQTT-style filter ('+' one level, trailing '#' the rest).
+     * @param[in] filter Topic filter.
+     * @param[in] topic Concrete topic (no wildcards).
+     * @return 1 if the topic matches, 0 otherwise.
+     */
+    int shm_pubsub_match(const char *filter, const char *topic);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Deliver a message to every subscription whose filter matches @p topic.
+     * @param[in,out] ps Pub/sub handle.
+     * @param[in] topic Topic, no wildcards, shorter than SHM_PUBSUB_TOPIC_MAX.
+     * @param[in] data Payload.
+     * @param[in] len Payload size.
+     * @param[in] flags 0, or SHM_PUBSUB_BRIDGED for messages injected by the bridge.
+     * @param[out] delivered Number of inboxes that took the message (may be NULL).
+     * @return SHM_PUBSUB_SUCCESS (also with no subscribers), SHM_PUBSUB_ERROR on a bad topic.
+     */
+    int shm_pubsub_publish(SHM_PUBSUB *ps, const char *topic, const void *data, uint32_t len, uint32_t flags, uint32_t *delivered);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Subscribe: create an inbox and register it under @p filter.
+     * @param[in,out] ps Pub/sub handle.
+     * @param[in] filter MQTT-style topic filter.
+     * @param[in] queue_len Inbox capacity in messages.
+     * @param[in] max_payload Largest payload accepted; bigger messages are dropped.
+     * @param[in] flags 0, or SHM_PUBSUB_NO_BRIDGED.
+     * @param[out] sub Subscription handle.
+     * @return SHM_PUBSUB_SUCCESS, or SHM_PUBSUB_ERROR (bad filter, table full).
+     */
+    int shm_pubsub_subscribe(SHM_PUBSUB *ps, const char *filter, uint32_t queue_len, uint32_t max_payload, uint32_t flags, SHM_PUBSUB_SUB *sub);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Remove the subscription and destroy its inbox.
+     * @param[in,out] sub Subscription handle.
+     */
+    void shm_pubsub_unsubscribe(SHM_PUBSUB_SUB *sub);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Take the next message from the inbox without blocking.
+     * @param[in,out] sub Subscription handle.
+     * @param[out] msg Message; its pointers stay valid until the next recv.
+     * @return SHM_PUBSUB_SUCCESS, or SHM_PUBSUB_AGAIN if the inbox is empty.
+     */
+    int shm_pubsub_recv(SHM_PUBSUB_SUB *sub, SHM_PUBSUB_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Sleep until the inbox has a message.
+     * @param[in,out] sub Subscription handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_PUBSUB_SUCCESS, SHM_PUBSUB_AGAIN on timeout, SHM_PUBSUB_ERROR on failure.
+     */
+    int shm_pubsub_wait(SHM_PUBSUB_SUB *sub, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when the inbox may have a
+     *        message. Created on first use.
+     * @param[in,out] sub Subscription handle.
+     * @return Descriptor (closed by shm_pubsub_unsubscribe()), or -1 on failure.
+     */
+    int shm_pubsub_pollfd(SHM_PUBSUB_SUB *sub);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_pubsub_recv() that arms the poll descriptor before returning
+     *        SHM_PUBSUB_AGAIN.
+     * @param[in,out] sub Subscription handle.
+     * @param[out] msg Message; its pointers stay valid until the next recv.
+     * @return SHM_PUBSUB_SUCCESS, or SHM_PUBSUB_AGAIN if the inbox is empty.
+     */
+    int shm_pubsub_try_recv(SHM_PUBSUB_SUB *sub, SHM_PUBSUB_MSG *msg);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Free the entries of subscribers that died and unlink their inboxes (broker).
+     * @param[in,out] ps Pub/sub handle.
+     * @return Number of subscriptions removed.
+     */
+    int shm_pubsub_reap(SHM_PUBSUB *ps);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_PUBSUB_H
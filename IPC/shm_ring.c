@@ -0,0 +1,772 @@
+/**
+ * @file    shm_ring.c
+ * @brief   Lock-free single-producer/single-consumer ring of variable-length records
+ *          in POSIX shared memory.
+ *
+ */
+
+#include "shm_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+#define SHM_RING_MAGIC  0x52494E47u  // "RING"
+#define SHM_RING_PAD    0xFFFFFFFFu  // Length value of the filler before a wrap
+#define SHM_RING_ALIGN  8
+#define SHM_RING_MIN    64
+
+#define HUGETLBFS_MAGIC 0x958458f6  // statfs f_type of a hugetlbfs mount
+#define THP_SIZE        (2 * 1024 * 1024)
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23  // Linux 5.14
+#endif
+
+static inline uint32_t record_size(uint32_t len)
+{
+    return (sizeof(uint32_t) + len + SHM_RING_ALIGN - 1) & ~(uint32_t)(SHM_RING_ALIGN - 1);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void hugetlb_path(char *path, size_t size, const char *name)
+{
+    snprintf(path, size, "%s/%s", SHM_RING_HUGETLBFS, name[0] == '/' ? name + 1 : name);
+}
+
+// Reserve a THP-aligned address range for the mapping; NULL lets the kernel choose
+static void *thp_aligned_hint(size_t size)
+{
+    uint8_t *res = mmap(NULL, size + THP_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    uint8_t *aligned;
+
+    if (res == MAP_FAILED)
+    {
+        return NULL;
+    }
+    aligned = (uint8_t *)(((uintptr_t)res + THP_SIZE - 1) & ~(uintptr_t)(THP_SIZE - 1));
+    if (aligned > res)
+    {
+        munmap(res, aligned - res);
+    }
+    munmap(aligned + size, res + THP_SIZE - aligned);
+    return aligned;
+}
+
+// Map the segment, then apply huge page advice, prefaulting and locking as requested.
+// Options the system refuses are dropped from r->flags with a warning.
+static int map_ring(SHM_RING *r, size_t size, uint32_t flags)
+{
+    int   mflags = MAP_SHARED;
+    void *hint = NULL;
+    void *p;
+
+    if (flags & SHM_RING_THP)
+    {
+        // A PMD-sized page can only back a 2 MB aligned virtual address
+        hint = thp_aligned_hint(size);
+        mflags |= hint != NULL ? MAP_FIXED : 0;
+    }
+    else if (flags & SHM_RING_POPULATE)
+    {
+        mflags |= MAP_POPULATE;
+    }
+
+    p = mmap(hint, size, PROT_READ | PROT_WRITE, mflags, r->fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        if (hint != NULL)
+        {
+            munmap(hint, size);
+        }
+        return SHM_RING_ERROR;
+    }
+    if (flags & SHM_RING_THP)
+    {
+        if (madvise(p, size, MADV_HUGEPAGE) == -1)
+        {
+            perror("shm_ring: madvise(MADV_HUGEPAGE)");
+            flags &= ~SHM_RING_THP;
+        }
+        // Prefault only after the advice, so the faults can be served with huge pages
+        if ((flags & SHM_RING_POPULATE) && madvise(p, size, MADV_POPULATE_WRITE) == -1)
+        {
+            perror("shm_ring: madvise(MADV_POPULATE_WRITE)");
+            flags &= ~SHM_RING_POPULATE;
+        }
+    }
+    if ((flags & SHM_RING_MLOCK) && mlock(p, size) == -1)
+    {
+        perror("shm_ring: mlock (raise ulimit -l)");
+        flags &= ~SHM_RING_MLOCK;
+    }
+
+    r->hdr = (SHM_RING_HDR *)p;
+    r->data = (uint8_t *)p + sizeof(SHM_RING_HDR);
+    r->map_size = size;
+    r->flags = flags;
+    return SHM_RING_SUCCESS;
+}
+
+// Create the backing file on hugetlbfs; its size must be a multiple of the huge page size
+static int create_hugetlb(SHM_RING *r, size_t size, uint32_t flags)
+{
+    char          path[sizeof(SHM_RING_HUGETLBFS) + SHM_RING_NAME_MAX];
+    struct statfs fs;
+
+    if (statfs(SHM_RING_HUGETLBFS, &fs) == -1 || fs.f_type != HUGETLBFS_MAGIC)
+    {
+        fprintf(stderr, "shm_ring: %s is not a hugetlbfs mount\n", SHM_RING_HUGETLBFS);
+        return SHM_RING_ERROR;
+    }
+    size = (size + fs.f_bsize - 1) & ~(size_t)(fs.f_bsize - 1);
+
+    hugetlb_path(path, sizeof(path), r->name);
+    unlink(path);  // Replace, never truncate: a process may still map the old file
+    r->fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0666);
+    if (r->fd == -1)
+    {
+        perror("shm_ring: open hugetlbfs file");
+        return SHM_RING_ERROR;
+    }
+    // mmap fails with ENOMEM when too few huge pages are reserved (vm.nr_hugepages)
+    if (ftruncate(r->fd, size) == -1 || map_ring(r, size, flags & ~SHM_RING_THP) != SHM_RING_SUCCESS)
+    {
+        close(r->fd);
+        unlink(path);
+        return SHM_RING_ERROR;
+    }
+    shm_unlink(r->name);  // A stale normal segment of the same name would shadow this one
+    return SHM_RING_SUCCESS;
+}
+
+// Wake both sides so a sleeping reader sees the flag and reopens the ring by name
+static void mark_closed(SHM_RING_HDR *hdr)
+{
+    atomic_store_explicit(&hdr->closed, 1, memory_order_release);
+    shm_notify_wake(&hdr->readable);
+    shm_notify_wake(&hdr->writable);
+}
+
+// Open the ring currently under @p name, if any, to retire it once its replacement is ready
+static int open_current(const char *name)
+{
+    char path[sizeof(SHM_RING_HUGETLBFS) + SHM_RING_NAME_MAX];
+    int  fd = shm_open(name, O_RDWR, 0);
+
+    if (fd == -1)
+    {
+        hugetlb_path(path, sizeof(path), name);
+        fd = open(path, O_RDWR);
+    }
+    return fd;
+}
+
+static void retire_ring(int fd)
+{
+    struct stat st;
+    void       *p;
+
+    if (fd == -1)
+    {
+        return;
+    }
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(SHM_RING_HDR))
+    {
+        p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            if (((SHM_RING_HDR *)p)->magic == SHM_RING_MAGIC)
+            {
+                mark_closed((SHM_RING_HDR *)p);
+            }
+            munmap(p, st.st_size);
+        }
+    }
+    close(fd);
+}
+
+static void load_positions(SHM_RING *r)
+{
+    r->mask = r->hdr->capacity - 1;
+    r->local_head = atomic_load_explicit(&r->hdr->head, memory_order_acquire);
+    r->local_tail = atomic_load_explicit(&r->hdr->tail, memory_order_acquire);
+    r->pending = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) a named ring.
+ * @param[out] r Ring handle.
+ * @param[in] name POSIX shm name, e.g. "/my_ring".
+ * @param[in] capacity Data area size in bytes; rounded up to a power of two.
+ * @return SHM_RING_SUCCESS on success, SHM_RING_ERROR on failure.
+ */
+int shm_ring_create(SHM_RING *r, const char *name, size_t capacity)
+{
+    return shm_ring_create_ex(r, name, capacity, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Create (or replace) a named ring with page-backing options.
+ * @param[out] r Ring handle; r->flags reports which options took effect.
+ * @param[in] name POSIX shm name, e.g. "/my_ring".
+ * @param[in] capacity Data area size in bytes; rounded up to a power of two.
+ * @param[in] flags SHM_RING_HUGETLB, SHM_RING_THP, SHM_RING_POPULATE, SHM_RING_MLOCK.
+ *            An option the system cannot provide is dropped with a warning.
+ * @return SHM_RING_SUCCESS on success, SHM_RING_ERROR on failure.
+ */
+int shm_ring_create_ex(SHM_RING *r, const char *name, size_t capacity, uint32_t flags)
+{
+    size_t cap = SHM_RING_MIN;
+    int    old = open_current(name);
+
+    while (cap < capacity && cap < (1u << 31))
+    {
+        cap <<= 1;
+    }
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+
+    if ((flags & SHM_RING_HUGETLB) && create_hugetlb(r, sizeof(SHM_RING_HDR) + cap, flags) != SHM_RING_SUCCESS)
+    {
+        fprintf(stderr, "shm_ring: no huge pages for %s, using normal pages\n", name);
+        flags &= ~SHM_RING_HUGETLB;
+    }
+    if (!(flags & SHM_RING_HUGETLB))
+    {
+        char path[sizeof(SHM_RING_HUGETLBFS) + SHM_RING_NAME_MAX];
+
+        hugetlb_path(path, sizeof(path), name);
+        unlink(path);  // Drop a stale huge page ring of the same name, if any
+
+        shm_unlink(name);  // Replace, never truncate: a process may still map the old segment
+        r->fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (r->fd == -1)
+        {
+            perror("shm_open");
+            retire_ring(old);
+            return SHM_RING_ERROR;
+        }
+
+        if (ftruncate(r->fd, sizeof(SHM_RING_HDR) + cap) == -1)
+        {
+            perror("ftruncate");
+            close(r->fd);
+            retire_ring(old);
+            return SHM_RING_ERROR;
+        }
+        if (map_ring(r, sizeof(SHM_RING_HDR) + cap, flags) != SHM_RING_SUCCESS)
+        {
+            close(r->fd);
+            retire_ring(old);
+            return SHM_RING_ERROR;
+        }
+    }
+
+    r->hdr->capacity = (uint32_t)cap;
+    r->hdr->flags = r->flags;
+    atomic_store_explicit(&r->hdr->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&r->hdr->tail, 0, memory_order_relaxed);
+    shm_notify_init(&r->hdr->readable);
+    shm_notify_init(&r->hdr->writable);
+    atomic_thread_fence(memory_order_release);
+    r->hdr->magic = SHM_RING_MAGIC;
+
+    // Readers of the old ring reopen the name only now, and find this one ready
+    retire_ring(old);
+    r->owner = 1;
+    load_positions(r);
+    return SHM_RING_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open a ring created by another process, mapped with the creator's flags.
+ * @param[out] r Ring handle.
+ * @param[in] name POSIX shm name.
+ * @return SHM_RING_SUCCESS on success, SHM_RING_AGAIN (nothing printed) if no ring of
+ *         that name exists yet, SHM_RING_ERROR on failure.
+ */
+int shm_ring_open(SHM_RING *r, const char *name)
+{
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+
+    r->fd = shm_open(name, O_RDWR, 0666);
+    if (r->fd == -1 && errno == ENOENT)
+    {
+        char path[sizeof(SHM_RING_HUGETLBFS) + SHM_RING_NAME_MAX];
+
+        hugetlb_path(path, sizeof(path), name);
+        r->fd = open(path, O_RDWR);
+        if (r->fd == -1 && errno == ENOENT)
+        {
+            return SHM_RING_AGAIN;  // Not created yet
+        }
+    }
+    if (r->fd == -1)
+    {
+        perror("shm_open");
+        return SHM_RING_ERROR;
+    }
+    if (fstat(r->fd, &st) == -1 || (size_t)st.st_size <= sizeof(SHM_RING_HDR))
+    {
+        fprintf(stderr, "shm_ring: %s is not a ring\n", name);
+        close(r->fd);
+        return SHM_RING_ERROR;
+    }
+    if (map_ring(r, st.st_size, 0) != SHM_RING_SUCCESS)
+    {
+        close(r->fd);
+        return SHM_RING_ERROR;
+    }
+
+    // Huge page segments are rounded up to whole pages, so the size may exceed the ring
+    atomic_thread_fence(memory_order_acquire);
+    if (r->hdr->magic != SHM_RING_MAGIC || sizeof(SHM_RING_HDR) + r->hdr->capacity > (size_t)st.st_size)
+    {
+        fprintf(stderr, "shm_ring: %s is not an initialized ring\n", name);
+        munmap(r->hdr, r->map_size);
+        close(r->fd);
+        return SHM_RING_ERROR;
+    }
+
+    // Map again the way the creator did (hugetlbfs needs nothing extra)
+    uint32_t flags = r->hdr->flags & (SHM_RING_THP | SHM_RING_POPULATE | SHM_RING_MLOCK);
+    if (flags != 0)
+    {
+        munmap(r->hdr, r->map_size);
+        if (map_ring(r, st.st_size, flags) != SHM_RING_SUCCESS)
+        {
+            close(r->fd);
+            return SHM_RING_ERROR;
+        }
+    }
+
+    load_positions(r);
+    return SHM_RING_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Unmap the ring. The creating process also marks it closed for its reader and
+ *        unlinks the name.
+ * @param[in,out] r Ring handle.
+ */
+void shm_ring_close(SHM_RING *r)
+{
+    shm_notify_poll_close(&r->poll);
+
+    // A ring already closed was retired by a newer one, which owns the name now. Unlink
+    // before closing, so a woken reader cannot reopen this ring by name.
+    if (r->owner && r->hdr != NULL && !atomic_load_explicit(&r->hdr->closed, memory_order_acquire))
+    {
+        if (r->flags & SHM_RING_HUGETLB)
+        {
+            char path[sizeof(SHM_RING_HUGETLBFS) + SHM_RING_NAME_MAX];
+
+            hugetlb_path(path, sizeof(path), r->name);
+            if (unlink(path) == -1)
+            {
+                perror("unlink");
+            }
+        }
+        else if (shm_unlink(r->name) == -1)
+        {
+            perror("shm_unlink");
+        }
+        mark_closed(r->hdr);
+    }
+    if (r->hdr != NULL && munmap(r->hdr, r->map_size) == -1)
+    {
+        perror("munmap");
+    }
+    if (r->fd >= 0 && close(r->fd) == -1)
+    {
+        perror("close");
+    }
+    r->hdr = NULL;
+    r->fd = -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest payload a single record can carry.
+ * @param[in] r Ring handle.
+ * @return Maximum payload size in bytes.
+ */
+uint32_t shm_ring_max_record(const SHM_RING *r)
+{
+    // Half the ring: a maximal record plus the pad before it always fits in an empty ring
+    return r->hdr->capacity / 2 - sizeof(uint32_t);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Publish every record committed so far (producer only).
+ * @param[in,out] r Ring handle.
+ */
+void shm_ring_flush(SHM_RING *r)
+{
+    atomic_store_explicit(&r->hdr->head, r->local_head, memory_order_release);
+    shm_notify_wake(&r->hdr->readable);
+}
+
+static void publish_tail(SHM_RING *r)
+{
+    atomic_store_explicit(&r->hdr->tail, r->local_tail, memory_order_release);
+    shm_notify_wake(&r->hdr->writable);
+}
+
+// Producer: does a record of padded size @p size fit at the current position?
+static int ring_fits(SHM_RING *r, uint32_t size)
+{
+    uint64_t capacity = r->mask + 1;
+    uint64_t contig = capacity - (r->local_head & r->mask);
+    uint64_t need = size <= contig ? size : contig + size;
+
+    if (r->local_head + need - r->local_tail > capacity)
+    {
+        r->local_tail = atomic_load_explicit(&r->hdr->tail, memory_order_acquire);
+        if (r->local_head + need - r->local_tail > capacity)
+        {
+            // Batched commits must become visible, or the consumer can never make room
+            if (atomic_load_explicit(&r->hdr->head, memory_order_relaxed) != r->local_head)
+            {
+                shm_ring_flush(r);
+            }
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Reserve space for a record (producer only).
+ * @param[in,out] r Ring handle.
+ * @param[in] len Payload size.
+ * @return Pointer to write the payload to, or NULL if the ring is full or len is too large.
+ */
+void *shm_ring_reserve(SHM_RING *r, uint32_t len)
+{
+    uint64_t off = r->local_head & r->mask;
+    uint64_t contig = r->mask + 1 - off;
+    uint32_t size = record_size(len);
+
+    if (len > shm_ring_max_record(r) || !ring_fits(r, size))
+    {
+        return NULL;
+    }
+
+    if (size > contig)
+    {
+        *(uint32_t *)(r->data + off) = SHM_RING_PAD;
+        r->local_head += contig;
+        off = 0;
+    }
+    *(uint32_t *)(r->data + off) = len;
+    r->pending = size;
+    return r->data + off + sizeof(uint32_t);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Finish the reserved record.
+ * @param[in,out] r Ring handle.
+ * @param[in] len Payload size passed to shm_ring_reserve().
+ * @param[in] publish Non-zero to publish every committed record to the consumer.
+ */
+void shm_ring_commit(SHM_RING *r, uint32_t len, int publish)
+{
+    r->local_head += record_size(len);
+    r->pending = 0;
+    if (publish)
+    {
+        shm_ring_flush(r);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Copy a record into the ring and publish it (producer only).
+ * @param[in,out] r Ring handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size.
+ * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if full, SHM_RING_ERROR if len is too large.
+ */
+int shm_ring_write(SHM_RING *r, const void *data, uint32_t len)
+{
+    void *dst;
+
+    if (len > shm_ring_max_record(r))
+    {
+        return SHM_RING_ERROR;
+    }
+    dst = shm_ring_reserve(r, len);
+    if (dst == NULL)
+    {
+        return SHM_RING_AGAIN;
+    }
+    memcpy(dst, data, len);
+    shm_ring_commit(r, len, 1);
+    return SHM_RING_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Look at the next record without consuming it (consumer only).
+ * @param[in,out] r Ring handle.
+ * @param[out] len Payload size.
+ * @return Pointer to the payload, valid until shm_ring_release(), or NULL if empty.
+ */
+const void *shm_ring_peek(SHM_RING *r, uint32_t *len)
+{
+    for (;;)
+    {
+        uint64_t off;
+        uint32_t l;
+
+        if (r->local_tail == r->local_head)
+        {
+            r->local_head = atomic_load_explicit(&r->hdr->head, memory_order_acquire);
+            if (r->local_tail == r->local_head)
+            {
+                // Hand batched releases back, or a producer waiting for space never gets it
+                if (atomic_load_explicit(&r->hdr->tail, memory_order_relaxed) != r->local_tail)
+                {
+                    publish_tail(r);
+                }
+                return NULL;
+            }
+        }
+
+        off = r->local_tail & r->mask;
+        l = *(const uint32_t *)(r->data + off);
+        if (l == SHM_RING_PAD)
+        {
+            r->local_tail += r->mask + 1 - off;
+            continue;
+        }
+
+        *len = l;
+        r->pending = record_size(l);
+        return r->data + off + sizeof(uint32_t);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Consume the record returned by shm_ring_peek().
+ * @param[in,out] r Ring handle.
+ * @param[in] publish Non-zero to publish the new tail to the producer.
+ */
+void shm_ring_release(SHM_RING *r, int publish)
+{
+    r->local_tail += r->pending;
+    r->pending = 0;
+    if (publish)
+    {
+        publish_tail(r);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Copy the next record out of the ring (consumer only).
+ * @param[in,out] r Ring handle.
+ * @param[out] buf Destination buffer.
+ * @param[in] size Size of @p buf.
+ * @param[out] len Payload size.
+ * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if empty, SHM_RING_ERROR if @p buf is too small.
+ */
+int shm_ring_read(SHM_RING *r, void *buf, uint32_t size, uint32_t *len)
+{
+    const void *src = shm_ring_peek(r, len);
+
+    if (src == NULL)
+    {
+        return SHM_RING_AGAIN;
+    }
+    if (*len > size)
+    {
+        r->pending = 0;
+        return SHM_RING_ERROR;
+    }
+    memcpy(buf, src, *len);
+    shm_ring_release(r, 1);
+    return SHM_RING_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Block until a record can be read (consumer only).
+ * @param[in,out] r Ring handle.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_RING_SUCCESS when a record is available, SHM_RING_AGAIN on timeout,
+ *         SHM_RING_CLOSED when the ring is closed and drained, SHM_RING_ERROR on failure.
+ */
+int shm_ring_wait_readable(SHM_RING *r, int timeout_ms)
+{
+    int64_t  deadline = now_ms() + timeout_ms;
+    uint32_t len;
+
+    // Peeking an empty ring also publishes batched releases before we sleep
+    while (shm_ring_peek(r, &len) == NULL)
+    {
+        uint32_t seq = shm_notify_prepare(&r->hdr->readable);
+        int      remaining = timeout_ms < 0 ? -1 : (int)(deadline - now_ms());
+        int      closed = atomic_load_explicit(&r->hdr->closed, memory_order_acquire);
+
+        // Checked before the peek: records published before the close are still drained
+        if (shm_ring_peek(r, &len) != NULL)
+        {
+            shm_notify_cancel(&r->hdr->readable);
+            break;
+        }
+        if (closed)
+        {
+            shm_notify_cancel(&r->hdr->readable);
+            return SHM_RING_CLOSED;
+        }
+        if (timeout_ms >= 0 && remaining <= 0)
+        {
+            shm_notify_cancel(&r->hdr->readable);
+            return SHM_RING_AGAIN;
+        }
+        if (shm_notify_wait(&r->hdr->readable, seq, remaining) == SHM_NOTIFY_ERROR)
+        {
+            return SHM_RING_ERROR;
+        }
+    }
+    r->pending = 0;
+    return SHM_RING_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Block until a record of @p len bytes fits (producer only).
+ * @param[in,out] r Ring handle.
+ * @param[in] len Payload size.
+ * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+ * @return SHM_RING_SUCCESS when it fits, SHM_RING_AGAIN on timeout, SHM_RING_ERROR if
+ *         @p len can never fit or on failure.
+ */
+int shm_ring_wait_writable(SHM_RING *r, uint32_t len, int timeout_ms)
+{
+    int64_t  deadline = now_ms() + timeout_ms;
+    uint32_t size = record_size(len);
+
+    if (len > shm_ring_max_record(r))
+    {
+        return SHM_RING_ERROR;
+    }
+
+    // A full ring also flushes batched commits before we sleep
+    while (!ring_fits(r, size))
+    {
+        uint32_t seq = shm_notify_prepare(&r->hdr->writable);
+        int      remaining = timeout_ms < 0 ? -1 : (int)(deadline - now_ms());
+
+        if (ring_fits(r, size))
+        {
+            shm_notify_cancel(&r->hdr->writable);
+            break;
+        }
+        if (timeout_ms >= 0 && remaining <= 0)
+        {
+            shm_notify_cancel(&r->hdr->writable);
+            return SHM_RING_AGAIN;
+        }
+        if (shm_notify_wait(&r->hdr->writable, seq, remaining) == SHM_NOTIFY_ERROR)
+        {
+            return SHM_RING_ERROR;
+        }
+    }
+    return SHM_RING_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get a descriptor for epoll that becomes readable when the ring may have
+ *        a record (consumer) or room (producer). Created on first use.
+ * @param[in,out] r Ring handle.
+ * @param[in] writable 0 on the consumer side, 1 on the producer side.
+ * @return Descriptor (closed by shm_ring_close()), or -1 on failure.
+ */
+int shm_ring_pollfd(SHM_RING *r, int writable)
+{
+    if (r->poll.id == 0)
+    {
+        if (shm_notify_poll_open(&r->poll) != SHM_NOTIFY_SUCCESS)
+        {
+            return -1;
+        }
+        if (shm_notify_poll_attach(&r->poll, writable ? &r->hdr->writable : &r->hdr->readable) != SHM_NOTIFY_SUCCESS)
+        {
+            shm_notify_poll_close(&r->poll);
+            return -1;
+        }
+    }
+    return r->poll.fd;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_ring_read() that arms the poll descriptor before returning SHM_RING_AGAIN.
+ * @param[in,out] r Ring handle.
+ * @param[out] buf Destination buffer.
+ * @param[in] size Size of @p buf.
+ * @param[out] len Payload size.
+ * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if empty, SHM_RING_ERROR if @p buf is too small.
+ */
+int shm_ring_try_read(SHM_RING *r, void *buf, uint32_t size, uint32_t *len)
+{
+    int ret = shm_ring_read(r, buf, size, len);
+
+    if (ret == SHM_RING_AGAIN && r->poll.id != 0)
+    {
+        // A record published between the read and the arming is caught by the re-read
+        shm_notify_poll_arm(&r->poll);
+        ret = shm_ring_read(r, buf, size, len);
+    }
+    return ret;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief shm_ring_write() that arms the poll descriptor before returning SHM_RING_AGAIN.
+ * @param[in,out] r Ring handle.
+ * @param[in] data Payload.
+ * @param[in] len Payload size.
+ * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if full, SHM_RING_ERROR if len is too large.
+ */
+int shm_ring_try_write(SHM_RING *r, const void *data, uint32_t len)
+{
+    int ret = shm_ring_write(r, data, len);
+
+    if (ret == SHM_RING_AGAIN && r->poll.id != 0)
+    {
+        shm_notify_poll_arm(&r->poll);
+        ret = shm_ring_write(r, data, len);
+    }
+    return ret;
+}
@@ -0,0 +1,285 @@
+/**
+ * @file    shm_ring.h
+ * @brief   Lock-free single-producer/single-consumer ring of variable-length records
+ *          in POSIX shared memory.
+ *
+ * Segment layout (all offsets cache-line aligned):
+ *   header line   - magic, capacity
+ *   head line     - producer position, written only by the producer
+ *   tail line     - consumer position, written only by the consumer
+ *   notify lines  - futex words for a sleeping consumer / producer
+ *   data          - capacity bytes (power of two)
+ *
+ * Positions are free-running 64-bit byte counters. Each record is a 4-byte length
+ * followed by the payload, padded to 8 bytes. A record never wraps: if it does not
+ * fit before the end of the data area, a pad marker fills the rest and the record
+ * starts at offset 0. The producer publishes head with a release store after the
+ * payload is written; the consumer publishes tail with a release store after it is
+ * done with the payload. Each side caches the other side's position and only reloads
+ * it when the cached value says the ring is full/empty, so in steady state the two
+ * cores only exchange cache lines when there is data to move.
+ *
+ * Blocking is optional: shm_ring_wait_readable()/shm_ring_wait_writable() sleep on
+ * futex notifiers kept in their own header lines. Publishing checks for a sleeper
+ * and makes a system call only when there is one.
+ *
+ * Large rings (video frames) can be created with shm_ring_create_ex() flags that
+ * trade startup work for steady-state speed: huge pages (hugetlbfs or transparent),
+ * prefaulting, and locking the pages in RAM. The flags in effect are stored in the
+ * header and applied again by shm_ring_open(), so readers map the ring the same way.
+ *
+ * A ring is closed when its producer calls shm_ring_close(), or when shm_ring_create()
+ * replaces it under the same name (a restarted writer). shm_ring_wait_readable() then
+ * returns SHM_RING_CLOSED once the remaining records are drained, and the reader can
+ * shm_ring_open() the name again to follow the new ring.
+ *
+ * For event loops, shm_ring_pollfd() returns a descriptor to add to epoll (see
+ * shm_notify.h). shm_ring_try_read() and shm_ring_try_write() arm it whenever they
+ * return SHM_RING_AGAIN, so it fires once the other side makes progress.
+ *
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "shm_notify.h"
+
+/** Success return code */
+#define SHM_RING_SUCCESS 0
+/** Failure return code */
+#define SHM_RING_ERROR   1
+/** Ring full (write) or empty (read); try again later */
+#define SHM_RING_AGAIN   2
+/** Ring closed by its producer or replaced by a newer one; reopen it by name */
+#define SHM_RING_CLOSED  3
+
+#define SHM_RING_CACHE_LINE 64
+#define SHM_RING_NAME_MAX   64
+
+/** Back the ring with hugetlbfs pages (file under SHM_RING_HUGETLBFS); falls back to
+ *  normal pages if the mount or reserved pages are missing */
+#define SHM_RING_HUGETLB  0x1
+/** Ask for transparent huge pages (MADV_HUGEPAGE); needs shmem THP enabled */
+#define SHM_RING_THP      0x2
+/** Prefault every page at map time instead of on first touch */
+#define SHM_RING_POPULATE 0x4
+/** mlock() the mapping; limited by RLIMIT_MEMLOCK */
+#define SHM_RING_MLOCK    0x8
+
+/** hugetlbfs mount used for SHM_RING_HUGETLB rings */
+#define SHM_RING_HUGETLBFS "/dev/hugepages"
+
+typedef struct
+{
+    alignas(SHM_RING_CACHE_LINE) uint32_t magic;
+    uint32_t         capacity;  // Data area size in bytes, power of two
+    uint32_t         flags;     // SHM_RING_HUGETLB etc. that took effect at creation
+    _Atomic uint32_t closed;    // Set by the producer's close, or when a new ring takes the name
+
+    alignas(SHM_RING_CACHE_LINE) _Atomic uint64_t head;  // Producer position
+    alignas(SHM_RING_CACHE_LINE) _Atomic uint64_t tail;  // Consumer position
+
+    alignas(SHM_RING_CACHE_LINE) SHM_NOTIFY readable;  // Consumer sleeps here when empty
+    alignas(SHM_RING_CACHE_LINE) SHM_NOTIFY writable;  // Producer sleeps here when full
+} SHM_RING_HDR;
+
+typedef struct
+{
+    SHM_RING_HDR   *hdr;
+    uint8_t        *data;
+    uint64_t        mask;
+    uint64_t        local_head;  // Producer: next write position, consumer: cached head
+    uint64_t        local_tail;  // Consumer: next read position, producer: cached tail
+    uint32_t        pending;     // Padded size of the reserved or peeked record
+    size_t          map_size;
+    uint32_t        flags;  // Mapping flags that took effect in this process
+    int             fd;
+    int             owner;  // Created the segment; unlinks it on close
+    char            name[SHM_RING_NAME_MAX];
+    SHM_NOTIFY_POLL poll;   // Event-loop poller, see shm_ring_pollfd()
+} SHM_RING;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) a named ring.
+     * @param[out] r Ring handle.
+     * @param[in] name POSIX shm name, e.g. "/my_ring".
+     * @param[in] capacity Data area size in bytes; rounded up to a power of two.
+     * @return SHM_RING_SUCCESS on success, SHM_RING_ERROR on failure.
+     */
+    int shm_ring_create(SHM_RING *r, const char *name, size_t capacity);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Create (or replace) a named ring with page-backing options.
+     * @param[out] r Ring handle; r->flags reports which options took effect.
+     * @param[in] name POSIX shm name, e.g. "/my_ring".
+     * @param[in] capacity Data area size in bytes; rounded up to a power of two.
+     * @param[in] flags SHM_RING_HUGETLB, SHM_RING_THP, SHM_RING_POPULATE, SHM_RING_MLOCK.
+     *            An option the system cannot provide is dropped with a warning.
+     * @return SHM_RING_SUCCESS on success, SHM_RING_ERROR on failure.
+     */
+    int shm_ring_create_ex(SHM_RING *r, const char *name, size_t capacity, uint32_t flags);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open a ring created by another process, mapped with the creator's flags.
+     * @param[out] r Ring handle.
+     * @param[in] name POSIX shm name.
+     * @return SHM_RING_SUCCESS on success, SHM_RING_AGAIN (nothing printed) if no ring of
+     *         that name exists yet, SHM_RING_ERROR on failure.
+     */
+    int shm_ring_open(SHM_RING *r, const char *name);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Unmap the ring. The creating process also marks it closed for its reader and
+     *        unlinks the name.
+     * @param[in,out] r Ring handle.
+     */
+    void shm_ring_close(SHM_RING *r);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest payload a single record can carry.
+     * @param[in] r Ring handle.
+     * @return Maximum payload size in bytes.
+     */
+    uint32_t shm_ring_max_record(const SHM_RING *r);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Reserve space for a record (producer only). Nothing is visible to the
+     *        consumer until a publishing shm_ring_commit() or shm_ring_flush().
+     * @param[in,out] r Ring handle.
+     * @param[in] len Payload size.
+     * @return Pointer to write the payload to, or NULL if the ring is full or len is too large.
+     */
+    void *shm_ring_reserve(SHM_RING *r, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Finish the reserved record. With @p publish 0 the record stays private, so a
+     *        batch of records can be made visible with one store by the last commit.
+     * @param[in,out] r Ring handle.
+     * @param[in] len Payload size passed to shm_ring_reserve().
+     * @param[in] publish Non-zero to publish every committed record to the consumer.
+     */
+    void shm_ring_commit(SHM_RING *r, uint32_t len, int publish);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Publish every record committed so far (producer only), e.g. at the end of a
+     *        batch. A reserve that finds the ring full flushes on its own.
+     * @param[in,out] r Ring handle.
+     */
+    void shm_ring_flush(SHM_RING *r);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Copy a record into the ring and publish it (producer only).
+     * @param[in,out] r Ring handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size.
+     * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if full, SHM_RING_ERROR if len is too large.
+     */
+    int shm_ring_write(SHM_RING *r, const void *data, uint32_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Look at the next record without consuming it (consumer only). Finding the
+     *        ring empty publishes any batched releases.
+     * @param[in,out] r Ring handle.
+     * @param[out] len Payload size.
+     * @return Pointer to the payload, valid until shm_ring_release(), or NULL if empty.
+     */
+    const void *shm_ring_peek(SHM_RING *r, uint32_t *len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Consume the record returned by shm_ring_peek(). With @p publish 0 the space is
+     *        handed back to the producer by a later release.
+     * @param[in,out] r Ring handle.
+     * @param[in] publish Non-zero to publish the new tail to the producer.
+     */
+    void shm_ring_release(SHM_RING *r, int publish);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Copy the next record out of the ring (consumer only).
+     * @param[in,out] r Ring handle.
+     * @param[out] buf Destination buffer.
+     * @param[in] size Size of @p buf.
+     * @param[out] len Payload size.
+     * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if empty, SHM_RING_ERROR if @p buf is too small
+     *         (the record is left in the ring and @p len holds its size).
+     */
+    int shm_ring_read(SHM_RING *r, void *buf, uint32_t size, uint32_t *len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Block until a record can be read (consumer only). Uses no CPU while waiting.
+     * @param[in,out] r Ring handle.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_RING_SUCCESS when a record is available, SHM_RING_AGAIN on timeout,
+     *         SHM_RING_CLOSED when the ring is closed and drained, SHM_RING_ERROR on failure.
+     */
+    int shm_ring_wait_readable(SHM_RING *r, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Block until a record of @p len bytes fits (producer only).
+     * @param[in,out] r Ring handle.
+     * @param[in] len Payload size.
+     * @param[in] timeout_ms Timeout in milliseconds, negative to wait forever.
+     * @return SHM_RING_SUCCESS when it fits, SHM_RING_AGAIN on timeout, SHM_RING_ERROR if
+     *         @p len can never fit or on failure.
+     */
+    int shm_ring_wait_writable(SHM_RING *r, uint32_t len, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get a descriptor for epoll that becomes readable when the ring may have
+     *        a record (consumer) or room (producer). Created on first use.
+     * @param[in,out] r Ring handle.
+     * @param[in] writable 0 on the consumer side, 1 on the producer side.
+     * @return Descriptor (closed by shm_ring_close()), or -1 on failure.
+     */
+    int shm_ring_pollfd(SHM_RING *r, int writable);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_ring_read() that arms the poll descriptor before returning SHM_RING_AGAIN.
+     * @param[in,out] r Ring handle.
+     * @param[out] buf Destination buffer.
+     * @param[in] size Size of @p buf.
+     * @param[out] len Payload size.
+     * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if empty, SHM_RING_ERROR if @p buf is too small.
+     */
+    int shm_ring_try_read(SHM_RING *r, void *buf, uint32_t size, uint32_t *len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief shm_ring_write() that arms the poll descriptor before returning SHM_RING_AGAIN.
+     * @param[in,out] r Ring handle.
+     * @param[in] data Payload.
+     * @param[in] len Payload size.
+     * @return SHM_RING_SUCCESS, SHM_RING_AGAIN if full, SHM_RING_ERROR if len is too large.
+     */
+    int shm_ring_try_write(SHM_RING *r, const void *data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_RING_H
@@ -0,0 +1,479 @@
+/**
+ * @file    shm_sync.c
+ * @brief   Process-shared locks for data in shared memory: a robust mutex, a
+ *          writer-preferring reader-writer lock and a seqlock.
+ *
+ */
+
+#include "shm_sync.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PROBE_MS       50  // How often a blocked locker checks whether the writer is still alive
+#define SEQLOCK_SPINS  64  // Busy polls on an odd sequence before yielding to the writer
+
+static pid_t          self_pid;
+static pthread_once_t pid_once = PTHREAD_ONCE_INIT;
+
+static void reset_pid(void)
+{
+    self_pid = getpid();
+}
+
+static void init_pid(void)
+{
+    self_pid = getpid();
+    pthread_atfork(NULL, NULL, reset_pid);
+}
+
+// getpid() is a system call; the write-lock fast path only pays for it once per process
+static pid_t my_pid(void)
+{
+    pthread_once(&pid_once, init_pid);
+    return self_pid;
+}
+
+static int mutex_result(SHM_MUTEX *m, int err)
+{
+    switch (err)
+    {
+        case 0:
+            return SHM_SYNC_SUCCESS;
+        case EBUSY:
+            return SHM_SYNC_BUSY;
+        case EOWNERDEAD:
+            // We own it now; make it usable again and let the caller repair the data
+            if (pthread_mutex_consistent(&m->mutex) != 0)
+            {
+                fprintf(stderr, "shm_mutex: cannot mark recovered mutex consistent\n");
+                return SHM_SYNC_ERROR;
+            }
+            return SHM_SYNC_RECOVERED;
+        default:
+            fprintf(stderr, "shm_mutex: %s\n", strerror(err));
+            return SHM_SYNC_ERROR;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize a robust, process-shared mutex (segment creator only).
+ * @param[out] m Mutex in shared memory.
+ * @return SHM_SYNC_SUCCESS on success, SHM_SYNC_ERROR on failure.
+ */
+int shm_mutex_init(SHM_MUTEX *m)
+{
+    pthread_mutexattr_t attr;
+    int                 err;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    err = pthread_mutex_init(&m->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_mutex_init: %s\n", strerror(err));
+        return SHM_SYNC_ERROR;
+    }
+    return SHM_SYNC_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Lock the mutex, recovering it if the previous owner died.
+ * @param[in,out] m Mutex.
+ * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED (locked; repair the protected data), or
+ *         SHM_SYNC_ERROR.
+ */
+int shm_mutex_lock(SHM_MUTEX *m)
+{
+    return mutex_result(m, pthread_mutex_lock(&m->mutex));
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Lock the mutex if it is free.
+ * @param[in,out] m Mutex.
+ * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED, SHM_SYNC_BUSY or SHM_SYNC_ERROR.
+ */
+int shm_mutex_trylock(SHM_MUTEX *m)
+{
+    return mutex_result(m, pthread_mutex_trylock(&m->mutex));
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Unlock the mutex.
+ * @param[in,out] m Mutex.
+ * @return SHM_SYNC_SUCCESS on success, SHM_SYNC_ERROR on failure.
+ */
+int shm_mutex_unlock(SHM_MUTEX *m)
+{
+    int err = pthread_mutex_unlock(&m->mutex);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_mutex_unlock: %s\n", strerror(err));
+        return SHM_SYNC_ERROR;
+    }
+    return SHM_SYNC_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Destroy the mutex (last user only, before the segment is removed).
+ * @param[in,out] m Mutex.
+ */
+void shm_mutex_destroy(SHM_MUTEX *m)
+{
+    pthread_mutex_destroy(&m->mutex);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Reader-writer lock
+//-------------------------------------------------------------------------------------------------
+
+#define OWNER(s) ((pid_t)((s) & 0xFFFFFFFFu))
+
+static int pid_dead(pid_t pid)
+{
+    return pid != 0 && pid != my_pid() && kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+// If the write owner no longer exists, claim its lock. Returns 1 if we now hold it.
+static int take_over_dead_writer(SHM_RWLOCK *l)
+{
+    uint64_t s = atomic_load(&l->state);
+
+    if (!(s & SHM_RWLOCK_WRITER) || !pid_dead(OWNER(s)))
+    {
+        return 0;
+    }
+    if (!atomic_compare_exchange_strong(&l->state, &s, SHM_RWLOCK_WRITER | (uint32_t)my_pid()))
+    {
+        return 0;  // Someone else reaped it first, or it changed hands
+    }
+    fprintf(stderr, "shm_rwlock: writer %d died holding the lock, recovered\n", (int)OWNER(s));
+    return 1;
+}
+
+static int writers_waiting(SHM_RWLOCK *l)
+{
+    for (int i = 0; i < SHM_RWLOCK_WAITERS; i++)
+    {
+        if (atomic_load(&l->waiting[i]) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Free the slots of waiting writers that died. Returns 1 if any was freed.
+static int reap_dead_waiters(SHM_RWLOCK *l)
+{
+    int reaped = 0;
+
+    for (int i = 0; i < SHM_RWLOCK_WAITERS; i++)
+    {
+        pid_t pid = atomic_load(&l->waiting[i]);
+        if (pid_dead(pid) && atomic_compare_exchange_strong(&l->waiting[i], &pid, 0))
+        {
+            fprintf(stderr, "shm_rwlock: writer %d died waiting for the lock, slot reclaimed\n", (int)pid);
+            reaped = 1;
+        }
+    }
+    return reaped;
+}
+
+// Take a waiting slot; -1 if all are taken (the writer then waits without holding readers off)
+static int register_waiter(SHM_RWLOCK *l)
+{
+    for (int i = 0; i < SHM_RWLOCK_WAITERS; i++)
+    {
+        pid_t free_slot = 0;
+        if (atomic_compare_exchange_strong(&l->waiting[i], &free_slot, my_pid()))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void unregister_waiter(SHM_RWLOCK *l, int slot)
+{
+    if (slot >= 0)
+    {
+        atomic_store(&l->waiting[slot], 0);
+    }
+}
+
+static int reader_may_enter(SHM_RWLOCK *l)
+{
+    return atomic_load(&l->state) < SHM_RWLOCK_WRITER && !writers_waiting(l);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize a reader-writer lock (segment creator only).
+ * @param[out] l Lock in shared memory.
+ */
+void shm_rwlock_init(SHM_RWLOCK *l)
+{
+    atomic_store(&l->state, 0);
+    for (int i = 0; i < SHM_RWLOCK_WAITERS; i++)
+    {
+        atomic_store(&l->waiting[i], 0);
+    }
+    shm_notify_init(&l->readers_wake);
+    shm_notify_init(&l->writers_wake);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Take the lock shared. Waits while a writer holds or waits for it.
+ * @param[in,out] l Lock.
+ * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED if a dead writer had to be cleared
+ *         (the data may be half-written), or SHM_SYNC_ERROR.
+ */
+int shm_rwlock_rdlock(SHM_RWLOCK *l)
+{
+    int ret = SHM_SYNC_SUCCESS;
+
+    for (;;)
+    {
+        uint64_t s = atomic_load_explicit(&l->state, memory_order_relaxed);
+
+        if (s < SHM_RWLOCK_WRITER && !writers_waiting(l))
+        {
+            if (atomic_compare_exchange_weak_explicit(&l->state, &s, s + 1, memory_order_acquire, memory_order_relaxed))
+            {
+                return ret;
+            }
+            continue;
+        }
+        if (take_over_dead_writer(l))
+        {
+            shm_rwlock_wrunlock(l);
+            ret = SHM_SYNC_RECOVERED;
+            continue;
+        }
+        if (reap_dead_waiters(l))
+        {
+            continue;
+        }
+
+        uint32_t seq = shm_notify_prepare(&l->readers_wake);
+        if (reader_may_enter(l))
+        {
+            shm_notify_cancel(&l->readers_wake);
+            continue;
+        }
+        if (shm_notify_wait(&l->readers_wake, seq, PROBE_MS) == SHM_NOTIFY_ERROR)
+        {
+            return SHM_SYNC_ERROR;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Release a shared hold.
+ * @param[in,out] l Lock.
+ */
+void shm_rwlock_rdunlock(SHM_RWLOCK *l)
+{
+    // seq_cst pairs with the writer's registration: either we see it waiting or it sees 0
+    if (atomic_fetch_sub(&l->state, 1) == 1 && writers_waiting(l))
+    {
+        shm_notify_wake(&l->writers_wake);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Take the lock exclusively.
+ * @param[in,out] l Lock.
+ * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED (taken over from a dead writer; repair
+ *         the protected data), or SHM_SYNC_ERROR.
+ */
+int shm_rwlock_wrlock(SHM_RWLOCK *l)
+{
+    // The owner pid goes in with the writer bit, so there is no moment without an owner
+    const uint64_t mine = SHM_RWLOCK_WRITER | (uint32_t)my_pid();
+    uint64_t       s = 0;
+    int            slot;
+
+    // Uncontended: no registration, no notifier traffic
+    if (atomic_compare_exchange_strong_explicit(&l->state, &s, mine, memory_order_acquire, memory_order_relaxed))
+    {
+        return SHM_SYNC_SUCCESS;
+    }
+
+    // Registering as waiting closes the door to new readers
+    slot = register_waiter(l);
+    for (;;)
+    {
+        s = 0;
+        if (atomic_compare_exchange_strong_explicit(&l->state, &s, mine, memory_order_acquire, memory_order_relaxed))
+        {
+            unregister_waiter(l, slot);
+            return SHM_SYNC_SUCCESS;
+        }
+        if (take_over_dead_writer(l))
+        {
+            unregister_waiter(l, slot);
+            return SHM_SYNC_RECOVERED;
+        }
+
+        uint32_t seq = shm_notify_prepare(&l->writers_wake);
+        if (atomic_load(&l->state) == 0)
+        {
+            shm_notify_cancel(&l->writers_wake);
+            continue;
+        }
+        if (shm_notify_wait(&l->writers_wake, seq, PROBE_MS) == SHM_NOTIFY_ERROR)
+        {
+            unregister_waiter(l, slot);
+            shm_notify_wake(&l->readers_wake);
+            return SHM_SYNC_ERROR;
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Release an exclusive hold.
+ * @param[in,out] l Lock.
+ */
+void shm_rwlock_wrunlock(SHM_RWLOCK *l)
+{
+    // One store clears the writer bit and the owner together
+    atomic_store(&l->state, 0);
+
+    // Hand over to the next writer if there is one; readers would only block again
+    if (writers_waiting(l))
+    {
+        shm_notify_wake(&l->writers_wake);
+    }
+    else
+    {
+        shm_notify_wake(&l->readers_wake);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+// Seqlock
+//-------------------------------------------------------------------------------------------------
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize a seqlock (segment creator only).
+ * @param[out] s Seqlock in shared memory.
+ */
+void shm_seqlock_init(SHM_SEQLOCK *s)
+{
+    atomic_store(&s->seq, 0);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Start a read section. Spins while a write is in progress.
+ * @param[in] s Seqlock.
+ * @return Sequence to pass to shm_seqlock_read_retry().
+ */
+uint32_t shm_seqlock_read_begin(SHM_SEQLOCK *s)
+{
+    for (int spins = 0;; spins++)
+    {
+        uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (!(seq & 1))
+        {
+            return seq;
+        }
+        if (spins >= SEQLOCK_SPINS)
+        {
+            sched_yield();  // The writer may be preempted on our CPU
+        }
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief End a read section.
+ * @param[in] s Seqlock.
+ * @param[in] seq Value from shm_seqlock_read_begin().
+ * @return Non-zero if a write overlapped and the data must be read again.
+ */
+int shm_seqlock_read_retry(SHM_SEQLOCK *s, uint32_t seq)
+{
+    // Keep the data loads above the re-check
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&s->seq, memory_order_relaxed) != seq;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Start a write section (writers must already be serialized).
+ * @param[in,out] s Seqlock.
+ */
+void shm_seqlock_write_begin(SHM_SEQLOCK *s)
+{
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    // Keep the data stores below the odd sequence
+    atomic_thread_fence(memory_order_release);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief End a write section and publish it.
+ * @param[in,out] s Seqlock.
+ */
+void shm_seqlock_write_end(SHM_SEQLOCK *s)
+{
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Copy a consistent snapshot of @p len bytes out of seqlock-protected memory.
+ * @param[in] s Seqlock.
+ * @param[out] dst Destination.
+ * @param[in] src Protected data.
+ * @param[in] len Bytes to copy.
+ * @return Sequence of the snapshot (even).
+ */
+uint32_t shm_seqlock_read(SHM_SEQLOCK *s, void *dst, const void *src, size_t len)
+{
+    uint32_t seq;
+
+    do
+    {
+        seq = shm_seqlock_read_begin(s);
+        memcpy(dst, src, len);
+    } while (shm_seqlock_read_retry(s, seq));
+    return seq;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Replace @p len bytes of seqlock-protected memory.
+ * @param[in,out] s Seqlock.
+ * @param[out] dst Protected data.
+ * @param[in] src New contents.
+ * @param[in] len Bytes to copy.
+ */
+void shm_seqlock_write(SHM_SEQLOCK *s, void *dst, const void *src, size_t len)
+{
+    shm_seqlock_write_begin(s);
+    memcpy(dst, src, len);
+    shm_seqlock_write_end(s);
+}
@@ -0,0 +1,219 @@
+/**
+ * @file    shm_sync.h
+ * @brief   Process-shared locks for data in shared memory: a robust mutex, a
+ *          writer-preferring reader-writer lock and a seqlock.
+ *
+ * All three live inside the shared segment and are initialized once by its creator.
+ *
+ * SHM_MUTEX   - pthread mutex with PTHREAD_PROCESS_SHARED and PTHREAD_MUTEX_ROBUST. If
+ *               the owner dies while holding it, the next locker gets SHM_SYNC_RECOVERED:
+ *               it owns the lock, the mutex is already marked consistent, and it must
+ *               repair whatever the dead owner may have left half-written.
+ *
+ * SHM_RWLOCK  - one atomic state word plus futex notifiers (shm_notify.h). Readers do
+ *               not enter while a writer holds or waits for the lock, so a stream of
+ *               readers cannot starve writers. The write owner's pid is part of the
+ *               state word, set by the same CAS that takes the lock and cleared by the
+ *               store that releases it, so a write-locked state always names its owner.
+ *               A writer that dies holding the lock is taken over (SHM_SYNC_RECOVERED).
+ *               Waiting writers register their pid in a slot, and readers reclaim the
+ *               slots of waiters that died. A reader that dies holding the lock leaks
+ *               its count, so keep read sections short and crash-free.
+ *
+ * SHM_SEQLOCK - sequence counter for read-mostly data. Readers never write shared
+ *               memory and retry if a write overlapped; writers must be serialized
+ *               (one writer process, or a SHM_MUTEX around the write).
+ *
+ */
+
+#ifndef SHM_SYNC_H
+#define SHM_SYNC_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "shm_notify.h"
+
+/** Success return code */
+#define SHM_SYNC_SUCCESS   0
+/** Failure return code */
+#define SHM_SYNC_ERROR     1
+/** Lock acquired from a dead owner; the protected data may be inconsistent */
+#define SHM_SYNC_RECOVERED 2
+/** Try-lock found the lock held */
+#define SHM_SYNC_BUSY      3
+
+/** SHM_RWLOCK state bit while write-locked; the owner's pid is in the low 32 bits */
+#define SHM_RWLOCK_WRITER (1ull << 32)
+/** Writers that can wait at once with readers held off; more still get the lock, but in turn with readers */
+#define SHM_RWLOCK_WAITERS 8
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+} SHM_MUTEX;
+
+typedef struct
+{
+    _Atomic uint64_t state;                        // Reader count, or SHM_RWLOCK_WRITER | owner pid
+    _Atomic pid_t    waiting[SHM_RWLOCK_WAITERS];  // Pids of writers blocked in shm_rwlock_wrlock(), 0 if free
+    SHM_NOTIFY       readers_wake;
+    SHM_NOTIFY       writers_wake;
+} SHM_RWLOCK;
+
+typedef struct
+{
+    _Atomic uint32_t seq;  // Odd while a write is in progress
+} SHM_SEQLOCK;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize a robust, process-shared mutex (segment creator only).
+     * @param[out] m Mutex in shared memory.
+     * @return SHM_SYNC_SUCCESS on success, SHM_SYNC_ERROR on failure.
+     */
+    int shm_mutex_init(SHM_MUTEX *m);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Lock the mutex, recovering it if the previous owner died.
+     * @param[in,out] m Mutex.
+     * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED (locked; repair the protected data), or
+     *         SHM_SYNC_ERROR.
+     */
+    int shm_mutex_lock(SHM_MUTEX *m);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Lock the mutex if it is free.
+     * @param[in,out] m Mutex.
+     * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED, SHM_SYNC_BUSY or SHM_SYNC_ERROR.
+     */
+    int shm_mutex_trylock(SHM_MUTEX *m);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Unlock the mutex.
+     * @param[in,out] m Mutex.
+     * @return SHM_SYNC_SUCCESS on success, SHM_SYNC_ERROR on failure.
+     */
+    int shm_mutex_unlock(SHM_MUTEX *m);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Destroy the mutex (last user only, before the segment is removed).
+     * @param[in,out] m Mutex.
+     */
+    void shm_mutex_destroy(SHM_MUTEX *m);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize a reader-writer lock (segment creator only).
+     * @param[out] l Lock in shared memory.
+     */
+    void shm_rwlock_init(SHM_RWLOCK *l);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Take the lock shared. Waits while a writer holds or waits for it.
+     * @param[in,out] l Lock.
+     * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED if a dead writer had to be cleared
+     *         (the data may be half-written), or SHM_SYNC_ERROR.
+     */
+    int shm_rwlock_rdlock(SHM_RWLOCK *l);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Release a shared hold.
+     * @param[in,out] l Lock.
+     */
+    void shm_rwlock_rdunlock(SHM_RWLOCK *l);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Take the lock exclusively.
+     * @param[in,out] l Lock.
+     * @return SHM_SYNC_SUCCESS, SHM_SYNC_RECOVERED (taken over from a dead writer; repair
+     *         the protected data), or SHM_SYNC_ERROR.
+     */
+    int shm_rwlock_wrlock(SHM_RWLOCK *l);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Release an exclusive hold.
+     * @param[in,out] l Lock.
+     */
+    void shm_rwlock_wrunlock(SHM_RWLOCK *l);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize a seqlock (segment creator only).
+     * @param[out] s Seqlock in shared memory.
+     */
+    void shm_seqlock_init(SHM_SEQLOCK *s);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Start a read section. Spins while a write is in progress.
+     * @param[in] s Seqlock.
+     * @return Sequence to pass to shm_seqlock_read_retry().
+     */
+    uint32_t shm_seqlock_read_begin(SHM_SEQLOCK *s);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief End a read section.
+     * @param[in] s Seqlock.
+     * @param[in] seq Value from shm_seqlock_read_begin().
+     * @return Non-zero if a write overlapped and the data must be read again.
+     */
+    int shm_seqlock_read_retry(SHM_SEQLOCK *s, uint32_t seq);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Start a write section (writers must already be serialized).
+     * @param[in,out] s Seqlock.
+     */
+    void shm_seqlock_write_begin(SHM_SEQLOCK *s);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief End a write section and publish it.
+     * @param[in,out] s Seqlock.
+     */
+    void shm_seqlock_write_end(SHM_SEQLOCK *s);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Copy a consistent snapshot of @p len bytes out of seqlock-protected memory.
+     * @param[in] s Seqlock.
+     * @param[out] dst Destination.
+     * @param[in] src Protected data.
+     * @param[in] len Bytes to copy.
+     * @return Sequence of the snapshot (even).
+     */
+    uint32_t shm_seqlock_read(SHM_SEQLOCK *s, void *dst, const void *src, size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Replace @p len bytes of seqlock-protected memory.
+     * @param[in,out] s Seqlock.
+     * @param[out] dst Protected data.
+     * @param[in] src New contents.
+     * @param[in] len Bytes to copy.
+     */
+    void shm_seqlock_write(SHM_SEQLOCK *s, void *dst, const void *src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // SHM_SYNC_H
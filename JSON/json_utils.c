@@ -299,6 +299,61 @@ int json_save_to_file(JSON_OBJ *root, const char *filename)
     return JSON_SUCCESS;
 }
 
+static int walk_value(JSON_OBJ *value, char *path, size_t len, JSON_WALK_FN fn, void *ctx)
+{
+    const char *key;
+    JSON_OBJ   *child;
+    size_t      index;
+
+    if (json_is_object(value))
+    {
+        json_object_foreach(value, key, child)
+        {
+            int n = snprintf(path + len, JSON_PATH_MAX - len, "%s%s", len ? "." : "", key);
+            if (n < 0 || (size_t)n >= JSON_PATH_MAX - len || walk_value(child, path, len + n, fn, ctx) != JSON_SUCCESS)
+            {
+                return JSON_ERROR;
+            }
+        }
+        path[len] = '\0';
+        return JSON_SUCCESS;
+    }
+    if (json_is_array(value))
+    {
+        json_array_foreach(value, index, child)
+        {
+            int n = snprintf(path + len, JSON_PATH_MAX - len, "%s%zu", len ? "." : "", index);
+            if (n < 0 || (size_t)n >= JSON_PATH_MAX - len || walk_value(child, path, len + n, fn, ctx) != JSON_SUCCESS)
+            {
+                return JSON_ERROR;
+            }
+        }
+        path[len] = '\0';
+        return JSON_SUCCESS;
+    }
+    return fn(path, value, ctx);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Visit every leaf value under @p root with its dotted path, e.g. "cameras.0.url".
+ * @param[in] root JSON object or array.
+ * @param[in] fn Callback for each leaf.
+ * @param[in] ctx Passed through to @p fn.
+ * @return JSON_SUCCESS on success, JSON_ERROR if a path is too long or @p fn failed.
+ */
+int json_walk(JSON_OBJ *root, JSON_WALK_FN fn, void *ctx)
+{
+    char path[JSON_PATH_MAX] = "";
+
+    if (walk_value(root, path, 0, fn, ctx) != JSON_SUCCESS)
+    {
+        fprintf(stderr, "Failed to walk JSON (path too long or callback error): %s\n", path);
+        return JSON_ERROR;
+    }
+    return JSON_SUCCESS;
+}
+
 //-------------------------------------------------------------------------------------------------
 /**
  * @brief Free a JSON object.
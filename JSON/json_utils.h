@@ -18,9 +18,15 @@
 /** Failure return code */
 #define JSON_ERROR   1
 
+/** Longest dotted path passed to a JSON_WALK_FN */
+#define JSON_PATH_MAX 256
+
 typedef json_t      JSON_OBJ;
 typedef json_int_t  JSON_INT_MAX;
 
+/** Called for every leaf (non-object, non-array value); return JSON_SUCCESS to continue */
+typedef int (*JSON_WALK_FN)(const char *path, JSON_OBJ *value, void *ctx);
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -171,6 +177,16 @@ extern "C"
      */
     int json_save_to_file(JSON_OBJ *root, const char *filename);
 
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Visit every leaf value under @p root with its dotted path, e.g. "cameras.0.url".
+     * @param[in] root JSON object or array.
+     * @param[in] fn Callback for each leaf.
+     * @param[in] ctx Passed through to @p fn.
+     * @return JSON_SUCCESS on success, JSON_ERROR if a path is too long or @p fn failed.
+     */
+    int json_walk(JSON_OBJ *root, JSON_WALK_FN fn, void *ctx);
+
     //-------------------------------------------------------------------------------------------------
     /**
      * @brief Free a JSON object.
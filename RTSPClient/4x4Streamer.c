@@ -5,100 +5,79 @@
 #include <libavutil/log.h>
 #include <libavutil/opt.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stream_affinity.h"
+#include "stream_reconnect.h"
 
 #define NUM_STREAMS 4
 
 typedef struct
 {
-    const char      *url;
-    int              index;
-    AVFormatContext *fmt_ctx;
-    AVCodecContext  *dec_ctx;
-    SDL_Texture     *texture;
-    int              video_stream_index;
-    pthread_mutex_t *mutex;
+    const char            *url;
+    int                    index;
+    AVFormatContext       *fmt_ctx;
+    AVCodecContext        *dec_ctx;
+    SDL_Renderer          *renderer;  // NULL in benchmark mode
+    SDL_Texture           *texture;   // NULL in benchmark mode
+    int                    video_stream_index;
+    pthread_mutex_t       *mutex;
+    const AFFINITY_POLICY *affinity;
+    atomic_int             node;            // NUMA node the thread runs on, -1 if unpinned
+    atomic_int             quit;            // Set by the main thread to stop the stream
+    atomic_int             finished;        // Set by the stream thread when it returns
+    atomic_ulong           frames_decoded;  // Read by main thread for the benchmark report
+    atomic_ulong           connects;        // Successful connects, the first one included
+    atomic_ulong           decoder_reuses;  // Reconnects that kept the decoder
 } StreamContext;
 
-// Thread function to handle each stream
-void *stream_handler(void *arg)
-{
-    StreamContext *stream = (StreamContext *)arg;
-    AVPacket       pkt;
-    int            ret;
-    AVFrame       *frame = av_frame_alloc();
-    SDL_Event      event;
-    int            quit = 0;
-
-    // Open input stream
-    ret = avformat_open_input(&stream->fmt_ctx, stream->url, NULL, NULL);
-    if (ret < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to open input stream: %s\n", av_err2str(ret));
-        return NULL;
-    }
-
-    ret = avformat_find_stream_info(stream->fmt_ctx, NULL);
-    if (ret < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to retrieve stream information: %s\n", av_err2str(ret));
-        return NULL;
-    }
-
-    // Find video stream
-    stream->video_stream_index = -1;
-    for (int i = 0; i < stream->fmt_ctx->nb_streams; i++)
-    {
-        if (stream->fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-        {
-            stream->video_stream_index = i;
-            break;
-        }
-    }
-
-    if (stream->video_stream_index == -1)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Could not find video stream\n");
-        return NULL;
-    }
+// Set by SIGINT/SIGTERM; the main thread then stops every stream
+static atomic_int stop_requested;
 
-    // Find the decoder
-    AVCodec *dec = avcodec_find_decoder(stream->fmt_ctx->streams[stream->video_stream_index]->codecpar->codec_id);
-    if (!dec)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to find video decoder\n");
-        return NULL;
-    }
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    atomic_store(&stop_requested, 1);
+}
 
-    stream->dec_ctx = avcodec_alloc_context3(dec);
-    if (!stream->dec_ctx)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to allocate codec context\n");
-        return NULL;
-    }
+// Lets a blocking open/read return as soon as the stream is asked to quit
+static int stream_interrupted(void *arg)
+{
+    return atomic_load(&((StreamContext *)arg)->quit);
+}
 
-    ret = avcodec_parameters_to_context(stream->dec_ctx, stream->fmt_ctx->streams[stream->video_stream_index]->codecpar);
-    if (ret < 0)
+// Sleep in short slices so a quit request is not held up by a long backoff
+static void backoff_sleep(StreamContext *stream, int delay_ms)
+{
+    while (delay_ms > 0 && !atomic_load(&stream->quit))
     {
-        av_log(NULL, AV_LOG_ERROR, "Failed to copy codec parameters to codec context: %s\n", av_err2str(ret));
-        return NULL;
+        int slice = delay_ms < 100 ? delay_ms : 100;
+        usleep(slice * 1000);
+        delay_ms -= slice;
     }
+}
 
-    ret = avcodec_open2(stream->dec_ctx, dec, NULL);
-    if (ret < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to open codec: %s\n", av_err2str(ret));
-        return NULL;
-    }
+// Read and decode until the connection drops or the source ends. Returns the
+// av_read_frame error (AVERROR_EOF at the end of a file or a closed connection), or 0 on quit.
+static int stream_decode_loop(StreamContext *stream, DECODER_CACHE *cache)
+{
+    AVPacket pkt;
+    AVFrame *frame = cache->frame;
+    int      ret;
 
     // Wait for the frame in the main thread to render
-    while (!quit)
+    while (!atomic_load(&stream->quit))
     {
         ret = av_read_frame(stream->fmt_ctx, &pkt);
         if (ret < 0)
         {
-            break;  // End of stream or error
+            return ret;  // End of stream or error
         }
 
         if (pkt.stream_index == stream->video_stream_index)
@@ -106,12 +85,18 @@ void *stream_handler(void *arg)
             ret = avcodec_send_packet(stream->dec_ctx, &pkt);
             if (ret < 0)
             {
-                av_log(NULL, AV_LOG_ERROR, "Error sending packet to decoder: %s\n", av_err2str(ret));
-                break;
+                // A corrupt packet after a reconnect is not fatal for the decoder
+                av_log(NULL, AV_LOG_WARNING, "Error sending packet to decoder: %s\n", av_err2str(ret));
             }
 
             ret = avcodec_receive_frame(stream->dec_ctx, frame);
             if (ret == 0)
+            {
+                atomic_fetch_add_explicit(&stream->frames_decoded, 1, memory_order_relaxed);
+            }
+
+            // No texture in benchmark mode: decode only
+            if (ret == 0 && stream->texture != NULL)
             {
                 // Lock the mutex to safely update texture in the main thread
                 pthread_mutex_lock(stream->mutex);
@@ -122,21 +107,194 @@ void *stream_handler(void *arg)
         }
         av_packet_unref(&pkt);
     }
+    return 0;
+}
 
-    av_frame_free(&frame);
+// A file or other seekable input really ends at EOF. A network source does not: the
+// RTSP demuxer also reports AVERROR_EOF when the camera closes its connection.
+static int stream_is_finite(const AVFormatContext *fmt_ctx, const char *url)
+{
+    const char *protocol = avio_find_protocol_name(url);
+
+    if (protocol != NULL && strcmp(protocol, "file") == 0)
+    {
+        return 1;
+    }
+    return fmt_ctx->pb != NULL && (fmt_ctx->pb->seekable & AVIO_SEEKABLE_NORMAL);
+}
+
+// Thread function to handle each stream
+void *stream_handler(void *arg)
+{
+    StreamContext    *stream = (StreamContext *)arg;
+    DECODER_CACHE     cache;
+    RECONNECT_BACKOFF backoff;
+    AVIOInterruptCB   interrupt = {stream_interrupted, stream};
+
+    // Pin before anything is allocated: the decoder context, its frame pool and the
+    // demuxer buffers are then first touched (and placed) on this thread's node
+    atomic_store_explicit(&stream->node, affinity_apply(stream->affinity, AFFINITY_ROLE_DECODE, stream->index), memory_order_relaxed);
+
+    if (decoder_cache_init(&cache) != RECONNECT_SUCCESS)
+    {
+        atomic_store(&stream->finished, 1);
+        return NULL;
+    }
+    reconnect_backoff_init(&backoff, RECONNECT_INITIAL_MS, RECONNECT_MAX_MS);
+
+    // Only the demuxer is rebuilt per connection; the decoder lives in the cache
+    while (!atomic_load(&stream->quit))
+    {
+        if (reconnect_open_input(&stream->fmt_ctx, stream->url, &cache, &interrupt, &stream->video_stream_index) != RECONNECT_SUCCESS)
+        {
+            backoff_sleep(stream, reconnect_backoff_next(&backoff));
+            continue;
+        }
+
+        if (decoder_cache_prepare(&cache, stream->fmt_ctx->streams[stream->video_stream_index]->codecpar) != RECONNECT_SUCCESS)
+        {
+            avformat_close_input(&stream->fmt_ctx);
+            backoff_sleep(stream, reconnect_backoff_next(&backoff));
+            continue;
+        }
+        stream->dec_ctx = cache.dec_ctx;
+
+        if (atomic_fetch_add_explicit(&stream->connects, 1, memory_order_relaxed) > 0)
+        {
+            av_log(NULL, AV_LOG_INFO, "Stream %d reconnected (decoder %s)\n", stream->index,
+                   cache.reused > atomic_load_explicit(&stream->decoder_reuses, memory_order_relaxed) ? "reused" : "rebuilt");
+        }
+        atomic_store_explicit(&stream->decoder_reuses, cache.reused, memory_order_relaxed);
+        reconnect_backoff_reset(&backoff);
+
+        int ret = stream_decode_loop(stream, &cache);
+        int finite = stream_is_finite(stream->fmt_ctx, stream->url);
+
+        avformat_close_input(&stream->fmt_ctx);
+        if (ret == AVERROR_EOF && finite)
+        {
+            // The end of a file is not a drop, so no reconnect
+            av_log(NULL, AV_LOG_INFO, "Stream %d ended\n", stream->index);
+            break;
+        }
+        if (!atomic_load(&stream->quit))
+        {
+            backoff_sleep(stream, reconnect_backoff_next(&backoff));
+        }
+    }
+
+    stream->dec_ctx = NULL;
+    decoder_cache_free(&cache);
+    atomic_store(&stream->finished, 1);
     return NULL;
 }
 
+// Present every stream's latest frame until the user closes a window, a stop signal
+// arrives or every stream has ended
+static void display_loop(StreamContext *streams, pthread_mutex_t *mutexes)
+{
+    SDL_Event event;
+
+    while (!atomic_load(&stop_requested))
+    {
+        int running = 0;
+
+        while (SDL_PollEvent(&event))
+        {
+            if (event.type == SDL_QUIT || (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_CLOSE))
+            {
+                atomic_store(&stop_requested, 1);
+            }
+        }
+        for (int i = 0; i < NUM_STREAMS; i++)
+        {
+            running += !atomic_load(&streams[i].finished);
+
+            // The stream thread updates the texture under the same mutex
+            pthread_mutex_lock(&mutexes[i]);
+            SDL_RenderClear(streams[i].renderer);
+            SDL_RenderCopy(streams[i].renderer, streams[i].texture, NULL, NULL);
+            pthread_mutex_unlock(&mutexes[i]);
+            SDL_RenderPresent(streams[i].renderer);
+        }
+        if (running == 0)
+        {
+            break;
+        }
+        SDL_Delay(10);
+    }
+}
+
+// Ask the first count streams to quit and wait for their threads
+static void stop_streams(StreamContext *streams, pthread_t *threads, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        atomic_store(&streams[i].quit, 1);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-p policy] [-b seconds] <url1> <url2> <url3> <url4>\n", prog);
+    printf("  -p policy   Thread placement: none, compact, scatter or\n");
+    printf("              decode=<cpus>[@node],render=<cpus>[@node]\n");
+    printf("  -b seconds  Benchmark mode: decode without rendering and report frame rates\n");
+    printf("Ctrl-C or closing a window stops every stream.\n");
+    printf("Example: %s -p scatter -b 60 rtsp://cam1/s rtsp://cam2/s rtsp://cam3/s rtsp://cam4/s\n", prog);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc < NUM_STREAMS + 1)
+    const char     *policy_spec = "none";
+    int             bench_seconds = 0;
+    AFFINITY_POLICY affinity;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "p:b:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p':
+                policy_spec = optarg;
+                break;
+            case 'b':
+                bench_seconds = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (argc - optind < NUM_STREAMS)
     {
-        printf("Usage: %s <url1> <url2> <url3> <url4>\n", argv[0]);
+        usage(argv[0]);
         return -1;
     }
 
+    if (affinity_policy_init(&affinity, policy_spec) != AFFINITY_SUCCESS)
+    {
+        return -1;
+    }
+    // Each stream reads and decodes on one thread, placed by its decode role
+    if (affinity.policy == AFFINITY_POLICY_CUSTOM && (affinity.role_ncpus[AFFINITY_ROLE_INGEST] > 0 || affinity.role_node[AFFINITY_ROLE_INGEST] >= 0))
+    {
+        fprintf(stderr, "4x4Streamer: no separate ingest thread, place streams with decode=\n");
+        return -1;
+    }
+    affinity_describe(&affinity, NUM_STREAMS, stdout);
+
+    // The main thread owns SDL and presents the frames
+    affinity_apply(&affinity, AFFINITY_ROLE_RENDER, 0);
+
     // Initialize libavformat and register all codecs
     av_register_all();
+    srand((unsigned)time(NULL));  // Reconnect jitter
     avformat_network_init();
 
     // Setup StreamContext for each stream
@@ -144,24 +302,46 @@ int main(int argc, char *argv[])
     pthread_t       threads[NUM_STREAMS];
     pthread_mutex_t mutexes[NUM_STREAMS];
 
-    // Initialize SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    // Initialize SDL (not needed in benchmark mode)
+    if (bench_seconds == 0 && SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         fprintf(stderr, "SDL initialization failed: %s\n", SDL_GetError());
         return -1;
     }
 
+    // After SDL_Init, which would otherwise turn SIGINT into an SDL_QUIT event only
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
     // Create SDL windows, textures, and mutexes in the main thread
     for (int i = 0; i < NUM_STREAMS; i++)
     {
         pthread_mutex_init(&mutexes[i], NULL);
-        streams[i].url = argv[i + 1];
+        streams[i].url = argv[optind + i];
         streams[i].index = i;
         streams[i].mutex = &mutexes[i];
+        streams[i].affinity = &affinity;
+        atomic_init(&streams[i].node, -1);
+        atomic_init(&streams[i].quit, 0);
+        atomic_init(&streams[i].finished, 0);
+        atomic_init(&streams[i].frames_decoded, 0);
+        atomic_init(&streams[i].connects, 0);
+        atomic_init(&streams[i].decoder_reuses, 0);
+        streams[i].fmt_ctx = NULL;
 
         // Create SDL window and renderer for each stream
+        streams[i].renderer = NULL;
         streams[i].texture = NULL;
 
+        if (bench_seconds > 0)
+        {
+            continue;
+        }
+
         // Create SDL window and renderer
         SDL_Window *window = SDL_CreateWindow("Video Player", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 640, 480, SDL_WINDOW_SHOWN);
         if (!window)
@@ -176,24 +356,75 @@ int main(int argc, char *argv[])
             return -1;
         }
 
+        streams[i].renderer = renderer;
         streams[i].texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12, SDL_TEXTUREACCESS_STREAMING, 640, 480);
         if (!streams[i].texture)
         {
             fprintf(stderr, "SDL texture creation failed: %s\n", SDL_GetError());
             return -1;
         }
-
-        streams[i].fmt_ctx = NULL;
-        pthread_create(&threads[i], NULL, stream_handler, &streams[i]);
     }
 
-    // Wait for all threads to finish
+    // Start the stream threads only once every window exists, so a failed start has
+    // only running threads to stop
     for (int i = 0; i < NUM_STREAMS; i++)
     {
-        pthread_join(threads[i], NULL);
+        int err = pthread_create(&threads[i], NULL, stream_handler, &streams[i]);
+        if (err != 0)
+        {
+            fprintf(stderr, "Failed to start stream %d: %s\n", i, strerror(err));
+            stop_streams(streams, threads, i);
+            if (bench_seconds == 0)
+            {
+                SDL_Quit();
+            }
+            return -1;
+        }
+    }
+
+    if (bench_seconds > 0)
+    {
+        struct timespec start, end;
+        unsigned long   total = 0;
+
+        // Skip the connect/probe phase so only steady-state decoding is measured
+        sleep(2);
+        unsigned long base[NUM_STREAMS];
+        for (int i = 0; i < NUM_STREAMS; i++)
+        {
+            base[i] = atomic_load_explicit(&streams[i].frames_decoded, memory_order_relaxed);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int ms = 0; ms < bench_seconds * 1000 && !atomic_load(&stop_requested); ms += 100)
+        {
+            usleep(100 * 1000);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("Benchmark (%s, %.1f s):\n", policy_spec, elapsed);
+        for (int i = 0; i < NUM_STREAMS; i++)
+        {
+            unsigned long frames = atomic_load_explicit(&streams[i].frames_decoded, memory_order_relaxed) - base[i];
+            unsigned long connects = atomic_load_explicit(&streams[i].connects, memory_order_relaxed);
+            total += frames;
+            printf("  stream %d: node %2d  %8.1f fps  reconnects %lu (decoder reused %lu)\n", i, atomic_load(&streams[i].node), frames / elapsed,
+                   connects > 0 ? connects - 1 : 0, atomic_load_explicit(&streams[i].decoder_reuses, memory_order_relaxed));
+        }
+        printf("  total   :          %8.1f fps\n", total / elapsed);
     }
+    else
+    {
+        display_loop(streams, mutexes);
+    }
+
+    // Stop the streams and wait for all threads to finish
+    stop_streams(streams, threads, NUM_STREAMS);
 
     // Cleanup SDL resources
-    SDL_Quit();
+    if (bench_seconds == 0)
+    {
+        SDL_Quit();
+    }
     return 0;
 }
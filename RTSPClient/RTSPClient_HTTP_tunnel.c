@@ -0,0 +1,258 @@
+/*
+ * RTSP Client over HTTP tunnel / interleaved TCP (no FFmpeg)
+ *
+ * Author: Kshitij Mistry
+ *
+ * Drives OPTIONS > DESCRIBE > SETUP > PLAY > TEARDOWN on the raw RTSP engine
+ * (rtsp_tunnel.c), depacketizes the H.264 RTP stream and prints receive throughput.
+ * Running the same camera once with "http" and once with "tcp" compares the tunnel
+ * against plain interleaved TCP; the receive path is shared, only request encoding differs.
+ *
+ * Usage:
+ *   ./RTSPClient_HTTP_tunnel <ip_address> <http|tcp> <stream_path> [seconds] [username] [password]
+ *   Example: ./RTSPClient_HTTP_tunnel 192.168.101.47 http /unicaststream/2 30 admin admin
+ *
+ */
+
+#define _GNU_SOURCE  // strcasestr
+
+#include <openssl/evp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rtp_depacketizer.h"
+#include "rtsp_tunnel.h"
+
+#define REPLY_TIMEOUT_MS 5000
+
+typedef struct
+{
+    RTP_H264_DEPACK depack;
+    uint64_t        keyframes;
+    uint64_t        au_bytes;
+} STREAM_STATS;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Hex encoded MD5 of a string
+static void md5_hex(const char *str, char *hex)
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int  len = 0;
+
+    EVP_Digest(str, strlen(str), digest, &len, EVP_md5(), NULL);
+    for (unsigned int i = 0; i < len; i++)
+    {
+        sprintf(hex + i * 2, "%02x", digest[i]);
+    }
+    hex[len * 2] = '\0';
+}
+
+// Copy the quoted value of key="..." out of a WWW-Authenticate header
+static int get_quoted(const char *hdr, const char *key, char *val, size_t size)
+{
+    const char *p = strstr(hdr, key);
+    if (p == NULL)
+    {
+        return -1;
+    }
+    p += strlen(key);
+    snprintf(val, size, "%.*s", (int)strcspn(p, "\""), p);
+    return 0;
+}
+
+// Build the Authorization header for a Digest challenge (RFC 2069 style, as the camera expects)
+static void build_digest(const char *challenge, const char *method, const char *url, const char *username, const char *password, char *out,
+                         size_t size)
+{
+    char realm[128] = "", nonce[128] = "";
+    char buf[512], ha1[33], ha2[33], response[33];
+
+    get_quoted(challenge, "realm=\"", realm, sizeof(realm));
+    get_quoted(challenge, "nonce=\"", nonce, sizeof(nonce));
+
+    snprintf(buf, sizeof(buf), "%s:%s:%s", username, realm, password);
+    md5_hex(buf, ha1);
+    snprintf(buf, sizeof(buf), "%s:%s", method, url);
+    md5_hex(buf, ha2);
+    snprintf(buf, sizeof(buf), "%s:%s:%s", ha1, nonce, ha2);
+    md5_hex(buf, response);
+
+    snprintf(out, size, "Authorization: Digest username=\"%s\", realm=\"%s\", nonce=\"%s\", uri=\"%s\", response=\"%s\"\r\n", username, realm,
+             nonce, url, response);
+}
+
+// Send a request, answering one Digest challenge if the camera asks for it
+static int request_auth(RTSP_TUNNEL *t, const char *method, const char *url, const char *headers, const char *username, const char *password)
+{
+    static char challenge[RTSP_MAX_RESPONSE] = "";
+    char        all[2048];
+    char        auth[1024] = "";
+
+    if (challenge[0] != '\0')
+    {
+        build_digest(challenge, method, url, username, password, auth, sizeof(auth));
+    }
+    snprintf(all, sizeof(all), "%s%s", auth, headers ? headers : "");
+
+    int status = rtsp_tunnel_request(t, method, url, all, REPLY_TIMEOUT_MS);
+    if (status == 401 && username[0] != '\0' && challenge[0] == '\0')
+    {
+        snprintf(challenge, sizeof(challenge), "%s", t->response);
+        build_digest(challenge, method, url, username, password, auth, sizeof(auth));
+        snprintf(all, sizeof(all), "%s%s", auth, headers ? headers : "");
+        status = rtsp_tunnel_request(t, method, url, all, REPLY_TIMEOUT_MS);
+    }
+    return status;
+}
+
+// Resolve the control URL of the first video track in the SDP; -1 if it does not fit in out
+static int video_control_url(const char *sdp, const char *base, char *out, size_t size)
+{
+    const char *m = strstr(sdp, "m=video");
+    const char *c = m ? strstr(m, "a=control:") : NULL;
+    int         n;
+
+    if (c == NULL)
+    {
+        n = snprintf(out, size, "%s", base);
+    }
+    else
+    {
+        c += 10;
+        int len = (int)strcspn(c, "\r\n");
+        if (strncmp(c, "rtsp://", 7) == 0)
+        {
+            n = snprintf(out, size, "%.*s", len, c);
+        }
+        else
+        {
+            n = snprintf(out, size, "%s/%.*s", base, len, c);
+        }
+    }
+    return n >= 0 && (size_t)n < size ? 0 : -1;
+}
+
+static void on_frame(void *opaque, const uint8_t *au, size_t len, uint32_t timestamp, int keyframe)
+{
+    STREAM_STATS *stats = (STREAM_STATS *)opaque;
+    (void)au;
+    (void)timestamp;
+
+    stats->au_bytes += len;
+    stats->keyframes += keyframe;
+}
+
+static void on_data(void *opaque, uint8_t channel, const uint8_t *data, size_t len)
+{
+    STREAM_STATS *stats = (STREAM_STATS *)opaque;
+
+    // Channel 0 is RTP for the video track, channel 1 its RTCP
+    if (channel == 0)
+    {
+        rtp_h264_input(&stats->depack, data, len);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4)
+    {
+        printf("Usage: %s <ip_address> <http|tcp> <stream_path> [seconds] [username] [password]\n", argv[0]);
+        printf("Example: %s 192.168.101.47 http /unicaststream/2 30 admin admin\n", argv[0]);
+        return -1;
+    }
+
+    const char      *ipAddress = argv[1];
+    int              useHttp = strcmp(argv[2], "http") == 0;
+    const char      *streamPath = argv[3];
+    int              seconds = argc > 4 ? atoi(argv[4]) : 10;
+    const char      *username = argc > 5 ? argv[5] : "";
+    const char      *password = argc > 6 ? argv[6] : "";
+    uint16_t         port = useHttp ? 80 : 554;
+    RTSP_TRANSPORT_E transport = useHttp ? RTSP_TRANSPORT_HTTP_TUNNEL : RTSP_TRANSPORT_INTERLEAVED;
+
+    char         rtspUrl[512];
+    char         trackUrl[512];
+    RTSP_TUNNEL  tunnel;
+    STREAM_STATS stats;
+
+    snprintf(rtspUrl, sizeof(rtspUrl), "rtsp://%s:%u%s", ipAddress, port, streamPath);
+    printf("RTSP URL: %s\n", rtspUrl);
+    printf("Transport Type: %s\n", useHttp ? "HTTP tunnel" : "interleaved TCP");
+
+    memset(&stats, 0, sizeof(stats));
+    if (rtp_h264_init(&stats.depack, on_frame, &stats) != RTP_SUCCESS)
+    {
+        fprintf(stderr, "Failed to allocate depacketizer\n");
+        return -1;
+    }
+
+    if (rtsp_tunnel_open(&tunnel, transport, ipAddress, port, streamPath, on_data, &stats) != RTSP_SUCCESS)
+    {
+        return -1;
+    }
+
+    if (request_auth(&tunnel, "OPTIONS", rtspUrl, NULL, username, password) != 200)
+    {
+        fprintf(stderr, "OPTIONS failed:\n%s\n", tunnel.response);
+        return -1;
+    }
+
+    if (request_auth(&tunnel, "DESCRIBE", rtspUrl, "Accept: application/sdp\r\n", username, password) != 200)
+    {
+        fprintf(stderr, "DESCRIBE failed:\n%s\n", tunnel.response);
+        return -1;
+    }
+
+    const char *sdp = strstr(tunnel.response, "\r\n\r\n");
+    if (video_control_url(sdp ? sdp + 4 : "", rtspUrl, trackUrl, sizeof(trackUrl)) != 0)
+    {
+        fprintf(stderr, "Video track URL longer than %zu bytes\n", sizeof(trackUrl) - 1);
+        return -1;
+    }
+    printf("Video track: %s\n", trackUrl);
+
+    if (request_auth(&tunnel, "SETUP", trackUrl, "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n", username, password) != 200)
+    {
+        fprintf(stderr, "SETUP failed:\n%s\n", tunnel.response);
+        return -1;
+    }
+
+    if (request_auth(&tunnel, "PLAY", rtspUrl, "Range: npt=0.000-\r\n", username, password) != 200)
+    {
+        fprintf(stderr, "PLAY failed:\n%s\n", tunnel.response);
+        return -1;
+    }
+
+    double start = now_sec();
+    double end = start + seconds;
+    while (now_sec() < end)
+    {
+        if (rtsp_tunnel_pump(&tunnel, 1000) == RTSP_ERROR)
+        {
+            fprintf(stderr, "Connection closed\n");
+            break;
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    request_auth(&tunnel, "TEARDOWN", rtspUrl, NULL, username, password);
+    rtsp_tunnel_close(&tunnel);
+
+    printf("Received     : %llu bytes in %.2f s (%.2f Mbit/s on the wire)\n", (unsigned long long)tunnel.rx_bytes, elapsed,
+           tunnel.rx_bytes * 8 / elapsed / 1e6);
+    printf("RTP packets  : %llu (%llu lost)\n", (unsigned long long)stats.depack.packets, (unsigned long long)stats.depack.lost);
+    printf("Access units : %llu (%llu key, %.1f fps, %.2f Mbit/s payload)\n", (unsigned long long)stats.depack.frames,
+           (unsigned long long)stats.keyframes, stats.depack.frames / elapsed, stats.au_bytes * 8 / elapsed / 1e6);
+
+    rtp_h264_free(&stats.depack);
+    return 0;
+}
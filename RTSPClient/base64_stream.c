@@ -0,0 +1,324 @@
+/**
+ * @file    base64_stream.c
+ * @brief   Incremental base64 encoder/decoder for the RTSP-over-HTTP tunnel.
+ *
+ * The decoder runs three tiers: an SSSE3 loop translating 16 characters per step,
+ * a scalar loop translating whole quanta, and a per-character state machine that
+ * handles whitespace, padding and quanta split across chunk boundaries.
+ *
+ */
+
+#include "base64_stream.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define B64_HAVE_X86 1
+#endif
+
+#define B64_SKIP 0x40  // Whitespace, ignored
+#define B64_PAD  0x41  // '='
+#define B64_BAD  0xFF  // Not part of the alphabet
+
+static const char enc_tab[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static uint8_t dec_tab[256];
+static int     dec_tab_ready = 0;
+static int     use_ssse3 = 0;
+
+static void b64_init_tables(void)
+{
+    if (dec_tab_ready)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        dec_tab[i] = B64_BAD;
+    }
+    for (int i = 0; i < 64; i++)
+    {
+        dec_tab[(uint8_t)enc_tab[i]] = (uint8_t)i;
+    }
+    dec_tab['\r'] = dec_tab['\n'] = dec_tab[' '] = dec_tab['\t'] = B64_SKIP;
+    dec_tab['='] = B64_PAD;
+
+#ifdef B64_HAVE_X86
+    __builtin_cpu_init();
+    use_ssse3 = __builtin_cpu_supports("ssse3");
+#endif
+    dec_tab_ready = 1;
+}
+
+#ifdef B64_HAVE_X86
+// Translate and pack 16 characters into 12 bytes per step. Stops at the first block
+// holding anything other than the 64 alphabet characters, so the caller can fall back
+// to the scalar state machine for whitespace and padding.
+__attribute__((target("ssse3"))) static size_t b64_decode_ssse3(const uint8_t *in, size_t n, uint8_t *out, size_t *consumed)
+{
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask_2f = _mm_set1_epi8(0x2F);
+    const __m128i shuf = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t        i = 0, o = 0;
+
+    // Each step stores 16 bytes but only advances 12, so keep one spare block of input
+    // behind us: the caller sized out for the whole input, which covers the overhang.
+    while (i + 24 <= n)
+    {
+        __m128i str = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(str, 4), mask_2f);
+        __m128i lo_nibbles = _mm_and_si128(str, mask_2f);
+        __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+        __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+        {
+            break;
+        }
+
+        __m128i eq_2f = _mm_cmpeq_epi8(str, mask_2f);
+        __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+        str = _mm_add_epi8(str, roll);
+
+        // Merge 4 x 6 bits into 3 bytes per lane, then gather the 12 bytes in order
+        str = _mm_maddubs_epi16(str, _mm_set1_epi32(0x01400140));
+        str = _mm_madd_epi16(str, _mm_set1_epi32(0x00011000));
+        str = _mm_shuffle_epi8(str, shuf);
+        _mm_storeu_si128((__m128i *)(out + o), str);
+
+        i += 16;
+        o += 12;
+    }
+
+    *consumed = i;
+    return o;
+}
+#endif
+
+// Decode whole quanta while they contain only alphabet characters
+static size_t b64_decode_quads(const uint8_t *in, size_t n, uint8_t *out, size_t *consumed)
+{
+    size_t i = 0, o = 0;
+
+    while (i + 4 <= n)
+    {
+        uint32_t a = dec_tab[in[i]], b = dec_tab[in[i + 1]], c = dec_tab[in[i + 2]], d = dec_tab[in[i + 3]];
+        if ((a | b | c | d) & 0xC0)
+        {
+            break;
+        }
+
+        uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+        out[o] = (uint8_t)(v >> 16);
+        out[o + 1] = (uint8_t)(v >> 8);
+        out[o + 2] = (uint8_t)v;
+        i += 4;
+        o += 3;
+    }
+
+    *consumed = i;
+    return o;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Reset a decoder to the start of a new base64 stream.
+ * @param[out] dec Decoder state.
+ */
+void b64_decoder_init(B64_DECODER *dec)
+{
+    b64_init_tables();
+    dec->acc = 0;
+    dec->nchars = 0;
+    dec->npad = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode the next chunk of a base64 stream.
+ * @param[in,out] dec Decoder state.
+ * @param[in] in Base64 characters.
+ * @param[in] in_len Number of characters in @p in.
+ * @param[out] out Output buffer, at least B64_DECODED_MAX(in_len) bytes.
+ * @param[out] out_len Number of bytes written to @p out.
+ * @return B64_SUCCESS on success, B64_ERROR on malformed input.
+ */
+int b64_decode_update(B64_DECODER *dec, const char *in, size_t in_len, uint8_t *out, size_t *out_len)
+{
+    const uint8_t *src = (const uint8_t *)in;
+    size_t         i = 0, o = 0, used;
+
+    while (i < in_len)
+    {
+        // Bulk paths only start on a quantum boundary
+        if (dec->nchars == 0 && dec->npad == 0)
+        {
+#ifdef B64_HAVE_X86
+            if (use_ssse3)
+            {
+                o += b64_decode_ssse3(src + i, in_len - i, out + o, &used);
+                i += used;
+            }
+#endif
+            o += b64_decode_quads(src + i, in_len - i, out + o, &used);
+            i += used;
+            if (i >= in_len)
+            {
+                break;
+            }
+        }
+
+        uint8_t v = dec_tab[src[i++]];
+        if (v == B64_SKIP)
+        {
+            continue;
+        }
+
+        if (v == B64_PAD)
+        {
+            if (dec->npad > 0)
+            {
+                dec->npad--;
+            }
+            else if (dec->nchars == 2)
+            {
+                out[o++] = (uint8_t)(dec->acc >> 4);
+                dec->npad = 1;
+                dec->nchars = 0;
+            }
+            else if (dec->nchars == 3)
+            {
+                out[o++] = (uint8_t)(dec->acc >> 10);
+                out[o++] = (uint8_t)(dec->acc >> 2);
+                dec->nchars = 0;
+            }
+            else
+            {
+                *out_len = o;
+                return B64_ERROR;
+            }
+            dec->acc = 0;
+            continue;
+        }
+
+        if (v == B64_BAD || dec->npad > 0)
+        {
+            *out_len = o;
+            return B64_ERROR;
+        }
+
+        dec->acc = (dec->acc << 6) | v;
+        if (++dec->nchars == 4)
+        {
+            out[o++] = (uint8_t)(dec->acc >> 16);
+            out[o++] = (uint8_t)(dec->acc >> 8);
+            out[o++] = (uint8_t)dec->acc;
+            dec->acc = 0;
+            dec->nchars = 0;
+        }
+    }
+
+    *out_len = o;
+    return B64_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Check that the stream ended on a quantum boundary.
+ * @param[in] dec Decoder state.
+ * @return B64_SUCCESS if no partial quantum is pending, B64_ERROR otherwise.
+ */
+int b64_decode_final(const B64_DECODER *dec)
+{
+    return (dec->nchars == 0 && dec->npad == 0) ? B64_SUCCESS : B64_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Reset an encoder to the start of a new base64 stream.
+ * @param[out] enc Encoder state.
+ */
+void b64_encoder_init(B64_ENCODER *enc)
+{
+    enc->npend = 0;
+}
+
+static void b64_encode_group(const uint8_t *g, char *out)
+{
+    uint32_t v = ((uint32_t)g[0] << 16) | ((uint32_t)g[1] << 8) | g[2];
+    out[0] = enc_tab[(v >> 18) & 0x3F];
+    out[1] = enc_tab[(v >> 12) & 0x3F];
+    out[2] = enc_tab[(v >> 6) & 0x3F];
+    out[3] = enc_tab[v & 0x3F];
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode the next chunk of data.
+ * @param[in,out] enc Encoder state.
+ * @param[in] in Input bytes.
+ * @param[in] in_len Number of bytes in @p in.
+ * @param[out] out Output buffer, at least B64_ENCODED_MAX(in_len + 2) chars.
+ * @return Number of characters written to @p out.
+ */
+size_t b64_encode_update(B64_ENCODER *enc, const uint8_t *in, size_t in_len, char *out)
+{
+    size_t i = 0, o = 0;
+
+    // Complete a group left over from the previous call
+    if (enc->npend > 0 && i < in_len)
+    {
+        uint8_t g[3];
+        g[0] = enc->pend[0];
+        g[1] = enc->npend == 2 ? enc->pend[1] : in[i++];
+        if (i >= in_len && enc->npend == 1)
+        {
+            enc->pend[1] = g[1];
+            enc->npend = 2;
+            return o;
+        }
+        g[2] = in[i++];
+        b64_encode_group(g, out + o);
+        o += 4;
+        enc->npend = 0;
+    }
+
+    for (; i + 3 <= in_len; i += 3)
+    {
+        b64_encode_group(in + i, out + o);
+        o += 4;
+    }
+
+    while (i < in_len)
+    {
+        enc->pend[enc->npend++] = in[i++];
+    }
+    return o;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Flush pending bytes with '=' padding.
+ * @param[in,out] enc Encoder state.
+ * @param[out] out Output buffer, at least 4 chars.
+ * @return Number of characters written to @p out.
+ */
+size_t b64_encode_final(B64_ENCODER *enc, char *out)
+{
+    if (enc->npend == 0)
+    {
+        return 0;
+    }
+
+    uint8_t g[3] = {enc->pend[0], enc->npend == 2 ? enc->pend[1] : 0, 0};
+    b64_encode_group(g, out);
+    out[3] = '=';
+    if (enc->npend == 1)
+    {
+        out[2] = '=';
+    }
+    enc->npend = 0;
+    return 4;
+}
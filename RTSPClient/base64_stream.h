@@ -0,0 +1,106 @@
+/**
+ * @file    base64_stream.h
+ * @brief   Incremental base64 encoder/decoder for the RTSP-over-HTTP tunnel.
+ *
+ * Both directions keep their partial quantum in a small state object, so data can be
+ * fed in arbitrary socket-sized chunks. The decoder uses an SSSE3 path (16 chars per
+ * step) when the CPU supports it and falls back to a table driven scalar loop.
+ *
+ */
+
+#ifndef BASE64_STREAM_H
+#define BASE64_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Success return code */
+#define B64_SUCCESS 0
+/** Failure return code (invalid character or misplaced padding) */
+#define B64_ERROR   1
+
+/** Worst case decoded size for @p n input characters. Up to 3 characters carried over
+ *  from the previous chunk complete a quantum, and a '=' flushes a partial one early. */
+#define B64_DECODED_MAX(n) ((((n) + 6) / 4) * 3)
+/** Worst case encoded size for @p n input bytes (including the final flush) */
+#define B64_ENCODED_MAX(n) ((((n) + 2) / 3) * 4)
+
+typedef struct
+{
+    uint32_t acc;     // Pending 6 bit groups
+    int      nchars;  // Number of groups in acc (0..3)
+    int      npad;    // Number of '=' still expected to close a padded quantum
+} B64_DECODER;
+
+typedef struct
+{
+    uint8_t pend[2];  // Bytes waiting for a complete 3 byte group
+    int     npend;
+} B64_ENCODER;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Reset a decoder to the start of a new base64 stream.
+     * @param[out] dec Decoder state.
+     */
+    void b64_decoder_init(B64_DECODER *dec);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode the next chunk of a base64 stream.
+     *        CR, LF, space and tab are skipped, so line-wrapped bodies are accepted.
+     * @param[in,out] dec Decoder state.
+     * @param[in] in Base64 characters.
+     * @param[in] in_len Number of characters in @p in.
+     * @param[out] out Output buffer, at least B64_DECODED_MAX(in_len) bytes.
+     * @param[out] out_len Number of bytes written to @p out.
+     * @return B64_SUCCESS on success, B64_ERROR on malformed input.
+     */
+    int b64_decode_update(B64_DECODER *dec, const char *in, size_t in_len, uint8_t *out, size_t *out_len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Check that the stream ended on a quantum boundary.
+     * @param[in] dec Decoder state.
+     * @return B64_SUCCESS if no partial quantum is pending, B64_ERROR otherwise.
+     */
+    int b64_decode_final(const B64_DECODER *dec);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Reset an encoder to the start of a new base64 stream.
+     * @param[out] enc Encoder state.
+     */
+    void b64_encoder_init(B64_ENCODER *enc);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode the next chunk of data. Up to two trailing bytes are kept back until
+     *        more data or b64_encode_final() arrives.
+     * @param[in,out] enc Encoder state.
+     * @param[in] in Input bytes.
+     * @param[in] in_len Number of bytes in @p in.
+     * @param[out] out Output buffer, at least B64_ENCODED_MAX(in_len + 2) chars.
+     * @return Number of characters written to @p out.
+     */
+    size_t b64_encode_update(B64_ENCODER *enc, const uint8_t *in, size_t in_len, char *out);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Flush pending bytes with '=' padding.
+     * @param[in,out] enc Encoder state.
+     * @param[out] out Output buffer, at least 4 chars.
+     * @return Number of characters written to @p out.
+     */
+    size_t b64_encode_final(B64_ENCODER *enc, char *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // BASE64_STREAM_H
@@ -0,0 +1,141 @@
+/*
+ * Chunked round-trip test for the incremental base64 codec
+ *
+ * Author: Kshitij Mistry
+ *
+ * Encodes runs of independently padded messages in random-sized pieces, splits the
+ * concatenated text at random points and decodes it piece by piece, as the tunnel's GET
+ * leg sees it. Each piece is decoded into a buffer of exactly B64_DECODED_MAX(piece)
+ * bytes followed by a guard area, so a bound that is too small shows up as an overrun
+ * instead of silent corruption. The decoded stream must match the input.
+ *
+ * Usage:
+ *   ./base64_test [rounds] [seed]
+ *   Example: ./base64_test 20000 1
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "base64_stream.h"
+
+#define MAX_MESSAGES  8
+#define MAX_MESSAGE   600
+#define MAX_TEXT      (MAX_MESSAGES * B64_ENCODED_MAX(MAX_MESSAGE + 2))
+#define MAX_PIECE     300
+#define GUARD         16
+#define GUARD_BYTE    0xA5
+
+static unsigned next_random(unsigned *state)
+{
+    *state = *state * 1103515245u + 12345u;
+    return (*state >> 16) & 0x7FFF;
+}
+
+// Encode each message in random pieces and flush it, so every message ends padded
+static size_t encode_messages(const uint8_t *data, const size_t *sizes, int count, char *text, unsigned *seed)
+{
+    B64_ENCODER enc;
+    size_t      len = 0, at = 0;
+
+    for (int m = 0; m < count; m++)
+    {
+        size_t done = 0;
+
+        b64_encoder_init(&enc);
+        while (done < sizes[m])
+        {
+            size_t n = 1 + next_random(seed) % 64;
+            n = n < sizes[m] - done ? n : sizes[m] - done;
+            len += b64_encode_update(&enc, data + at + done, n, text + len);
+            done += n;
+        }
+        len += b64_encode_final(&enc, text + len);
+        at += sizes[m];
+    }
+    return len;
+}
+
+// Decode text in random pieces; returns 0 when it round-trips within the documented bound
+static int decode_pieces(const char *text, size_t len, const uint8_t *expect, size_t expect_len, unsigned *seed, int round)
+{
+    static uint8_t decoded[MAX_MESSAGES * MAX_MESSAGE];
+    uint8_t        out[B64_DECODED_MAX(MAX_PIECE) + GUARD];
+    B64_DECODER    dec;
+    size_t         at = 0, total = 0, out_len;
+
+    b64_decoder_init(&dec);
+    while (at < len)
+    {
+        size_t piece = 1 + next_random(seed) % MAX_PIECE;
+        size_t bound;
+
+        piece = piece < len - at ? piece : len - at;
+        bound = B64_DECODED_MAX(piece);
+        memset(out + bound, GUARD_BYTE, GUARD);
+        if (b64_decode_update(&dec, text + at, piece, out, &out_len) != B64_SUCCESS)
+        {
+            fprintf(stderr, "round %d: decode error at offset %zu\n", round, at);
+            return 1;
+        }
+        for (int g = 0; g < GUARD; g++)
+        {
+            if (out[bound + g] != GUARD_BYTE)
+            {
+                fprintf(stderr, "round %d: %zu chars decoded past B64_DECODED_MAX(%zu) = %zu\n", round, piece, piece, bound);
+                return 1;
+            }
+        }
+        if (out_len > bound || total + out_len > expect_len)
+        {
+            fprintf(stderr, "round %d: %zu chars gave %zu bytes, bound %zu\n", round, piece, out_len, bound);
+            return 1;
+        }
+        memcpy(decoded + total, out, out_len);
+        total += out_len;
+        at += piece;
+    }
+    if (b64_decode_final(&dec) != B64_SUCCESS || total != expect_len || memcmp(decoded, expect, total) != 0)
+    {
+        fprintf(stderr, "round %d: decoded stream differs from the input\n", round);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    static uint8_t data[MAX_MESSAGES * MAX_MESSAGE];
+    static char    text[MAX_TEXT];
+    size_t         sizes[MAX_MESSAGES];
+    int            rounds = argc > 1 ? atoi(argv[1]) : 20000;
+    unsigned       seed = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 1;
+
+    for (int round = 0; round < rounds; round++)
+    {
+        int    count = 1 + next_random(&seed) % MAX_MESSAGES;
+        size_t total = 0;
+
+        for (int m = 0; m < count; m++)
+        {
+            // Short messages often, so padding lands near piece edges
+            sizes[m] = next_random(&seed) % (next_random(&seed) % 2 ? 8 : MAX_MESSAGE);
+            for (size_t i = 0; i < sizes[m]; i++)
+            {
+                data[total + i] = (uint8_t)next_random(&seed);
+            }
+            total += sizes[m];
+        }
+
+        size_t len = encode_messages(data, sizes, count, text, &seed);
+        if (decode_pieces(text, len, data, total, &seed, round) != 0)
+        {
+            printf("base64 chunked round trip: FAILED\n");
+            return 1;
+        }
+    }
+    printf("base64 chunked round trip: %d rounds ok\n", rounds);
+    return 0;
+}
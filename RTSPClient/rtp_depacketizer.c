@@ -0,0 +1,270 @@
+/**
+ * @file    rtp_depacketizer.c
+ * @brief   RTP (RFC 3550) parser and H.264 (RFC 6184) depacketizer.
+ *
+ */
+
+#include "rtp_depacketizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RTP_INITIAL_AU_SIZE (256 * 1024)
+
+#define H264_NAL_IDR    5
+#define H264_NAL_STAP_A 24
+#define H264_NAL_FU_A   28
+
+static const uint8_t start_code[4] = {0x00, 0x00, 0x00, 0x01};
+
+static int au_append(RTP_H264_DEPACK *dp, const uint8_t *data, size_t len)
+{
+    if (dp->len + len > dp->cap)
+    {
+        size_t   cap = dp->cap * 2;
+        uint8_t *buf;
+
+        while (cap < dp->len + len)
+        {
+            cap *= 2;
+        }
+        buf = (uint8_t *)realloc(dp->buf, cap);
+        if (buf == NULL)
+        {
+            return RTP_ERROR;
+        }
+        dp->buf = buf;
+        dp->cap = cap;
+    }
+
+    memcpy(dp->buf + dp->len, data, len);
+    dp->len += len;
+    return RTP_SUCCESS;
+}
+
+static int au_append_nal(RTP_H264_DEPACK *dp, const uint8_t *nal, size_t len)
+{
+    if ((nal[0] & 0x1F) == H264_NAL_IDR)
+    {
+        dp->keyframe = 1;
+    }
+    if (au_append(dp, start_code, sizeof(start_code)) != RTP_SUCCESS)
+    {
+        return RTP_ERROR;
+    }
+    return au_append(dp, nal, len);
+}
+
+static void au_flush(RTP_H264_DEPACK *dp)
+{
+    // An FU-A whose end never came is incomplete: drop it, and do not let the next
+    // access unit continue it
+    if (dp->fu_valid)
+    {
+        dp->len = dp->fu_start;
+        dp->fu_valid = 0;
+    }
+    if (dp->len > 0)
+    {
+        dp->frames++;
+        dp->on_frame(dp->opaque, dp->buf, dp->len, dp->timestamp, dp->keyframe);
+    }
+    dp->len = 0;
+    dp->keyframe = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Parse the fixed RTP header, CSRC list, extension and padding.
+ * @param[in] data Raw RTP packet.
+ * @param[in] len Packet length.
+ * @param[out] pkt Parsed fields; payload points into @p data.
+ * @return RTP_SUCCESS on success, RTP_ERROR on a malformed packet.
+ */
+int rtp_parse(const uint8_t *data, size_t len, RTP_PACKET *pkt)
+{
+    size_t hdr_len;
+
+    if (len < 12 || (data[0] >> 6) != 2)
+    {
+        return RTP_ERROR;
+    }
+
+    hdr_len = 12 + (size_t)(data[0] & 0x0F) * 4;  // CSRC list
+    if (data[0] & 0x10)
+    {
+        // Header extension: 16 bit profile, 16 bit length in 32 bit words
+        if (len < hdr_len + 4)
+        {
+            return RTP_ERROR;
+        }
+        hdr_len += 4 + (size_t)((data[hdr_len + 2] << 8) | data[hdr_len + 3]) * 4;
+    }
+    if (len < hdr_len)
+    {
+        return RTP_ERROR;
+    }
+    if (data[0] & 0x20)
+    {
+        // Padding: last byte holds the pad count
+        size_t pad = data[len - 1];
+        if (pad == 0 || len < hdr_len + pad)
+        {
+            return RTP_ERROR;
+        }
+        len -= pad;
+    }
+
+    pkt->marker = data[1] >> 7;
+    pkt->payload_type = data[1] & 0x7F;
+    pkt->seq = (uint16_t)((data[2] << 8) | data[3]);
+    pkt->timestamp = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) | ((uint32_t)data[6] << 8) | data[7];
+    pkt->ssrc = ((uint32_t)data[8] << 24) | ((uint32_t)data[9] << 16) | ((uint32_t)data[10] << 8) | data[11];
+    pkt->payload = data + hdr_len;
+    pkt->payload_len = len - hdr_len;
+    return RTP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize an H.264 depacketizer.
+ * @param[out] dp Depacketizer.
+ * @param[in] on_frame Access unit callback.
+ * @param[in] opaque User pointer passed to @p on_frame.
+ * @return RTP_SUCCESS on success, RTP_ERROR on allocation failure.
+ */
+int rtp_h264_init(RTP_H264_DEPACK *dp, RTP_FRAME_CB on_frame, void *opaque)
+{
+    memset(dp, 0, sizeof(*dp));
+    dp->buf = (uint8_t *)malloc(RTP_INITIAL_AU_SIZE);
+    if (dp->buf == NULL)
+    {
+        return RTP_ERROR;
+    }
+    dp->cap = RTP_INITIAL_AU_SIZE;
+    dp->on_frame = on_frame;
+    dp->opaque = opaque;
+    return RTP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Feed one RTP packet.
+ * @param[in,out] dp Depacketizer.
+ * @param[in] data Raw RTP packet.
+ * @param[in] len Packet length.
+ * @return RTP_SUCCESS on success, RTP_ERROR on a malformed packet.
+ */
+int rtp_h264_input(RTP_H264_DEPACK *dp, const uint8_t *data, size_t len)
+{
+    RTP_PACKET pkt;
+
+    if (rtp_parse(data, len, &pkt) != RTP_SUCCESS || pkt.payload_len < 1)
+    {
+        return RTP_ERROR;
+    }
+
+    dp->packets++;
+    dp->bytes += pkt.payload_len;
+
+    if (dp->have_seq && pkt.seq != (uint16_t)(dp->last_seq + 1))
+    {
+        // Lost packets: whatever FU-A is in flight can no longer be completed
+        dp->lost += (uint16_t)(pkt.seq - dp->last_seq - 1);
+        if (dp->fu_valid)
+        {
+            dp->len = dp->fu_start;
+            dp->fu_valid = 0;
+        }
+    }
+    dp->last_seq = pkt.seq;
+    dp->have_seq = 1;
+
+    // A new timestamp starts a new access unit even if the marker bit was lost
+    if (dp->len > 0 && pkt.timestamp != dp->timestamp)
+    {
+        au_flush(dp);
+    }
+    dp->timestamp = pkt.timestamp;
+
+    const uint8_t *p = pkt.payload;
+    size_t         n = pkt.payload_len;
+    uint8_t        nal_type = p[0] & 0x1F;
+
+    if (nal_type >= 1 && nal_type <= 23)
+    {
+        if (au_append_nal(dp, p, n) != RTP_SUCCESS)
+        {
+            return RTP_ERROR;
+        }
+    }
+    else if (nal_type == H264_NAL_STAP_A)
+    {
+        // Aggregation packet: 16 bit size followed by the NAL, repeated
+        size_t off = 1;
+        while (off + 2 <= n)
+        {
+            size_t nal_len = ((size_t)p[off] << 8) | p[off + 1];
+            off += 2;
+            if (nal_len == 0 || off + nal_len > n)
+            {
+                return RTP_ERROR;
+            }
+            if (au_append_nal(dp, p + off, nal_len) != RTP_SUCCESS)
+            {
+                return RTP_ERROR;
+            }
+            off += nal_len;
+        }
+    }
+    else if (nal_type == H264_NAL_FU_A)
+    {
+        if (n < 2)
+        {
+            return RTP_ERROR;
+        }
+
+        uint8_t fu_header = p[1];
+        if (fu_header & 0x80)
+        {
+            // Start fragment: rebuild the NAL header from the FU indicator and header
+            uint8_t nal_header = (p[0] & 0xE0) | (fu_header & 0x1F);
+            if ((fu_header & 0x1F) == H264_NAL_IDR)
+            {
+                dp->keyframe = 1;
+            }
+            dp->fu_start = dp->len;
+            if (au_append(dp, start_code, sizeof(start_code)) != RTP_SUCCESS || au_append(dp, &nal_header, 1) != RTP_SUCCESS)
+            {
+                return RTP_ERROR;
+            }
+            dp->fu_valid = 1;
+        }
+        if (dp->fu_valid && au_append(dp, p + 2, n - 2) != RTP_SUCCESS)
+        {
+            return RTP_ERROR;
+        }
+        if (fu_header & 0x40)
+        {
+            dp->fu_valid = 0;
+        }
+    }
+
+    if (pkt.marker)
+    {
+        au_flush(dp);
+    }
+    return RTP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Release depacketizer buffers.
+ * @param[in,out] dp Depacketizer.
+ */
+void rtp_h264_free(RTP_H264_DEPACK *dp)
+{
+    free(dp->buf);
+    dp->buf = NULL;
+    dp->len = dp->cap = 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file    rtp_depacketizer.h
+ * @brief   RTP (RFC 3550) parser and H.264 (RFC 6184) depacketizer.
+ *
+ * Reassembles single NAL, STAP-A and FU-A packets into Annex-B access units and hands
+ * each complete unit to a callback. Sequence gaps are counted and a fragmented NAL
+ * that lost a piece is dropped instead of being passed to the decoder.
+ *
+ */
+
+#ifndef RTP_DEPACKETIZER_H
+#define RTP_DEPACKETIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Success return code */
+#define RTP_SUCCESS 0
+/** Failure return code */
+#define RTP_ERROR   1
+
+typedef struct
+{
+    int            marker;
+    uint8_t        payload_type;
+    uint16_t       seq;
+    uint32_t       timestamp;
+    uint32_t       ssrc;
+    const uint8_t *payload;
+    size_t         payload_len;
+} RTP_PACKET;
+
+/** Called once per reassembled access unit (Annex-B, start codes included) */
+typedef void (*RTP_FRAME_CB)(void *opaque, const uint8_t *au, size_t len, uint32_t timestamp, int keyframe);
+
+typedef struct
+{
+    uint8_t     *buf;  // Access unit being assembled
+    size_t       len;
+    size_t       cap;
+    uint32_t     timestamp;
+    int          keyframe;
+    int          fu_valid;  // 0 while discarding the rest of a damaged FU-A
+    size_t       fu_start;  // Offset of the FU-A NAL in flight, for rollback on loss
+    uint16_t     last_seq;
+    int          have_seq;
+
+    RTP_FRAME_CB on_frame;
+    void        *opaque;
+
+    uint64_t     packets;
+    uint64_t     lost;
+    uint64_t     frames;
+    uint64_t     bytes;
+} RTP_H264_DEPACK;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Parse the fixed RTP header, CSRC list, extension and padding.
+     * @param[in] data Raw RTP packet.
+     * @param[in] len Packet length.
+     * @param[out] pkt Parsed fields; payload points into @p data.
+     * @return RTP_SUCCESS on success, RTP_ERROR on a malformed packet.
+     */
+    int rtp_parse(const uint8_t *data, size_t len, RTP_PACKET *pkt);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize an H.264 depacketizer.
+     * @param[out] dp Depacketizer.
+     * @param[in] on_frame Access unit callback.
+     * @param[in] opaque User pointer passed to @p on_frame.
+     * @return RTP_SUCCESS on success, RTP_ERROR on allocation failure.
+     */
+    int rtp_h264_init(RTP_H264_DEPACK *dp, RTP_FRAME_CB on_frame, void *opaque);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Feed one RTP packet.
+     * @param[in,out] dp Depacketizer.
+     * @param[in] data Raw RTP packet.
+     * @param[in] len Packet length.
+     * @return RTP_SUCCESS on success, RTP_ERROR on a malformed packet.
+     */
+    int rtp_h264_input(RTP_H264_DEPACK *dp, const uint8_t *data, size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Release depacketizer buffers.
+     * @param[in,out] dp Depacketizer.
+     */
+    void rtp_h264_free(RTP_H264_DEPACK *dp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RTP_DEPACKETIZER_H
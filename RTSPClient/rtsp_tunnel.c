@@ -0,0 +1,538 @@
+/**
+ * @file    rtsp_tunnel.c
+ * @brief   RTSP control connection over interleaved TCP or the HTTP GET/POST tunnel.
+ *
+ */
+
+#define _GNU_SOURCE  // memmem, strcasestr
+
+#include "rtsp_tunnel.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RTSP_USER_AGENT  "libRTSP (LIVE555 Streaming Media v2024.05.30)"  // Same as RTSPClient_DESCRIBE_raw
+#define RTSP_RX_MIN_FREE (64 * 1024)                                       // Compact the demux buffer below this
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int tcp_connect(const char *host, uint16_t port)
+{
+    struct sockaddr_in server_addr;
+    int                one = 1;
+    int                rcvbuf = 4 * 1024 * 1024;
+    int                sock = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (sock < 0)
+    {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &server_addr.sin_addr) <= 0)
+    {
+        fprintf(stderr, "Invalid address: %s\n", host);
+        close(sock);
+        return -1;
+    }
+
+    // Requests are small and latency sensitive; the data leg wants a deep receive queue
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        perror("Connection failed");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            perror("Send failed");
+            return RTSP_ERROR;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return RTSP_SUCCESS;
+}
+
+// (Re)open the POST leg. The server glues it to the GET leg through the session cookie,
+// so a fresh POST can replace one whose Content-Length budget is used up.
+static int open_post_leg(RTSP_TUNNEL *t)
+{
+    char request[1024];
+
+    if (t->tx_fd >= 0)
+    {
+        close(t->tx_fd);
+    }
+    t->tx_fd = tcp_connect(t->host, t->port);
+    if (t->tx_fd < 0)
+    {
+        return RTSP_ERROR;
+    }
+
+    snprintf(request, sizeof(request),
+             "POST %s HTTP/1.0\r\n"
+             "CSeq: 1\r\n"
+             "User-Agent: " RTSP_USER_AGENT "\r\n"
+             "Host: %s\r\n"
+             "x-sessioncookie: %s\r\n"
+             "Content-Type: application/x-rtsp-tunnelled\r\n"
+             "Pragma: no-cache\r\n"
+             "Cache-Control: no-cache\r\n"
+             "Content-Length: %d\r\n"
+             "Expires: Sun, 9 Jan 1972 00:00:00 GMT\r\n"
+             "\r\n",
+             t->path, t->host, t->cookie, RTSP_TUNNEL_POST_LIMIT);
+
+    t->tx_left = RTSP_TUNNEL_POST_LIMIT;
+    return send_all(t->tx_fd, request, strlen(request));
+}
+
+// Open the GET leg and consume the HTTP reply header, which also tells whether the body
+// is base64. Any body bytes that arrived with the header are left in rx_raw.
+static int open_get_leg(RTSP_TUNNEL *t, size_t *early_len)
+{
+    char   request[1024];
+    size_t len = 0;
+    char  *end = NULL;
+
+    t->rx_fd = tcp_connect(t->host, t->port);
+    if (t->rx_fd < 0)
+    {
+        return RTSP_ERROR;
+    }
+
+    snprintf(request, sizeof(request),
+             "GET %s HTTP/1.0\r\n"
+             "CSeq: 1\r\n"
+             "User-Agent: " RTSP_USER_AGENT "\r\n"
+             "Host: %s\r\n"
+             "x-sessioncookie: %s\r\n"
+             "Accept: application/x-rtsp-tunnelled\r\n"
+             "Pragma: no-cache\r\n"
+             "Cache-Control: no-cache\r\n"
+             "\r\n",
+             t->path, t->host, t->cookie);
+
+    if (send_all(t->rx_fd, request, strlen(request)) != RTSP_SUCCESS)
+    {
+        return RTSP_ERROR;
+    }
+
+    while (end == NULL)
+    {
+        ssize_t n;
+
+        if (len + 1 >= RTSP_MAX_RESPONSE)
+        {
+            fprintf(stderr, "Tunnel GET reply header too large\n");
+            return RTSP_ERROR;
+        }
+        n = recv(t->rx_fd, t->rx_raw + len, RTSP_MAX_RESPONSE - 1 - len, 0);
+        if (n <= 0)
+        {
+            perror("Receive failed");
+            return RTSP_ERROR;
+        }
+        len += (size_t)n;
+        t->rx_raw[len] = '\0';
+        end = strstr(t->rx_raw, "\r\n\r\n");
+    }
+
+    if (strncmp(t->rx_raw, "HTTP/1.", 7) != 0 || strncmp(t->rx_raw + 9, "200", 3) != 0)
+    {
+        fprintf(stderr, "Tunnel GET rejected: %.*s\n", (int)strcspn(t->rx_raw, "\r\n"), t->rx_raw);
+        return RTSP_ERROR;
+    }
+
+    // Some NVRs base64 the GET body as well and say so in the reply header; the leg is
+    // classified here, once, and never from the data
+    const char *cte;
+    end[2] = '\0';
+    cte = strcasestr(t->rx_raw, "\nContent-Transfer-Encoding:");
+    t->rx_b64 = cte != NULL && strncasecmp(cte + 28 + strspn(cte + 28, " \t"), "base64", 6) == 0;
+
+    end += 4;
+    *early_len = len - (size_t)(end - t->rx_raw);
+    memmove(t->rx_raw, end, *early_len);
+    return RTSP_SUCCESS;
+}
+
+// Split the demux buffer into '$' frames and RTSP messages. rx_head is always at a
+// message boundary, so a '$' is only taken as a frame there, never inside RTSP text.
+static int rx_demux(RTSP_TUNNEL *t)
+{
+    while (t->rx_head < t->rx_tail)
+    {
+        const uint8_t *p = t->rx_buf + t->rx_head;
+        size_t         avail = t->rx_tail - t->rx_head;
+
+        if (p[0] == '$')
+        {
+            size_t len;
+
+            if (avail < 4)
+            {
+                break;
+            }
+            len = ((size_t)p[2] << 8) | p[3];
+            if (avail < 4 + len)
+            {
+                break;
+            }
+            t->rx_frames++;
+            t->on_data(t->opaque, p[1], p + 4, len);
+            t->rx_head += 4 + len;
+            continue;
+        }
+
+        // Anything else is an RTSP message: a reply, or a request from the server, which
+        // is skipped whole. Both are header lines, an empty line and Content-Length bytes.
+        const uint8_t *hdr_end = memmem(p, avail < RTSP_MAX_RESPONSE - 1 ? avail : RTSP_MAX_RESPONSE - 1, "\r\n\r\n", 4);
+        char           header[RTSP_MAX_RESPONSE];
+        size_t         hdr_len, body_len = 0;
+        const char    *cl;
+
+        if (hdr_end == NULL)
+        {
+            if (avail >= RTSP_MAX_RESPONSE - 1)
+            {
+                fprintf(stderr, "RTSP message header too large, or the stream lost framing\n");
+                return RTSP_ERROR;
+            }
+            break;
+        }
+        hdr_len = (size_t)(hdr_end - p) + 4;
+
+        // Copy the header so the Content-Length lookup is bounded
+        memcpy(header, p, hdr_len);
+        header[hdr_len] = '\0';
+        cl = strcasestr(header, "\nContent-Length:");
+        if (cl != NULL)
+        {
+            char *cl_end;
+            body_len = strtoul(cl + 16, &cl_end, 10);
+            if (cl_end == cl + 16 || body_len >= RTSP_MAX_RESPONSE - hdr_len)
+            {
+                fprintf(stderr, "RTSP message Content-Length invalid or over %d bytes\n", RTSP_MAX_RESPONSE - 1);
+                return RTSP_ERROR;
+            }
+        }
+        if (avail < hdr_len + body_len)
+        {
+            break;
+        }
+
+        if (hdr_len >= 5 && memcmp(p, "RTSP/", 5) == 0)
+        {
+            memcpy(t->response, p, hdr_len + body_len);
+            t->response[hdr_len + body_len] = '\0';
+            t->response_len = hdr_len + body_len;
+            t->response_ready = 1;
+        }
+        t->rx_head += hdr_len + body_len;
+    }
+
+    if (t->rx_head == t->rx_tail)
+    {
+        t->rx_head = t->rx_tail = 0;
+    }
+    return RTSP_SUCCESS;
+}
+
+// Append encoded bytes from the GET leg to the demux buffer
+static int rx_decode(RTSP_TUNNEL *t, size_t raw_len)
+{
+    size_t out_len;
+
+    if (b64_decode_update(&t->rx_dec, t->rx_raw, raw_len, t->rx_buf + t->rx_tail, &out_len) != B64_SUCCESS)
+    {
+        fprintf(stderr, "Invalid base64 on tunnel GET leg\n");
+        return RTSP_ERROR;
+    }
+    t->rx_tail += out_len;
+    return RTSP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Connect to the server.
+ * @param[out] t Tunnel handle.
+ * @param[in] transport Interleaved TCP or HTTP tunnel.
+ * @param[in] host Server IPv4 address.
+ * @param[in] port Server port (554 for RTSP, 80 for the tunnel).
+ * @param[in] path Stream path, used as the HTTP resource.
+ * @param[in] on_data Interleaved frame callback.
+ * @param[in] opaque User pointer passed to @p on_data.
+ * @return RTSP_SUCCESS on success, RTSP_ERROR on failure.
+ */
+int rtsp_tunnel_open(RTSP_TUNNEL *t, RTSP_TRANSPORT_E transport, const char *host, uint16_t port, const char *path,
+                     RTSP_INTERLEAVED_CB on_data, void *opaque)
+{
+    size_t early_len = 0;
+
+    memset(t, 0, sizeof(*t));
+    t->transport = transport;
+    t->port = port;
+    t->rx_fd = -1;
+    t->tx_fd = -1;
+    t->on_data = on_data;
+    t->opaque = opaque;
+    snprintf(t->host, sizeof(t->host), "%s", host);
+    snprintf(t->path, sizeof(t->path), "%s", path);
+
+    t->rx_buf = (uint8_t *)malloc(RTSP_TUNNEL_RX_SIZE);
+    t->rx_raw = (char *)malloc(RTSP_TUNNEL_RX_SIZE);
+    if (t->rx_buf == NULL || t->rx_raw == NULL)
+    {
+        perror("Failed to allocate memory");
+        rtsp_tunnel_close(t);
+        return RTSP_ERROR;
+    }
+    b64_decoder_init(&t->rx_dec);
+
+    if (transport == RTSP_TRANSPORT_INTERLEAVED)
+    {
+        t->rx_fd = tcp_connect(host, port);
+        t->tx_fd = t->rx_fd;
+        return t->rx_fd < 0 ? RTSP_ERROR : RTSP_SUCCESS;
+    }
+
+    srand((unsigned)(time(NULL) ^ getpid()));
+    for (size_t i = 0; i < sizeof(t->cookie) - 1; i++)
+    {
+        t->cookie[i] = "0123456789abcdef"[rand() & 0x0F];
+    }
+
+    if (open_get_leg(t, &early_len) != RTSP_SUCCESS || open_post_leg(t) != RTSP_SUCCESS)
+    {
+        rtsp_tunnel_close(t);
+        return RTSP_ERROR;
+    }
+
+    // Normally empty: replies only start once the first request goes out
+    if (early_len > 0)
+    {
+        if (t->rx_b64)
+        {
+            return rx_decode(t, early_len);
+        }
+        memcpy(t->rx_buf, t->rx_raw, early_len);
+        t->rx_tail = early_len;
+    }
+    return RTSP_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Read whatever is available on the data leg and demux it.
+ * @param[in,out] t Tunnel handle.
+ * @param[in] timeout_ms Time to wait for data.
+ * @return RTSP_SUCCESS if data was processed, RTSP_TIMEOUT if none arrived, RTSP_ERROR on failure.
+ */
+int rtsp_tunnel_pump(RTSP_TUNNEL *t, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = t->rx_fd, .events = POLLIN};
+    size_t        room;
+    ssize_t       n;
+
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0)
+    {
+        perror("poll");
+        return RTSP_ERROR;
+    }
+    if (ret == 0)
+    {
+        return RTSP_TIMEOUT;
+    }
+
+    // Keep a partial frame at the front so the next recv lands behind it
+    if (t->rx_head > 0 && RTSP_TUNNEL_RX_SIZE - t->rx_tail < RTSP_RX_MIN_FREE)
+    {
+        memmove(t->rx_buf, t->rx_buf + t->rx_head, t->rx_tail - t->rx_head);
+        t->rx_tail -= t->rx_head;
+        t->rx_head = 0;
+    }
+    room = RTSP_TUNNEL_RX_SIZE - t->rx_tail;
+    if (room == 0)
+    {
+        fprintf(stderr, "Interleaved frame larger than the demux buffer\n");
+        return RTSP_ERROR;
+    }
+
+    if (t->rx_b64 == 0)
+    {
+        // Plain leg: receive straight into the demux buffer, no staging copy
+        n = recv(t->rx_fd, t->rx_buf + t->rx_tail, room, 0);
+        if (n <= 0)
+        {
+            return RTSP_ERROR;
+        }
+        t->rx_bytes += (size_t)n;
+        t->rx_tail += (size_t)n;
+    }
+    else
+    {
+        // Decoded output is 3/4 of the input plus up to 3 pending characters
+        size_t raw_room = (room / 3) * 4;
+        if (raw_room > RTSP_TUNNEL_RX_SIZE)
+        {
+            raw_room = RTSP_TUNNEL_RX_SIZE;
+        }
+        raw_room = raw_room > 4 ? raw_room - 4 : 0;
+        if (raw_room == 0)
+        {
+            return RTSP_SUCCESS;
+        }
+
+        n = recv(t->rx_fd, t->rx_raw, raw_room, 0);
+        if (n <= 0)
+        {
+            return RTSP_ERROR;
+        }
+        t->rx_bytes += (size_t)n;
+
+        if (rx_decode(t, (size_t)n) != RTSP_SUCCESS)
+        {
+            return RTSP_ERROR;
+        }
+    }
+
+    return rx_demux(t);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Send an RTSP request and wait for its reply.
+ * @param[in,out] t Tunnel handle.
+ * @param[in] method RTSP method (OPTIONS, DESCRIBE, ...).
+ * @param[in] url Request URL.
+ * @param[in] headers Extra header lines, each ending in CRLF, or NULL.
+ * @param[in] timeout_ms Time to wait for the reply.
+ * @return RTSP status code (200, 401, ...) or -1 on transport failure.
+ */
+int rtsp_tunnel_request(RTSP_TUNNEL *t, const char *method, const char *url, const char *headers, int timeout_ms)
+{
+    char    request[RTSP_MAX_RESPONSE];
+    char    session[160] = "";
+    int     len;
+    int64_t deadline;
+
+    if (t->session[0] != '\0')
+    {
+        snprintf(session, sizeof(session), "Session: %s\r\n", t->session);
+    }
+
+    len = snprintf(request, sizeof(request),
+                   "%s %s RTSP/1.0\r\n"
+                   "CSeq: %d\r\n"
+                   "User-Agent: " RTSP_USER_AGENT "\r\n"
+                   "%s%s\r\n",
+                   method, url, ++t->cseq, session, headers ? headers : "");
+    if (len < 0 || (size_t)len >= sizeof(request))
+    {
+        fprintf(stderr, "RTSP request too large\n");
+        return -1;
+    }
+
+    t->response_ready = 0;
+
+    if (t->transport == RTSP_TRANSPORT_HTTP_TUNNEL)
+    {
+        // Each request is encoded on its own, padding included, as in the capture
+        char        encoded[B64_ENCODED_MAX(RTSP_MAX_RESPONSE + 2)];
+        B64_ENCODER enc;
+        size_t      enc_len;
+
+        b64_encoder_init(&enc);
+        enc_len = b64_encode_update(&enc, (const uint8_t *)request, (size_t)len, encoded);
+        enc_len += b64_encode_final(&enc, encoded + enc_len);
+
+        if (enc_len > t->tx_left && open_post_leg(t) != RTSP_SUCCESS)
+        {
+            return -1;
+        }
+        if (send_all(t->tx_fd, encoded, enc_len) != RTSP_SUCCESS)
+        {
+            return -1;
+        }
+        t->tx_left -= enc_len;
+    }
+    else if (send_all(t->tx_fd, request, (size_t)len) != RTSP_SUCCESS)
+    {
+        return -1;
+    }
+
+    deadline = now_ms() + timeout_ms;
+    while (!t->response_ready)
+    {
+        int64_t left = deadline - now_ms();
+        if (left <= 0 || rtsp_tunnel_pump(t, (int)left) == RTSP_ERROR)
+        {
+            fprintf(stderr, "No reply to %s\n", method);
+            return -1;
+        }
+    }
+
+    // Remember the session id (without the ;timeout= suffix) for later requests
+    const char *s = strcasestr(t->response, "\nSession:");
+    if (s != NULL)
+    {
+        s += 9;
+        s += strspn(s, " ");
+        snprintf(t->session, sizeof(t->session), "%.*s", (int)strcspn(s, ";\r\n"), s);
+    }
+
+    return atoi(t->response + 9);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Close both legs and release buffers.
+ * @param[in,out] t Tunnel handle.
+ */
+void rtsp_tunnel_close(RTSP_TUNNEL *t)
+{
+    if (t->tx_fd >= 0 && t->tx_fd != t->rx_fd)
+    {
+        close(t->tx_fd);
+    }
+    if (t->rx_fd >= 0)
+    {
+        close(t->rx_fd);
+    }
+    t->rx_fd = t->tx_fd = -1;
+    free(t->rx_buf);
+    free(t->rx_raw);
+    t->rx_buf = NULL;
+    t->rx_raw = NULL;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file    rtsp_tunnel.h
+ * @brief   RTSP control connection over interleaved TCP or the HTTP GET/POST tunnel.
+ *
+ * In tunnel mode two persistent HTTP connections share an x-sessioncookie:
+ * the GET leg carries RTSP replies and '$' interleaved RTP from the server, the POST
+ * leg carries base64 encoded RTSP requests from the client (see RTSP_Over_http.pcap).
+ * Both transports share the same receive path, so tunnel and plain TCP differ only in
+ * the request encoding. A base64 encoded GET leg, which some NVRs send, is recognised
+ * once, from "Content-Transfer-Encoding: base64" in the GET reply header, and decoded
+ * incrementally into the demux buffer.
+ *
+ * The demux only ever looks at message boundaries: a '$' there starts an interleaved
+ * frame, anything else is an RTSP message (a reply, or a server request that is
+ * skipped), framed by its header and Content-Length. A message that does not fit in
+ * RTSP_MAX_RESPONSE is an error, not something to wait for.
+ *
+ */
+
+#ifndef RTSP_TUNNEL_H
+#define RTSP_TUNNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "base64_stream.h"
+
+/** Success return code */
+#define RTSP_SUCCESS 0
+/** Failure return code */
+#define RTSP_ERROR   1
+/** No complete message arrived before the timeout */
+#define RTSP_TIMEOUT 2
+
+#define RTSP_TUNNEL_RX_SIZE    (512 * 1024)  // Demux buffer, large enough for several RTP packets
+#define RTSP_TUNNEL_POST_LIMIT 32767         // Content-Length announced on the POST leg
+#define RTSP_MAX_RESPONSE      8192
+
+typedef enum
+{
+    RTSP_TRANSPORT_INTERLEAVED,  // RTSP + interleaved RTP on one TCP connection
+    RTSP_TRANSPORT_HTTP_TUNNEL   // RTSP over HTTP GET/POST tunnel
+} RTSP_TRANSPORT_E;
+
+/** Called for every '$' frame; data points into the demux buffer and is valid during the call */
+typedef void (*RTSP_INTERLEAVED_CB)(void *opaque, uint8_t channel, const uint8_t *data, size_t len);
+
+typedef struct
+{
+    RTSP_TRANSPORT_E    transport;
+    char                host[64];
+    uint16_t            port;
+    char                path[256];
+    char                cookie[24];
+
+    int                 rx_fd;     // GET leg, or the only connection in interleaved mode
+    int                 tx_fd;     // POST leg, or equal to rx_fd
+    size_t              tx_left;   // Bytes left before the POST Content-Length is used up
+
+    int                 rx_b64;    // GET leg body is base64 encoded
+    B64_DECODER         rx_dec;
+    uint8_t            *rx_buf;    // Demux buffer (plain bytes)
+    size_t              rx_head;   // First unparsed byte
+    size_t              rx_tail;   // End of valid data
+    char               *rx_raw;    // Staging for encoded bytes when rx_b64 is set
+
+    char                response[RTSP_MAX_RESPONSE];
+    size_t              response_len;
+    int                 response_ready;
+
+    int                 cseq;
+    char                session[128];
+
+    RTSP_INTERLEAVED_CB on_data;
+    void               *opaque;
+
+    uint64_t            rx_bytes;  // Bytes received on the data leg (before base64 decoding)
+    uint64_t            rx_frames;
+} RTSP_TUNNEL;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Connect to the server. In tunnel mode both legs are opened and the GET
+     *        reply header is consumed before returning.
+     * @param[out] t Tunnel handle.
+     * @param[in] transport Interleaved TCP or HTTP tunnel.
+     * @param[in] host Server IPv4 address.
+     * @param[in] port Server port (554 for RTSP, 80 for the tunnel).
+     * @param[in] path Stream path, used as the HTTP resource.
+     * @param[in] on_data Interleaved frame callback.
+     * @param[in] opaque User pointer passed to @p on_data.
+     * @return RTSP_SUCCESS on success, RTSP_ERROR on failure.
+     */
+    int rtsp_tunnel_open(RTSP_TUNNEL *t, RTSP_TRANSPORT_E transport, const char *host, uint16_t port, const char *path,
+                         RTSP_INTERLEAVED_CB on_data, void *opaque);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Send an RTSP request and wait for its reply. Interleaved frames arriving in
+     *        the meantime are delivered through the callback.
+     * @param[in,out] t Tunnel handle.
+     * @param[in] method RTSP method (OPTIONS, DESCRIBE, ...).
+     * @param[in] url Request URL.
+     * @param[in] headers Extra header lines, each ending in CRLF, or NULL.
+     * @param[in] timeout_ms Time to wait for the reply.
+     * @return RTSP status code (200, 401, ...) or -1 on transport failure.
+     */
+    int rtsp_tunnel_request(RTSP_TUNNEL *t, const char *method, const char *url, const char *headers, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Read whatever is available on the data leg and demux it.
+     * @param[in,out] t Tunnel handle.
+     * @param[in] timeout_ms Time to wait for data.
+     * @return RTSP_SUCCESS if data was processed, RTSP_TIMEOUT if none arrived, RTSP_ERROR on failure.
+     */
+    int rtsp_tunnel_pump(RTSP_TUNNEL *t, int timeout_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Close both legs and release buffers.
+     * @param[in,out] t Tunnel handle.
+     */
+    void rtsp_tunnel_close(RTSP_TUNNEL *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // RTSP_TUNNEL_H
@@ -0,0 +1,819 @@
+/*
+ * Multi-stream soak test for the mosaic client stream path
+ *
+ * Author: Kshitij Mistry
+ *
+ * Encodes a test-pattern H.264 clip with libavcodec, then runs N streams through the
+ * same decode path the mosaic client uses (stream_affinity + stream_reconnect) for
+ * hours, logging CPU, RSS, decode rate, latency percentiles and frame drops per
+ * interval so leaks and slow degradation show up as trends.
+ *
+ * Feed modes:
+ *   direct - each stream has an ingest thread that replays the clip at the target fps
+ *            into a bounded packet queue; latency is measured from feed to decoded frame
+ *   url    - each stream reads a URL (e.g. a local RTSP server replaying the clip that
+ *            -w writes out); drops are counted against the expected frame rate
+ *
+ * Usage:
+ *   ./soak_test [-n streams] [-s WxH] [-r fps] [-g gop] [-d seconds] [-i interval]
+ *               [-m direct|url] [-u url] [-p policy] [-e encoder] [-o report.csv] [-w clip.h264]
+ *   Example: ./soak_test -n 64 -s 1280x720 -r 25 -g 50 -d 14400 -o soak.csv
+ *
+ */
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/avutil.h>
+#include <libavutil/log.h>
+#include <libavutil/opt.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stream_affinity.h"
+#include "stream_reconnect.h"
+
+#define MAX_STREAMS    256
+#define CLIP_GOPS      4     // Clip length in GOPs; replayed in a loop
+#define QUEUE_SECONDS  2     // Packet queue depth per stream, in seconds of video
+#define STAMP_RING     1024  // Feed timestamps kept per stream for latency lookup
+#define LAT_BUCKETS    1024  // Log-linear latency histogram, ~3% resolution
+
+typedef struct
+{
+    int         streams;
+    int         width;
+    int         height;
+    int         fps;
+    int         gop;
+    int         duration;
+    int         interval;
+    int         use_url;
+    const char *url;
+    const char *policy;
+    const char *encoder;
+    const char *csv_path;
+    const char *dump_path;
+} SOAK_CONFIG;
+
+typedef struct
+{
+    AVPacket         **packets;
+    int                count;
+    AVCodecParameters *params;
+} TEST_CLIP;
+
+typedef struct
+{
+    AVPacket      **slots;
+    int             size;
+    int             head;
+    int             tail;
+    int             count;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} PACKET_QUEUE;
+
+typedef struct
+{
+    int                    index;
+    const SOAK_CONFIG     *cfg;
+    const TEST_CLIP       *clip;
+    const AFFINITY_POLICY *affinity;
+    PACKET_QUEUE           queue;
+    int64_t                feed_us[STAMP_RING];  // Feed time by packet sequence number
+    atomic_ulong           frames;
+    atomic_ulong           drops;
+    volatile int           quit;
+    pthread_t              ingest_thread;
+    pthread_t              decode_thread;
+    int                    ingest_started;
+    int                    decode_started;
+} SOAK_STREAM;
+
+static atomic_uint lat_hist[LAT_BUCKETS];
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int lat_bucket(uint64_t us)
+{
+    if (us < 64)
+    {
+        return (int)us;
+    }
+    int e = 63 - __builtin_clzll(us);
+    int idx = 64 + (e - 6) * 32 + (int)((us >> (e - 5)) & 31);
+    return idx < LAT_BUCKETS ? idx : LAT_BUCKETS - 1;
+}
+
+static uint64_t lat_bucket_value(int idx)
+{
+    if (idx < 64)
+    {
+        return (uint64_t)idx;
+    }
+    int e = (idx - 64) / 32 + 6;
+    return (uint64_t)(32 + (idx - 64) % 32) << (e - 5);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Test clip
+//-------------------------------------------------------------------------------------------------
+
+// Moving diagonal gradient with a bouncing bar: every frame differs, so the encoder
+// produces realistic P-frames instead of skipping the whole picture
+static void draw_pattern(AVFrame *frame, int n)
+{
+    int bar = (n * 8) % frame->width;
+
+    for (int y = 0; y < frame->height; y++)
+    {
+        uint8_t *row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; x++)
+        {
+            row[x] = (uint8_t)(x + y + n * 3);
+        }
+        for (int x = bar; x < bar + 16 && x < frame->width; x++)
+        {
+            row[x] = 235;
+        }
+    }
+    for (int y = 0; y < frame->height / 2; y++)
+    {
+        memset(frame->data[1] + y * frame->linesize[1], 128 + (n % 64), frame->width / 2);
+        memset(frame->data[2] + y * frame->linesize[2], 128 - (n % 64), frame->width / 2);
+    }
+}
+
+static int clip_append(TEST_CLIP *clip, AVCodecContext *enc, int capacity)
+{
+    AVPacket *pkt = av_packet_alloc();
+    int       ret;
+
+    while (pkt && (ret = avcodec_receive_packet(enc, pkt)) == 0)
+    {
+        if (clip->count == capacity)
+        {
+            av_packet_free(&pkt);
+            return -1;
+        }
+        clip->packets[clip->count++] = pkt;
+        pkt = av_packet_alloc();
+    }
+    av_packet_free(&pkt);
+    return 0;
+}
+
+static int encode_clip(const SOAK_CONFIG *cfg, TEST_CLIP *clip)
+{
+    int             frames = cfg->gop * CLIP_GOPS;
+    AVCodec        *codec;
+    AVCodecContext *enc;
+    AVFrame        *frame;
+    int             ret;
+
+    codec = cfg->encoder ? avcodec_find_encoder_by_name(cfg->encoder) : avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec)
+    {
+        av_log(NULL, AV_LOG_ERROR, "H.264 encoder not available (try -e libx264 or -e h264_vaapi)\n");
+        return -1;
+    }
+
+    enc = avcodec_alloc_context3(codec);
+    frame = av_frame_alloc();
+    clip->packets = calloc(frames + 16, sizeof(AVPacket *));
+    clip->params = avcodec_parameters_alloc();
+    if (!enc || !frame || !clip->packets || !clip->params)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to allocate encoder\n");
+        return -1;
+    }
+
+    // Closed GOPs without B-frames: the clip loops cleanly and decode order equals display order
+    enc->width = cfg->width;
+    enc->height = cfg->height;
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = (AVRational){1, cfg->fps};
+    enc->framerate = (AVRational){cfg->fps, 1};
+    enc->gop_size = cfg->gop;
+    enc->max_b_frames = 0;
+    enc->bit_rate = (int64_t)cfg->width * cfg->height * cfg->fps / 10;
+    av_opt_set(enc->priv_data, "preset", "veryfast", 0);
+    av_opt_set(enc->priv_data, "tune", "zerolatency", 0);
+
+    ret = avcodec_open2(enc, codec, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open encoder: %s\n", av_err2str(ret));
+        return -1;
+    }
+
+    frame->format = enc->pix_fmt;
+    frame->width = enc->width;
+    frame->height = enc->height;
+    if (av_frame_get_buffer(frame, 0) < 0)
+    {
+        return -1;
+    }
+
+    for (int n = 0; n < frames; n++)
+    {
+        av_frame_make_writable(frame);
+        draw_pattern(frame, n);
+        frame->pts = n;
+        frame->pict_type = (n % cfg->gop == 0) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        if (avcodec_send_frame(enc, frame) < 0 || clip_append(clip, enc, frames + 16) < 0)
+        {
+            av_log(NULL, AV_LOG_ERROR, "Encoding failed at frame %d\n", n);
+            return -1;
+        }
+    }
+    avcodec_send_frame(enc, NULL);
+    clip_append(clip, enc, frames + 16);
+
+    avcodec_parameters_from_context(clip->params, enc);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+
+    if (clip->count == 0 || !(clip->packets[0]->flags & AV_PKT_FLAG_KEY))
+    {
+        av_log(NULL, AV_LOG_ERROR, "Encoder produced no leading keyframe\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Raw Annex-B dump, e.g. for "ffmpeg -re -stream_loop -1 -i clip.h264 -c copy -f rtsp ..."
+static int dump_clip(const TEST_CLIP *clip, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        perror("fopen");
+        return -1;
+    }
+    for (int i = 0; i < clip->count; i++)
+    {
+        fwrite(clip->packets[i]->data, 1, clip->packets[i]->size, fp);
+    }
+    fclose(fp);
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Packet queue (ingest -> decode)
+//-------------------------------------------------------------------------------------------------
+
+static int queue_init(PACKET_QUEUE *q, int size)
+{
+    q->slots = calloc(size, sizeof(AVPacket *));
+    q->size = size;
+    q->head = q->tail = q->count = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return q->slots ? 0 : -1;
+}
+
+// Returns -1 when full; the caller owns the packet then
+static int queue_push(PACKET_QUEUE *q, AVPacket *pkt)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->size)
+    {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    q->slots[q->tail] = pkt;
+    q->tail = (q->tail + 1) % q->size;
+    q->count++;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+static AVPacket *queue_pop(PACKET_QUEUE *q, int timeout_ms)
+{
+    AVPacket       *pkt = NULL;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)timeout_ms * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0)
+    {
+        if (pthread_cond_timedwait(&q->cond, &q->lock, &deadline) != 0)
+        {
+            break;
+        }
+    }
+    if (q->count > 0)
+    {
+        pkt = q->slots[q->head];
+        q->head = (q->head + 1) % q->size;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pkt;
+}
+
+static void queue_free(PACKET_QUEUE *q)
+{
+    AVPacket *pkt;
+    while ((pkt = queue_pop(q, 0)) != NULL)
+    {
+        av_packet_free(&pkt);
+    }
+    free(q->slots);
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+}
+
+//-------------------------------------------------------------------------------------------------
+// Stream threads
+//-------------------------------------------------------------------------------------------------
+
+// Replays the clip at the target frame rate. A full queue means the decoder fell behind:
+// the packet is dropped and so is everything up to the next keyframe.
+static void *ingest_thread(void *arg)
+{
+    SOAK_STREAM *s = (SOAK_STREAM *)arg;
+    int64_t      period = 1000000 / s->cfg->fps;
+    int64_t      next = now_us();
+    int64_t      seq = 0;
+    int          skip_to_key = 0;
+
+    affinity_apply(s->affinity, AFFINITY_ROLE_INGEST, s->index);
+
+    // Stagger streams across one frame period so they don't all burst at once
+    next += period * s->index / s->cfg->streams;
+
+    while (!s->quit)
+    {
+        const AVPacket *src = s->clip->packets[seq % s->clip->count];
+        int64_t         wait = next - now_us();
+
+        if (wait > 0)
+        {
+            usleep((useconds_t)wait);
+        }
+        next += period;
+
+        if (skip_to_key && !(src->flags & AV_PKT_FLAG_KEY))
+        {
+            atomic_fetch_add(&s->drops, 1);
+            seq++;
+            continue;
+        }
+        skip_to_key = 0;
+
+        AVPacket *pkt = av_packet_clone(src);
+        pkt->pts = pkt->dts = seq;
+        s->feed_us[seq % STAMP_RING] = now_us();
+        if (queue_push(&s->queue, pkt) != 0)
+        {
+            av_packet_free(&pkt);
+            atomic_fetch_add(&s->drops, 1);
+            skip_to_key = 1;
+        }
+        seq++;
+    }
+    return NULL;
+}
+
+static void decode_drain(SOAK_STREAM *s, DECODER_CACHE *cache, int measure_latency)
+{
+    while (avcodec_receive_frame(cache->dec_ctx, cache->frame) == 0)
+    {
+        atomic_fetch_add(&s->frames, 1);
+        if (measure_latency && cache->frame->pts != AV_NOPTS_VALUE)
+        {
+            int64_t lat = now_us() - s->feed_us[cache->frame->pts % STAMP_RING];
+            atomic_fetch_add(&lat_hist[lat_bucket(lat > 0 ? (uint64_t)lat : 0)], 1);
+        }
+        av_frame_unref(cache->frame);
+    }
+}
+
+static int stream_interrupted(void *arg)
+{
+    return ((SOAK_STREAM *)arg)->quit;
+}
+
+// Sleep in short slices so a stop is not held up by a long backoff
+static void backoff_sleep(SOAK_STREAM *s, int delay_ms)
+{
+    while (delay_ms > 0 && !s->quit)
+    {
+        int slice = delay_ms < 100 ? delay_ms : 100;
+        usleep(slice * 1000);
+        delay_ms -= slice;
+    }
+}
+
+static void *decode_thread(void *arg)
+{
+    SOAK_STREAM  *s = (SOAK_STREAM *)arg;
+    DECODER_CACHE cache;
+
+    affinity_apply(s->affinity, AFFINITY_ROLE_DECODE, s->index);
+    if (decoder_cache_init(&cache) != RECONNECT_SUCCESS)
+    {
+        return NULL;
+    }
+
+    if (!s->cfg->use_url)
+    {
+        if (decoder_cache_prepare(&cache, s->clip->params) != RECONNECT_SUCCESS)
+        {
+            decoder_cache_free(&cache);
+            return NULL;
+        }
+        while (!s->quit)
+        {
+            AVPacket *pkt = queue_pop(&s->queue, 100);
+            if (pkt == NULL)
+            {
+                continue;
+            }
+            avcodec_send_packet(cache.dec_ctx, pkt);
+            av_packet_free(&pkt);
+            decode_drain(s, &cache, 1);
+        }
+    }
+    else
+    {
+        // Same connect/reconnect path as 4x4Streamer
+        RECONNECT_BACKOFF backoff;
+        AVIOInterruptCB   interrupt = {stream_interrupted, s};
+        AVFormatContext  *fmt_ctx = NULL;
+        AVPacket         *pkt = av_packet_alloc();
+        int               video;
+
+        reconnect_backoff_init(&backoff, RECONNECT_INITIAL_MS, RECONNECT_MAX_MS);
+        while (!s->quit && pkt)
+        {
+            if (reconnect_open_input(&fmt_ctx, s->cfg->url, &cache, &interrupt, &video) != RECONNECT_SUCCESS ||
+                decoder_cache_prepare(&cache, fmt_ctx->streams[video]->codecpar) != RECONNECT_SUCCESS)
+            {
+                avformat_close_input(&fmt_ctx);
+                backoff_sleep(s, reconnect_backoff_next(&backoff));
+                continue;
+            }
+            reconnect_backoff_reset(&backoff);
+
+            while (!s->quit && av_read_frame(fmt_ctx, pkt) >= 0)
+            {
+                if (pkt->stream_index == video)
+                {
+                    avcodec_send_packet(cache.dec_ctx, pkt);
+                    decode_drain(s, &cache, 0);
+                }
+                av_packet_unref(pkt);
+            }
+            avformat_close_input(&fmt_ctx);
+
+            // A server that accepts and then drops the session must not cause a tight loop
+            backoff_sleep(s, reconnect_backoff_next(&backoff));
+        }
+        av_packet_free(&pkt);
+    }
+
+    decoder_cache_free(&cache);
+    return NULL;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Monitoring
+//-------------------------------------------------------------------------------------------------
+
+static double rss_mb(void)
+{
+    long  pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp != NULL)
+    {
+        if (fscanf(fp, "%*s %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(fp);
+    }
+    return pages * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+static double cpu_seconds(void)
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+// Take and reset the interval histogram; returns p50/p95/p99/max in milliseconds
+static void lat_percentiles(double out[4])
+{
+    static unsigned snapshot[LAT_BUCKETS];
+    const double    quantiles[3] = {0.50, 0.95, 0.99};
+    uint64_t        total = 0, seen = 0;
+    uint64_t        rank[3];
+    int             q = 0, max_idx = -1;
+
+    for (int i = 0; i < LAT_BUCKETS; i++)
+    {
+        snapshot[i] = atomic_exchange(&lat_hist[i], 0);
+        total += snapshot[i];
+        if (snapshot[i] > 0)
+        {
+            max_idx = i;
+        }
+    }
+
+    out[0] = out[1] = out[2] = out[3] = -1.0;
+    if (total == 0)
+    {
+        return;
+    }
+    // Nearest-rank: the p-th percentile is the ceil(p * total)-th sample, and at least the first
+    for (int i = 0; i < 3; i++)
+    {
+        rank[i] = (uint64_t)ceil(quantiles[i] * total);
+        rank[i] = rank[i] < 1 ? 1 : rank[i];
+    }
+    for (int i = 0; i < LAT_BUCKETS && q < 3; i++)
+    {
+        seen += snapshot[i];
+        while (q < 3 && seen >= rank[q])
+        {
+            out[q++] = lat_bucket_value(i) / 1000.0;
+        }
+    }
+    out[3] = lat_bucket_value(max_idx) / 1000.0;
+}
+
+// Stop and join the threads of the first @p count streams, then free their queues
+static void stop_streams(SOAK_STREAM *streams, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        streams[i].quit = 1;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (streams[i].ingest_started)
+        {
+            pthread_join(streams[i].ingest_thread, NULL);
+        }
+        if (streams[i].decode_started)
+        {
+            pthread_join(streams[i].decode_thread, NULL);
+        }
+        queue_free(&streams[i].queue);
+    }
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n", prog);
+    printf("  -n streams    Number of streams (default 64, max %d)\n", MAX_STREAMS);
+    printf("  -s WxH        Test pattern resolution (default 640x360)\n");
+    printf("  -r fps        Frame rate (default 25)\n");
+    printf("  -g gop        GOP length in frames (default 50)\n");
+    printf("  -d seconds    Test duration (default 3600)\n");
+    printf("  -i seconds    Report interval (default 10)\n");
+    printf("  -m mode       direct (in-process packet feed) or url (default direct)\n");
+    printf("  -u url        Stream URL for url mode, e.g. rtsp://127.0.0.1:8554/test\n");
+    printf("  -p policy     Thread placement, see 4x4Streamer -p (default none)\n");
+    printf("  -e encoder    libavcodec encoder name (default: first H.264 encoder)\n");
+    printf("  -o file       CSV report (default: stdout only)\n");
+    printf("  -w file       Write the encoded clip as raw H.264 for a local RTSP server\n");
+}
+
+int main(int argc, char *argv[])
+{
+    SOAK_CONFIG     cfg = {64, 640, 360, 25, 50, 3600, 10, 0, NULL, "none", NULL, NULL, NULL};
+    TEST_CLIP       clip = {0};
+    AFFINITY_POLICY affinity;
+    SOAK_STREAM    *streams;
+    FILE           *csv = NULL;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "n:s:r:g:d:i:m:u:p:e:o:w:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                cfg.streams = atoi(optarg);
+                break;
+            case 's':
+                if (sscanf(optarg, "%dx%d", &cfg.width, &cfg.height) != 2)
+                {
+                    usage(argv[0]);
+                    return -1;
+                }
+                break;
+            case 'r':
+                cfg.fps = atoi(optarg);
+                break;
+            case 'g':
+                cfg.gop = atoi(optarg);
+                break;
+            case 'd':
+                cfg.duration = atoi(optarg);
+                break;
+            case 'i':
+                cfg.interval = atoi(optarg);
+                break;
+            case 'm':
+                cfg.use_url = strcmp(optarg, "url") == 0;
+                break;
+            case 'u':
+                cfg.url = optarg;
+                break;
+            case 'p':
+                cfg.policy = optarg;
+                break;
+            case 'e':
+                cfg.encoder = optarg;
+                break;
+            case 'o':
+                cfg.csv_path = optarg;
+                break;
+            case 'w':
+                cfg.dump_path = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return -1;
+        }
+    }
+
+    if (cfg.streams < 1 || cfg.streams > MAX_STREAMS || cfg.fps < 1 || cfg.gop < 1 || cfg.interval < 1 || (cfg.use_url && !cfg.url))
+    {
+        usage(argv[0]);
+        return -1;
+    }
+    if (affinity_policy_init(&affinity, cfg.policy) != AFFINITY_SUCCESS)
+    {
+        return -1;
+    }
+
+    av_log_set_level(AV_LOG_ERROR);
+    av_register_all();
+    avformat_network_init();
+    srand((unsigned)time(NULL));
+
+    if (!cfg.use_url || cfg.dump_path)
+    {
+        printf("Encoding %d-frame %dx%d test clip...\n", cfg.gop * CLIP_GOPS, cfg.width, cfg.height);
+        if (encode_clip(&cfg, &clip) != 0)
+        {
+            return -1;
+        }
+        if (cfg.dump_path && dump_clip(&clip, cfg.dump_path) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (cfg.csv_path)
+    {
+        csv = fopen(cfg.csv_path, "w");
+        if (csv == NULL)
+        {
+            perror("fopen");
+            return -1;
+        }
+        fprintf(csv, "elapsed_s,streams,cpu_pct,rss_mb,fps,drops,lat_p50_ms,lat_p95_ms,lat_p99_ms,lat_max_ms\n");
+    }
+
+    streams = calloc(cfg.streams, sizeof(SOAK_STREAM));
+    if (streams == NULL)
+    {
+        perror("calloc");
+        return -1;
+    }
+
+    affinity_describe(&affinity, cfg.streams, stdout);
+    affinity_apply(&affinity, AFFINITY_ROLE_RENDER, 0);
+
+    for (int i = 0; i < cfg.streams; i++)
+    {
+        SOAK_STREAM *s = &streams[i];
+        s->index = i;
+        s->cfg = &cfg;
+        s->clip = &clip;
+        s->affinity = &affinity;
+        if (queue_init(&s->queue, cfg.fps * QUEUE_SECONDS) != 0)
+        {
+            perror("calloc");
+            stop_streams(streams, i);
+            free(streams);
+            return -1;
+        }
+
+        // On a failed start, stop the threads already running before giving up
+        int err = pthread_create(&s->decode_thread, NULL, decode_thread, s);
+        s->decode_started = err == 0;
+        if (err == 0 && !cfg.use_url)
+        {
+            err = pthread_create(&s->ingest_thread, NULL, ingest_thread, s);
+            s->ingest_started = err == 0;
+        }
+        if (err != 0)
+        {
+            fprintf(stderr, "Failed to start stream %d: %s\n", i, strerror(err));
+            stop_streams(streams, i + 1);
+            free(streams);
+            return -1;
+        }
+    }
+
+    printf("%8s %6s %8s %9s %9s %7s %8s %8s %8s %8s\n", "time_s", "strms", "cpu_%", "rss_MB", "fps", "drops", "p50_ms", "p95_ms", "p99_ms",
+           "max_ms");
+
+    int64_t       start = now_us(), last = start;
+    double        last_cpu = cpu_seconds();
+    double        first_rss = -1.0, rss = 0.0;
+    unsigned long last_frames = 0, last_drops = 0;
+
+    while ((now_us() - start) / 1000000 < cfg.duration)
+    {
+        sleep(cfg.interval);
+
+        int64_t       now = now_us();
+        double        wall = (now - last) / 1e6;
+        double        cpu = cpu_seconds();
+        unsigned long frames = 0, drops = 0;
+        double        lat[4];
+
+        for (int i = 0; i < cfg.streams; i++)
+        {
+            frames += atomic_load(&streams[i].frames);
+            drops += atomic_load(&streams[i].drops);
+        }
+        if (cfg.use_url)
+        {
+            // No feed side to count drops: anything short of the nominal rate is a drop
+            double expected = (double)cfg.fps * cfg.streams * wall;
+            double decoded = (double)(frames - last_frames);
+            drops = last_drops + (unsigned long)(expected > decoded ? expected - decoded : 0);
+        }
+        lat_percentiles(lat);
+        rss = rss_mb();
+        if (first_rss < 0)
+        {
+            first_rss = rss;
+        }
+
+        double fps = (frames - last_frames) / wall;
+        double cpu_pct = (cpu - last_cpu) / wall * 100.0;
+        double elapsed = (now - start) / 1e6;
+
+        printf("%8.0f %6d %8.1f %9.1f %9.1f %7lu %8.2f %8.2f %8.2f %8.2f\n", elapsed, cfg.streams, cpu_pct, rss, fps, drops - last_drops, lat[0],
+               lat[1], lat[2], lat[3]);
+        if (csv)
+        {
+            fprintf(csv, "%.0f,%d,%.1f,%.1f,%.1f,%lu,%.3f,%.3f,%.3f,%.3f\n", elapsed, cfg.streams, cpu_pct, rss, fps, drops - last_drops, lat[0],
+                    lat[1], lat[2], lat[3]);
+            fflush(csv);
+        }
+
+        last = now;
+        last_cpu = cpu;
+        last_frames = frames;
+        last_drops = drops;
+    }
+
+    stop_streams(streams, cfg.streams);
+
+    double hours = (now_us() - start) / 3.6e9;
+    printf("RSS %.1f MB -> %.1f MB (%+.2f MB/hour), %lu frames dropped\n", first_rss, rss, hours > 0 ? (rss - first_rss) / hours : 0.0,
+           last_drops);
+
+    if (csv)
+    {
+        fclose(csv);
+    }
+    for (int i = 0; i < clip.count; i++)
+    {
+        av_packet_free(&clip.packets[i]);
+    }
+    free(clip.packets);
+    avcodec_parameters_free(&clip.params);
+    free(streams);
+    return 0;
+}
@@ -0,0 +1,383 @@
+/**
+ * @file    stream_affinity.c
+ * @brief   CPU/NUMA placement policy for ingest, decode and render threads.
+ *
+ * Topology comes from sysfs and the memory policy is set with the raw set_mempolicy
+ * system call, so no libnuma is needed at build or run time.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include "stream_affinity.h"
+
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define MPOL_PREFERRED 1  // From <numaif.h>, kept local to avoid the libnuma dependency
+
+static const char *role_names[AFFINITY_ROLE_COUNT] = {"ingest", "decode", "render"};
+
+// Parse a kernel style CPU list ("0-3,8,10-11"). Returns the number of CPUs or -1.
+static int parse_cpulist(const char *list, int *cpus, int max)
+{
+    int n = 0;
+
+    while (*list != '\0' && *list != '\n')
+    {
+        char *end;
+        long  lo = strtol(list, &end, 10), hi;
+
+        if (end == list || lo < 0)
+        {
+            return -1;
+        }
+        hi = lo;
+        if (*end == '-')
+        {
+            list = end + 1;
+            hi = strtol(list, &end, 10);
+            if (end == list || hi < lo)
+            {
+                return -1;
+            }
+        }
+        if (hi >= AFFINITY_MAX_CPUS)
+        {
+            return -1;
+        }
+        for (long c = lo; c <= hi && n < max; c++)
+        {
+            cpus[n++] = (int)c;
+        }
+        list = end;
+        if (*list == ',')
+        {
+            list++;
+        }
+        else if (*list != '\0' && *list != '\n')
+        {
+            return -1;
+        }
+    }
+    return n;
+}
+
+static int read_cpulist(const char *path, int *cpus, int max)
+{
+    char  buf[1024];
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL)
+    {
+        return -1;
+    }
+    if (fgets(buf, sizeof(buf), fp) == NULL)
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return parse_cpulist(buf, cpus, max);
+}
+
+static void read_topology(AFFINITY_POLICY *p)
+{
+    char path[128];
+
+    p->num_nodes = 0;
+    p->num_cpus = 0;
+    for (int node = 0; node < AFFINITY_MAX_NODES; node++)
+    {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        int n = read_cpulist(path, p->node_cpus[node], AFFINITY_MAX_CPUS);
+        if (n <= 0)
+        {
+            continue;
+        }
+
+        // Node ids can have holes (e.g. memory-only nodes); keep the kernel numbering
+        p->node_ncpus[node] = n;
+        p->num_nodes = node + 1;
+        for (int i = 0; i < n && p->num_cpus < AFFINITY_MAX_CPUS; i++)
+        {
+            p->node_of_cpu[p->node_cpus[node][i]] = node;
+            p->cpu_order[p->num_cpus++] = p->node_cpus[node][i];
+        }
+    }
+
+    if (p->num_cpus == 0)
+    {
+        // No NUMA sysfs (container, non-NUMA kernel): one node with every online CPU
+        int n = read_cpulist("/sys/devices/system/cpu/online", p->node_cpus[0], AFFINITY_MAX_CPUS);
+        if (n <= 0)
+        {
+            n = 1;
+            p->node_cpus[0][0] = 0;
+        }
+        p->num_nodes = 1;
+        p->node_ncpus[0] = n;
+        p->num_cpus = n;
+        memcpy(p->cpu_order, p->node_cpus[0], sizeof(int) * n);
+    }
+}
+
+// Parse a "@node" suffix. The node must exist on this machine: it becomes a bit in the
+// set_mempolicy mask, so an out-of-range number would shift past the mask.
+static int parse_node(const AFFINITY_POLICY *p, const char *text, int *node)
+{
+    char  path[128];
+    char *end;
+    long  n;
+
+    errno = 0;
+    n = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || n < 0 || n >= AFFINITY_MAX_NODES)
+    {
+        return AFFINITY_ERROR;
+    }
+    // Memory-only nodes have no CPUs, so they are not counted in num_nodes; ask sysfs
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%ld", n);
+    if (n >= p->num_nodes && access(path, F_OK) != 0)
+    {
+        return AFFINITY_ERROR;
+    }
+    *node = (int)n;
+    return AFFINITY_SUCCESS;
+}
+
+// Custom spec: role=cpulist[@node] entries separated by ','. A token without '=' continues
+// the previous role's CPU list, so "decode=4-7,12@1" means CPUs 4-7 and 12 on node 1.
+static int parse_custom(AFFINITY_POLICY *p, const char *spec)
+{
+    char  list[AFFINITY_ROLE_COUNT][512] = {{0}};
+    char *copy = strdup(spec);
+    char *save = NULL;
+    int   role = -1;
+
+    if (copy == NULL)
+    {
+        return AFFINITY_ERROR;
+    }
+
+    for (char *tok = strtok_r(copy, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strchr(tok, '=');
+        char *at;
+
+        if (eq != NULL)
+        {
+            *eq = '\0';
+            role = -1;
+            for (int r = 0; r < AFFINITY_ROLE_COUNT; r++)
+            {
+                if (strcmp(tok, role_names[r]) == 0)
+                {
+                    role = r;
+                }
+            }
+            tok = eq + 1;
+        }
+        if (role < 0)
+        {
+            fprintf(stderr, "Affinity: unknown role in \"%s\"\n", spec);
+            free(copy);
+            return AFFINITY_ERROR;
+        }
+
+        at = strchr(tok, '@');
+        if (at != NULL)
+        {
+            *at = '\0';
+            if (parse_node(p, at + 1, &p->role_node[role]) != AFFINITY_SUCCESS)
+            {
+                fprintf(stderr, "Affinity: no NUMA node \"%s\" for %s (this machine has %d)\n", at + 1, role_names[role], p->num_nodes);
+                free(copy);
+                return AFFINITY_ERROR;
+            }
+        }
+        if (*tok != '\0')
+        {
+            size_t used = strlen(list[role]);
+            snprintf(list[role] + used, sizeof(list[role]) - used, "%s%s", used ? "," : "", tok);
+        }
+    }
+    free(copy);
+
+    for (int r = 0; r < AFFINITY_ROLE_COUNT; r++)
+    {
+        int n = list[r][0] ? parse_cpulist(list[r], p->role_cpus[r], AFFINITY_MAX_CPUS) : 0;
+        if (n < 0)
+        {
+            fprintf(stderr, "Affinity: bad CPU list for %s: %s\n", role_names[r], list[r]);
+            return AFFINITY_ERROR;
+        }
+        p->role_ncpus[r] = n;
+    }
+    return AFFINITY_SUCCESS;
+}
+
+// CPUs of a node that streams may use. In the built-in layouts the render thread keeps the
+// last online CPU to itself, so it is left out of its node unless it is the only CPU.
+static int stream_ncpus(const AFFINITY_POLICY *p, int node)
+{
+    int render = p->cpu_order[p->num_cpus - 1];
+
+    if (p->num_cpus > 1 && p->node_of_cpu[render] == node)
+    {
+        return p->node_ncpus[node] - 1;
+    }
+    return p->node_ncpus[node];
+}
+
+// CPU for (role, index), or -1 to leave the thread unpinned
+static int pick_cpu(const AFFINITY_POLICY *p, AFFINITY_ROLE_E role, int index)
+{
+    switch (p->policy)
+    {
+        case AFFINITY_POLICY_COMPACT:
+        case AFFINITY_POLICY_SCATTER:
+            if (role == AFFINITY_ROLE_RENDER)
+            {
+                return p->cpu_order[p->num_cpus - 1];
+            }
+            if (p->policy == AFFINITY_POLICY_COMPACT)
+            {
+                return p->cpu_order[index % (p->num_cpus > 1 ? p->num_cpus - 1 : 1)];
+            }
+            else
+            {
+                // Skip nodes with no CPU left for streams so every stream lands somewhere
+                int node = index % p->num_nodes;
+                while (stream_ncpus(p, node) == 0)
+                {
+                    node = (node + 1) % p->num_nodes;
+                }
+                return p->node_cpus[node][(index / p->num_nodes) % stream_ncpus(p, node)];
+            }
+
+        case AFFINITY_POLICY_CUSTOM:
+            if (p->role_ncpus[role] == 0)
+            {
+                return -1;
+            }
+            return p->role_cpus[role][index % p->role_ncpus[role]];
+
+        default:
+            return -1;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Read the machine topology and parse a policy string.
+ * @param[out] p Policy.
+ * @param[in] spec "none", "compact", "scatter" or a custom role list (see file header).
+ * @return AFFINITY_SUCCESS on success, AFFINITY_ERROR on a malformed spec.
+ */
+int affinity_policy_init(AFFINITY_POLICY *p, const char *spec)
+{
+    memset(p, 0, sizeof(*p));
+    for (int r = 0; r < AFFINITY_ROLE_COUNT; r++)
+    {
+        p->role_node[r] = -1;
+    }
+    read_topology(p);
+
+    if (spec == NULL || strcmp(spec, "none") == 0)
+    {
+        p->policy = AFFINITY_POLICY_NONE;
+    }
+    else if (strcmp(spec, "compact") == 0)
+    {
+        p->policy = AFFINITY_POLICY_COMPACT;
+    }
+    else if (strcmp(spec, "scatter") == 0)
+    {
+        p->policy = AFFINITY_POLICY_SCATTER;
+    }
+    else
+    {
+        p->policy = AFFINITY_POLICY_CUSTOM;
+        return parse_custom(p, spec);
+    }
+    return AFFINITY_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Pin the calling thread for a role and prefer its node for allocations.
+ * @param[in] p Policy.
+ * @param[in] role Thread role.
+ * @param[in] index Stream index (selects the CPU within the role's set).
+ * @return NUMA node the thread was placed on, or -1 if left unpinned.
+ */
+int affinity_apply(const AFFINITY_POLICY *p, AFFINITY_ROLE_E role, int index)
+{
+    int cpu = pick_cpu(p, role, index);
+    int node = p->policy == AFFINITY_POLICY_CUSTOM ? p->role_node[role] : -1;
+
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret != 0)
+        {
+            fprintf(stderr, "Affinity: cannot pin %s thread %d to CPU %d: %s\n", role_names[role], index, cpu, strerror(ret));
+            return -1;
+        }
+        if (node < 0)
+        {
+            node = p->node_of_cpu[cpu];
+        }
+    }
+
+    if (node >= 0 && p->num_nodes > 1)
+    {
+        // Preferred (not bound): fall back to other nodes instead of failing when full
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0)
+        {
+            perror("set_mempolicy");
+        }
+    }
+    return node;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Print the policy and the resulting placement for @p streams streams.
+ * @param[in] p Policy.
+ * @param[in] streams Number of streams.
+ * @param[in] out Output stream.
+ */
+void affinity_describe(const AFFINITY_POLICY *p, int streams, FILE *out)
+{
+    static const char *policy_names[] = {"none", "compact", "scatter", "custom"};
+
+    fprintf(out, "Affinity policy: %s (%d CPUs, %d NUMA nodes)\n", policy_names[p->policy], p->num_cpus, p->num_nodes);
+    if (p->policy == AFFINITY_POLICY_NONE)
+    {
+        return;
+    }
+
+    for (int i = 0; i < streams; i++)
+    {
+        fprintf(out, "  stream %2d:", i);
+        for (int r = 0; r < AFFINITY_ROLE_RENDER; r++)
+        {
+            int cpu = pick_cpu(p, (AFFINITY_ROLE_E)r, i);
+            fprintf(out, " %s=%s%d", role_names[r], cpu < 0 ? "any" : "cpu", cpu < 0 ? 0 : cpu);
+        }
+        fprintf(out, "\n");
+    }
+    int cpu = pick_cpu(p, AFFINITY_ROLE_RENDER, 0);
+    fprintf(out, "  render   : %s%d\n", cpu < 0 ? "any" : "cpu", cpu < 0 ? 0 : cpu);
+}
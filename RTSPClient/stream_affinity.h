@@ -0,0 +1,105 @@
+/**
+ * @file    stream_affinity.h
+ * @brief   CPU/NUMA placement policy for ingest, decode and render threads.
+ *
+ * A policy maps (role, index) to one CPU and its NUMA node. Applying it pins the
+ * calling thread and makes the node the preferred target for the thread's later
+ * allocations, so frame buffers allocated after the call are node local.
+ *
+ * Policy strings:
+ *   none     - leave scheduling to the kernel
+ *   compact  - fill node 0 first, then the next node (shares L3, minimizes nodes used)
+ *   scatter  - round-robin streams across nodes (spreads memory bandwidth)
+ *              Both give the render thread the last online CPU and keep streams off it.
+ *   custom   - per role core lists with an optional node, e.g.
+ *              "ingest=0-3@0,decode=4-11,render=12@1"
+ *              A node must exist on this machine, or the spec is rejected.
+ *
+ */
+
+#ifndef STREAM_AFFINITY_H
+#define STREAM_AFFINITY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/** Success return code */
+#define AFFINITY_SUCCESS 0
+/** Failure return code */
+#define AFFINITY_ERROR   1
+
+#define AFFINITY_MAX_CPUS  256
+#define AFFINITY_MAX_NODES 16
+
+typedef enum
+{
+    AFFINITY_ROLE_INGEST,
+    AFFINITY_ROLE_DECODE,
+    AFFINITY_ROLE_RENDER,
+    AFFINITY_ROLE_COUNT
+} AFFINITY_ROLE_E;
+
+typedef enum
+{
+    AFFINITY_POLICY_NONE,
+    AFFINITY_POLICY_COMPACT,
+    AFFINITY_POLICY_SCATTER,
+    AFFINITY_POLICY_CUSTOM
+} AFFINITY_POLICY_E;
+
+typedef struct
+{
+    AFFINITY_POLICY_E policy;
+
+    // Topology, read from /sys/devices/system/node
+    int               num_cpus;
+    int               num_nodes;
+    int               cpu_order[AFFINITY_MAX_CPUS];  // Online CPUs sorted by node
+    int               node_of_cpu[AFFINITY_MAX_CPUS];
+    int               node_cpus[AFFINITY_MAX_NODES][AFFINITY_MAX_CPUS];
+    int               node_ncpus[AFFINITY_MAX_NODES];
+
+    // Custom policy
+    int               role_cpus[AFFINITY_ROLE_COUNT][AFFINITY_MAX_CPUS];
+    int               role_ncpus[AFFINITY_ROLE_COUNT];
+    int               role_node[AFFINITY_ROLE_COUNT];  // -1: node of the chosen CPU
+} AFFINITY_POLICY;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Read the machine topology and parse a policy string.
+     * @param[out] p Policy.
+     * @param[in] spec "none", "compact", "scatter" or a custom role list (see file header).
+     * @return AFFINITY_SUCCESS on success, AFFINITY_ERROR on a malformed spec.
+     */
+    int affinity_policy_init(AFFINITY_POLICY *p, const char *spec);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Pin the calling thread for a role and prefer its node for allocations.
+     * @param[in] p Policy.
+     * @param[in] role Thread role.
+     * @param[in] index Stream index (selects the CPU within the role's set).
+     * @return NUMA node the thread was placed on, or -1 if left unpinned.
+     */
+    int affinity_apply(const AFFINITY_POLICY *p, AFFINITY_ROLE_E role, int index);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Print the policy and the resulting placement for @p streams streams.
+     * @param[in] p Policy.
+     * @param[in] streams Number of streams.
+     * @param[in] out Output stream.
+     */
+    void affinity_describe(const AFFINITY_POLICY *p, int streams, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // STREAM_AFFINITY_H
@@ -0,0 +1,248 @@
+/**
+ * @file    stream_reconnect.c
+ * @brief   Reconnect manager: exponential backoff and decoder reuse across reconnects.
+ *
+ */
+
+#include "stream_reconnect.h"
+
+#include <libavutil/avutil.h>
+#include <libavutil/log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECONNECT_SOCKET_TIMEOUT "5000000"  // us; a dead camera must not block av_read_frame forever
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize a backoff sequence.
+ * @param[out] b Backoff state.
+ * @param[in] initial_ms First delay.
+ * @param[in] max_ms Upper bound for the delay.
+ */
+void reconnect_backoff_init(RECONNECT_BACKOFF *b, int initial_ms, int max_ms)
+{
+    b->initial_ms = initial_ms;
+    b->max_ms = max_ms;
+    b->current_ms = initial_ms;
+    b->attempts = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Get the delay before the next attempt and grow the sequence.
+ * @param[in,out] b Backoff state.
+ * @return Delay in milliseconds.
+ */
+int reconnect_backoff_next(RECONNECT_BACKOFF *b)
+{
+    int jitter = b->current_ms / 4;
+    int delay = b->current_ms - jitter + (jitter > 0 ? rand() % (2 * jitter + 1) : 0);
+
+    b->attempts++;
+    b->current_ms = b->current_ms * 2 > b->max_ms ? b->max_ms : b->current_ms * 2;
+    return delay;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Restart the sequence after a successful connect.
+ * @param[in,out] b Backoff state.
+ */
+void reconnect_backoff_reset(RECONNECT_BACKOFF *b)
+{
+    b->current_ms = b->initial_ms;
+    b->attempts = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Initialize an empty decoder cache and allocate its frame.
+ * @param[out] c Decoder cache.
+ * @return RECONNECT_SUCCESS on success, RECONNECT_ERROR on allocation failure.
+ */
+int decoder_cache_init(DECODER_CACHE *c)
+{
+    memset(c, 0, sizeof(*c));
+    c->params = avcodec_parameters_alloc();
+    c->frame = av_frame_alloc();
+    if (!c->params || !c->frame)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to allocate decoder cache\n");
+        decoder_cache_free(c);
+        return RECONNECT_ERROR;
+    }
+    return RECONNECT_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Check whether the cached decoder can decode a stream with @p par.
+ * @param[in] c Decoder cache.
+ * @param[in] par Codec parameters of the (re)connected stream.
+ * @return 1 if the decoder can be reused, 0 otherwise.
+ */
+int decoder_cache_matches(const DECODER_CACHE *c, const AVCodecParameters *par)
+{
+    const AVCodecParameters *old = c->params;
+
+    if (!c->dec_ctx || par->codec_id != old->codec_id)
+    {
+        return 0;
+    }
+
+    // SPS/PPS (sprop-parameter-sets) carry resolution, profile and format, so identical
+    // extradata is the strongest check and is already known right after the DESCRIBE
+    if (par->extradata_size > 0 || old->extradata_size > 0)
+    {
+        return par->extradata_size == old->extradata_size && memcmp(par->extradata, old->extradata, par->extradata_size) == 0;
+    }
+
+    // No out-of-band headers: only trust fully probed geometry
+    return par->width > 0 && par->width == old->width && par->height == old->height && par->format == old->format;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Make the cached decoder ready for @p par.
+ * @param[in,out] c Decoder cache.
+ * @param[in] par Codec parameters of the (re)connected stream.
+ * @return RECONNECT_SUCCESS on success, RECONNECT_ERROR on failure.
+ */
+int decoder_cache_prepare(DECODER_CACHE *c, const AVCodecParameters *par)
+{
+    AVCodec *dec;
+    int      ret;
+
+    if (decoder_cache_matches(c, par))
+    {
+        // Drop references to the old connection's frames; the buffer pool survives
+        avcodec_flush_buffers(c->dec_ctx);
+        c->reused++;
+        return RECONNECT_SUCCESS;
+    }
+
+    avcodec_free_context(&c->dec_ctx);
+
+    dec = avcodec_find_decoder(par->codec_id);
+    if (!dec)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to find video decoder\n");
+        return RECONNECT_ERROR;
+    }
+
+    c->dec_ctx = avcodec_alloc_context3(dec);
+    if (!c->dec_ctx)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to allocate codec context\n");
+        return RECONNECT_ERROR;
+    }
+
+    ret = avcodec_parameters_to_context(c->dec_ctx, par);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to copy codec parameters to codec context: %s\n", av_err2str(ret));
+        avcodec_free_context(&c->dec_ctx);
+        return RECONNECT_ERROR;
+    }
+
+    ret = avcodec_open2(c->dec_ctx, dec, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open codec: %s\n", av_err2str(ret));
+        avcodec_free_context(&c->dec_ctx);
+        return RECONNECT_ERROR;
+    }
+
+    ret = avcodec_parameters_copy(c->params, par);
+    if (ret < 0)
+    {
+        avcodec_free_context(&c->dec_ctx);
+        return RECONNECT_ERROR;
+    }
+
+    c->rebuilt++;
+    return RECONNECT_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Release the decoder, parameters and frame.
+ * @param[in,out] c Decoder cache.
+ */
+void decoder_cache_free(DECODER_CACHE *c)
+{
+    avcodec_free_context(&c->dec_ctx);
+    avcodec_parameters_free(&c->params);
+    av_frame_free(&c->frame);
+}
+
+static int find_video_stream(const AVFormatContext *fmt_ctx)
+{
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++)
+    {
+        if (fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Open an input and locate its video stream.
+ * @param[out] fmt_ctx Opened format context.
+ * @param[in] url Stream URL.
+ * @param[in] cache Decoder cache (may be empty).
+ * @param[in] interrupt Interrupt callback, so a quit request aborts a blocking open.
+ * @param[out] video_stream_index Index of the first video stream.
+ * @return RECONNECT_SUCCESS on success, RECONNECT_ERROR on failure (fmt_ctx is closed).
+ */
+int reconnect_open_input(AVFormatContext **fmt_ctx, const char *url, const DECODER_CACHE *cache, const AVIOInterruptCB *interrupt,
+                         int *video_stream_index)
+{
+    AVDictionary *options = NULL;
+    int           ret;
+
+    *fmt_ctx = avformat_alloc_context();
+    if (!*fmt_ctx)
+    {
+        return RECONNECT_ERROR;
+    }
+    (*fmt_ctx)->interrupt_callback = *interrupt;
+
+    av_dict_set(&options, "stimeout", RECONNECT_SOCKET_TIMEOUT, 0);
+    ret = avformat_open_input(fmt_ctx, url, NULL, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open input stream: %s\n", av_err2str(ret));
+        return RECONNECT_ERROR;  // avformat_open_input frees the context on failure
+    }
+
+    // RTSP knows its streams from the SDP; if those parameters prove nothing changed,
+    // the multi-second probe that reads and decodes frames can be skipped
+    *video_stream_index = find_video_stream(*fmt_ctx);
+    if (*video_stream_index >= 0 && decoder_cache_matches(cache, (*fmt_ctx)->streams[*video_stream_index]->codecpar))
+    {
+        return RECONNECT_SUCCESS;
+    }
+
+    ret = avformat_find_stream_info(*fmt_ctx, NULL);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to retrieve stream information: %s\n", av_err2str(ret));
+        avformat_close_input(fmt_ctx);
+        return RECONNECT_ERROR;
+    }
+
+    *video_stream_index = find_video_stream(*fmt_ctx);
+    if (*video_stream_index < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Could not find video stream\n");
+        avformat_close_input(fmt_ctx);
+        return RECONNECT_ERROR;
+    }
+    return RECONNECT_SUCCESS;
+}
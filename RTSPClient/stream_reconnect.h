@@ -0,0 +1,126 @@
+/**
+ * @file    stream_reconnect.h
+ * @brief   Reconnect manager: exponential backoff and decoder reuse across reconnects.
+ *
+ * Only the demuxer (AVFormatContext) is torn down when a camera drops. The decoder
+ * context, its internal frame buffer pool and the output AVFrame are kept in a
+ * DECODER_CACHE; after reconnecting, if the camera still sends the same codec
+ * parameters the decoder is just flushed, and the stream-info probe is skipped
+ * when the SDP alone already proves the parameters are unchanged.
+ *
+ */
+
+#ifndef STREAM_RECONNECT_H
+#define STREAM_RECONNECT_H
+
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+
+/** Success return code */
+#define RECONNECT_SUCCESS 0
+/** Failure return code */
+#define RECONNECT_ERROR   1
+
+#define RECONNECT_INITIAL_MS 250
+#define RECONNECT_MAX_MS     30000
+
+typedef struct
+{
+    int      initial_ms;
+    int      max_ms;
+    int      current_ms;
+    unsigned attempts;  // Failed attempts since the last successful connect
+} RECONNECT_BACKOFF;
+
+typedef struct
+{
+    AVCodecContext    *dec_ctx;
+    AVCodecParameters *params;  // Parameters dec_ctx was opened with
+    AVFrame           *frame;   // Output frame, reused for every receive
+    unsigned long      reused;  // Reconnects that only flushed the decoder
+    unsigned long      rebuilt; // Decoder (re)opens, including the first one
+} DECODER_CACHE;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize a backoff sequence.
+     * @param[out] b Backoff state.
+     * @param[in] initial_ms First delay.
+     * @param[in] max_ms Upper bound for the delay.
+     */
+    void reconnect_backoff_init(RECONNECT_BACKOFF *b, int initial_ms, int max_ms);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Get the delay before the next attempt and grow the sequence.
+     *        +/-25% jitter keeps cameras that dropped together from retrying in lockstep.
+     * @param[in,out] b Backoff state.
+     * @return Delay in milliseconds.
+     */
+    int reconnect_backoff_next(RECONNECT_BACKOFF *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Restart the sequence after a successful connect.
+     * @param[in,out] b Backoff state.
+     */
+    void reconnect_backoff_reset(RECONNECT_BACKOFF *b);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Initialize an empty decoder cache and allocate its frame.
+     * @param[out] c Decoder cache.
+     * @return RECONNECT_SUCCESS on success, RECONNECT_ERROR on allocation failure.
+     */
+    int decoder_cache_init(DECODER_CACHE *c);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Check whether the cached decoder can decode a stream with @p par.
+     * @param[in] c Decoder cache.
+     * @param[in] par Codec parameters of the (re)connected stream.
+     * @return 1 if the decoder can be reused, 0 otherwise.
+     */
+    int decoder_cache_matches(const DECODER_CACHE *c, const AVCodecParameters *par);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Make the cached decoder ready for @p par: flush it when the parameters are
+     *        unchanged, otherwise free it and open a new one.
+     * @param[in,out] c Decoder cache.
+     * @param[in] par Codec parameters of the (re)connected stream.
+     * @return RECONNECT_SUCCESS on success, RECONNECT_ERROR on failure.
+     */
+    int decoder_cache_prepare(DECODER_CACHE *c, const AVCodecParameters *par);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Release the decoder, parameters and frame.
+     * @param[in,out] c Decoder cache.
+     */
+    void decoder_cache_free(DECODER_CACHE *c);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Open an input and locate its video stream. The stream-info probe is skipped
+     *        when the SDP parameters already match the cached decoder.
+     * @param[out] fmt_ctx Opened format context.
+     * @param[in] url Stream URL.
+     * @param[in] cache Decoder cache (may be empty).
+     * @param[in] interrupt Interrupt callback, so a quit request aborts a blocking open.
+     * @param[out] video_stream_index Index of the first video stream.
+     * @return RECONNECT_SUCCESS on success, RECONNECT_ERROR on failure (fmt_ctx is closed).
+     */
+    int reconnect_open_input(AVFormatContext **fmt_ctx, const char *url, const DECODER_CACHE *cache, const AVIOInterruptCB *interrupt,
+                             int *video_stream_index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // STREAM_RECONNECT_H
@@ -1,73 +1,57 @@
+/*
+ * PackBits decoder demo
+ *
+ * Decodes a small sample, or the packets given on the command line as hex. The output
+ * is sized exactly by a scan over the packet headers; a truncated stream is reported
+ * instead of decoded.
+ *
+ * Usage:
+ *   ./decode_packBits [hex bytes...]
+ *
+ * Example:
+ *   ./decode_packBits
+ *   ./decode_packBits FE AA 02 01 02 03 FF FF
+ *   ./decode_packBits FE AA 05 01 02     # truncated literal
+ *
+ */
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-// Function to decode PackBits
-void decodePackBits(uint8_t *encoded, size_t encoded_len, uint8_t **decoded, size_t *decoded_len)
-{
-    size_t decoded_size = 0;
-    size_t decoded_capacity = 1024;  // Initial capacity for the decoded buffer
-    *decoded = (uint8_t *)malloc(decoded_capacity);
+#include "packbits.h"
 
-    if (*decoded == NULL)
-    {
-        perror("Failed to allocate memory");
-        exit(1);
-    }
+int main(int argc, char *argv[])
+{
+    uint8_t  sample[] = {0xFE, 0xFF, 0xFE, 0xF0};
+    uint8_t *encoded = sample;
+    size_t   encoded_len = sizeof(sample);
+    size_t   decoded_len = 0;
 
-    size_t i = 0;
-    while (i < encoded_len)
+    if (argc > 1)
     {
-        uint8_t byte = encoded[i++];
-
-        if (byte >= 0x80)
-        {                                // Repeat next byte (0x80 to 0xFF)
-            int     count = 257 - byte;  // Number of times to repeat (257 - byte value)
-            uint8_t repeat_byte = encoded[i++];
-            for (int j = 0; j < count; j++)
-            {
-                (*decoded)[decoded_size++] = repeat_byte;
-            }
-        }
-        else
-        {                          // Literal bytes (0x00 to 0x7F)
-            int count = byte + 1;  // Number of literal bytes
-            for (int j = 0; j < count; j++)
-            {
-                (*decoded)[decoded_size++] = encoded[i++];
-            }
-        }
-
-        // Ensure the decoded array has enough capacity
-        if (decoded_size >= decoded_capacity)
+        encoded_len = (size_t)argc - 1;
+        encoded = malloc(encoded_len);
+        for (int i = 1; i < argc; i++)
         {
-            decoded_capacity *= 2;  // Double the capacity
-            *decoded = (uint8_t *)realloc(*decoded, decoded_capacity);
-            if (*decoded == NULL)
-            {
-                perror("Failed to realloc memory");
-                exit(1);
-            }
+            encoded[i - 1] = (uint8_t)strtoul(argv[i], NULL, 16);
         }
     }
 
-    *decoded_len = decoded_size;
-}
-
-int main()
-{
-    uint8_t encoded[] = {0xFE, 0xFF, 0xFE, 0xF0};
-    // uint8_t  encoded[] = {0xD0, 0xFF, 0x00, 0xF0};
-    size_t   encoded_len = sizeof(encoded) / sizeof(encoded[0]);
-    uint8_t *decoded = NULL;
-    size_t   decoded_len = 0;
-
-    // Decode PackBits
-    decodePackBits(encoded, encoded_len, &decoded, &decoded_len);
+    if (packbits_decoded_size(encoded, encoded_len, &decoded_len) != PACKBITS_SUCCESS)
+    {
+        printf("Truncated input\n");
+        return 1;
+    }
 
-    printf("Decoded len: %ld\n", decoded_len);
+    uint8_t *decoded = malloc(decoded_len + 1);
+    if (packbits_decode(encoded, encoded_len, decoded, decoded_len, &decoded_len) != PACKBITS_SUCCESS)
+    {
+        printf("Decode failed\n");
+        return 1;
+    }
 
-    // Print decoded output
+    printf("Decoded len: %zu\n", decoded_len);
     printf("Decoded: ");
     for (size_t i = 0; i < decoded_len; i++)
     {
@@ -75,8 +59,10 @@ int main()
     }
     printf("\n");
 
-    // Free the allocated memory
+    if (encoded != sample)
+    {
+        free(encoded);
+    }
     free(decoded);
-
     return 0;
 }
@@ -1,62 +1,69 @@
+/*
+ * PackBits encoder demo
+ *
+ * Encodes a small sample, or the bytes given on the command line as hex, with every
+ * encoder path the CPU supports and prints the packets. All paths must agree.
+ *
+ * Usage:
+ *   ./encode_packBits [hex bytes...]
+ *
+ * Example:
+ *   ./encode_packBits
+ *   ./encode_packBits AA AA AA 01 02 03 FF FF
+ *
+ */
+
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_RUN_LENGTH 128  // Maximum run length in PackBits (127 for positive)
+#include "packbits.h"
 
-int packbits_encode(const uint8_t *input, size_t input_len, uint8_t *output)
+int main(int argc, char *argv[])
 {
-    size_t i = 0, out_pos = 0;
+    uint8_t sample[] = {0xff, 0xff, 0xff, 0xf0, 0xf0, 0xf0};
+    uint8_t *input = sample;
+    size_t   input_len = sizeof(sample);
 
-    while (i < input_len)
+    if (argc > 1)
     {
-        // Start a run of repeated bytes if possible
-        size_t run_length = 1;
-        if (i + 1 < input_len && input[i] == input[i + 1])
-        {
-            // Find the length of the run
-            while (i + run_length < input_len && run_length < MAX_RUN_LENGTH && input[i] == input[i + run_length])
-            {
-                run_length++;
-            }
-            // Encode run as a negative length and the repeated byte
-            output[out_pos++] = (uint8_t)(-(int32_t)run_length + 1);
-            output[out_pos++] = input[i];
-            i += run_length;
-        }
-        else
+        input_len = (size_t)argc - 1;
+        input = malloc(input_len);
+        for (int i = 1; i < argc; i++)
         {
-            // Encode non-repeating bytes directly
-            size_t non_run_length = 0;
-            while (i + non_run_length < input_len && non_run_length < MAX_RUN_LENGTH &&
-                   (i + non_run_length + 1 >= input_len || input[i + non_run_length] != input[i + non_run_length + 1]))
-            {
-                non_run_length++;
-            }
-            output[out_pos++] = (uint8_t)(non_run_length - 1);
-            memcpy(&output[out_pos], &input[i], non_run_length);
-            out_pos += non_run_length;
-            i += non_run_length;
+            input[i - 1] = (uint8_t)strtoul(argv[i], NULL, 16);
         }
     }
-    return out_pos;
-}
 
-int main()
-{
-    uint8_t input[] = {0xff, 0xff, 0xff, 0xf0, 0xf0, 0xf0};
-    size_t  input_len = sizeof(input);
-    uint8_t output[256];  // Buffer to hold the compressed data
-
-    int output_len = packbits_encode(input, input_len, output);
+    uint8_t *output = malloc(packbits_encode_bound(input_len));
+    uint8_t *check = malloc(packbits_encode_bound(input_len));
+    size_t   output_len = packbits_encode(input, input_len, output);
+    int      failed = 0;
 
-    printf("Encoded data: ");
-    for (int i = 0; i < output_len; i++)
+    printf("Encoded data (%s): ", packbits_path_name(packbits_best_path()));
+    for (size_t i = 0; i < output_len; i++)
     {
         printf("%02X ", output[i]);
     }
     printf("\n");
 
-    return 0;
+    // Every supported path must produce the same bytes
+    for (int p = PACKBITS_SCALAR; p <= (int)packbits_best_path(); p++)
+    {
+        size_t len = packbits_encode_path((PACKBITS_PATH_E)p, input, input_len, check);
+        if (len != output_len || memcmp(check, output, len) != 0)
+        {
+            printf("%s path differs\n", packbits_path_name((PACKBITS_PATH_E)p));
+            failed = 1;
+        }
+    }
+
+    if (input != sample)
+    {
+        free(input);
+    }
+    free(output);
+    free(check);
+    return failed;
 }
@@ -0,0 +1,476 @@
+/*
+ * PackBits codec benchmark over representative corpora
+ *
+ * Generates (or loads with -f) each corpus and runs every codec path over it:
+ *   scalar, sse2, avx2 - packbits_encode_path(); the scalar row also times packbits_decode()
+ *   stream             - PACKBITS_ENC / PACKBITS_DEC, 64 KB chunks through a 64 KB ring
+ *   frame xN           - packbits_frame_encode() / _decode() in -b KB blocks on -t threads
+ *
+ * Corpora:
+ *   random  - uniform random bytes, the worst case
+ *   runs    - runs of 64 to 4096 equal bytes
+ *   text    - words, spaces and indented lines, like source or logs
+ *   fax     - 1-bit 1728-pixel rows of a scanned text page (white is 0)
+ *   motion  - 640x480 8-bit masks of a few moving blobs, with sensor noise
+ *
+ * Each path is timed -r times and the best run is kept. The report gives GB/s of raw
+ * data, cycles per raw byte (TSC cycles) and the encoded/raw ratio. Every result is
+ * checked: every encoder path and the stream encoder must produce the scalar
+ * encoder's bytes, and every decoder must reproduce the input.
+ *
+ * Usage:
+ *   ./packBench [-c random,runs,text,fax,motion] [-f file]... [-s size_mb] [-r reps] [-t threads] [-b block_kb]
+ *
+ * Example:
+ *   ./packBench
+ *   ./packBench -c fax,motion -s 256 -t 8
+ *   ./packBench -c "" -f scan.raw -f depth.raw
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "packbits_frame.h"
+
+#define MAX_FILES   8
+#define STREAM_SIZE (64 << 10)
+
+typedef struct
+{
+    double   seconds;
+    uint64_t cycles;
+} TIMING;
+
+typedef struct
+{
+    const char *name;
+    void (*make)(uint8_t *buf, size_t len);
+} CORPUS;
+
+static uint64_t rng = 88172645463325252ull;
+
+static uint32_t next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Best of reps runs of code
+#define MEASURE(best, reps, code)                                          \
+    do                                                                     \
+    {                                                                      \
+        (best).seconds = 1e30;                                             \
+        for (int rep_ = 0; rep_ < (reps); rep_++)                          \
+        {                                                                  \
+            uint64_t c0_ = cycles();                                       \
+            double   t0_ = now_s();                                        \
+            code;                                                          \
+            double   dt_ = now_s() - t0_;                                  \
+            uint64_t dc_ = cycles() - c0_;                                 \
+            if (dt_ < (best).seconds)                                      \
+            {                                                              \
+                (best).seconds = dt_;                                      \
+                (best).cycles = dc_;                                       \
+            }                                                              \
+        }                                                                  \
+    } while (0)
+
+//-------------------------------------------------------------------------------------------------
+// Corpora
+//-------------------------------------------------------------------------------------------------
+
+static void make_random(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        buf[i] = (uint8_t)next_rand();
+    }
+}
+
+static void make_runs(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len;)
+    {
+        size_t run = 64 + next_rand() % 4033;
+        run = run < len - i ? run : len - i;
+        memset(buf + i, (int)(next_rand() & 0xFF), run);
+        i += run;
+    }
+}
+
+static void make_text(uint8_t *buf, size_t len)
+{
+    static const char *words[] = {"the", "packet", "of", "run", "frame", "camera", "stream", "to", "and", "error", "buffer", "connected",
+                                  "0x00", "return", "size", "if", "=", "{", "}", "timestamp", "2024-03-10", "INFO", "a", "in"};
+    size_t              i = 0, col = 0;
+
+    while (i < len)
+    {
+        const char *w = words[next_rand() % (sizeof(words) / sizeof(words[0]))];
+        size_t      n = strlen(w);
+
+        if (col == 0)
+        {
+            // Indentation: a run of 0 to 12 spaces
+            for (size_t s = (next_rand() % 4) * 4; s > 0 && i < len; s--, col++)
+            {
+                buf[i++] = ' ';
+            }
+        }
+        for (size_t k = 0; k < n && i < len; k++, col++)
+        {
+            buf[i++] = (uint8_t)w[k];
+        }
+        if (i < len)
+        {
+            buf[i++] = col > 60 + next_rand() % 20 ? '\n' : ' ';
+            col = buf[i - 1] == '\n' ? 0 : col + 1;
+        }
+    }
+}
+
+// Set pixels [from, to) of a 1-bit row, most significant bit first
+static void set_bits(uint8_t *row, size_t from, size_t to)
+{
+    for (size_t p = from; p < to; p++)
+    {
+        row[p >> 3] |= (uint8_t)(0x80 >> (p & 7));
+    }
+}
+
+static void make_fax(uint8_t *buf, size_t len)
+{
+    const size_t width = 1728, stride = width / 8;
+    size_t       y = 0;
+
+    memset(buf, 0, len);
+    for (size_t off = 0; off + stride <= len; off += stride, y++)
+    {
+        // 28-pixel text lines every 40 rows, inside 100-pixel margins
+        if (y % 40 >= 28 || y % 2000 < 120)
+        {
+            continue;
+        }
+        for (size_t x = 100 + next_rand() % 40; x < width - 100;)
+        {
+            size_t black = 1 + next_rand() % 6;
+            set_bits(buf + off, x, x + black < width - 100 ? x + black : width - 100);
+            x += black + 2 + next_rand() % (next_rand() % 8 == 0 ? 120 : 24);
+        }
+    }
+}
+
+static void make_motion(uint8_t *buf, size_t len)
+{
+    const size_t width = 640, height = 480, frame = width * height;
+    int          bx[3] = {100, 300, 500}, by[3] = {100, 240, 380}, dx[3] = {3, -2, 4}, dy[3] = {2, 3, -2}, r[3] = {40, 60, 25};
+
+    memset(buf, 0, len);
+    for (size_t off = 0; off < len; off += frame)
+    {
+        for (int b = 0; b < 3; b++)
+        {
+            bx[b] += dx[b];
+            by[b] += dy[b];
+            dx[b] = bx[b] < r[b] || bx[b] > (int)width - r[b] ? -dx[b] : dx[b];
+            dy[b] = by[b] < r[b] || by[b] > (int)height - r[b] ? -dy[b] : dy[b];
+            for (int y = by[b] - r[b]; y < by[b] + r[b]; y++)
+            {
+                for (int x = bx[b] - r[b]; x < bx[b] + r[b]; x++)
+                {
+                    if (y < 0 || y >= (int)height || x < 0 || x >= (int)width || (x - bx[b]) * (x - bx[b]) + (y - by[b]) * (y - by[b]) >= r[b] * r[b])
+                    {
+                        continue;
+                    }
+                    size_t p = off + (size_t)y * width + (size_t)x;
+                    if (p < len)
+                    {
+                        buf[p] = 0xFF;
+                    }
+                }
+            }
+        }
+        // Sensor noise: about one speck per 2000 pixels
+        for (size_t n = 0; n < frame / 2000; n++)
+        {
+            size_t p = off + next_rand() % frame;
+            if (p < len)
+            {
+                buf[p] = 0xFF;
+            }
+        }
+    }
+}
+
+static const CORPUS corpora[] = {
+    {"random", make_random}, {"runs", make_runs}, {"text", make_text}, {"fax", make_fax}, {"motion", make_motion},
+};
+
+static uint8_t *load(const char *path, size_t *len)
+{
+    FILE    *fp = fopen(path, "rb");
+    uint8_t *buf = NULL;
+    long     size;
+
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        perror(path);
+        return NULL;
+    }
+    buf = malloc(size > 0 ? (size_t)size : 1);
+    if (fread(buf, 1, (size_t)size, fp) != (size_t)size)
+    {
+        perror(path);
+        free(buf);
+        buf = NULL;
+    }
+    *len = (size_t)size;
+    fclose(fp);
+    return buf;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Streams
+//-------------------------------------------------------------------------------------------------
+
+// Drain the ring into dst at *len
+static void drain(PACKBITS_RING *ring, uint8_t *dst, size_t *len)
+{
+    const uint8_t *data;
+    size_t         n;
+
+    while ((n = packbits_ring_peek(ring, &data)) > 0)
+    {
+        memcpy(dst + *len, data, n);
+        packbits_ring_consume(ring, n);
+        *len += n;
+    }
+}
+
+static size_t stream_encode(const uint8_t *input, size_t len, uint8_t *output)
+{
+    static uint8_t buf[STREAM_SIZE];
+    PACKBITS_RING  ring;
+    PACKBITS_ENC   enc;
+    size_t         out = 0, used;
+
+    packbits_ring_init(&ring, buf, sizeof(buf));
+    packbits_enc_init(&enc, &ring, packbits_best_path());
+    for (size_t off = 0; off < len;)
+    {
+        size_t chunk = len - off < STREAM_SIZE ? len - off : STREAM_SIZE;
+        int    ret = packbits_enc_write(&enc, input + off, chunk, &used);
+        off += used;
+        if (ret == PACKBITS_AGAIN)
+        {
+            drain(&ring, output, &out);
+        }
+    }
+    while (packbits_enc_finish(&enc) == PACKBITS_AGAIN)
+    {
+        drain(&ring, output, &out);
+    }
+    drain(&ring, output, &out);
+    return out;
+}
+
+static size_t stream_decode(const uint8_t *input, size_t len, uint8_t *output, int *status)
+{
+    static uint8_t buf[STREAM_SIZE];
+    PACKBITS_RING  ring;
+    PACKBITS_DEC   dec;
+    size_t         out = 0, used;
+
+    packbits_ring_init(&ring, buf, sizeof(buf));
+    packbits_dec_init(&dec, &ring);
+    for (size_t off = 0; off < len;)
+    {
+        size_t chunk = len - off < STREAM_SIZE ? len - off : STREAM_SIZE;
+        int    ret = packbits_dec_write(&dec, input + off, chunk, &used);
+        off += used;
+        if (ret == PACKBITS_AGAIN)
+        {
+            drain(&ring, output, &out);
+        }
+    }
+    while ((*status = packbits_dec_finish(&dec)) == PACKBITS_AGAIN)
+    {
+        drain(&ring, output, &out);
+    }
+    drain(&ring, output, &out);
+    return out;
+}
+
+//-------------------------------------------------------------------------------------------------
+
+static void report(const char *corpus, const char *path, size_t raw, size_t encoded, const TIMING *enc, const TIMING *dec, int ok)
+{
+    char dec_rate[16] = "-", dec_cpb[16] = "-";
+
+    if (dec != NULL)
+    {
+        snprintf(dec_rate, sizeof(dec_rate), "%.2f", raw / dec->seconds / 1e9);
+        snprintf(dec_cpb, sizeof(dec_cpb), "%.2f", (double)dec->cycles / raw);
+    }
+    printf("%-10s %-10s %7.3f %10.2f %8.2f %10s %8s   %s\n", corpus, path, (double)encoded / raw, raw / enc->seconds / 1e9, (double)enc->cycles / raw,
+           dec_rate, dec_cpb, ok ? "ok" : "FAILED");
+}
+
+// Every path over one corpus; returns nonzero if a check failed
+static int bench(const char *name, const uint8_t *input, size_t len, int reps, int threads, size_t block_size)
+{
+    size_t         bound = packbits_frame_bound(len, block_size);
+    uint8_t       *ref = malloc(bound), *enc = malloc(bound), *dec = malloc(len + 1);
+    size_t         ref_len = 0, enc_len = 0, dec_len = 0;
+    TIMING         te, td;
+    PACKBITS_FRAME frame;
+    char           label[32];
+    int            failed = 0, ok, status = PACKBITS_SUCCESS;
+
+    // Fault the buffers in before timing
+    memset(ref, 0, bound);
+    memset(enc, 0, bound);
+    memset(dec, 0, len + 1);
+
+    for (int p = PACKBITS_SCALAR; p <= (int)packbits_best_path(); p++)
+    {
+        uint8_t *out = p == PACKBITS_SCALAR ? ref : enc;
+        size_t   out_len = 0;
+
+        MEASURE(te, reps, out_len = packbits_encode_path((PACKBITS_PATH_E)p, input, len, out));
+        if (p == PACKBITS_SCALAR)
+        {
+            ref_len = out_len;
+            MEASURE(td, reps, status = packbits_decode(ref, ref_len, dec, len, &dec_len));
+            ok = status == PACKBITS_SUCCESS && dec_len == len && memcmp(dec, input, len) == 0;
+        }
+        else
+        {
+            ok = out_len == ref_len && memcmp(out, ref, ref_len) == 0;
+        }
+        report(name, packbits_path_name((PACKBITS_PATH_E)p), len, out_len, &te, p == PACKBITS_SCALAR ? &td : NULL, ok);
+        failed |= !ok;
+    }
+
+    MEASURE(te, reps, enc_len = stream_encode(input, len, enc));
+    ok = enc_len == ref_len && memcmp(enc, ref, ref_len) == 0;
+    memset(dec, 0, len);
+    MEASURE(td, reps, dec_len = stream_decode(ref, ref_len, dec, &status));
+    ok &= status == PACKBITS_SUCCESS && dec_len == len && memcmp(dec, input, len) == 0;
+    report(name, "stream", len, enc_len, &te, &td, ok);
+    failed |= !ok;
+
+    MEASURE(te, reps, packbits_frame_encode(input, len, block_size, threads, enc, bound, &enc_len));
+    memset(dec, 0, len);
+    ok = packbits_frame_open(&frame, enc, enc_len) == PACKBITS_SUCCESS;
+    MEASURE(td, reps, status = ok ? packbits_frame_decode(&frame, threads, dec, len) : PACKBITS_ERROR);
+    ok &= status == PACKBITS_SUCCESS && memcmp(dec, input, len) == 0;
+    snprintf(label, sizeof(label), "frame x%d", threads);
+    report(name, label, len, enc_len, &te, &td, ok);
+    failed |= !ok;
+
+    free(ref);
+    free(enc);
+    free(dec);
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *list = "random,runs,text,fax,motion", *files[MAX_FILES];
+    size_t      size_mb = 32, block_kb = 64;
+    int         reps = 5, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), nfiles = 0, opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "c:f:s:r:t:b:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': list = optarg; break;
+            case 'f':
+                if (nfiles < MAX_FILES)
+                {
+                    files[nfiles++] = optarg;
+                }
+                break;
+            case 's': size_mb = strtoull(optarg, NULL, 10); break;
+            case 'r': reps = atoi(optarg); break;
+            case 't': threads = atoi(optarg); break;
+            case 'b': block_kb = strtoull(optarg, NULL, 10); break;
+            default:
+                fprintf(stderr, "Usage: %s [-c random,runs,text,fax,motion] [-f file]... [-s size_mb] [-r reps] [-t threads] [-b block_kb]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (size_mb == 0 || reps < 1 || threads < 1 || threads > PACKBITS_FRAME_MAX_THREADS || block_kb == 0)
+    {
+        fprintf(stderr, "Size, reps and block of at least 1, 1 to %d threads\n", PACKBITS_FRAME_MAX_THREADS);
+        return 1;
+    }
+
+    printf("best path %s, %d thread(s), %zu KB frame blocks, best of %d\n\n", packbits_path_name(packbits_best_path()), threads, block_kb, reps);
+    printf("%-10s %-10s %7s %10s %8s %10s %8s   %s\n", "corpus", "path", "ratio", "enc GB/s", "enc c/B", "dec GB/s", "dec c/B", "check");
+
+    size_t len = size_mb << 20;
+    for (size_t c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++)
+    {
+        // Whole names from the comma-separated list
+        char padded[256];
+        char key[32];
+        snprintf(padded, sizeof(padded), ",%s,", list);
+        snprintf(key, sizeof(key), ",%s,", corpora[c].name);
+        if (strstr(padded, key) == NULL)
+        {
+            continue;
+        }
+
+        uint8_t *input = malloc(len);
+        corpora[c].make(input, len);
+        failed |= bench(corpora[c].name, input, len, reps, threads, block_kb << 10);
+        free(input);
+    }
+    for (int f = 0; f < nfiles; f++)
+    {
+        size_t   file_len;
+        uint8_t *input = load(files[f], &file_len);
+        if (input == NULL || file_len == 0)
+        {
+            failed = 1;
+            free(input);
+            continue;
+        }
+        const char *base = strrchr(files[f], '/');
+        failed |= bench(base != NULL ? base + 1 : files[f], input, file_len, reps, threads, block_kb << 10);
+        free(input);
+    }
+
+    printf("\n%s\n", failed ? "FAILED" : "all round trips ok");
+    return failed;
+}
@@ -0,0 +1,131 @@
+/*
+ * PackBits stream filter
+ *
+ * Encodes stdin to stdout, or decodes it with -d, in constant memory. Input is read in
+ * chunks of -c bytes, and the stream object writes into a ring of -r bytes, which is
+ * written to stdout whenever it fills. Works on pipes and files of any size. The
+ * encoded output is the same as encoding the whole input at once. Byte counts and
+ * throughput go to stderr.
+ *
+ * Usage:
+ *   ./packStream [-d] [-c chunk] [-r ring] [-p scalar|sse2|avx2] < input > output
+ *
+ * Example:
+ *   ./packStream < mask.raw > mask.pb
+ *   ./packStream -d < mask.pb | cmp - mask.raw
+ *   cat big.tif | ./packStream -c 1000 -r 4096 | ./packStream -d | cmp - big.tif
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "packbits.h"
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Write out everything in the ring
+static int drain(PACKBITS_RING *ring, unsigned long long *total)
+{
+    const uint8_t *data;
+    size_t         n;
+
+    while ((n = packbits_ring_peek(ring, &data)) > 0)
+    {
+        if (fwrite(data, 1, n, stdout) != n)
+        {
+            return -1;
+        }
+        packbits_ring_consume(ring, n);
+        *total += n;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    PACKBITS_PATH_E    path = packbits_best_path();
+    size_t             chunk_size = 64 << 10, ring_size = 64 << 10;
+    int                decode = 0, opt, ret = PACKBITS_SUCCESS;
+    unsigned long long in_total = 0, out_total = 0;
+
+    while ((opt = getopt(argc, argv, "dc:r:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'd': decode = 1; break;
+            case 'c': chunk_size = strtoull(optarg, NULL, 10); break;
+            case 'r': ring_size = strtoull(optarg, NULL, 10); break;
+            case 'p':
+                for (path = PACKBITS_SCALAR; path < PACKBITS_PATHS && strcmp(optarg, packbits_path_name(path)) != 0; path++)
+                {
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-d] [-c chunk] [-r ring] [-p scalar|sse2|avx2] < input > output\n", argv[0]);
+                return 1;
+        }
+    }
+    if (chunk_size == 0 || ring_size <= PACKBITS_MAX_PACKET || path >= PACKBITS_PATHS)
+    {
+        fprintf(stderr, "Chunk of at least 1 byte, ring of more than %d bytes, path scalar, sse2 or avx2\n", PACKBITS_MAX_PACKET);
+        return 1;
+    }
+
+    uint8_t      *chunk = malloc(chunk_size);
+    uint8_t      *buf = malloc(ring_size);
+    PACKBITS_RING ring;
+    PACKBITS_ENC  enc;
+    PACKBITS_DEC  dec;
+    size_t        got;
+    double        start = now_s();
+
+    packbits_ring_init(&ring, buf, ring_size);
+    packbits_enc_init(&enc, &ring, path);
+    packbits_dec_init(&dec, &ring);
+
+    while ((got = fread(chunk, 1, chunk_size, stdin)) > 0)
+    {
+        size_t off = 0, used;
+
+        in_total += got;
+        do
+        {
+            ret = decode ? packbits_dec_write(&dec, chunk + off, got - off, &used) : packbits_enc_write(&enc, chunk + off, got - off, &used);
+            off += used;
+            if (ret == PACKBITS_AGAIN && drain(&ring, &out_total) != 0)
+            {
+                perror("Write failed");
+                return 1;
+            }
+        } while (ret == PACKBITS_AGAIN);
+    }
+
+    // Held-back input, or a run still owed to the ring
+    while ((ret = decode ? packbits_dec_finish(&dec) : packbits_enc_finish(&enc)) == PACKBITS_AGAIN)
+    {
+        drain(&ring, &out_total);
+    }
+    if (drain(&ring, &out_total) != 0 || fflush(stdout) != 0)
+    {
+        perror("Write failed");
+        return 1;
+    }
+    double seconds = now_s() - start;
+
+    fprintf(stderr, "%s%s%s: %llu bytes in, %llu bytes out, %.1f MB/s, chunk %zu, ring %zu%s\n", decode ? "decoded" : "encoded (",
+            decode ? "" : packbits_path_name(path), decode ? "" : ")", in_total, out_total, (decode ? out_total : in_total) / seconds / 1e6, chunk_size, ring_size,
+            ret == PACKBITS_ERROR ? ", input truncated" : "");
+
+    free(chunk);
+    free(buf);
+    return ret == PACKBITS_ERROR;
+}
@@ -0,0 +1,247 @@
+/*
+ * Element-width PackBits: 8/16/32-bit elements and the per-tile auto selector
+ *
+ * Generates 16-bit depth maps, 32-bit label masks and 8-bit motion masks (or loads
+ * a file with -f), then encodes each one:
+ *   - as bytes, with packbits_encode();
+ *   - as 16-bit elements, with packbits_encode16();
+ *   - as 32-bit elements, with packbits_encode32();
+ *   - with packbits_encode_auto() in -T KB tiles.
+ * It prints the ratio and speed of each, and how many tiles the auto mode gave each
+ * width. The "mixed" corpus joins the three, so the auto mode has to switch widths
+ * from tile to tile. Every encoding is decoded and compared with the input.
+ *
+ * Usage:
+ *   ./packWide [-s size_mb] [-T tile_kb] [-f file]
+ *
+ * Example:
+ *   ./packWide
+ *   ./packWide -f depth.raw -T 64
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "packbits_wide.h"
+
+#define WIDTH  640
+#define HEIGHT 480
+
+static uint64_t rng = 88172645463325252ull;
+
+static uint32_t next_rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Depth in mm: a back wall, boxes at their own depth, and holes where the sensor saw nothing
+static void make_depth(uint8_t *buf, size_t len)
+{
+    uint16_t *d = (uint16_t *)buf;
+    size_t    n = len / 2;
+
+    for (size_t f = 0; f * WIDTH * HEIGHT < n; f++)
+    {
+        uint16_t *px = d + f * WIDTH * HEIGHT;
+        size_t    count = n - f * WIDTH * HEIGHT < WIDTH * HEIGHT ? n - f * WIDTH * HEIGHT : WIDTH * HEIGHT;
+
+        for (size_t p = 0; p < count; p++)
+        {
+            px[p] = 4200;
+        }
+        for (int b = 0; b < 6; b++)
+        {
+            size_t   x0 = next_rand() % (WIDTH - 120), y0 = next_rand() % (HEIGHT - 120), w = 40 + next_rand() % 80, h = 40 + next_rand() % 80;
+            uint16_t z = (uint16_t)(800 + next_rand() % 3000);
+            for (size_t y = y0; y < y0 + h; y++)
+            {
+                for (size_t x = x0; x < x0 + w && y * WIDTH + x < count; x++)
+                {
+                    px[y * WIDTH + x] = z;
+                }
+            }
+        }
+        for (size_t h = 0; h < 200; h++)
+        {
+            size_t p = next_rand() % count, run = 1 + next_rand() % 12;
+            for (size_t k = 0; k < run && p + k < count; k++)
+            {
+                px[p + k] = 0;
+            }
+        }
+    }
+}
+
+// Instance labels: rectangles of large ids on a background of 0
+static void make_labels(uint8_t *buf, size_t len)
+{
+    uint32_t *l = (uint32_t *)buf;
+    size_t    n = len / 4;
+
+    memset(buf, 0, len);
+    for (size_t f = 0; f * WIDTH * HEIGHT < n; f++)
+    {
+        uint32_t *px = l + f * WIDTH * HEIGHT;
+        size_t    count = n - f * WIDTH * HEIGHT < WIDTH * HEIGHT ? n - f * WIDTH * HEIGHT : WIDTH * HEIGHT;
+
+        for (int r = 0; r < 12; r++)
+        {
+            size_t   x0 = next_rand() % (WIDTH - 100), y0 = next_rand() % (HEIGHT - 100), w = 20 + next_rand() % 80, h = 20 + next_rand() % 80;
+            uint32_t id = 0x10000 + next_rand() % 0xFFFFFF;
+            for (size_t y = y0; y < y0 + h; y++)
+            {
+                for (size_t x = x0; x < x0 + w && y * WIDTH + x < count; x++)
+                {
+                    px[y * WIDTH + x] = id;
+                }
+            }
+        }
+    }
+}
+
+// Motion mask: 0 or 255 per pixel
+static void make_mask(uint8_t *buf, size_t len)
+{
+    memset(buf, 0, len);
+    for (size_t i = 0; i < len;)
+    {
+        size_t gap = 20 + next_rand() % 600, run = 5 + next_rand() % 120;
+        i += gap;
+        for (size_t k = 0; k < run && i < len; k++)
+        {
+            buf[i++] = 0xFF;
+        }
+    }
+}
+
+// One width over a corpus; returns nonzero if the round trip failed
+static int run_width(const uint8_t *input, size_t len, int width, uint8_t *enc, uint8_t *dec)
+{
+    size_t count = len / (size_t)width, enc_len = 0, dec_count = 0;
+    int    status;
+    double t0 = now_s();
+
+    enc_len = width == 1 ? packbits_encode(input, len, enc)
+              : width == 2 ? packbits_encode16((const uint16_t *)input, count, enc)
+                           : packbits_encode32((const uint32_t *)input, count, enc);
+    double t1 = now_s();
+    status = width == 1 ? packbits_decode(enc, enc_len, dec, len, &dec_count)
+             : width == 2 ? packbits_decode16(enc, enc_len, (uint16_t *)dec, count, &dec_count)
+                          : packbits_decode32(enc, enc_len, (uint32_t *)dec, count, &dec_count);
+    double t2 = now_s();
+    int    ok = status == PACKBITS_SUCCESS && dec_count == count && memcmp(dec, input, count * (size_t)width) == 0;
+
+    printf("  %-7d %7.3f %9.2f %9.2f   %s\n", width * 8, (double)enc_len / len, len / (t1 - t0) / 1e9, len / (t2 - t1) / 1e9, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+static int run_corpus(const char *name, const uint8_t *input, size_t len, size_t tile)
+{
+    uint8_t *enc = malloc(packbits_auto_bound(len, tile));
+    uint8_t *dec = malloc(len + 1);
+    size_t   enc_len, dec_len, widths[5];
+    int      failed = 0;
+
+    memset(enc, 0, packbits_auto_bound(len, tile));
+    memset(dec, 0, len + 1);
+    printf("%s, %zu bytes\n  %-7s %7s %9s %9s   %s\n", name, len, "bits", "ratio", "enc GB/s", "dec GB/s", "check");
+    for (int width = 1; width <= 4; width *= 2)
+    {
+        failed |= run_width(input, len, width, enc, dec);
+    }
+
+    double t0 = now_s();
+    packbits_encode_auto(input, len, tile, enc, &enc_len, widths);
+    double t1 = now_s();
+    int    ok = packbits_decode_auto(enc, enc_len, dec, len, &dec_len) == PACKBITS_SUCCESS && dec_len == len && memcmp(dec, input, len) == 0;
+    double t2 = now_s();
+
+    printf("  %-7s %7.3f %9.2f %9.2f   %s   tiles 8/16/32-bit: %zu/%zu/%zu\n\n", "auto", (double)enc_len / len, len / (t1 - t0) / 1e9, len / (t2 - t1) / 1e9,
+           ok ? "ok" : "FAILED", widths[1], widths[2], widths[4]);
+    free(enc);
+    free(dec);
+    return failed || !ok;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *file = NULL;
+    size_t      size_mb = 16, tile_kb = 16;
+    int         opt, failed = 0;
+
+    while ((opt = getopt(argc, argv, "s:T:f:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's': size_mb = strtoull(optarg, NULL, 10); break;
+            case 'T': tile_kb = strtoull(optarg, NULL, 10); break;
+            case 'f': file = optarg; break;
+            default: fprintf(stderr, "Usage: %s [-s size_mb] [-T tile_kb] [-f file]\n", argv[0]); return 1;
+        }
+    }
+    if (size_mb == 0 || tile_kb == 0 || (tile_kb << 10) > PACKBITS_MAX_TILE)
+    {
+        fprintf(stderr, "Size of at least 1 MB, tiles of 1 KB to %u KB\n", PACKBITS_MAX_TILE >> 10);
+        return 1;
+    }
+
+    size_t tile = tile_kb << 10;
+    if (file != NULL)
+    {
+        FILE    *fp = fopen(file, "rb");
+        long     size;
+        uint8_t *input;
+
+        if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) != 0)
+        {
+            perror(file);
+            return 1;
+        }
+        input = malloc((size_t)size);
+        if (fread(input, 1, (size_t)size, fp) != (size_t)size)
+        {
+            perror(file);
+            return 1;
+        }
+        fclose(fp);
+        failed |= run_corpus(file, input, (size_t)size, tile);
+        free(input);
+        return failed;
+    }
+
+    size_t   len = size_mb << 20;
+    uint8_t *depth = malloc(len), *labels = malloc(len), *mask = malloc(len), *mixed = malloc(3 * len);
+
+    make_depth(depth, len);
+    make_labels(labels, len);
+    make_mask(mask, len);
+    memcpy(mixed, depth, len);
+    memcpy(mixed + len, labels, len);
+    memcpy(mixed + 2 * len, mask, len);
+
+    failed |= run_corpus("depth (16-bit)", depth, len, tile);
+    failed |= run_corpus("labels (32-bit)", labels, len, tile);
+    failed |= run_corpus("mask (8-bit)", mask, len, tile);
+    failed |= run_corpus("mixed", mixed, 3 * len, tile);
+    printf("%s\n", failed ? "FAILED" : "all round trips ok");
+
+    free(depth);
+    free(labels);
+    free(mask);
+    free(mixed);
+    return failed;
+}
@@ -0,0 +1,685 @@
+/**
+ * @file    packbits.c
+ * @brief   PackBits run-length codec with SIMD run detection.
+ *
+ */
+
+#include "packbits.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKBITS_X86 1
+#define TARGET(isa)  __attribute__((target(isa)))
+#endif
+
+// Length of the run or literal span starting at i; end = min(input_len, i + 128)
+typedef size_t (*SCAN_FN)(const uint8_t *in, size_t i, size_t end, size_t n);
+
+//-------------------------------------------------------------------------------------------------
+// Scanners
+//-------------------------------------------------------------------------------------------------
+
+// Bytes equal to in[i] from i on
+static inline size_t run_scalar(const uint8_t *in, size_t i, size_t end, size_t n)
+{
+    size_t k = i + 1;
+
+    (void)n;
+    while (k < end && in[k] == in[i])
+    {
+        k++;
+    }
+    return k - i;
+}
+
+// Bytes up to the first pair of equal neighbours, which starts the next run
+static inline size_t literal_scalar(const uint8_t *in, size_t i, size_t end, size_t n)
+{
+    size_t j = i;
+
+    while (j < end && (j + 1 >= n || in[j] != in[j + 1]))
+    {
+        j++;
+    }
+    return j - i;
+}
+
+#ifdef PACKBITS_X86
+TARGET("sse2") static inline size_t run_sse2(const uint8_t *in, size_t i, size_t end, size_t n)
+{
+    __m128i b = _mm_set1_epi8((char)in[i]);
+    size_t  k = i + 1;
+
+    for (; k + 16 <= n && k < end; k += 16)
+    {
+        unsigned differ = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(in + k)), b)) & 0xFFFF;
+        if (differ != 0)
+        {
+            k += __builtin_ctz(differ);
+            return (k < end ? k : end) - i;
+        }
+    }
+    return k >= end ? end - i : run_scalar(in, k - 1, end, n) + (k - 1 - i);
+}
+
+TARGET("sse2") static inline size_t literal_sse2(const uint8_t *in, size_t i, size_t end, size_t n)
+{
+    size_t j = i;
+
+    // in[j..j+15] against in[j+1..j+16]: bit x set where in[j+x] starts a pair
+    for (; j + 16 < n && j < end; j += 16)
+    {
+        __m128i  a = _mm_loadu_si128((const __m128i *)(in + j));
+        __m128i  s = _mm_loadu_si128((const __m128i *)(in + j + 1));
+        unsigned pair = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, s));
+        if (pair != 0)
+        {
+            j += __builtin_ctz(pair);
+            return (j < end ? j : end) - i;
+        }
+    }
+    return j >= end ? end - i : literal_scalar(in, j, end, n) + (j - i);
+}
+
+TARGET("avx2") static inline size_t run_avx2(const uint8_t *in, size_t i, size_t end, size_t n)
+{
+    __m256i b = _mm256_set1_epi8((char)in[i]);
+    size_t  k = i + 1;
+
+    for (; k + 32 <= n && k < end; k += 32)
+    {
+        uint32_t differ = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(in + k)), b));
+        if (differ != 0)
+        {
+            k += __builtin_ctz(differ);
+            return (k < end ? k : end) - i;
+        }
+    }
+    return k >= end ? end - i : run_scalar(in, k - 1, end, n) + (k - 1 - i);
+}
+
+TARGET("avx2") static inline size_t literal_avx2(const uint8_t *in, size_t i, size_t end, size_t n)
+{
+    size_t j = i;
+
+    for (; j + 32 < n && j < end; j += 32)
+    {
+        __m256i  a = _mm256_loadu_si256((const __m256i *)(in + j));
+        __m256i  s = _mm256_loadu_si256((const __m256i *)(in + j + 1));
+        uint32_t pair = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, s));
+        if (pair != 0)
+        {
+            j += __builtin_ctz(pair);
+            return (j < end ? j : end) - i;
+        }
+    }
+    return j >= end ? end - i : literal_scalar(in, j, end, n) + (j - i);
+}
+#endif
+
+//-------------------------------------------------------------------------------------------------
+// Encoders
+//-------------------------------------------------------------------------------------------------
+
+// Packets from *pos on, while a worst-case packet still fits in the output. Unless
+// final, it stops short of the last 128 input bytes, whose packets may depend on input
+// not seen yet; every packet depends only on the bytes from its own start, so the
+// caller can resume there. Shared by every path and inlined into each, scanners too.
+static inline __attribute__((always_inline)) size_t encode_with(const uint8_t *input, size_t *pos, size_t input_len, int final, uint8_t *output,
+                                                                size_t output_cap, SCAN_FN run, SCAN_FN literal)
+{
+    size_t i = *pos, out_pos = 0;
+
+    while (i < input_len && (final || input_len - i > PACKBITS_MAX_PACKET) && output_cap - out_pos > PACKBITS_MAX_PACKET)
+    {
+        size_t end = input_len - i > PACKBITS_MAX_PACKET ? i + PACKBITS_MAX_PACKET : input_len;
+        size_t len;
+
+        if (i + 1 < input_len && input[i] == input[i + 1])
+        {
+            // Run of 2..128: header 257 - len, then the byte
+            len = run(input, i, end, input_len);
+            output[out_pos++] = (uint8_t)(257 - len);
+            output[out_pos++] = input[i];
+        }
+        else
+        {
+            len = literal(input, i, end, input_len);
+            output[out_pos++] = (uint8_t)(len - 1);
+            memcpy(output + out_pos, input + i, len);
+            out_pos += len;
+        }
+        i += len;
+    }
+    *pos = i;
+    return out_pos;
+}
+
+typedef size_t (*ENCODE_FN)(const uint8_t *input, size_t *pos, size_t input_len, int final, uint8_t *output, size_t output_cap);
+
+static size_t encode_scalar(const uint8_t *input, size_t *pos, size_t input_len, int final, uint8_t *output, size_t output_cap)
+{
+    return encode_with(input, pos, input_len, final, output, output_cap, run_scalar, literal_scalar);
+}
+
+#ifdef PACKBITS_X86
+TARGET("sse2") static size_t encode_sse2(const uint8_t *input, size_t *pos, size_t input_len, int final, uint8_t *output, size_t output_cap)
+{
+    return encode_with(input, pos, input_len, final, output, output_cap, run_sse2, literal_sse2);
+}
+
+TARGET("avx2") static size_t encode_avx2(const uint8_t *input, size_t *pos, size_t input_len, int final, uint8_t *output, size_t output_cap)
+{
+    return encode_with(input, pos, input_len, final, output, output_cap, run_avx2, literal_avx2);
+}
+#endif
+
+// Encoder for a path, falling back to the best one the CPU supports
+static ENCODE_FN encoder(PACKBITS_PATH_E path)
+{
+    PACKBITS_PATH_E best = packbits_best_path();
+
+    switch (path < best ? path : best)
+    {
+#ifdef PACKBITS_X86
+        case PACKBITS_AVX2: return encode_avx2;
+        case PACKBITS_SSE2: return encode_sse2;
+#endif
+        default: return encode_scalar;
+    }
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest encoded size of @p len input bytes.
+ *
+ * Every pair of equal bytes becomes a run, so the worst case is not all literals but
+ * a 1-byte literal before each 2-byte run ("a bb c dd ..."): 4 bytes out per 3 in.
+ *
+ * @param[in] len Input size.
+ * @return Output buffer size that is always enough.
+ */
+size_t packbits_encode_bound(size_t len)
+{
+    return len + (len + 2) / 3;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Path packbits_encode() uses on this CPU.
+ * @return Best supported path.
+ */
+PACKBITS_PATH_E packbits_best_path(void)
+{
+    static int cached = -1;  // Every thread computes the same answer, so racing to store it is harmless
+    int        best = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+
+    if (best < 0)
+    {
+#ifdef PACKBITS_X86
+        __builtin_cpu_init();
+        best = __builtin_cpu_supports("avx2") ? PACKBITS_AVX2 : __builtin_cpu_supports("sse2") ? PACKBITS_SSE2 : PACKBITS_SCALAR;
+#else
+        best = PACKBITS_SCALAR;
+#endif
+        __atomic_store_n(&cached, best, __ATOMIC_RELAXED);
+    }
+    return (PACKBITS_PATH_E)best;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Readable name of a path.
+ * @param[in] path Path.
+ * @return "scalar", "sse2" or "avx2".
+ */
+const char *packbits_path_name(PACKBITS_PATH_E path)
+{
+    static const char *names[PACKBITS_PATHS] = {"scalar", "sse2", "avx2"};
+    return path < PACKBITS_PATHS ? names[path] : "unknown";
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode with a given path.
+ * @param[in] path PACKBITS_SCALAR, PACKBITS_SSE2 or PACKBITS_AVX2; a path the CPU
+ *            (or the build) does not support falls back to the best one that it does.
+ * @param[in] input Data to compress.
+ * @param[in] input_len Input size.
+ * @param[out] output At least packbits_encode_bound(input_len) bytes.
+ * @return Encoded size.
+ */
+size_t packbits_encode_path(PACKBITS_PATH_E path, const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    size_t pos = 0;
+    return encoder(path)(input, &pos, input_len, 1, output, SIZE_MAX);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode with the fastest path the CPU supports.
+ * @param[in] input Data to compress.
+ * @param[in] input_len Input size.
+ * @param[out] output At least packbits_encode_bound(input_len) bytes.
+ * @return Encoded size.
+ */
+size_t packbits_encode(const uint8_t *input, size_t input_len, uint8_t *output)
+{
+    return packbits_encode_path(packbits_best_path(), input, input_len, output);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest decoded size of @p len encoded bytes (every packet a 128-byte run).
+ * @param[in] len Encoded size.
+ * @return Output buffer size that is always enough.
+ */
+size_t packbits_decode_bound(size_t len)
+{
+    return len / 2 * PACKBITS_MAX_PACKET;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Exact decoded size, from the packet headers alone.
+ * @param[in] input Encoded data.
+ * @param[in] input_len Encoded size.
+ * @param[out] decoded_len Decoded size.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if the last packet is truncated.
+ */
+int packbits_decoded_size(const uint8_t *input, size_t input_len, size_t *decoded_len)
+{
+    size_t i = 0, size = 0;
+
+    while (i < input_len)
+    {
+        uint8_t h = input[i];
+
+        if (h < 128)
+        {
+            size += h + 1u;
+            i += h + 2u;
+        }
+        else
+        {
+            size += h > 128 ? 257u - h : 0;
+            i += h > 128 ? 2 : 1;
+        }
+    }
+    *decoded_len = size;
+    return i == input_len ? PACKBITS_SUCCESS : PACKBITS_ERROR;
+}
+
+// Whole packets from *pos into output from *out_pos, up to the first one that is
+// truncated or does not fit
+static void decode_core(const uint8_t *input, size_t *pos, size_t input_len, uint8_t *output, size_t *out_pos, size_t output_cap)
+{
+    size_t i = *pos, o = *out_pos;
+
+    // Room for the largest packet on both sides: write a fixed 128 bytes, no checks
+    while (input_len - i > PACKBITS_MAX_PACKET && output_cap - o >= PACKBITS_MAX_PACKET)
+    {
+        uint8_t h = input[i];
+
+        if (h < 128)
+        {
+            memcpy(output + o, input + i + 1, PACKBITS_MAX_PACKET);
+            o += h + 1u;
+            i += h + 2u;
+        }
+        else if (h > 128)
+        {
+            memset(output + o, input[i + 1], PACKBITS_MAX_PACKET);
+            o += 257u - h;
+            i += 2;
+        }
+        else
+        {
+            i++;  // No-op packet
+        }
+    }
+
+    // Near either end: exact sizes, each packet checked before it is written
+    while (i < input_len)
+    {
+        uint8_t h = input[i];
+        size_t  n = h < 128 ? h + 1u : h > 128 ? 257u - h : 0;
+
+        if (h < 128 ? input_len - i - 1 < n : h > 128 && input_len - i < 2)
+        {
+            break;  // Truncated
+        }
+        if (output_cap - o < n)
+        {
+            break;  // Does not fit
+        }
+        if (h < 128)
+        {
+            memcpy(output + o, input + i + 1, n);
+            i += n + 1;
+        }
+        else
+        {
+            memset(output + o, h > 128 ? input[i + 1] : 0, n);
+            i += h > 128 ? 2 : 1;
+        }
+        o += n;
+    }
+    *pos = i;
+    *out_pos = o;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode into a caller buffer.
+ * @param[in] input Encoded data.
+ * @param[in] input_len Encoded size.
+ * @param[out] output Decoded data.
+ * @param[in] output_cap Size of @p output.
+ * @param[out] decoded_len Bytes decoded; on error, those of the packets before the bad one.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a packet is truncated or does not fit.
+ */
+int packbits_decode(const uint8_t *input, size_t input_len, uint8_t *output, size_t output_cap, size_t *decoded_len)
+{
+    size_t i = 0, o = 0;
+
+    decode_core(input, &i, input_len, output, &o, output_cap);
+    *decoded_len = o;
+    return i == input_len ? PACKBITS_SUCCESS : PACKBITS_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Streams
+//-------------------------------------------------------------------------------------------------
+
+// Free space in the ring (*room) and how much of it is contiguous from head
+static size_t ring_space(const PACKBITS_RING *ring, size_t *room)
+{
+    size_t to_end = ring->size - ring->head % ring->size;
+
+    *room = ring->size - (ring->head - ring->tail);
+    return to_end < *room ? to_end : *room;
+}
+
+static void ring_put(PACKBITS_RING *ring, const uint8_t *data, size_t len)
+{
+    size_t at = ring->head % ring->size;
+    size_t first = ring->size - at < len ? ring->size - at : len;
+
+    memcpy(ring->buf + at, data, first);
+    memcpy(ring->buf, data + first, len - first);
+    ring->head += len;
+}
+
+static void ring_fill(PACKBITS_RING *ring, uint8_t byte, size_t len)
+{
+    size_t at = ring->head % ring->size;
+    size_t first = ring->size - at < len ? ring->size - at : len;
+
+    memset(ring->buf + at, byte, first);
+    memset(ring->buf, byte, len - first);
+    ring->head += len;
+}
+
+// Encode from *pos into the ring; 1 if it stopped for room with packets still to emit
+static int enc_emit(PACKBITS_ENC *enc, const uint8_t *data, size_t *pos, size_t len, int final)
+{
+    ENCODE_FN      encode = encoder(enc->path);
+    PACKBITS_RING *ring = enc->out;
+
+    while (*pos < len && (final || len - *pos > PACKBITS_MAX_PACKET))
+    {
+        size_t room, contiguous = ring_space(ring, &room);
+
+        if (contiguous > PACKBITS_MAX_PACKET)
+        {
+            ring->head += encode(data, pos, len, final, ring->buf + ring->head % ring->size, contiguous);
+        }
+        else if (room > PACKBITS_MAX_PACKET)
+        {
+            // Across the end of the ring: one packet through a scratch buffer
+            uint8_t packet[PACKBITS_MAX_PACKET + 1];
+            ring_put(ring, packet, encode(data, pos, len, final, packet, sizeof(packet)));
+        }
+        else
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Set up an empty ring over a caller buffer.
+ * @param[out] ring Ring.
+ * @param[in] buf Storage; must outlive the ring.
+ * @param[in] size Size of @p buf; at least PACKBITS_MAX_PACKET + 1 for an encoder.
+ */
+void packbits_ring_init(PACKBITS_RING *ring, uint8_t *buf, size_t size)
+{
+    ring->buf = buf;
+    ring->size = size;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Oldest unread bytes that are contiguous in the ring.
+ * @param[in] ring Ring.
+ * @param[out] data Start of the bytes.
+ * @return Number of contiguous bytes; call again after packbits_ring_consume() for the rest.
+ */
+size_t packbits_ring_peek(const PACKBITS_RING *ring, const uint8_t **data)
+{
+    size_t at = ring->tail % ring->size;
+    size_t used = ring->head - ring->tail;
+
+    *data = ring->buf + at;
+    return ring->size - at < used ? ring->size - at : used;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Mark bytes as read, freeing their space.
+ * @param[in,out] ring Ring.
+ * @param[in] len Bytes read, at most what packbits_ring_peek() returned.
+ */
+void packbits_ring_consume(PACKBITS_RING *ring, size_t len)
+{
+    ring->tail += len;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Start a stream encoder.
+ * @param[out] enc Encoder.
+ * @param[in] out Ring the packets go to.
+ * @param[in] path Encoder path, as for packbits_encode_path().
+ */
+void packbits_enc_init(PACKBITS_ENC *enc, PACKBITS_RING *out, PACKBITS_PATH_E path)
+{
+    enc->out = out;
+    enc->path = path;
+    enc->carry_len = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode the next chunk of input.
+ * @param[in,out] enc Encoder.
+ * @param[in] input Chunk.
+ * @param[in] input_len Chunk size.
+ * @param[out] consumed Bytes of the chunk taken; the rest must be passed again.
+ * @return PACKBITS_SUCCESS when the whole chunk was taken, PACKBITS_AGAIN when the
+ *         ring is full.
+ */
+int packbits_enc_write(PACKBITS_ENC *enc, const uint8_t *input, size_t input_len, size_t *consumed)
+{
+    size_t used = 0, pos;
+    int    full;
+
+    while (used < input_len)
+    {
+        if (enc->carry_len == 0 && input_len - used > PACKBITS_MAX_PACKET)
+        {
+            // Straight from the chunk, leaving its last 128 bytes
+            full = enc_emit(enc, input, &used, input_len, 0);
+        }
+        else
+        {
+            // Held-back bytes joined with the start of this chunk
+            size_t held = enc->carry_len;
+            size_t take = sizeof(enc->carry) - held < input_len - used ? sizeof(enc->carry) - held : input_len - used;
+
+            memcpy(enc->carry + held, input + used, take);
+            enc->carry_len += take;
+            pos = 0;
+            full = enc_emit(enc, enc->carry, &pos, enc->carry_len, 0);
+            if (held > 0 && pos >= held)
+            {
+                // Past the held-back bytes: go on from the chunk itself
+                used += pos - held;
+                enc->carry_len = 0;
+            }
+            else
+            {
+                used += take;
+                memmove(enc->carry, enc->carry + pos, enc->carry_len - pos);
+                enc->carry_len -= pos;
+            }
+        }
+        if (full)
+        {
+            *consumed = used;
+            return PACKBITS_AGAIN;
+        }
+    }
+    *consumed = used;
+    return PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode the input held back, at the end of the stream.
+ * @param[in,out] enc Encoder.
+ * @return PACKBITS_SUCCESS when all of it is in the ring, PACKBITS_AGAIN when the ring
+ *         is full.
+ */
+int packbits_enc_finish(PACKBITS_ENC *enc)
+{
+    size_t pos = 0;
+    int    full = enc_emit(enc, enc->carry, &pos, enc->carry_len, 1);
+
+    memmove(enc->carry, enc->carry + pos, enc->carry_len - pos);
+    enc->carry_len -= pos;
+    return full ? PACKBITS_AGAIN : PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Start a stream decoder.
+ * @param[out] dec Decoder.
+ * @param[in] out Ring the decoded bytes go to.
+ */
+void packbits_dec_init(PACKBITS_DEC *dec, PACKBITS_RING *out)
+{
+    dec->out = out;
+    dec->left = 0;
+    dec->literal = 0;
+    dec->have_byte = 0;
+    dec->byte = 0;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode the next chunk of packets.
+ * @param[in,out] dec Decoder.
+ * @param[in] input Chunk.
+ * @param[in] input_len Chunk size.
+ * @param[out] consumed Bytes of the chunk taken; the rest must be passed again.
+ * @return PACKBITS_SUCCESS when the whole chunk was taken and decoded, PACKBITS_AGAIN
+ *         when the ring is full (possibly with the chunk taken but a run still owed).
+ */
+int packbits_dec_write(PACKBITS_DEC *dec, const uint8_t *input, size_t input_len, size_t *consumed)
+{
+    PACKBITS_RING *ring = dec->out;
+    size_t         used = 0;
+
+    for (;;)
+    {
+        size_t room, contiguous = ring_space(ring, &room), n;
+
+        if (dec->left == 0)
+        {
+            // Whole packets straight into the ring, then the header of one that is split
+            n = 0;
+            decode_core(input, &used, input_len, ring->buf + ring->head % ring->size, &n, contiguous);
+            ring->head += n;
+            if (used == input_len)
+            {
+                break;
+            }
+            uint8_t h = input[used++];
+            dec->literal = h < 128;
+            dec->have_byte = 0;
+            dec->left = h < 128 ? h + 1u : h > 128 ? 257u - h : 0;
+            continue;
+        }
+        if (!dec->literal && !dec->have_byte)
+        {
+            if (used == input_len)
+            {
+                break;
+            }
+            dec->byte = input[used++];
+            dec->have_byte = 1;
+            continue;
+        }
+
+        n = dec->left < room ? dec->left : room;
+        if (dec->literal)
+        {
+            n = n < input_len - used ? n : input_len - used;
+            ring_put(ring, input + used, n);
+            used += n;
+        }
+        else
+        {
+            ring_fill(ring, dec->byte, n);
+        }
+        dec->left -= n;
+        if (dec->left > 0)
+        {
+            if (dec->literal && used == input_len)
+            {
+                break;  // Rest of the literal is in the next chunk
+            }
+            *consumed = used;
+            return PACKBITS_AGAIN;
+        }
+    }
+    *consumed = used;
+    return PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Check the end of the stream.
+ * @param[in,out] dec Decoder.
+ * @return PACKBITS_SUCCESS at a packet boundary, PACKBITS_AGAIN while a run is still
+ *         owed to a full ring, PACKBITS_ERROR if the stream stopped inside a packet.
+ */
+int packbits_dec_finish(PACKBITS_DEC *dec)
+{
+    size_t consumed;
+
+    if (dec->left > 0 && (dec->literal || !dec->have_byte))
+    {
+        return PACKBITS_ERROR;
+    }
+    return dec->left > 0 ? packbits_dec_write(dec, NULL, 0, &consumed) : PACKBITS_SUCCESS;
+}
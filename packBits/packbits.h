@@ -0,0 +1,260 @@
+/**
+ * @file    packbits.h
+ * @brief   PackBits run-length codec (TIFF compression 32773) with SIMD run detection.
+ *
+ * The stream is a sequence of packets, each starting with a header byte n:
+ *   0..127    - n + 1 literal bytes follow
+ *   129..255  - the next byte repeated 257 - n times (a run of 2..128)
+ *   128       - no-op, skipped by decoders
+ *
+ * The encoder turns every pair of equal bytes into a run and everything else into
+ * literal packets of at most 128 bytes. Most of its time goes into finding where a run
+ * or a literal span ends. The SIMD paths compare 16 (SSE2) or 32 (AVX2) bytes at a
+ * time: for a run, the next bytes against the repeated byte; for literals, the input
+ * against itself shifted by one, so the first equal neighbour pair is the first set
+ * bit of the movemask. Literal spans are then copied in one memcpy.
+ *
+ * Every path produces byte-identical output. packbits_encode() uses the best path the
+ * CPU supports, chosen once at the first call; packbits_encode_path() forces one, for
+ * testing and benchmarks.
+ *
+ * Decoding never allocates. Either size the output exactly with packbits_decoded_size(),
+ * a pass over the headers only, or use packbits_decode_bound(). packbits_decode() checks
+ * every packet against both buffers before touching them, so a truncated or oversized
+ * stream is rejected rather than overrunning. Runs and literals are written with memset
+ * and memcpy; while at least a packet's worth of room remains on both sides, it writes
+ * a fixed 128 bytes per packet, which the compiler turns into a few vector stores, and
+ * lets the next packet overwrite the excess.
+ *
+ * For inputs too large to hold at once, PACKBITS_ENC and PACKBITS_DEC take the input in
+ * chunks of any size and write into a caller-owned PACKBITS_RING, so memory stays
+ * constant. The encoder holds back the last 128 bytes of each chunk, because the packets
+ * that cover them may depend on the next byte. It encodes them together with the start of
+ * the next chunk, so its output is byte-identical to packbits_encode() over the whole
+ * input, however the input is split. The decoder carries a packet split across chunks
+ * (or across the end of the ring) as its header and the bytes still owed. Both return
+ * PACKBITS_AGAIN when the ring is full: drain it and call again with the rest.
+ *
+ */
+
+#ifndef PACKBITS_H
+#define PACKBITS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Longest run or literal packet */
+#define PACKBITS_MAX_PACKET 128
+
+#define PACKBITS_SUCCESS 0
+#define PACKBITS_ERROR   1
+#define PACKBITS_AGAIN   2
+
+typedef enum
+{
+    PACKBITS_SCALAR,
+    PACKBITS_SSE2,
+    PACKBITS_AVX2,
+    PACKBITS_PATHS
+} PACKBITS_PATH_E;
+
+/** Byte ring between a stream and its consumer; head and tail count bytes ever written and read */
+typedef struct
+{
+    uint8_t *buf;
+    size_t   size;
+    size_t   head;
+    size_t   tail;
+} PACKBITS_RING;
+
+typedef struct
+{
+    PACKBITS_RING  *out;
+    PACKBITS_PATH_E path;
+    size_t          carry_len;
+    uint8_t         carry[3 * PACKBITS_MAX_PACKET];  // Input not encoded yet, then the head of the next chunk
+} PACKBITS_ENC;
+
+typedef struct
+{
+    PACKBITS_RING *out;
+    size_t         left;     // Bytes of the current packet still to write
+    uint8_t        literal;  // Current packet copies input rather than repeating a byte
+    uint8_t        have_byte;
+    uint8_t        byte;     // Run byte, once have_byte
+} PACKBITS_DEC;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest encoded size of @p len input bytes.
+     *
+     * Every pair of equal bytes becomes a run, so the worst case is not all literals but
+     * a 1-byte literal before each 2-byte run ("a bb c dd ..."): 4 bytes out per 3 in.
+     *
+     * @param[in] len Input size.
+     * @return Output buffer size that is always enough.
+     */
+    size_t packbits_encode_bound(size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode with the fastest path the CPU supports.
+     * @param[in] input Data to compress.
+     * @param[in] input_len Input size.
+     * @param[out] output At least packbits_encode_bound(input_len) bytes.
+     * @return Encoded size.
+     */
+    size_t packbits_encode(const uint8_t *input, size_t input_len, uint8_t *output);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode with a given path.
+     * @param[in] path PACKBITS_SCALAR, PACKBITS_SSE2 or PACKBITS_AVX2; a path the CPU
+     *            (or the build) does not support falls back to the best one that it does.
+     * @param[in] input Data to compress.
+     * @param[in] input_len Input size.
+     * @param[out] output At least packbits_encode_bound(input_len) bytes.
+     * @return Encoded size.
+     */
+    size_t packbits_encode_path(PACKBITS_PATH_E path, const uint8_t *input, size_t input_len, uint8_t *output);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Path packbits_encode() uses on this CPU.
+     * @return Best supported path.
+     */
+    PACKBITS_PATH_E packbits_best_path(void);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Readable name of a path.
+     * @param[in] path Path.
+     * @return "scalar", "sse2" or "avx2".
+     */
+    const char *packbits_path_name(PACKBITS_PATH_E path);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest decoded size of @p len encoded bytes (every packet a 128-byte run).
+     * @param[in] len Encoded size.
+     * @return Output buffer size that is always enough.
+     */
+    size_t packbits_decode_bound(size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Exact decoded size, from the packet headers alone.
+     * @param[in] input Encoded data.
+     * @param[in] input_len Encoded size.
+     * @param[out] decoded_len Decoded size.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if the last packet is truncated.
+     */
+    int packbits_decoded_size(const uint8_t *input, size_t input_len, size_t *decoded_len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode into a caller buffer.
+     * @param[in] input Encoded data.
+     * @param[in] input_len Encoded size.
+     * @param[out] output Decoded data.
+     * @param[in] output_cap Size of @p output.
+     * @param[out] decoded_len Bytes decoded; on error, those of the packets before the bad one.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a packet is truncated or does not fit.
+     */
+    int packbits_decode(const uint8_t *input, size_t input_len, uint8_t *output, size_t output_cap, size_t *decoded_len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Set up an empty ring over a caller buffer.
+     * @param[out] ring Ring.
+     * @param[in] buf Storage; must outlive the ring.
+     * @param[in] size Size of @p buf; at least PACKBITS_MAX_PACKET + 1 for an encoder.
+     */
+    void packbits_ring_init(PACKBITS_RING *ring, uint8_t *buf, size_t size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Oldest unread bytes that are contiguous in the ring.
+     * @param[in] ring Ring.
+     * @param[out] data Start of the bytes.
+     * @return Number of contiguous bytes; call again after packbits_ring_consume() for the rest.
+     */
+    size_t packbits_ring_peek(const PACKBITS_RING *ring, const uint8_t **data);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Mark bytes as read, freeing their space.
+     * @param[in,out] ring Ring.
+     * @param[in] len Bytes read, at most what packbits_ring_peek() returned.
+     */
+    void packbits_ring_consume(PACKBITS_RING *ring, size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Start a stream encoder.
+     * @param[out] enc Encoder.
+     * @param[in] out Ring the packets go to.
+     * @param[in] path Encoder path, as for packbits_encode_path().
+     */
+    void packbits_enc_init(PACKBITS_ENC *enc, PACKBITS_RING *out, PACKBITS_PATH_E path);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode the next chunk of input.
+     * @param[in,out] enc Encoder.
+     * @param[in] input Chunk.
+     * @param[in] input_len Chunk size.
+     * @param[out] consumed Bytes of the chunk taken; the rest must be passed again.
+     * @return PACKBITS_SUCCESS when the whole chunk was taken, PACKBITS_AGAIN when the
+     *         ring is full.
+     */
+    int packbits_enc_write(PACKBITS_ENC *enc, const uint8_t *input, size_t input_len, size_t *consumed);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode the input held back, at the end of the stream.
+     * @param[in,out] enc Encoder.
+     * @return PACKBITS_SUCCESS when all of it is in the ring, PACKBITS_AGAIN when the ring
+     *         is full.
+     */
+    int packbits_enc_finish(PACKBITS_ENC *enc);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Start a stream decoder.
+     * @param[out] dec Decoder.
+     * @param[in] out Ring the decoded bytes go to.
+     */
+    void packbits_dec_init(PACKBITS_DEC *dec, PACKBITS_RING *out);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode the next chunk of packets.
+     * @param[in,out] dec Decoder.
+     * @param[in] input Chunk.
+     * @param[in] input_len Chunk size.
+     * @param[out] consumed Bytes of the chunk taken; the rest must be passed again.
+     * @return PACKBITS_SUCCESS when the whole chunk was taken and decoded, PACKBITS_AGAIN
+     *         when the ring is full (possibly with the chunk taken but a run still owed).
+     */
+    int packbits_dec_write(PACKBITS_DEC *dec, const uint8_t *input, size_t input_len, size_t *consumed);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Check the end of the stream.
+     * @param[in,out] dec Decoder.
+     * @return PACKBITS_SUCCESS at a packet boundary, PACKBITS_AGAIN while a run is still
+     *         owed to a full ring, PACKBITS_ERROR if the stream stopped inside a packet.
+     */
+    int packbits_dec_finish(PACKBITS_DEC *dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PACKBITS_H
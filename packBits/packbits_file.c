@@ -0,0 +1,314 @@
+/**
+ * @file    packbits_file.c
+ * @brief   Memory-mapped PackBits file compression.
+ *
+ */
+
+#include "packbits_file.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "packbits_frame.h"
+
+typedef struct
+{
+    int      fd;
+    uint8_t *data;
+    size_t   len;
+} MAPPING;
+
+// An output is written to a temporary file next to it, then renamed over it
+typedef struct
+{
+    MAPPING map;
+    char    temp[PATH_MAX];
+} OUTPUT;
+
+// Map a whole file read-only for one sequential pass
+static int map_input(const char *path, MAPPING *m)
+{
+    struct stat st;
+
+    m->data = NULL;
+    m->fd = open(path, O_RDONLY);
+    if (m->fd == -1 || fstat(m->fd, &st) == -1)
+    {
+        perror("packbits: open input");
+        return PACKBITS_ERROR;
+    }
+    m->len = (size_t)st.st_size;
+    if (m->len == 0)
+    {
+        return PACKBITS_SUCCESS;  // Nothing to map
+    }
+    m->data = mmap(NULL, m->len, PROT_READ, MAP_PRIVATE, m->fd, 0);
+    if (m->data == MAP_FAILED)
+    {
+        perror("packbits: mmap input");
+        m->data = NULL;
+        return PACKBITS_ERROR;
+    }
+    madvise(m->data, m->len, MADV_SEQUENTIAL);
+    return PACKBITS_SUCCESS;
+}
+
+// Create a temporary output beside path with len bytes allocated on disk and map it for writing
+static int map_output(const char *path, const MAPPING *input, size_t len, OUTPUT *o)
+{
+    MAPPING    *m = &o->map;
+    struct stat in_st, out_st;
+    int         exists, rc;
+
+    m->fd = -1;
+    m->data = NULL;
+    m->len = len;
+    o->temp[0] = '\0';
+    if (fstat(input->fd, &in_st) == -1)
+    {
+        perror("packbits: stat input");
+        return PACKBITS_ERROR;
+    }
+    exists = stat(path, &out_st) == 0;
+    if (exists && out_st.st_dev == in_st.st_dev && out_st.st_ino == in_st.st_ino)
+    {
+        fprintf(stderr, "packbits: output is the input file\n");
+        return PACKBITS_ERROR;
+    }
+    if ((size_t)snprintf(o->temp, sizeof(o->temp), "%s.XXXXXX", path) >= sizeof(o->temp))
+    {
+        fprintf(stderr, "packbits: output path too long\n");
+        o->temp[0] = '\0';
+        return PACKBITS_ERROR;
+    }
+    m->fd = mkstemp(o->temp);
+    if (m->fd == -1)
+    {
+        perror("packbits: create output");
+        o->temp[0] = '\0';
+        return PACKBITS_ERROR;
+    }
+    // mkstemp() creates the file 0600; give it the mode of the file it replaces
+    fchmod(m->fd, exists ? out_st.st_mode & 07777 : 0644);
+    if (len == 0)
+    {
+        return PACKBITS_SUCCESS;
+    }
+    rc = posix_fallocate(m->fd, 0, (off_t)len);
+    if (rc != 0)
+    {
+        fprintf(stderr, "packbits: fallocate %s: %s\n", o->temp, strerror(rc));
+        return PACKBITS_ERROR;
+    }
+    m->data = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+    if (m->data == MAP_FAILED)
+    {
+        perror("packbits: mmap output");
+        m->data = NULL;
+        return PACKBITS_ERROR;
+    }
+    madvise(m->data, len, MADV_SEQUENTIAL);
+    return PACKBITS_SUCCESS;
+}
+
+static void unmap(MAPPING *m)
+{
+    if (m->data != NULL)
+    {
+        munmap(m->data, m->len);
+    }
+    if (m->fd != -1)
+    {
+        close(m->fd);
+    }
+}
+
+// Cut the output to its real size and rename it over path; on failure remove it and leave path alone
+static int finish_output(OUTPUT *o, const char *path, int rc, size_t len)
+{
+    MAPPING *m = &o->map;
+
+    if (m->data != NULL)
+    {
+        munmap(m->data, m->len);
+        m->data = NULL;
+    }
+    if (rc == PACKBITS_SUCCESS && ftruncate(m->fd, (off_t)len) == -1)
+    {
+        perror("packbits: ftruncate");
+        rc = PACKBITS_ERROR;
+    }
+    if (m->fd != -1)
+    {
+        close(m->fd);
+        m->fd = -1;
+    }
+    if (rc == PACKBITS_SUCCESS && rename(o->temp, path) == -1)
+    {
+        perror("packbits: rename output");
+        rc = PACKBITS_ERROR;
+    }
+    if (rc != PACKBITS_SUCCESS && o->temp[0] != '\0')
+    {
+        unlink(o->temp);
+    }
+    return rc;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode a file.
+ * @param[in] input_path File to compress.
+ * @param[in] output_path File to create or replace.
+ * @param[in] block_size 0 for a plain stream, else input bytes per frame block.
+ * @param[in] threads Frame worker threads; 0 for one per online CPU.
+ * @param[in] flags PACKBITS_FILE_RAW to leave out the plain-stream header, else 0.
+ * @param[out] output_size Encoded size, or NULL.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR (also for PACKBITS_FILE_RAW with a block size).
+ */
+int packbits_file_encode(const char *input_path, const char *output_path, size_t block_size, int threads, unsigned flags,
+                         uint64_t *output_size)
+{
+    MAPPING in;
+    OUTPUT  out;
+    size_t  len = 0;
+    size_t  skip = (flags & PACKBITS_FILE_RAW) ? 0 : sizeof(PACKBITS_FILE_HEADER);
+    int     rc;
+
+    if (block_size > 0 && (flags & PACKBITS_FILE_RAW))
+    {
+        fprintf(stderr, "packbits: a frame cannot be headerless\n");
+        return PACKBITS_ERROR;
+    }
+    if (map_input(input_path, &in) != PACKBITS_SUCCESS)
+    {
+        unmap(&in);
+        return PACKBITS_ERROR;
+    }
+
+    size_t bound = block_size > 0 ? packbits_frame_bound(in.len, block_size) : skip + packbits_encode_bound(in.len);
+    rc = map_output(output_path, &in, bound, &out);
+    if (rc == PACKBITS_SUCCESS)
+    {
+        if (block_size > 0)
+        {
+            rc = packbits_frame_encode(in.data, in.len, block_size, threads, out.map.data, bound, &len);
+        }
+        else
+        {
+            if (skip > 0)
+            {
+                PACKBITS_FILE_HEADER hdr = {PACKBITS_FILE_MAGIC, PACKBITS_FILE_VERSION, sizeof(hdr), in.len};
+                memcpy(out.map.data, &hdr, sizeof(hdr));
+            }
+            len = skip + (in.len > 0 ? packbits_encode(in.data, in.len, out.map.data + skip) : 0);
+        }
+    }
+    rc = finish_output(&out, output_path, rc, len);
+    unmap(&in);
+
+    if (output_size != NULL)
+    {
+        *output_size = len;
+    }
+    return rc;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode a file, a frame or a plain stream.
+ * @param[in] input_path Encoded file.
+ * @param[in] output_path File to create or replace.
+ * @param[in] threads Frame worker threads; 0 for one per online CPU.
+ * @param[in] flags PACKBITS_FILE_RAW for a headerless plain stream, else 0.
+ * @param[out] output_size Decoded size, or NULL.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR (also for truncated, damaged or unrecognised input).
+ */
+int packbits_file_decode(const char *input_path, const char *output_path, int threads, unsigned flags, uint64_t *output_size)
+{
+    MAPPING              in;
+    OUTPUT               out;
+    PACKBITS_FRAME       frame;
+    PACKBITS_FILE_HEADER hdr = {0};
+    size_t               len = 0, skip = 0, decoded;
+    int                  framed = 0, rc;
+
+    if (map_input(input_path, &in) != PACKBITS_SUCCESS)
+    {
+        unmap(&in);
+        return PACKBITS_ERROR;
+    }
+
+    // The format comes from the magic number, or from the caller for a headerless stream
+    if (!(flags & PACKBITS_FILE_RAW))
+    {
+        if (in.len > 0)
+        {
+            memcpy(&hdr, in.data, in.len < sizeof(hdr) ? in.len : sizeof(hdr));
+        }
+        framed = hdr.magic == PACKBITS_FRAME_MAGIC;
+        if (!framed && hdr.magic != PACKBITS_FILE_MAGIC)
+        {
+            fprintf(stderr, "packbits: %s is not a PackBits file\n", input_path);
+            unmap(&in);
+            return PACKBITS_ERROR;
+        }
+    }
+    // The recorded size must be one the payload can decode to: a forged header could
+    // otherwise reserve any amount of disk for the output before decoding fails
+    if (framed)
+    {
+        rc = packbits_frame_open(&frame, in.data, in.len);
+        if (rc == PACKBITS_SUCCESS && frame.raw_size > packbits_decode_bound(frame.index[frame.block_count] - frame.index[0]))
+        {
+            rc = PACKBITS_ERROR;
+        }
+        len = rc == PACKBITS_SUCCESS ? (size_t)frame.raw_size : 0;
+    }
+    else if (flags & PACKBITS_FILE_RAW)
+    {
+        rc = packbits_decoded_size(in.data, in.len, &len);
+    }
+    else
+    {
+        rc = in.len >= sizeof(hdr) && hdr.version == PACKBITS_FILE_VERSION && hdr.header_size == sizeof(hdr) &&
+                     hdr.raw_size <= packbits_decode_bound(in.len - sizeof(hdr))
+                 ? PACKBITS_SUCCESS
+                 : PACKBITS_ERROR;
+        len = (size_t)hdr.raw_size;
+        skip = sizeof(hdr);
+    }
+    if (rc != PACKBITS_SUCCESS)
+    {
+        fprintf(stderr, "packbits: %s is truncated or has a bad header\n", input_path);
+        unmap(&in);
+        return PACKBITS_ERROR;
+    }
+
+    rc = map_output(output_path, &in, len, &out);
+    if (rc == PACKBITS_SUCCESS && (len > 0 || in.len > skip))
+    {
+        // A plain stream must decode to exactly its recorded size
+        rc = framed ? packbits_frame_decode(&frame, threads, out.map.data, len)
+                    : packbits_decode(in.data + skip, in.len - skip, out.map.data, len, &decoded);
+        if (rc != PACKBITS_SUCCESS || (!framed && decoded != len))
+        {
+            fprintf(stderr, "packbits: %s is damaged\n", input_path);
+            rc = PACKBITS_ERROR;
+        }
+    }
+    rc = finish_output(&out, output_path, rc, len);
+    unmap(&in);
+
+    if (output_size != NULL)
+    {
+        *output_size = rc == PACKBITS_SUCCESS ? len : 0;
+    }
+    return rc;
+}
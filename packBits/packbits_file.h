@@ -0,0 +1,90 @@
+/**
+ * @file    packbits_file.h
+ * @brief   Memory-mapped PackBits file compression.
+ *
+ * Encodes or decodes one file into another without read()/write() copies:
+ *   - the input is mapped read-only with MADV_SEQUENTIAL, so the kernel reads ahead
+ *     aggressively and drops pages behind the codec;
+ *   - the output is created at its final (decode) or worst-case (encode) size with
+ *     posix_fallocate, mapped shared, written in place by the codec, and truncated to
+ *     the real size at the end. Allocating up front means a full disk fails the call
+ *     instead of raising SIGBUS halfway through the mapping.
+ *
+ * The output is written to a temporary file beside it ("<output>.XXXXXX") and renamed
+ * over it only when the call succeeds, so a failed call leaves an existing output as it
+ * was.
+ *
+ * With a block size the output is a block-parallel frame (packbits_frame.h), encoded
+ * on @p threads threads. Without one it is a plain PackBits stream behind a
+ * PACKBITS_FILE_HEADER, which records the raw size. Every file this module writes
+ * starts with a magic number, "PKBF" or "PKBS", and decoding picks the format by it;
+ * a file with neither is refused instead of guessed at.
+ *
+ * A headerless stream, such as packStream output, is written and read with
+ * PACKBITS_FILE_RAW. Nothing in such a stream marks it: its first bytes may even parse
+ * as a frame header. So it is only ever decoded when the caller says so, and is sized
+ * by a header scan.
+ *
+ * The output may not be the input file. A failed call removes only its temporary file.
+ *
+ */
+
+#ifndef PACKBITS_FILE_H
+#define PACKBITS_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packbits.h"
+
+#define PACKBITS_FILE_MAGIC   0x53424B50  // "PKBS"
+#define PACKBITS_FILE_VERSION 1
+
+/** Flag: a headerless plain stream, on both encode and decode */
+#define PACKBITS_FILE_RAW 0x1
+
+/** Header of a plain-stream file; the packets follow it */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint64_t raw_size;
+} PACKBITS_FILE_HEADER;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode a file.
+     * @param[in] input_path File to compress.
+     * @param[in] output_path File to create or replace.
+     * @param[in] block_size 0 for a plain stream, else input bytes per frame block.
+     * @param[in] threads Frame worker threads; 0 for one per online CPU.
+     * @param[in] flags PACKBITS_FILE_RAW to leave out the plain-stream header, else 0.
+     * @param[out] output_size Encoded size, or NULL.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR (also for PACKBITS_FILE_RAW with a block size).
+     */
+    int packbits_file_encode(const char *input_path, const char *output_path, size_t block_size, int threads, unsigned flags,
+                             uint64_t *output_size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode a file, a frame or a plain stream.
+     * @param[in] input_path Encoded file.
+     * @param[in] output_path File to create or replace.
+     * @param[in] threads Frame worker threads; 0 for one per online CPU.
+     * @param[in] flags PACKBITS_FILE_RAW for a headerless plain stream, else 0.
+     * @param[out] output_size Decoded size, or NULL.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR (also for truncated, damaged or unrecognised input).
+     */
+    int packbits_file_decode(const char *input_path, const char *output_path, int threads, unsigned flags, uint64_t *output_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PACKBITS_FILE_H
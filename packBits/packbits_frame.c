@@ -0,0 +1,322 @@
+/**
+ * @file    packbits_frame.c
+ * @brief   Block-parallel PackBits container with a seekable block index.
+ *
+ */
+
+#include "packbits_frame.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+// Work shared by the threads of one call
+typedef struct
+{
+    int (*run)(void *job, uint32_t block);
+    void    *job;
+    uint32_t count;
+    uint64_t next;  // Next block to claim
+    int      failed;
+} BLOCK_QUEUE;
+
+typedef struct
+{
+    const uint8_t *input;
+    size_t         input_len;
+    size_t         block_size;
+    uint8_t       *output;
+    size_t         slot_start;
+    size_t         slot_size;
+    uint64_t      *index;
+} ENCODE_JOB;
+
+typedef struct
+{
+    const PACKBITS_FRAME *frame;
+    uint8_t              *output;
+} DECODE_JOB;
+
+//-------------------------------------------------------------------------------------------------
+// Thread pool
+//-------------------------------------------------------------------------------------------------
+
+static void *worker(void *arg)
+{
+    BLOCK_QUEUE *q = arg;
+    uint64_t     b;
+
+    while ((b = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->count)
+    {
+        if (q->run(q->job, (uint32_t)b) != PACKBITS_SUCCESS)
+        {
+            __atomic_store_n(&q->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+// Run every block on up to @p threads threads, the caller included
+static int for_each_block(uint32_t count, int threads, int (*run)(void *, uint32_t), void *job)
+{
+    BLOCK_QUEUE q = {run, job, count, 0, 0};
+    pthread_t   tid[PACKBITS_FRAME_MAX_THREADS];
+    int         started = 0;
+
+    if (threads <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus < 1 ? 1 : cpus > PACKBITS_FRAME_MAX_THREADS ? PACKBITS_FRAME_MAX_THREADS : (int)cpus;
+    }
+    threads = threads > PACKBITS_FRAME_MAX_THREADS ? PACKBITS_FRAME_MAX_THREADS : threads;
+    threads = (uint32_t)threads > count ? (int)count : threads;
+
+    // Fewer threads than asked if some cannot start; the caller alone still finishes
+    while (started < threads - 1 && pthread_create(&tid[started], NULL, worker, &q) == 0)
+    {
+        started++;
+    }
+    worker(&q);
+    for (int t = 0; t < started; t++)
+    {
+        pthread_join(tid[t], NULL);
+    }
+    return q.failed ? PACKBITS_ERROR : PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+// Blocks
+//-------------------------------------------------------------------------------------------------
+
+static size_t index_end(uint32_t block_count)
+{
+    return sizeof(PACKBITS_FRAME_HEADER) + ((size_t)block_count + 1) * sizeof(uint64_t);
+}
+
+// Encode block b into its slot; its size goes to index[b] until the gaps are closed
+static int encode_block(void *arg, uint32_t b)
+{
+    ENCODE_JOB *job = arg;
+    size_t      start = (size_t)b * job->block_size;
+    size_t      len = job->input_len - start < job->block_size ? job->input_len - start : job->block_size;
+
+    job->index[b] = packbits_encode(job->input + start, len, job->output + job->slot_start + (size_t)b * job->slot_size);
+    return PACKBITS_SUCCESS;
+}
+
+// Decode block b to its place; it must come out at exactly its size
+static int decode_block(void *arg, uint32_t b)
+{
+    DECODE_JOB           *job = arg;
+    const PACKBITS_FRAME *f = job->frame;
+    uint64_t              start = (uint64_t)b * f->block_size;
+    size_t                len = f->raw_size - start < f->block_size ? f->raw_size - start : f->block_size;
+    size_t                decoded;
+
+    if (packbits_decode(f->data + f->index[b], f->index[b + 1] - f->index[b], job->output + start, len, &decoded) != PACKBITS_SUCCESS ||
+        decoded != len)
+    {
+        return PACKBITS_ERROR;
+    }
+    return PACKBITS_SUCCESS;
+}
+
+// Bytes [skip, skip + len) of one block's packets
+static int decode_range(const uint8_t *input, size_t input_len, size_t skip, uint8_t *output, size_t len)
+{
+    size_t i = 0, o = 0;
+
+    while (o < len && i < input_len)
+    {
+        uint8_t h = input[i];
+        size_t  n = h < 128 ? h + 1u : h > 128 ? 257u - h : 0;
+        size_t  step = h < 128 ? n + 1 : h > 128 ? 2 : 1;
+
+        if (input_len - i < step)
+        {
+            return PACKBITS_ERROR;  // Truncated
+        }
+        if (n <= skip)
+        {
+            skip -= n;  // Before the range: header only
+        }
+        else
+        {
+            size_t take = n - skip < len - o ? n - skip : len - o;
+            if (h < 128)
+            {
+                memcpy(output + o, input + i + 1 + skip, take);
+            }
+            else
+            {
+                memset(output + o, input[i + 1], take);
+            }
+            o += take;
+            skip = 0;
+        }
+        i += step;
+    }
+    return o == len ? PACKBITS_SUCCESS : PACKBITS_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest frame for @p len input bytes.
+ * @param[in] len Input size.
+ * @param[in] block_size Input bytes per block.
+ * @return Output buffer size that is always enough.
+ */
+size_t packbits_frame_bound(size_t len, size_t block_size)
+{
+    if (block_size == 0)
+    {
+        return index_end(0);
+    }
+    return index_end((uint32_t)((len + block_size - 1) / block_size)) + len / block_size * packbits_encode_bound(block_size) +
+           packbits_encode_bound(len % block_size);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode into a frame, blocks in parallel.
+ * @param[in] input Data to compress.
+ * @param[in] input_len Input size.
+ * @param[in] block_size Input bytes per block, 1 to UINT32_MAX.
+ * @param[in] threads Worker threads, counting the caller; 0 for one per online CPU.
+ * @param[out] output Frame.
+ * @param[in] output_cap Size of @p output; at least packbits_frame_bound().
+ * @param[out] output_len Frame size.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR on bad sizes.
+ */
+int packbits_frame_encode(const uint8_t *input, size_t input_len, size_t block_size, int threads, uint8_t *output, size_t output_cap,
+                          size_t *output_len)
+{
+    if (block_size == 0 || block_size > UINT32_MAX || (input_len + block_size - 1) / block_size > UINT32_MAX ||
+        output_cap < packbits_frame_bound(input_len, block_size))
+    {
+        return PACKBITS_ERROR;
+    }
+
+    PACKBITS_FRAME_HEADER *hdr = (PACKBITS_FRAME_HEADER *)output;
+    uint32_t               blocks = (uint32_t)((input_len + block_size - 1) / block_size);
+    ENCODE_JOB             job = {input, input_len, block_size, output, index_end(blocks), packbits_encode_bound(block_size),
+                                  (uint64_t *)(output + sizeof(*hdr))};
+
+    hdr->magic = PACKBITS_FRAME_MAGIC;
+    hdr->version = PACKBITS_FRAME_VERSION;
+    hdr->header_size = sizeof(*hdr);
+    hdr->block_size = (uint32_t)block_size;
+    hdr->block_count = blocks;
+    hdr->raw_size = input_len;
+
+    if (blocks > 0)
+    {
+        for_each_block(blocks, threads, encode_block, &job);
+    }
+
+    // Close the gaps between slots; block b's slot is never before its final place
+    size_t pos = job.slot_start;
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        size_t size = job.index[b];
+        memmove(output + pos, output + job.slot_start + (size_t)b * job.slot_size, size);
+        job.index[b] = pos;
+        pos += size;
+    }
+    job.index[blocks] = pos;
+    *output_len = pos;
+    return PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Check a frame's header and index, and set up a view of it.
+ * @param[out] frame View.
+ * @param[in] data Frame; must outlive the view.
+ * @param[in] len Frame size.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if it is not a valid frame.
+ */
+int packbits_frame_open(PACKBITS_FRAME *frame, const uint8_t *data, size_t len)
+{
+    const PACKBITS_FRAME_HEADER *hdr = (const PACKBITS_FRAME_HEADER *)data;
+
+    if (len < sizeof(*hdr) || hdr->magic != PACKBITS_FRAME_MAGIC || hdr->version != PACKBITS_FRAME_VERSION ||
+        hdr->header_size != sizeof(*hdr) || hdr->block_size == 0 ||
+        hdr->block_count != hdr->raw_size / hdr->block_size + (hdr->raw_size % hdr->block_size != 0) || len < index_end(hdr->block_count))
+    {
+        return PACKBITS_ERROR;
+    }
+
+    const uint64_t *index = (const uint64_t *)(data + sizeof(*hdr));
+    if (index[0] != index_end(hdr->block_count) || index[hdr->block_count] > len)
+    {
+        return PACKBITS_ERROR;
+    }
+    for (uint32_t b = 0; b < hdr->block_count; b++)
+    {
+        if (index[b + 1] < index[b])
+        {
+            return PACKBITS_ERROR;
+        }
+    }
+
+    frame->data = data;
+    frame->len = len;
+    frame->block_size = hdr->block_size;
+    frame->block_count = hdr->block_count;
+    frame->raw_size = hdr->raw_size;
+    frame->index = index;
+    return PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode a whole frame, blocks in parallel.
+ * @param[in] frame View.
+ * @param[in] threads Worker threads, counting the caller; 0 for one per online CPU.
+ * @param[out] output Decoded data.
+ * @param[in] output_cap Size of @p output; at least frame->raw_size.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a block is damaged or output is too small.
+ */
+int packbits_frame_decode(const PACKBITS_FRAME *frame, int threads, uint8_t *output, size_t output_cap)
+{
+    DECODE_JOB job = {frame, output};
+
+    if (output_cap < frame->raw_size)
+    {
+        return PACKBITS_ERROR;
+    }
+    return frame->block_count > 0 ? for_each_block(frame->block_count, threads, decode_block, &job) : PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode any byte range of the original input.
+ * @param[in] frame View.
+ * @param[in] offset Start in the original input.
+ * @param[out] output Decoded bytes.
+ * @param[in] len Bytes to decode; offset + len at most frame->raw_size.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if the range is outside the frame or a block is damaged.
+ */
+int packbits_frame_read(const PACKBITS_FRAME *frame, uint64_t offset, uint8_t *output, size_t len)
+{
+    if (offset > frame->raw_size || len > frame->raw_size - offset)
+    {
+        return PACKBITS_ERROR;
+    }
+    while (len > 0)
+    {
+        uint32_t b = (uint32_t)(offset / frame->block_size);
+        size_t   skip = offset % frame->block_size;
+        size_t   take = frame->block_size - skip < len ? frame->block_size - skip : len;
+
+        if (decode_range(frame->data + frame->index[b], frame->index[b + 1] - frame->index[b], skip, output, take) != PACKBITS_SUCCESS)
+        {
+            return PACKBITS_ERROR;
+        }
+        output += take;
+        offset += take;
+        len -= take;
+    }
+    return PACKBITS_SUCCESS;
+}
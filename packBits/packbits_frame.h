@@ -0,0 +1,127 @@
+/**
+ * @file    packbits_frame.h
+ * @brief   Block-parallel PackBits container with a seekable block index.
+ *
+ * A plain PackBits stream can only be decoded from its start, because where a packet
+ * begins depends on every packet before it. A frame cuts the input into fixed-size blocks
+ * (64 KB, say, or one scanline each), encodes every block as its own stream, and records
+ * where each block starts:
+ *
+ *   PACKBITS_FRAME_HEADER   magic, version, block size and count, raw size (24 bytes)
+ *   index                   block_count + 1 uint64 offsets from the frame start; block b
+ *                           is [index[b], index[b + 1]), the last entry is the frame size
+ *   blocks                  the packets of each block, back to back
+ *
+ * Fields are in host byte order (little-endian on every target we build for).
+ *
+ * Blocks are encoded and decoded on a pool of worker threads that claim block numbers
+ * from a shared counter, so uneven blocks balance themselves. The encoder writes block b
+ * into its own worst-case slot of the output, then closes the gaps in one pass and turns
+ * the sizes into offsets. Decoding writes each block straight to its place in the output.
+ * Any byte range (a row, a tile) can be read without touching the blocks before it;
+ * inside its first block, whole packets before the range are skipped by header alone.
+ *
+ * Every block decodes to exactly block_size bytes (the last one to the remainder), and
+ * the decoder checks that, so a damaged index or block is reported, not written past.
+ *
+ */
+
+#ifndef PACKBITS_FRAME_H
+#define PACKBITS_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packbits.h"
+
+#define PACKBITS_FRAME_MAGIC       0x46424B50  // "PKBF"
+#define PACKBITS_FRAME_VERSION     1
+#define PACKBITS_FRAME_MAX_THREADS 64
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint64_t raw_size;
+} PACKBITS_FRAME_HEADER;
+
+/** Reader view of an encoded frame; points into the caller's buffer */
+typedef struct
+{
+    const uint8_t  *data;
+    size_t          len;
+    uint32_t        block_size;
+    uint32_t        block_count;
+    uint64_t        raw_size;
+    const uint64_t *index;
+} PACKBITS_FRAME;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest frame for @p len input bytes.
+     * @param[in] len Input size.
+     * @param[in] block_size Input bytes per block.
+     * @return Output buffer size that is always enough.
+     */
+    size_t packbits_frame_bound(size_t len, size_t block_size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode into a frame, blocks in parallel.
+     * @param[in] input Data to compress.
+     * @param[in] input_len Input size.
+     * @param[in] block_size Input bytes per block, 1 to UINT32_MAX.
+     * @param[in] threads Worker threads, counting the caller; 0 for one per online CPU.
+     * @param[out] output Frame.
+     * @param[in] output_cap Size of @p output; at least packbits_frame_bound().
+     * @param[out] output_len Frame size.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR on bad sizes.
+     */
+    int packbits_frame_encode(const uint8_t *input, size_t input_len, size_t block_size, int threads, uint8_t *output, size_t output_cap,
+                              size_t *output_len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Check a frame's header and index, and set up a view of it.
+     * @param[out] frame View.
+     * @param[in] data Frame; must outlive the view.
+     * @param[in] len Frame size.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if it is not a valid frame.
+     */
+    int packbits_frame_open(PACKBITS_FRAME *frame, const uint8_t *data, size_t len);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode a whole frame, blocks in parallel.
+     * @param[in] frame View.
+     * @param[in] threads Worker threads, counting the caller; 0 for one per online CPU.
+     * @param[out] output Decoded data.
+     * @param[in] output_cap Size of @p output; at least frame->raw_size.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a block is damaged or output is too small.
+     */
+    int packbits_frame_decode(const PACKBITS_FRAME *frame, int threads, uint8_t *output, size_t output_cap);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode any byte range of the original input.
+     * @param[in] frame View.
+     * @param[in] offset Start in the original input.
+     * @param[out] output Decoded bytes.
+     * @param[in] len Bytes to decode; offset + len at most frame->raw_size.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if the range is outside the frame or a block is damaged.
+     */
+    int packbits_frame_read(const PACKBITS_FRAME *frame, uint64_t offset, uint8_t *output, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PACKBITS_FRAME_H
@@ -0,0 +1,330 @@
+/**
+ * @file    packbits_wide.c
+ * @brief   PackBits over 16- and 32-bit elements, and a per-tile width selector.
+ *
+ */
+
+#include "packbits_wide.h"
+
+#include <string.h>
+
+//-------------------------------------------------------------------------------------------------
+// Width specializations
+//-------------------------------------------------------------------------------------------------
+
+/*
+ * DEFINE_WIDTH(BITS, TYPE) generates, for elements of TYPE:
+ *   encode_BITS(in, count, out)     - packets of count elements; only the size when out is NULL
+ *   encoded_size_BITS(in, count)    - encode_BITS() without writing
+ *   decode_BITS(in, len, out, cap, &pos, &count)
+ *                                   - whole packets into out, up to the first one that is
+ *                                     truncated or does not fit; out may be unaligned
+ * Elements are loaded and stored with memcpy of sizeof(TYPE), which compiles to one move.
+ */
+#define DEFINE_WIDTH(BITS, TYPE)                                                                                                           \
+    static inline TYPE load_##BITS(const uint8_t *p)                                                                                       \
+    {                                                                                                                                      \
+        TYPE v;                                                                                                                            \
+        memcpy(&v, p, sizeof(v));                                                                                                          \
+        return v;                                                                                                                          \
+    }                                                                                                                                      \
+                                                                                                                                           \
+    static inline __attribute__((always_inline)) size_t encode_##BITS(const uint8_t *in, size_t n, uint8_t *out)                          \
+    {                                                                                                                                      \
+        const size_t w = sizeof(TYPE);                                                                                                     \
+        size_t       i = 0, o = 0;                                                                                                         \
+                                                                                                                                           \
+        while (i < n)                                                                                                                      \
+        {                                                                                                                                  \
+            size_t end = n - i > PACKBITS_MAX_PACKET ? i + PACKBITS_MAX_PACKET : n;                                                        \
+            TYPE   v = load_##BITS(in + i * w);                                                                                            \
+            size_t k = i + 1;                                                                                                              \
+                                                                                                                                           \
+            if (k < n && load_##BITS(in + k * w) == v)                                                                                     \
+            {                                                                                                                              \
+                while (k < end && load_##BITS(in + k * w) == v)                                                                            \
+                {                                                                                                                          \
+                    k++;                                                                                                                   \
+                }                                                                                                                          \
+                if (out != NULL)                                                                                                           \
+                {                                                                                                                          \
+                    out[o] = (uint8_t)(257 - (k - i));                                                                                     \
+                    memcpy(out + o + 1, &v, w);                                                                                            \
+                }                                                                                                                          \
+                o += 1 + w;                                                                                                                \
+            }                                                                                                                              \
+            else                                                                                                                           \
+            {                                                                                                                              \
+                while (k < end && (k + 1 >= n || load_##BITS(in + k * w) != load_##BITS(in + (k + 1) * w)))                               \
+                {                                                                                                                          \
+                    k++;                                                                                                                   \
+                }                                                                                                                          \
+                if (out != NULL)                                                                                                           \
+                {                                                                                                                          \
+                    out[o] = (uint8_t)(k - i - 1);                                                                                         \
+                    memcpy(out + o + 1, in + i * w, (k - i) * w);                                                                          \
+                }                                                                                                                          \
+                o += 1 + (k - i) * w;                                                                                                      \
+            }                                                                                                                              \
+            i = k;                                                                                                                         \
+        }                                                                                                                                  \
+        return o;                                                                                                                          \
+    }                                                                                                                                      \
+                                                                                                                                           \
+    static size_t encoded_size_##BITS(const uint8_t *in, size_t n)                                                                         \
+    {                                                                                                                                      \
+        return encode_##BITS(in, n, NULL);                                                                                                 \
+    }                                                                                                                                      \
+                                                                                                                                           \
+    static void decode_##BITS(const uint8_t *in, size_t len, uint8_t *out, size_t cap, size_t *pos, size_t *count)                         \
+    {                                                                                                                                      \
+        const size_t w = sizeof(TYPE);                                                                                                     \
+        size_t       i = *pos, o = *count;                                                                                                 \
+                                                                                                                                           \
+        while (i < len)                                                                                                                    \
+        {                                                                                                                                  \
+            uint8_t h = in[i];                                                                                                             \
+            size_t  n = h < 128 ? h + 1u : h > 128 ? 257u - h : 0;                                                                         \
+                                                                                                                                           \
+            if ((h < 128 ? (len - i - 1) / w < n : h > 128 && len - i - 1 < w) || cap - o < n)                                             \
+            {                                                                                                                              \
+                break; /* Truncated, or does not fit */                                                                                    \
+            }                                                                                                                              \
+            if (h < 128)                                                                                                                   \
+            {                                                                                                                              \
+                memcpy(out + o * w, in + i + 1, n * w);                                                                                    \
+                i += 1 + n * w;                                                                                                            \
+            }                                                                                                                              \
+            else if (h > 128)                                                                                                              \
+            {                                                                                                                              \
+                TYPE v = load_##BITS(in + i + 1);                                                                                          \
+                for (size_t k = 0; k < n; k++)                                                                                             \
+                {                                                                                                                          \
+                    memcpy(out + (o + k) * w, &v, w);                                                                                      \
+                }                                                                                                                          \
+                i += 1 + w;                                                                                                                \
+            }                                                                                                                              \
+            else                                                                                                                           \
+            {                                                                                                                              \
+                i++;                                                                                                                       \
+            }                                                                                                                              \
+            o += n;                                                                                                                        \
+        }                                                                                                                                  \
+        *pos = i;                                                                                                                          \
+        *count = o;                                                                                                                        \
+    }
+
+DEFINE_WIDTH(16, uint16_t)
+DEFINE_WIDTH(32, uint32_t)
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest encoded size of @p count elements of @p width bytes.
+ * @param[in] count Input elements.
+ * @param[in] width Element size: 1, 2 or 4.
+ * @return Output buffer size that is always enough.
+ */
+size_t packbits_wide_bound(size_t count, size_t width)
+{
+    // As for bytes, plus the wider payload: at most one element stored per element in
+    return count * width + (count + 2) / 3;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode 16-bit elements.
+ * @param[in] input Elements.
+ * @param[in] count Number of elements.
+ * @param[out] output At least packbits_wide_bound(count, 2) bytes.
+ * @return Encoded size in bytes.
+ */
+size_t packbits_encode16(const uint16_t *input, size_t count, uint8_t *output)
+{
+    return encode_16((const uint8_t *)input, count, output);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode 32-bit elements.
+ * @param[in] input Elements.
+ * @param[in] count Number of elements.
+ * @param[out] output At least packbits_wide_bound(count, 4) bytes.
+ * @return Encoded size in bytes.
+ */
+size_t packbits_encode32(const uint32_t *input, size_t count, uint8_t *output)
+{
+    return encode_32((const uint8_t *)input, count, output);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode 16-bit elements into a caller buffer.
+ * @param[in] input Encoded data.
+ * @param[in] input_len Encoded size in bytes.
+ * @param[out] output Decoded elements.
+ * @param[in] output_count Capacity of @p output in elements.
+ * @param[out] decoded_count Elements decoded; on error, those of the packets before the bad one.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a packet is truncated or does not fit.
+ */
+int packbits_decode16(const uint8_t *input, size_t input_len, uint16_t *output, size_t output_count, size_t *decoded_count)
+{
+    size_t i = 0, o = 0;
+
+    decode_16(input, input_len, (uint8_t *)output, output_count, &i, &o);
+    *decoded_count = o;
+    return i == input_len ? PACKBITS_SUCCESS : PACKBITS_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode 32-bit elements into a caller buffer.
+ * @param[in] input Encoded data.
+ * @param[in] input_len Encoded size in bytes.
+ * @param[out] output Decoded elements.
+ * @param[in] output_count Capacity of @p output in elements.
+ * @param[out] decoded_count Elements decoded; on error, those of the packets before the bad one.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a packet is truncated or does not fit.
+ */
+int packbits_decode32(const uint8_t *input, size_t input_len, uint32_t *output, size_t output_count, size_t *decoded_count)
+{
+    size_t i = 0, o = 0;
+
+    decode_32(input, input_len, (uint8_t *)output, output_count, &i, &o);
+    *decoded_count = o;
+    return i == input_len ? PACKBITS_SUCCESS : PACKBITS_ERROR;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Largest packbits_encode_auto() output for @p len input bytes.
+ * @param[in] len Input size.
+ * @param[in] tile_size Input bytes per tile.
+ * @return Output buffer size that is always enough.
+ */
+size_t packbits_auto_bound(size_t len, size_t tile_size)
+{
+    if (tile_size == 0)
+    {
+        return 0;
+    }
+
+    // Byte width is always a candidate, so no tile is larger than its byte encoding
+    return (len + tile_size - 1) / tile_size * PACKBITS_TILE_HEADER + len / tile_size * packbits_encode_bound(tile_size) +
+           packbits_encode_bound(len % tile_size);
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Encode in tiles, each in the element width that compresses it best.
+ * @param[in] input Data to compress.
+ * @param[in] input_len Input size.
+ * @param[in] tile_size Input bytes per tile, 1 to PACKBITS_MAX_TILE; a multiple of 4
+ *            lets every tile but the last try every width.
+ * @param[out] output At least packbits_auto_bound(input_len, tile_size) bytes.
+ * @param[out] output_len Encoded size.
+ * @param[out] widths Tiles encoded at each width (indexes 1, 2 and 4), or NULL.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR on a bad tile size.
+ */
+int packbits_encode_auto(const uint8_t *input, size_t input_len, size_t tile_size, uint8_t *output, size_t *output_len, size_t widths[5])
+{
+    size_t o = 0;
+
+    if (tile_size == 0 || tile_size > PACKBITS_MAX_TILE)
+    {
+        return PACKBITS_ERROR;
+    }
+    if (widths != NULL)
+    {
+        memset(widths, 0, 5 * sizeof(widths[0]));
+    }
+
+    for (size_t off = 0; off < input_len; off += tile_size)
+    {
+        const uint8_t *tile = input + off;
+        size_t         len = input_len - off < tile_size ? input_len - off : tile_size;
+        uint8_t       *packets = output + o + PACKBITS_TILE_HEADER;
+        size_t         best = packbits_encode(tile, len, packets), best_width = 1;
+
+        // Sizes of the wider encodings, without writing them
+        size_t size16 = len % 2 == 0 ? encoded_size_16(tile, len / 2) : SIZE_MAX;
+        size_t size32 = len % 4 == 0 ? encoded_size_32(tile, len / 4) : SIZE_MAX;
+        if (size16 < best && size16 <= size32)
+        {
+            best = encode_16(tile, len / 2, packets);
+            best_width = 2;
+        }
+        else if (size32 < best)
+        {
+            best = encode_32(tile, len / 4, packets);
+            best_width = 4;
+        }
+
+        uint32_t size = (uint32_t)best;
+        output[o] = (uint8_t)best_width;
+        memcpy(output + o + 1, &size, sizeof(size));
+        o += PACKBITS_TILE_HEADER + best;
+        if (widths != NULL)
+        {
+            widths[best_width]++;
+        }
+    }
+    *output_len = o;
+    return PACKBITS_SUCCESS;
+}
+
+//-------------------------------------------------------------------------------------------------
+/**
+ * @brief Decode packbits_encode_auto() output.
+ * @param[in] input Encoded data.
+ * @param[in] input_len Encoded size.
+ * @param[out] output Decoded data.
+ * @param[in] output_cap Size of @p output.
+ * @param[out] decoded_len Bytes decoded; on error, those of the tiles before the bad one.
+ * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a tile is damaged or does not fit.
+ */
+int packbits_decode_auto(const uint8_t *input, size_t input_len, uint8_t *output, size_t output_cap, size_t *decoded_len)
+{
+    size_t i = 0, o = 0;
+
+    *decoded_len = 0;
+    while (i < input_len)
+    {
+        uint8_t  width;
+        uint32_t size;
+        size_t   pos = 0, count = 0;
+
+        if (input_len - i < PACKBITS_TILE_HEADER)
+        {
+            return PACKBITS_ERROR;
+        }
+        width = input[i];
+        memcpy(&size, input + i + 1, sizeof(size));
+        i += PACKBITS_TILE_HEADER;
+        if (input_len - i < size)
+        {
+            return PACKBITS_ERROR;
+        }
+
+        switch (width)
+        {
+            case 1:
+                if (packbits_decode(input + i, size, output + o, output_cap - o, &count) != PACKBITS_SUCCESS)
+                {
+                    return PACKBITS_ERROR;
+                }
+                pos = size;
+                break;
+            case 2: decode_16(input + i, size, output + o, (output_cap - o) / 2, &pos, &count); break;
+            case 4: decode_32(input + i, size, output + o, (output_cap - o) / 4, &pos, &count); break;
+            default: return PACKBITS_ERROR;
+        }
+        if (pos != size)
+        {
+            return PACKBITS_ERROR;
+        }
+        i += size;
+        o += count * width;
+        *decoded_len = o;
+    }
+    return PACKBITS_SUCCESS;
+}
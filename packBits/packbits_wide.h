@@ -0,0 +1,139 @@
+/**
+ * @file    packbits_wide.h
+ * @brief   PackBits over 16- and 32-bit elements, and a per-tile width selector.
+ *
+ * Byte-oriented PackBits sees a 16-bit depth map or 32-bit label mask as bytes: a flat
+ * region of 0x1234 is "12 34 12 34 ...", which has no equal neighbours at all and
+ * goes out as literals. The wide variants use the same packet format with elements in
+ * place of bytes:
+ *   0..127    - n + 1 literal elements follow
+ *   129..255  - the next element repeated 257 - n times
+ *   128       - no-op
+ * Elements are stored in host byte order. Runs and literal spans are chosen exactly as
+ * in the byte encoder, comparing whole elements.
+ *
+ * Each width is generated from one macro-specialized implementation, so every width
+ * has its own inner loop with fixed-size element loads and stores; there is no
+ * per-element width check at run time.
+ *
+ * Data of unknown or mixed layout can go through packbits_encode_auto(). It cuts the
+ * input into tiles. For each tile, it encodes 1-byte elements (the SIMD encoder) and
+ * counts the output size of 2- and 4-byte elements without writing it. Each tile is
+ * stored in the width that gives the smallest output; on a tie, the narrower width
+ * wins. A tile is stored as:
+ *   width (1 byte: 1, 2 or 4) | encoded length (uint32, host order) | packets
+ *
+ */
+
+#ifndef PACKBITS_WIDE_H
+#define PACKBITS_WIDE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packbits.h"
+
+/** Bytes before each tile's packets in packbits_encode_auto() output */
+#define PACKBITS_TILE_HEADER 5
+
+/** Largest tile packbits_encode_auto() accepts, so an encoded tile length fits its uint32 */
+#define PACKBITS_MAX_TILE (1u << 30)
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest encoded size of @p count elements of @p width bytes.
+     * @param[in] count Input elements.
+     * @param[in] width Element size: 1, 2 or 4.
+     * @return Output buffer size that is always enough.
+     */
+    size_t packbits_wide_bound(size_t count, size_t width);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode 16-bit elements.
+     * @param[in] input Elements.
+     * @param[in] count Number of elements.
+     * @param[out] output At least packbits_wide_bound(count, 2) bytes.
+     * @return Encoded size in bytes.
+     */
+    size_t packbits_encode16(const uint16_t *input, size_t count, uint8_t *output);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode 32-bit elements.
+     * @param[in] input Elements.
+     * @param[in] count Number of elements.
+     * @param[out] output At least packbits_wide_bound(count, 4) bytes.
+     * @return Encoded size in bytes.
+     */
+    size_t packbits_encode32(const uint32_t *input, size_t count, uint8_t *output);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode 16-bit elements into a caller buffer.
+     * @param[in] input Encoded data.
+     * @param[in] input_len Encoded size in bytes.
+     * @param[out] output Decoded elements.
+     * @param[in] output_count Capacity of @p output in elements.
+     * @param[out] decoded_count Elements decoded; on error, those of the packets before the bad one.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a packet is truncated or does not fit.
+     */
+    int packbits_decode16(const uint8_t *input, size_t input_len, uint16_t *output, size_t output_count, size_t *decoded_count);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode 32-bit elements into a caller buffer.
+     * @param[in] input Encoded data.
+     * @param[in] input_len Encoded size in bytes.
+     * @param[out] output Decoded elements.
+     * @param[in] output_count Capacity of @p output in elements.
+     * @param[out] decoded_count Elements decoded; on error, those of the packets before the bad one.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a packet is truncated or does not fit.
+     */
+    int packbits_decode32(const uint8_t *input, size_t input_len, uint32_t *output, size_t output_count, size_t *decoded_count);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Largest packbits_encode_auto() output for @p len input bytes.
+     * @param[in] len Input size.
+     * @param[in] tile_size Input bytes per tile.
+     * @return Output buffer size that is always enough.
+     */
+    size_t packbits_auto_bound(size_t len, size_t tile_size);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Encode in tiles, each in the element width that compresses it best.
+     * @param[in] input Data to compress.
+     * @param[in] input_len Input size.
+     * @param[in] tile_size Input bytes per tile, 1 to PACKBITS_MAX_TILE; a multiple of 4
+     *            lets every tile but the last try every width.
+     * @param[out] output At least packbits_auto_bound(input_len, tile_size) bytes.
+     * @param[out] output_len Encoded size.
+     * @param[out] widths Tiles encoded at each width (indexes 1, 2 and 4), or NULL.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR on a bad tile size.
+     */
+    int packbits_encode_auto(const uint8_t *input, size_t input_len, size_t tile_size, uint8_t *output, size_t *output_len, size_t widths[5]);
+
+    //-------------------------------------------------------------------------------------------------
+    /**
+     * @brief Decode packbits_encode_auto() output.
+     * @param[in] input Encoded data.
+     * @param[in] input_len Encoded size.
+     * @param[out] output Decoded data.
+     * @param[in] output_cap Size of @p output.
+     * @param[out] decoded_len Bytes decoded; on error, those of the tiles before the bad one.
+     * @return PACKBITS_SUCCESS, or PACKBITS_ERROR if a tile is damaged or does not fit.
+     */
+    int packbits_decode_auto(const uint8_t *input, size_t input_len, uint8_t *output, size_t output_cap, size_t *decoded_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // PACKBITS_WIDE_H